@@ -0,0 +1,152 @@
+// Benchmarks the audio mixing path with many simultaneous sources, comparing
+// the old scalar per-sample loops with the AudioMix kernels used by AudioEngine.
+// It doesn't need an audio device, sources are synthetic mono / stereo clips.
+#include <audio/AudioMix.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static constexpr size_t SOURCES = 256;
+static constexpr size_t FRAMES = 512;
+static constexpr size_t SAMPLE_RATE = 48000;
+static constexpr size_t CLIP_FRAMES = SAMPLE_RATE;
+static constexpr size_t ITERATIONS = 2000;
+
+struct FakeClip
+{
+	std::vector<float> samples;
+	size_t channels;
+	size_t cur;
+};
+
+// The loops as they were before the kernels (branching per frame)
+static void legacy_clip(const FakeClip& clip, float* target, size_t cur)
+{
+	for(size_t i = 0; i < FRAMES; i++)
+	{
+		size_t f = (cur + i) % CLIP_FRAMES;
+		if(clip.channels == 1)
+		{
+			target[i * 2 + 0] = clip.samples[f];
+			target[i * 2 + 1] = clip.samples[f];
+		}
+		else
+		{
+			target[i * 2 + 0] = clip.samples[f * 2 + 0];
+			target[i * 2 + 1] = clip.samples[f * 2 + 1];
+		}
+	}
+}
+
+static void legacy_mix(const std::vector<FakeClip>& clips, float* fmix, float* fmixch, float* out)
+{
+	bool first = true;
+	for(const FakeClip& clip : clips)
+	{
+		legacy_clip(clip, fmix, clip.cur);
+		for(size_t i = 0; i < FRAMES; i++)
+		{
+			if(first)
+			{
+				fmixch[i * 2 + 0] = fmix[i * 2 + 0] * 0.5f;
+				fmixch[i * 2 + 1] = fmix[i * 2 + 1] * 0.7f;
+			}
+			else
+			{
+				fmixch[i * 2 + 0] += fmix[i * 2 + 0] * 0.5f;
+				fmixch[i * 2 + 1] += fmix[i * 2 + 1] * 0.7f;
+			}
+		}
+		first = false;
+	}
+
+	for(size_t i = 0; i < FRAMES; i++)
+	{
+		out[i * 2 + 0] += fmixch[i * 2 + 0];
+		out[i * 2 + 1] += fmixch[i * 2 + 1];
+	}
+}
+
+static void kernel_clip(const FakeClip& clip, float* target, size_t cur)
+{
+	// Same run based copy as AudioClip::mix_samples
+	size_t done = 0;
+	size_t ptr = cur % CLIP_FRAMES;
+	while(done < FRAMES)
+	{
+		size_t run = std::min(FRAMES - done, CLIP_FRAMES - ptr);
+		if(clip.channels == 1)
+		{
+			AudioMix::copy_mono(target + done * 2, clip.samples.data() + ptr, run);
+		}
+		else
+		{
+			AudioMix::copy_stereo(target + done * 2, clip.samples.data() + ptr * 2, run);
+		}
+		done += run;
+		ptr = (ptr + run) % CLIP_FRAMES;
+	}
+}
+
+static void kernel_mix(const std::vector<FakeClip>& clips, float* fmix, float* fmixch, float* out)
+{
+	AudioMix::zero(fmixch, FRAMES);
+	for(const FakeClip& clip : clips)
+	{
+		kernel_clip(clip, fmix, clip.cur);
+		AudioMix::mix_gain(fmixch, fmix, FRAMES, 0.5f, 0.7f);
+	}
+	AudioMix::mix_gain(out, fmixch, FRAMES, 1.0f, 1.0f);
+}
+
+template<typename F>
+static double run(const char* name, std::vector<FakeClip> clips, F func)
+{
+	std::vector<float> fmix(FRAMES * 2), fmixch(FRAMES * 2), out(FRAMES * 2);
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+	for(size_t it = 0; it < ITERATIONS; it++)
+	{
+		std::fill(out.begin(), out.end(), 0.0f);
+		func(clips, fmix.data(), fmixch.data(), out.data());
+		for(FakeClip& c : clips)
+		{
+			c.cur = (c.cur + FRAMES) % CLIP_FRAMES;
+		}
+	}
+	auto t1 = std::chrono::high_resolution_clock::now();
+
+	double secs = std::chrono::duration<double>(t1 - t0).count();
+	double per_callback = secs / ITERATIONS;
+	// How much of the real time budget of a callback we use
+	double budget = (double)FRAMES / (double)SAMPLE_RATE;
+	printf("%-8s %zu sources: %8.3f us per %zu frame callback (%.2f%% of realtime) [check %f]\n",
+		name, clips.size(), per_callback * 1e6, FRAMES, per_callback / budget * 100.0, out[7]);
+
+	return per_callback;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<FakeClip> clips(SOURCES);
+	for(size_t i = 0; i < SOURCES; i++)
+	{
+		FakeClip& c = clips[i];
+		c.channels = (i % 4 == 0) ? 2 : 1;
+		c.cur = (i * 977) % CLIP_FRAMES;
+		c.samples.resize(CLIP_FRAMES * c.channels);
+		for(size_t j = 0; j < c.samples.size(); j++)
+		{
+			c.samples[j] = (float)std::sin((double)j * 0.01 * (double)(i + 1));
+		}
+	}
+
+	double legacy = run("legacy", clips, legacy_mix);
+	double kernel = run("kernels", clips, kernel_mix);
+	printf("Speedup: %.2fx\n", legacy / kernel);
+
+	return 0;
+}
@@ -0,0 +1,667 @@
+// Benchmarks the engine's simulation hot paths, with OSP started headless (no window,
+// GL context or audio) so it can run on any machine. Results are written as JSON to
+// be tracked over time, every benchmark reports per iteration timings:
+// 	engine_bench -out=bench.json -vehicle=udata/vehicles/backup.toml
+// The staging benchmark builds a vehicle of -staging_parts (300) parts from the parts
+// of the given one.
+// Given a replay (see game/Replay.h) it only runs it, timing every frame:
+// 	engine_bench -replay=udata/replays/last.ospr -out=replay.json
+// Run from the game directory, as it loads res/ and udata/ like the game does.
+#include <OSP.h>
+#include <game/GameState.h>
+#include <game/Replay.h>
+#include <assets/AssetManager.h>
+#include <lua/LuaCore.h>
+#include <universe/PlanetarySystem.h>
+#include <universe/propagator/RK4Propagator.h>
+#include <universe/kepler/KeplerElements.h>
+#include <universe/vehicle/Vehicle.h>
+#include <universe/vehicle/VehicleLoader.h>
+#include <universe/vehicle/plumbing/StoredFluids.h>
+#include <planet_mesher/mesher/PlanetTile.h>
+#include <planet_mesher/quadtree/QuadTreePlanet.h>
+#include <physics/ground/GroundShape.h>
+#include <util/LuaUtil.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <random>
+
+struct BenchResult
+{
+	std::string name;
+	size_t iterations;
+	double total;
+	double mean, median, min, max;
+	// Benchmark specific values (counts, sizes...)
+	std::vector<std::pair<std::string, double>> extra;
+};
+
+static std::vector<BenchResult> results;
+
+// Samples are in seconds, they get sorted
+static BenchResult& add_result(const std::string& name, std::vector<double>& samples)
+{
+	size_t iterations = samples.size();
+
+	BenchResult r;
+	r.name = name;
+	r.iterations = iterations;
+	r.total = 0.0;
+	for(double s : samples)
+	{
+		r.total += s;
+	}
+	r.mean = r.total / (double)iterations;
+	std::sort(samples.begin(), samples.end());
+	r.median = samples[iterations / 2];
+	r.min = samples.front();
+	r.max = samples.back();
+
+	logger->info("{:<36} {:>8} it, mean {:>12.3f} us, median {:>12.3f} us", name, iterations,
+		r.mean * 1e6, r.median * 1e6);
+
+	results.push_back(r);
+	return results.back();
+}
+
+// Runs setup (untimed) and then fn, iterations times, after a few warmup runs
+static BenchResult& run_bench(const std::string& name, size_t iterations, const std::function<void()>& fn,
+	const std::function<void()>& setup = nullptr)
+{
+	size_t warmup = std::max<size_t>(1, iterations / 10);
+	for(size_t i = 0; i < warmup; i++)
+	{
+		if(setup) setup();
+		fn();
+	}
+
+	std::vector<double> samples(iterations);
+	for(size_t i = 0; i < iterations; i++)
+	{
+		if(setup) setup();
+		auto t0 = std::chrono::high_resolution_clock::now();
+		fn();
+		auto t1 = std::chrono::high_resolution_clock::now();
+		samples[i] = std::chrono::duration<double>(t1 - t0).count();
+	}
+
+	return add_result(name, samples);
+}
+
+static void write_json(const std::string& path)
+{
+	std::ofstream out(path);
+	if(!out)
+	{
+		logger->error("Could not write results to {}", path);
+		return;
+	}
+
+	out << "{\n";
+	out << "\t\"version\": \"" << OSP::OSP_VERSION << "\",\n";
+	out << "\t\"timestamp\": " << std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count() << ",\n";
+	out << "\t\"benchmarks\": [\n";
+	for(size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult& r = results[i];
+		out << "\t\t{\n";
+		out << "\t\t\t\"name\": \"" << r.name << "\",\n";
+		out << "\t\t\t\"iterations\": " << r.iterations << ",\n";
+		out << "\t\t\t\"total_s\": " << r.total << ",\n";
+		out << "\t\t\t\"mean_ns\": " << r.mean * 1e9 << ",\n";
+		out << "\t\t\t\"median_ns\": " << r.median * 1e9 << ",\n";
+		out << "\t\t\t\"min_ns\": " << r.min * 1e9 << ",\n";
+		out << "\t\t\t\"max_ns\": " << r.max * 1e9 << ",\n";
+		out << "\t\t\t\"extra\": {";
+		for(size_t j = 0; j < r.extra.size(); j++)
+		{
+			out << (j == 0 ? " " : ", ") << "\"" << r.extra[j].first << "\": " << r.extra[j].second;
+		}
+		out << (r.extra.empty() ? "}\n" : " }\n");
+		out << "\t\t}" << (i + 1 == results.size() ? "\n" : ",\n");
+	}
+	out << "\t]\n";
+	out << "}\n";
+
+	logger->info("Wrote {} results to {}", results.size(), path);
+}
+
+// Orbits around the most massive element, spread in radius and inclination
+static std::vector<KeplerElements> make_orbits(size_t count, double min_radius)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+	std::vector<KeplerElements> out(count);
+	for(KeplerElements& elems : out)
+	{
+		elems.orbit.smajor_axis = min_radius * (1.0 + unit(rng) * 4.0);
+		elems.orbit.eccentricity = unit(rng) * 0.6;
+		elems.orbit.inclination = unit(rng) * glm::pi<double>();
+		elems.orbit.periapsis_argument = unit(rng) * glm::two_pi<double>();
+		elems.orbit.asc_node_longitude = unit(rng) * glm::two_pi<double>();
+		elems.orbit.mean_at_epoch = 0.0;
+		elems.mean_anomaly = unit(rng) * glm::two_pi<double>();
+		elems.eccentric_anomaly = elems.orbit.mean_to_eccentric(elems.mean_anomaly);
+		elems.true_anomaly = elems.orbit.eccentric_to_true(elems.eccentric_anomaly);
+	}
+
+	return out;
+}
+
+static void bench_kepler(double parent_mass)
+{
+	std::vector<KeplerElements> orbits = make_orbits(1000, 7e6);
+	std::vector<CartesianState> states(orbits.size());
+
+	run_bench("kepler/get_cartesian", 1000, [&]()
+	{
+		for(size_t i = 0; i < orbits.size(); i++)
+		{
+			states[i] = orbits[i].get_cartesian(parent_mass, 1000.0);
+		}
+	}).extra.emplace_back("orbits", (double)orbits.size());
+
+	run_bench("kepler/state_to_elements", 1000, [&]()
+	{
+		for(size_t i = 0; i < orbits.size(); i++)
+		{
+			orbits[i] = state_to_elements(states[i].pos, states[i].vel);
+		}
+	}).extra.emplace_back("orbits", (double)orbits.size());
+
+	run_bench("kepler/mean_to_eccentric", 1000, [&]()
+	{
+		for(size_t i = 0; i < orbits.size(); i++)
+		{
+			orbits[i].eccentric_anomaly = orbits[i].orbit.mean_to_eccentric(orbits[i].mean_anomaly);
+		}
+	}).extra.emplace_back("orbits", (double)orbits.size());
+}
+
+static void bench_propagator(PlanetarySystem& system)
+{
+	StateVector initial;
+	for(SystemElement* elem : system.elements)
+	{
+		initial.emplace_back(elem->position_at_epoch, elem->velocity_at_epoch, elem->get_mass());
+	}
+
+	RK4Propagator propagator;
+	propagator.initialize(&system);
+
+	StateVector states = initial;
+	run_bench("rk4/propagate_system", 10000, [&]()
+	{
+		propagator.propagate(states, 1.0);
+	}).extra.emplace_back("bodies", (double)states.size());
+
+	// Lots of non-attracting bodies, around the last element (most likely a planet)
+	StateVector with_particles = initial;
+	const CartesianState& parent = initial.back();
+	for(const KeplerElements& elems : make_orbits(1000, 7e6))
+	{
+		KeplerElements e = elems;
+		CartesianState st = e.get_cartesian(parent.mass, 1.0);
+		with_particles.emplace_back(parent.pos + st.pos, parent.vel + st.vel, 1.0);
+	}
+
+	states = with_particles;
+	run_bench("rk4/propagate_particles", 1000, [&]()
+	{
+		propagator.propagate(states, 1.0);
+	}).extra.emplace_back("bodies", (double)states.size());
+}
+
+// Random tiles at the given depth, all on the same side
+static std::vector<PlanetTilePath> make_tile_paths(size_t count, size_t depth)
+{
+	std::mt19937 rng(4321);
+	std::uniform_int_distribution<int> quadrant(0, 3);
+
+	std::vector<PlanetTilePath> out;
+	for(size_t i = 0; i < count; i++)
+	{
+		std::vector<QuadTreeQuadrant> path;
+		for(size_t d = 0; d < depth; d++)
+		{
+			path.push_back((QuadTreeQuadrant)quadrant(rng));
+		}
+		out.emplace_back(path, PY);
+	}
+
+	return out;
+}
+
+static void bench_planet(SystemElement* elem)
+{
+	std::string script = AssetManager::load_string_raw(elem->config.surface.script_path);
+	auto arrays = std::make_unique<PlanetTile::GeneratorArrays>();
+	std::vector<PlanetTilePath> paths = make_tile_paths(64, (size_t)elem->config.surface.max_depth);
+
+	// Every run gets a fresh state, so garbage left by the previous one doesn't count
+	auto bench_generate = [&](const std::string& name, const LuaGCPolicy::Config& config) -> BenchResult&
+	{
+		sol::state lua;
+		bool wrote_error = false;
+		PlanetTile::prepare_lua(lua);
+		LuaUtil::safe_lua(lua, script, wrote_error, elem->config.surface.script_path);
+		LuaGCPolicy gc(config);
+		gc.attach(lua);
+
+		size_t next = 0;
+		BenchResult& gen = run_bench(name, 256, [&]()
+		{
+			PlanetTile tile;
+			tile.generate(paths[next % paths.size()], elem->config.radius, lua, elem->config.surface.has_water,
+				arrays.get());
+			gc.after_job(lua);
+			next++;
+		});
+		gen.extra.emplace_back("vertices", (double)PlanetTile::VERTEX_COUNT);
+		gen.extra.emplace_back("tiles_per_s", 1.0 / gen.mean);
+		gen.extra.emplace_back("gc_s", gc.get_gc_time());
+		gen.extra.emplace_back("full_collections", (double)gc.get_full_collections());
+		gen.extra.emplace_back("memory_kb", (double)gc.get_memory_kb());
+		return gen;
+	};
+
+	// With the settings the game uses, and then each GC policy with the real script
+	bench_generate("planet_tile/generate", PlanetTile::get_gc_config());
+	LuaGCPolicy::Config gc_config = PlanetTile::get_gc_config();
+	gc_config.mode = LuaGCPolicy::FULL;
+	double full_tps = 1.0 / bench_generate("planet_tile/generate_gc_full", gc_config).mean;
+	gc_config.mode = LuaGCPolicy::INCREMENTAL;
+	double incremental_tps = 1.0 / bench_generate("planet_tile/generate_gc_incremental", gc_config).mean;
+	logger->info("Tile generation GC: {:.1f} tiles/s full, {:.1f} tiles/s incremental ({:.2f}x)",
+		full_tps, incremental_tps, incremental_tps / full_tps);
+
+	// Physics tiles, through the same server bullet uses
+	GroundShape shape(elem);
+	GroundShapeServer* server = shape.get_server();
+	QuadTreePlanet qtree;
+	std::vector<QuadTreeNode*> leafs;
+	for(const PlanetTilePath& path : paths)
+	{
+		glm::dvec2 min = path.get_min();
+		leafs.push_back(qtree.subdivide_to(min + path.get_size() * 0.5, path.side, path.path.size()));
+	}
+
+	auto clear_cache = [server]()
+	{
+		for(auto& pair : server->cache)
+		{
+			delete pair.second;
+		}
+		server->cache.clear();
+	};
+
+	run_bench("ground_shape/generate_tiles", 16, [&]()
+	{
+		for(QuadTreeNode* leaf : leafs)
+		{
+			server->query(leaf, 1.0);
+		}
+	}, clear_cache).extra.emplace_back("tiles", (double)leafs.size());
+
+	struct CountCallback : public btTriangleCallback
+	{
+		size_t count = 0;
+		btScalar sum = 0.0;
+		void processTriangle(btVector3* triangle, int part, int index) override
+		{
+			count++;
+			sum += triangle[0].x();
+		}
+	};
+
+	for(QuadTreeNode* leaf : leafs)
+	{
+		server->query(leaf, 1.0);
+	}
+	CountCallback callback;
+	btVector3 all_min(btScalar(-BT_LARGE_FLOAT), btScalar(-BT_LARGE_FLOAT), btScalar(-BT_LARGE_FLOAT));
+	btVector3 all_max(btScalar(BT_LARGE_FLOAT), btScalar(BT_LARGE_FLOAT), btScalar(BT_LARGE_FLOAT));
+	BenchResult& tris = run_bench("ground_shape/process_all_triangles", 256, [&]()
+	{
+		callback.count = 0;
+		shape.processAllTriangles(&callback, all_min, all_max);
+	});
+	tris.extra.emplace_back("triangles", (double)callback.count);
+	tris.extra.emplace_back("cache_bytes", (double)server->get_cache_bytes());
+
+	clear_cache();
+}
+
+static void bench_fluids()
+{
+	AssetHandle<PhysicalMaterial> hydrogen("core:materials/hydrogen.toml");
+	AssetHandle<PhysicalMaterial> oxygen("core:materials/oxygen.toml");
+	StoredFluids* fluids = nullptr;
+
+	run_bench("stored_fluids/react", 10000, [&]()
+	{
+		fluids->react(2000.0f, 1.0f, 0.5f, 1.0f / 30.0f);
+	}, [&]()
+	{
+		delete fluids;
+		fluids = new StoredFluids();
+		fluids->temperature = 2000.0f;
+		fluids->add_fluid(hydrogen, 10.0f, 2.0f, 2000.0f);
+		fluids->add_fluid(oxygen, 80.0f, 16.0f, 2000.0f);
+	});
+
+	delete fluids;
+}
+
+static void bench_vehicle(const std::string& path)
+{
+	std::shared_ptr<cpptoml::table> toml = SerializeUtil::load_file(path);
+	if(!toml)
+	{
+		logger->warn("Could not load vehicle {}, skipping vehicle benchmarks", path);
+		return;
+	}
+
+	Vehicle* veh = nullptr;
+	BenchResult& load = run_bench("vehicle_loader/load", 32, [&]()
+	{
+		veh = new Vehicle();
+		VehicleLoader loader(*toml, *veh);
+	}, [&]()
+	{
+		delete veh;
+		veh = nullptr;
+	});
+	load.extra.emplace_back("parts", (double)veh->parts.size());
+	load.extra.emplace_back("pieces", (double)veh->all_pieces.size());
+
+	// Machines run on a lua state, like in the editor
+	sol::state lua;
+	lua_core->load(lua, "__UNDEFINED__");
+	veh->init(&lua);
+
+	BenchResult& pipes = run_bench("plumbing/step_flows", 1000, [&]()
+	{
+		veh->plumbing.step_flows(1.0f / 30.0f);
+	});
+	pipes.extra.emplace_back("pipes", (double)veh->plumbing.pipes.size());
+
+	delete veh;
+}
+
+// A single stack of count parts, cycling through the single piece parts of source
+// (so their prototypes and machine configs). Every stage_size parts there's a real
+// link (core:links/simple_link.lua) instead of a weld, like a decoupler
+static std::shared_ptr<cpptoml::table> make_staged_vehicle(const cpptoml::table& source, size_t count,
+	size_t stage_size)
+{
+	std::unordered_map<int64_t, size_t> pieces_of_part;
+	auto pieces = source.get_table_array_qualified("piece");
+	auto parts = source.get_table_array_qualified("part");
+	if(!pieces || !parts)
+	{
+		return nullptr;
+	}
+	for(const auto& piece : *pieces)
+	{
+		pieces_of_part[*piece->get_qualified_as<int64_t>("part")]++;
+	}
+
+	std::vector<std::shared_ptr<cpptoml::table>> usable;
+	for(const auto& part : *parts)
+	{
+		if(pieces_of_part[*part->get_qualified_as<int64_t>("id")] == 1)
+		{
+			usable.push_back(part);
+		}
+	}
+	if(usable.empty())
+	{
+		return nullptr;
+	}
+
+	constexpr double SPACING = 3.0;
+	auto out = cpptoml::make_table();
+	auto out_parts = cpptoml::make_table_array();
+	auto out_pieces = cpptoml::make_table_array();
+	for(size_t i = 0; i < count; i++)
+	{
+		int64_t id = (int64_t)i + 1;
+		auto part = usable[i % usable.size()]->clone()->as_table();
+		part->insert("id", id);
+		out_parts->push_back(part);
+
+		auto piece = cpptoml::make_table();
+		piece->insert("node", std::string("p_root"));
+		piece->insert("part", id);
+		piece->insert("id", id);
+		glm::dmat4 tform = glm::translate(glm::dmat4(1.0), glm::dvec3(0.0, 0.0, -SPACING * (double)i));
+		piece->insert("transform", serialize_matrix(tform));
+
+		if(i == 0)
+		{
+			piece->insert("root", true);
+		}
+		else
+		{
+			auto link = cpptoml::make_table();
+			link->insert("to", id - 1);
+			if(i % stage_size == 0)
+			{
+				link->insert("type", std::string("core:links/simple_link.lua"));
+				serialize_to_table(glm::dvec3(0.0, 0.0, SPACING * 0.5), *link, "pfrom");
+				serialize_to_table(glm::dvec3(0.0, 0.0, -SPACING * 0.5), *link, "pto");
+				serialize_to_table(glm::dquat(1.0, 0.0, 0.0, 0.0), *link, "rot");
+			}
+			else
+			{
+				link->insert("welded", true);
+			}
+			piece->insert("link", link);
+		}
+		out_pieces->push_back(piece);
+	}
+
+	out->insert("part_id", (int64_t)count);
+	out->insert("piece_id", (int64_t)count);
+	out->insert("part", out_parts);
+	out->insert("piece", out_pieces);
+	return out;
+}
+
+// Staging on a generated vehicle, unpacked in a bullet world: the lowest link breaks
+// and the same work UnpackedVehicle::update does is timed (separation, sorting and
+// the physics rebuild), without creating the entities of the separated vehicles
+static void bench_staging(const std::string& path, size_t count)
+{
+	std::shared_ptr<cpptoml::table> source = SerializeUtil::load_file(path);
+	std::shared_ptr<cpptoml::table> toml = source ? make_staged_vehicle(*source, count, 30) : nullptr;
+	if(!toml)
+	{
+		logger->warn("Could not generate a vehicle from {}, skipping staging benchmarks", path);
+		return;
+	}
+
+	auto* config = new btDefaultCollisionConfiguration();
+	auto* dispatcher = new btCollisionDispatcher(config);
+	auto* broadphase = new btDbvtBroadphase();
+	auto* solver = new btSequentialImpulseConstraintSolver();
+	auto* world = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, config);
+
+	Vehicle* veh = nullptr;
+	std::vector<Vehicle*> separated;
+	size_t pieces = 0;
+	auto cleanup = [&]()
+	{
+		for(Vehicle* n_veh : separated)
+		{
+			n_veh->unpacked_veh.deactivate();
+			delete n_veh;
+		}
+		separated.clear();
+		if(veh)
+		{
+			veh->unpacked_veh.deactivate();
+			delete veh;
+			veh = nullptr;
+		}
+	};
+
+	BenchResult& r = run_bench("unpacked_vehicle/staging", 50, [&]()
+	{
+		UnpackedVehicle::PieceStates removed_states;
+		separated = veh->unpacked_veh.handle_separation(removed_states);
+		veh->sort();
+		veh->unpacked_veh.build_physics(removed_states);
+	}, [&]()
+	{
+		cleanup();
+		veh = new Vehicle();
+		VehicleLoader loader(*toml, *veh);
+		veh->sort();
+		veh->unpacked_veh.set_world(world);
+		veh->unpacked_veh.activate();
+		pieces = veh->all_pieces.size();
+
+		// all_pieces is sorted from the root, so the last link is the lowest stage
+		for(auto it = veh->all_pieces.rbegin(); it != veh->all_pieces.rend(); it++)
+		{
+			if((*it)->link != nullptr && (*it)->link->is_initialized)
+			{
+				(*it)->link->notify_broken();
+				break;
+			}
+		}
+	});
+	r.extra.emplace_back("pieces", (double)pieces);
+	r.extra.emplace_back("separated_vehicles", (double)separated.size());
+	r.extra.emplace_back("remaining_pieces", (double)veh->all_pieces.size());
+
+	cleanup();
+	delete world;
+	delete solver;
+	delete broadphase;
+	delete dispatcher;
+	delete config;
+}
+
+static void bench_system(const std::string& save_path)
+{
+	std::shared_ptr<cpptoml::table> save = SerializeUtil::load_file(save_path);
+	if(!save)
+	{
+		logger->fatal("Could not load save {}", save_path);
+	}
+
+	// Only loaded, no physics or rendering
+	PlanetarySystem system(nullptr);
+	system.load(*save);
+
+	SystemElement* heaviest = nullptr;
+	SystemElement* surface = nullptr;
+	for(SystemElement* elem : system.elements)
+	{
+		if(heaviest == nullptr || elem->get_mass() > heaviest->get_mass())
+		{
+			heaviest = elem;
+		}
+		if(surface == nullptr && elem->config.has_surface)
+		{
+			surface = elem;
+		}
+	}
+
+	bench_kepler(heaviest ? heaviest->get_mass() : 5.97e24);
+	bench_propagator(system);
+	if(surface)
+	{
+		bench_planet(surface);
+	}
+	else
+	{
+		logger->warn("No element with a surface, skipping planet benchmarks");
+	}
+}
+
+static void bench_replay(const std::string& path)
+{
+	ReplayPlayer player;
+	if(!player.load(path, *osp->game_state))
+	{
+		logger->fatal("Could not load replay {}", path);
+	}
+
+	std::vector<double> samples;
+	size_t slowest = 0;
+	double slowest_time = 0.0;
+	size_t slowest_recorded = 0;
+	double slowest_recorded_time = 0.0;
+	double recorded_total = 0.0;
+	while(player.step())
+	{
+		size_t frame = player.get_frame() - 1;
+		if(player.get_last_time() > slowest_time)
+		{
+			slowest = frame;
+			slowest_time = player.get_last_time();
+		}
+		if(player.get_recorded_time() > slowest_recorded_time)
+		{
+			slowest_recorded = frame;
+			slowest_recorded_time = player.get_recorded_time();
+		}
+		recorded_total += player.get_recorded_time();
+		samples.push_back(player.get_last_time());
+	}
+
+	if(samples.empty())
+	{
+		logger->warn("Replay {} has no frames", path);
+		return;
+	}
+
+	BenchResult& r = add_result("replay/universe_update", samples);
+	r.extra.emplace_back("slowest_frame", (double)slowest);
+	r.extra.emplace_back("recorded_mean_ns", recorded_total / (double)samples.size() * 1e9);
+	r.extra.emplace_back("recorded_slowest_frame", (double)slowest_recorded);
+	r.extra.emplace_back("recorded_max_ns", slowest_recorded_time * 1e9);
+	r.extra.emplace_back("divergences", (double)player.get_divergences());
+}
+
+int main(int argc, char** argv)
+{
+	argh::parser args(argc, argv);
+	std::string out_path = args("out", "engine_bench.json").str();
+	std::string vehicle_path = args("vehicle", "udata/vehicles/backup.toml").str();
+	std::string save_path = args("save", "udata/saves/debug-save/save.toml").str();
+	std::string replay_path = args("replay", "").str();
+	size_t staging_parts = 300;
+	args("staging_parts", 300) >> staging_parts;
+
+	osp = new OSP();
+	osp->init(argc, argv, true);
+
+	if(replay_path.empty())
+	{
+		bench_system(save_path);
+		bench_fluids();
+		bench_vehicle(vehicle_path);
+		bench_staging(vehicle_path, staging_parts);
+	}
+	else
+	{
+		bench_replay(replay_path);
+	}
+
+	write_json(out_path);
+
+	osp->finish();
+	delete osp;
+
+	return 0;
+}
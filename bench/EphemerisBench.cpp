@@ -0,0 +1,159 @@
+// Benchmarks the Ephemeris tables on a sun, earth and moon system, integrated
+// with the same scheme the system propagator uses. Reports the build time, the
+// table size, the accuracy against the integrated states and the throughput of
+// queries against propagating. The error between integration steps is measured
+// against a partial step, so it includes the error of the integrator itself.
+#include <universe/propagator/Ephemeris.h>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+static constexpr double BENCH_G = 6.674e-11;
+static constexpr double DAYS = 60.0;
+static constexpr size_t ACCURACY_SAMPLES = 20000;
+static constexpr size_t QUERIES = 2000000;
+
+// Same as RK4Propagator::propagate, position then velocity
+static void propagate(std::vector<CartesianState>& states, double dt)
+{
+	for(CartesianState& st : states)
+	{
+		st.pos += st.vel * dt;
+	}
+
+	for(size_t i = 0; i < states.size(); i++)
+	{
+		glm::dvec3 acc = glm::dvec3(0.0);
+		for(size_t j = 0; j < states.size(); j++)
+		{
+			if(i == j) continue;
+			glm::dvec3 dx = states[j].pos - states[i].pos;
+			double dist = glm::length(dx);
+			acc += BENCH_G * (states[j].mass / (dist * dist * dist)) * dx;
+		}
+		states[i].vel += acc * dt;
+	}
+}
+
+// Like the ephemeris does while building
+static void advance(std::vector<CartesianState>& states, double dt, size_t substeps)
+{
+	for(size_t i = 0; i < substeps; i++)
+	{
+		propagate(states, dt / (double)substeps);
+	}
+}
+
+static std::vector<CartesianState> make_system()
+{
+	std::vector<CartesianState> out;
+	out.emplace_back(glm::dvec3(0.0), glm::dvec3(0.0), 1.989e30);
+	out.emplace_back(glm::dvec3(1.496e11, 0.0, 0.0), glm::dvec3(0.0, 29780.0, 0.0), 5.972e24);
+	out.emplace_back(glm::dvec3(1.496e11 + 3.844e8, 0.0, 0.0), glm::dvec3(0.0, 29780.0 + 1022.0, 0.0), 7.342e22);
+	return out;
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<CartesianState> initial = make_system();
+
+	Ephemeris eph;
+	eph.duration = DAYS * 86400.0;
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+	eph.build(initial, 0.0, propagate);
+	auto t1 = std::chrono::high_resolution_clock::now();
+
+	std::vector<uint8_t> data;
+	eph.write(data);
+	Ephemeris loaded;
+	bool read_ok = loaded.read(data.data(), data.size());
+
+	// Reference states at every step, to compare against
+	size_t steps = (size_t)((eph.get_end() - eph.get_start()) / eph.step);
+	std::vector<std::vector<CartesianState>> reference;
+	reference.reserve(steps + 1);
+	std::vector<CartesianState> states = initial;
+	reference.push_back(states);
+	for(size_t i = 0; i < steps; i++)
+	{
+		advance(states, eph.step, eph.substeps);
+		reference.push_back(states);
+	}
+
+	std::mt19937_64 rng(42);
+	std::uniform_int_distribution<size_t> step_dist(0, steps - 1);
+	std::uniform_real_distribution<double> frac_dist(0.0, 1.0);
+
+	// On steps and between them
+	std::vector<double> max_pos_err[2];
+	std::vector<double> max_vel_err[2];
+	for(size_t k = 0; k < 2; k++)
+	{
+		max_pos_err[k].assign(initial.size(), 0.0);
+		max_vel_err[k].assign(initial.size(), 0.0);
+	}
+	for(size_t i = 0; i < ACCURACY_SAMPLES; i++)
+	{
+		size_t step = step_dist(rng);
+		size_t k = i % 2;
+		double frac = k == 0 ? 0.0 : frac_dist(rng);
+		std::vector<CartesianState> ref = reference[step];
+		if(frac > 0.0)
+		{
+			advance(ref, frac * eph.step, eph.substeps);
+		}
+
+		double t = ((double)step + frac) * eph.step;
+		for(size_t b = 0; b < initial.size(); b++)
+		{
+			CartesianState st = loaded.state_at(b, t);
+			max_pos_err[k][b] = glm::max(max_pos_err[k][b], glm::distance(st.pos, ref[b].pos));
+			max_vel_err[k][b] = glm::max(max_vel_err[k][b], glm::distance(st.vel, ref[b].vel));
+		}
+	}
+
+	// Query throughput, random times so the chunk lookups are not cached
+	std::vector<double> times(4096);
+	for(double& t : times)
+	{
+		t = frac_dist(rng) * (eph.get_end() - eph.get_start());
+	}
+
+	glm::dvec3 sink = glm::dvec3(0.0);
+	auto t2 = std::chrono::high_resolution_clock::now();
+	for(size_t i = 0; i < QUERIES; i++)
+	{
+		sink += eph.state_at(i % initial.size(), times[i % times.size()]).pos;
+	}
+	auto t3 = std::chrono::high_resolution_clock::now();
+
+	states = initial;
+	size_t prop_steps = QUERIES / 100;
+	for(size_t i = 0; i < prop_steps; i++)
+	{
+		advance(states, eph.step, eph.substeps);
+	}
+	auto t4 = std::chrono::high_resolution_clock::now();
+	sink += states[0].pos;
+
+	double build_s = std::chrono::duration<double>(t1 - t0).count();
+	double query_ns = std::chrono::duration<double>(t3 - t2).count() / QUERIES * 1e9;
+	double step_ns = std::chrono::duration<double>(t4 - t3).count() / prop_steps * 1e9;
+
+	printf("%.0f days, %zu bodies, step %.0f s in %zu substeps\n", DAYS, initial.size(), eph.step, eph.substeps);
+	printf("Build: %.2f s, %zu segments, %zu bytes, read back %s\n",
+		build_s, eph.get_segment_count(), data.size(), read_ok ? "ok" : "FAILED");
+	for(size_t b = 0; b < initial.size(); b++)
+	{
+		printf("Body %zu: max error on steps %9.4f m %9.6f m/s, between steps %9.4f m %9.6f m/s\n",
+			b, max_pos_err[0][b], max_vel_err[0][b], max_pos_err[1][b], max_vel_err[1][b]);
+	}
+	printf("Query:     %8.1f ns per body state (%.2f M/s)\n", query_ns, 1e3 / query_ns);
+	printf("Propagate: %8.1f ns per system step, an average query replaces %zu steps (%.0fx faster)\n",
+		step_ns, steps / 2, (double)(steps / 2) * step_ns / (query_ns * initial.size()));
+	printf("(ignore) %g\n", sink.x);
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+// Benchmarks tile generation throughput with the "full collection after every tile"
+// GC policy against the incremental one. Every worker thread owns a lua state, as the
+// PlanetTileServer does, and runs a generator with a garbage profile similar to the
+// planet scripts (a table per vertex for the inputs, small vectors while computing).
+// The real scripts need the game's lua libraries, so this one is self contained: it
+// shows the effect on a known garbage profile. engine_bench compares both policies
+// with the real surface script (planet_tile/generate_gc_*).
+#include <lua/LuaGCPolicy.h>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+static constexpr size_t WORKERS = 4;
+static constexpr size_t TILES_PER_WORKER = 400;
+// Same as PlanetTile::GEN_ARRAY_SIZE
+static constexpr size_t VERTICES = 34 * 34;
+
+static const char* SCRIPT = R"LUA(
+local vertex_count = ...
+local persistent = {}
+-- Planet scripts keep some state around (noise tables, configuration)
+for i = 1, 4096 do
+	persistent[i] = { math.sin(i), math.cos(i), i * 0.5 }
+end
+
+local function vec3(x, y, z) return { x = x, y = y, z = z } end
+local function add(a, b) return vec3(a.x + b.x, a.y + b.y, a.z + b.z) end
+local function scale(a, s) return vec3(a.x * s, a.y * s, a.z * s) end
+
+return function(tile)
+	local out = {}
+	for i = 1, vertex_count do
+		local info = { coord_3d = vec3(math.sin(i + tile), math.cos(i), 0.5), depth = 10 }
+		local p = info.coord_3d
+		local h = 0.0
+		for o = 1, 6 do
+			local n = persistent[(i * o) % 4096 + 1]
+			local q = add(scale(p, o * 2.0), vec3(n[1], n[2], n[3]))
+			h = h + math.sin(q.x) * math.cos(q.y + q.z) / o
+		end
+		out[i] = { height = h * 1000.0, color = vec3(h, 1.0 - h, 0.5) }
+	end
+	return #out
+end
+)LUA";
+
+struct WorkerResult
+{
+	double gc_time;
+	size_t memory_kb;
+	size_t full_collections;
+	bool failed;
+};
+
+static void worker(LuaGCPolicy::Config config, WorkerResult* result)
+{
+	sol::state lua;
+	lua.open_libraries(sol::lib::base, sol::lib::math, sol::lib::table);
+
+	LuaGCPolicy gc(config);
+	gc.attach(lua);
+
+	result->failed = false;
+	sol::protected_function setup = lua.load(SCRIPT);
+	sol::protected_function_result setup_result = setup(VERTICES);
+	if(!setup_result.valid())
+	{
+		sol::error err = setup_result;
+		printf("Script failed: %s\n", err.what());
+		result->failed = true;
+		return;
+	}
+	sol::protected_function generate = setup_result;
+
+	for(size_t i = 0; i < TILES_PER_WORKER; i++)
+	{
+		generate((double)i);
+		gc.after_job(lua);
+	}
+
+	result->gc_time = gc.get_gc_time();
+	result->memory_kb = gc.get_memory_kb();
+	result->full_collections = gc.get_full_collections();
+}
+
+static double run(LuaGCPolicy::Config config)
+{
+	std::vector<WorkerResult> results(WORKERS);
+	std::vector<std::thread> threads;
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+	for(size_t i = 0; i < WORKERS; i++)
+	{
+		threads.emplace_back(worker, config, &results[i]);
+	}
+	for(std::thread& t : threads)
+	{
+		t.join();
+	}
+	auto t1 = std::chrono::high_resolution_clock::now();
+
+	double total = std::chrono::duration<double>(t1 - t0).count();
+	double gc_time = 0.0;
+	size_t memory_kb = 0, full = 0;
+	for(const WorkerResult& r : results)
+	{
+		if(r.failed)
+		{
+			return 0.0;
+		}
+		gc_time += r.gc_time;
+		memory_kb += r.memory_kb;
+		full += r.full_collections;
+	}
+
+	size_t tiles = WORKERS * TILES_PER_WORKER;
+	double tiles_per_second = (double)tiles / total;
+	printf("%-12s %zu workers: %8.1f tiles/s, GC %7.3f ms/tile, %7.2f MB lua per worker, %zu full collections\n",
+		LuaGCPolicy::get_mode_name(config.mode), WORKERS, tiles_per_second,
+		gc_time * 1000.0 / (double)tiles, (double)memory_kb / 1024.0 / WORKERS, full);
+
+	return tiles_per_second;
+}
+
+int main(int argc, char** argv)
+{
+	LuaGCPolicy::Config full;
+	full.mode = LuaGCPolicy::FULL;
+	LuaGCPolicy::Config incremental;
+	incremental.mode = LuaGCPolicy::INCREMENTAL;
+
+	double full_tps = run(full);
+	double inc_tps = run(incremental);
+	if(full_tps > 0.0)
+	{
+		printf("Speedup: %.2fx\n", inc_tps / full_tps);
+	}
+
+	return 0;
+}
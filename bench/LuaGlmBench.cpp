@@ -0,0 +1,106 @@
+// Benchmarks a machine-like lua workload (lots of small vector operations every frame)
+// with the glm usertypes and with the ffi_glm cdata types. It reports the memory allocated
+// per frame, which is what the GC has to clean up, and the time per frame.
+#include <lua/libs/LuaGlm.h>
+#include <lua/libs/LuaFFIGlm.h>
+#include <chrono>
+#include <cstdio>
+
+static constexpr size_t ENGINES = 64;
+static constexpr size_t WARMUP_FRAMES = 200;
+static constexpr size_t FRAMES = 2000;
+
+// Works with both libraries, as they share the interface
+static const char* SCRIPT = R"LUA(
+local glm, engine_count = ...
+local vec3 = glm.vec3
+
+local engines = {}
+for i = 1, engine_count do
+	engines[i] = {
+		pos = vec3.new(i * 0.1, 1.0, -i * 0.05),
+		dir = vec3.new(0.1, 1.0, 0.01 * i),
+		thrust = 1000.0 + i,
+	}
+end
+
+local vel = vec3.new(10.0, 0.0, 5.0)
+
+return function(dt)
+	local total_force = vec3.new(0.0, 0.0, 0.0)
+	local total_torque = vec3.new(0.0, 0.0, 0.0)
+	for i = 1, #engines do
+		local e = engines[i]
+		local force = glm.normalize(e.dir) * e.thrust
+		-- Some drag, same as a typical machine would do
+		local drag = -vel * (glm.length(vel) * 0.01)
+		total_force = total_force + force + drag
+		total_torque = total_torque + glm.cross(e.pos, force)
+	end
+	vel = vel + total_force * (dt / 5000.0)
+	return total_force.x + total_torque.y
+end
+)LUA";
+
+static double run(const char* name, LuaLib& lib)
+{
+	sol::state lua;
+	lua.open_libraries(sol::lib::base, sol::lib::math, sol::lib::string, sol::lib::table, sol::lib::jit);
+
+	sol::table glm = lua.create_table();
+	lib.load_to(glm);
+
+	sol::protected_function setup = lua.load(SCRIPT, name);
+	sol::protected_function_result setup_result = setup(glm, ENGINES);
+	if(!setup_result.valid())
+	{
+		sol::error err = setup_result;
+		printf("%s failed: %s\n", name, err.what());
+		return 0.0;
+	}
+	sol::protected_function frame = setup_result;
+
+	double check = 0.0;
+	for(size_t i = 0; i < WARMUP_FRAMES; i++)
+	{
+		check += frame(1.0 / 60.0).get<double>();
+	}
+
+	// Memory allocated per frame, with the GC stopped so nothing is collected meanwhile
+	lua.collect_garbage();
+	lua_gc(lua.lua_state(), LUA_GCSTOP, 0);
+	size_t mem_before = lua.memory_used();
+	for(size_t i = 0; i < FRAMES; i++)
+	{
+		check += frame(1.0 / 60.0).get<double>();
+	}
+	size_t mem_after = lua.memory_used();
+	lua_gc(lua.lua_state(), LUA_GCRESTART, 0);
+
+	// Time per frame, including the GC work
+	auto t0 = std::chrono::high_resolution_clock::now();
+	for(size_t i = 0; i < FRAMES; i++)
+	{
+		check += frame(1.0 / 60.0).get<double>();
+	}
+	auto t1 = std::chrono::high_resolution_clock::now();
+
+	double per_frame = std::chrono::duration<double>(t1 - t0).count() / FRAMES;
+	double kb_per_frame = (double)(mem_after - mem_before) / 1024.0 / FRAMES;
+	printf("%-8s %zu engines: %9.3f KB allocated per frame, %8.3f us per frame [check %g]\n",
+		name, ENGINES, kb_per_frame, per_frame * 1e6, check);
+
+	return per_frame;
+}
+
+int main(int argc, char** argv)
+{
+	LuaGlm glm;
+	LuaFFIGlm ffi_glm;
+
+	double usertype = run("glm", glm);
+	double ffi = run("ffi_glm", ffi_glm);
+	printf("Speedup: %.2fx\n", usertype / ffi);
+
+	return 0;
+}
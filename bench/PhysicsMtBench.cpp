@@ -0,0 +1,188 @@
+// Benchmarks the single threaded bullet world against the multithreaded one running
+// on the JobSystem (as the universe builds them), with several unpacked vehicles.
+// Every vehicle is a tower of boxes joined by fixed constraints (like linked pieces),
+// and they all fall and rest on a static ground, spread out so they are separate islands.
+// Bullet must be built with BT_THREADSAFE (BULLET2_MULTITHREADING) for the
+// multithreaded world to run in parallel.
+#include <physics/JobTaskScheduler.h>
+#include <util/JobSystem.h>
+#include <util/Logger.h>
+#pragma warning(push, 0)
+#include <btBulletDynamicsCommon.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#pragma warning(pop)
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+static constexpr int PIECES_PER_VEHICLE = 40;
+static constexpr int WARMUP_STEPS = 60;
+static constexpr int STEPS = 300;
+static constexpr double STEP_SIZE = 1.0 / 30.0;
+
+struct Scene
+{
+	btDefaultCollisionConfiguration* config;
+	btCollisionDispatcher* dispatcher;
+	btBroadphaseInterface* broadphase;
+	std::vector<btConstraintSolver*> solvers;
+	btConstraintSolverPoolMt* pool;
+	btDiscreteDynamicsWorld* world;
+
+	btBoxShape* box;
+	btStaticPlaneShape* ground_shape;
+	std::vector<btRigidBody*> bodies;
+	std::vector<btTypedConstraint*> constraints;
+	int ticks;
+};
+
+// Same as the universe, counts ticks through the internal tick callback
+static void bench_tick(btDynamicsWorld* world, btScalar tstep)
+{
+	((Scene*)world->getWorldUserInfo())->ticks++;
+}
+
+static btRigidBody* add_body(Scene& sc, btCollisionShape* shape, double mass, const btVector3& pos)
+{
+	btVector3 inertia = btVector3(0, 0, 0);
+	if(mass > 0.0)
+	{
+		shape->calculateLocalInertia(mass, inertia);
+	}
+	btTransform tform = btTransform::getIdentity();
+	tform.setOrigin(pos);
+	btRigidBody* body = new btRigidBody(mass, new btDefaultMotionState(tform), shape, inertia);
+	body->setActivationState(DISABLE_DEACTIVATION);
+	sc.world->addRigidBody(body);
+	sc.bodies.push_back(body);
+	return body;
+}
+
+static void build_scene(Scene& sc, int vehicles, bool mt, btITaskScheduler* scheduler)
+{
+	sc.config = new btDefaultCollisionConfiguration();
+	sc.broadphase = new btDbvtBroadphase();
+	sc.pool = nullptr;
+	sc.ticks = 0;
+	if(mt)
+	{
+		for(int i = 0; i < scheduler->getNumThreads(); i++)
+		{
+			sc.solvers.push_back(new btSequentialImpulseConstraintSolver());
+		}
+		sc.pool = new btConstraintSolverPoolMt(sc.solvers.data(), (int)sc.solvers.size());
+		sc.dispatcher = new btCollisionDispatcherMt(sc.config);
+		sc.world = new btDiscreteDynamicsWorldMt(sc.dispatcher, sc.broadphase, sc.pool, nullptr, sc.config);
+	}
+	else
+	{
+		sc.solvers.push_back(new btSequentialImpulseConstraintSolver());
+		sc.dispatcher = new btCollisionDispatcher(sc.config);
+		sc.world = new btDiscreteDynamicsWorld(sc.dispatcher, sc.broadphase, sc.solvers[0], sc.config);
+	}
+	sc.world->setGravity(btVector3(0, -9.81, 0));
+	sc.world->setInternalTickCallback(bench_tick, &sc, true);
+
+	sc.box = new btBoxShape(btVector3(0.5, 0.5, 0.5));
+	sc.ground_shape = new btStaticPlaneShape(btVector3(0, 1, 0), 0);
+	add_body(sc, sc.ground_shape, 0.0, btVector3(0, 0, 0));
+
+	for(int v = 0; v < vehicles; v++)
+	{
+		btVector3 base = btVector3((v % 8) * 20.0, 2.0, (v / 8) * 20.0);
+		btRigidBody* prev = nullptr;
+		for(int p = 0; p < PIECES_PER_VEHICLE; p++)
+		{
+			// A bit of an offset so towers lean and the contacts stay busy
+			btVector3 pos = base + btVector3(0.02 * p, 1.01 * p, 0.0);
+			btRigidBody* body = add_body(sc, sc.box, 100.0, pos);
+			if(prev)
+			{
+				btTransform in_a = btTransform::getIdentity();
+				in_a.setOrigin(btVector3(0, 0.505, 0));
+				btTransform in_b = btTransform::getIdentity();
+				in_b.setOrigin(btVector3(0, -0.505, 0));
+				auto* c = new btFixedConstraint(*prev, *body, in_a, in_b);
+				sc.world->addConstraint(c, true);
+				sc.constraints.push_back(c);
+			}
+			prev = body;
+		}
+	}
+}
+
+static void destroy_scene(Scene& sc)
+{
+	for(btTypedConstraint* c : sc.constraints)
+	{
+		sc.world->removeConstraint(c);
+		delete c;
+	}
+	for(btRigidBody* body : sc.bodies)
+	{
+		sc.world->removeRigidBody(body);
+		delete body->getMotionState();
+		delete body;
+	}
+	delete sc.world;
+	delete sc.pool;
+	for(btConstraintSolver* s : sc.solvers)
+	{
+		delete s;
+	}
+	delete sc.dispatcher;
+	delete sc.broadphase;
+	delete sc.config;
+	delete sc.box;
+	delete sc.ground_shape;
+}
+
+// Returns milliseconds per step
+static double run(int vehicles, bool mt, btITaskScheduler* scheduler)
+{
+	Scene sc;
+	build_scene(sc, vehicles, mt, scheduler);
+
+	for(int i = 0; i < WARMUP_STEPS; i++)
+	{
+		sc.world->stepSimulation(STEP_SIZE, 1, STEP_SIZE);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for(int i = 0; i < STEPS; i++)
+	{
+		sc.world->stepSimulation(STEP_SIZE, 1, STEP_SIZE);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+
+	if(sc.ticks != WARMUP_STEPS + STEPS)
+	{
+		printf("Tick callback ran %d times, expected %d\n", sc.ticks, WARMUP_STEPS + STEPS);
+	}
+
+	destroy_scene(sc);
+	return std::chrono::duration<double, std::milli>(end - start).count() / STEPS;
+}
+
+int main()
+{
+	create_global_logger();
+
+	auto settings = cpptoml::make_table();
+	JobSystem jobs = JobSystem(*settings);
+	JobTaskScheduler scheduler = JobTaskScheduler(&jobs);
+	btSetTaskScheduler(&scheduler);
+
+	printf("%d pieces per vehicle, %d threads\n", PIECES_PER_VEHICLE, scheduler.getNumThreads());
+	printf("%10s %14s %14s %8s\n", "vehicles", "single (ms)", "mt (ms)", "speedup");
+	for(int vehicles : {1, 2, 4, 8, 16, 32})
+	{
+		double single = run(vehicles, false, &scheduler);
+		double mt = run(vehicles, true, &scheduler);
+		printf("%10d %14.3f %14.3f %7.2fx\n", vehicles, single, mt, single / mt);
+	}
+
+	return 0;
+}
@@ -13,6 +13,8 @@ struct PackageMetadata
 	std::string author;
 	std::string version;
 	std::vector<std::string> dependencies;
+	// Regexes of asset paths which are loaded in parallel at startup
+	std::vector<std::string> preload;
 
 	std::string pkg_script_path;
 
@@ -37,6 +39,15 @@ struct PackageMetadata
 		{
 			dependencies.push_back(dep);
 		}
+
+		auto preloads = file->get_qualified_array_of<std::string>("preload");
+		if (preloads)
+		{
+			for (auto pre : *preloads)
+			{
+				preload.push_back(pre);
+			}
+		}
 	}
 
 	PackageMetadata()
@@ -36,6 +36,8 @@ function activate(from_rigid, from_frame, to_rigid, to_frame, world)
 
 
 		constraint:add_to_world(world, true)
+		-- The vehicle is notified once the constraint gets disabled
+		watch_constraint(constraint)
 	end
 end
 
@@ -48,16 +50,6 @@ function deactivate()
 
 end 
 
-function is_broken() 
-
-	if constraint == nil then
-		return true 
-	else
-		return not constraint:is_enabled()
-	end
-
-end 
-
 function set_breaking_enabled(value)
 
 
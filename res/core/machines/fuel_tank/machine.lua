@@ -48,4 +48,18 @@ function update(dt)
         plumbing.update(dt, not pause_reaction)
     end
 
-end
\ No newline at end of file
+end
+
+-- Called when saving the game, the contents are restored in load_state
+function save_state()
+    return {
+        contents = plumbing.fluid_container.contents,
+        ullage_distribution = plumbing.fluid_container.ullage_distribution
+    }
+end
+
+function load_state(state)
+    if state == nil then return end
+    plumbing.fluid_container.contents = state.contents
+    plumbing.fluid_container.ullage_distribution = state.ullage_distribution
+end
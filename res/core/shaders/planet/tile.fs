@@ -41,7 +41,7 @@ uniform float triplanar_power;
 uniform float triplanar_y_mult;
 #endif
 
-uniform int do_detail;
+flat in int vDoDetail;
 
 void main()
 {
@@ -51,7 +51,7 @@ void main()
     vec3 nrm = vNormal;
 
     #ifdef _USE_PLANET_DETAILS
-    if(do_detail == 1)
+    if(vDoDetail == 1)
     {
         // Adjusted triplanar mapping
         vec3 adjusted_pos = (vec3(tri_matrix * vec4(vPosScaled, 1.0))) * detail_scale;
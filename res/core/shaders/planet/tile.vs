@@ -1,14 +1,31 @@
 #version 430 core
 
+// Position is 0->1 inside the tile box (the matrices include it), normal is octahedral
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 1) in vec2 aNormalOct;
 layout (location = 2) in vec3 aColor;
-layout (location = 3) in vec3 aGlobalTex;
+// Index into tiles, all tiles of a planet are drawn in a single multi draw
+layout (location = 3) in uint aDrawID;
+
+struct TileData
+{
+	mat4 tform;
+	mat4 m_tform;
+	mat4 rotm_tform;
+	// Tile to (unrotated) planet coordinates
+	mat4 sph_tform;
+	// xy = tile min, z = depth
+	vec4 tile;
+	int flag;
+	int base_vertex;
+};
+
+layout (std430, binding = 0) readonly buffer TileBuffer
+{
+	TileData tiles[];
+};
 
-uniform mat4 tform;
-uniform mat4 m_tform;
 uniform mat4 normal_tform;
-uniform mat4 rotm_tform;
 
 uniform float f_coef;
 
@@ -24,11 +41,28 @@ out vec3 vPosNrm;
 out vec3 vPosScaled;
 
 out float flogz;
+flat out int vDoDetail;
 
-uniform vec3 tile;
+vec3 decode_normal(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if(n.z < 0.0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
 
 void main()
 {
+	vec3 aNormal = decode_normal(aNormalOct);
+	TileData t = tiles[aDrawID];
+	mat4 tform = t.tform;
+	mat4 m_tform = t.m_tform;
+	mat4 rotm_tform = t.rotm_tform;
+	mat4 sph_tform = t.sph_tform;
+	vDoDetail = t.flag;
+
     gl_Position = tform * vec4(aPos, 1.0f);
 	gl_Position.z = log2(max(1e-6, 1.0 + gl_Position.w)) * f_coef - 1.0;
 	flogz = 1.0 + gl_Position.w;
@@ -37,8 +71,11 @@ void main()
 	vNormal = vec3(normal_tform * vec4(aNormal, 1.0));
 	vPosNrm = vec3(rotm_tform * vec4(aPos, 1.0));
 
-	vGlobalUV = aGlobalTex.xy;
-    vTexture = aGlobalTex.z;
+	// Equirectangular projection of the point, 0->1
+	const float PI = 3.14159265359;
+	vec3 sph = normalize((sph_tform * vec4(aPos, 1.0)).xyz);
+	vGlobalUV = vec2((atan(sph.z, sph.x) + PI * 0.5) / PI, acos(clamp(sph.y, -1.0, 1.0)) / PI);
+	vTexture = 0.0;
 
 	vPos = (m_tform * vec4(aPos, 1.0)).xyz;
 	vPosScaled = (rotm_tform * vec4(aPos, 1.0)).xyz;
@@ -1,16 +1,33 @@
 #version 430 core
 
+// Position is 0->1 inside the tile box (the matrices include it), normal is octahedral
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 1) in vec2 aNormalOct;
 layout (location = 2) in float aDepth;
-layout (location = 3) in vec2 aTexture;
+// Index into tiles, all tiles of a planet are drawn in a single multi draw
+layout (location = 3) in uint aDrawID;
+
+struct TileData
+{
+	mat4 tform;
+	mat4 m_tform;
+	mat4 rotm_tform;
+	// Tile to (unrotated) planet coordinates
+	mat4 sph_tform;
+	// xy = tile min, z = depth
+	vec4 tile;
+	// clockwise
+	int flag;
+	int base_vertex;
+};
+
+layout (std430, binding = 0) readonly buffer TileBuffer
+{
+	TileData tiles[];
+};
 
-uniform mat4 tform;
-uniform mat4 deferred_tform;
 uniform mat4 normal_tform;
-uniform mat4 rotm_tform;
 
-uniform int clockwise;
 uniform float f_coef;
 
 out vec3 vNormal;
@@ -20,22 +37,38 @@ out vec2 vTexture;
 out float flogz;
 out float vDepth;
 
-uniform vec3 tile;
-
 uniform float time;
 
-vec2 get_real_uv()
+// Must match PlanetTile::TILE_SIZE
+const int TILE_SIZE = 32;
+
+vec2 get_real_uv(TileData t)
+{
+	// Vertices are laid out row by row in the tile's slot
+	int vi = gl_VertexID - t.base_vertex;
+	vec2 uv = vec2(vi % TILE_SIZE, vi / TILE_SIZE) / float(TILE_SIZE) * 1000.0;
+	return (uv / pow(2, t.tile.z) + t.tile.xy * 1000.0) * 0.001;
+}
+
+vec3 decode_normal(vec2 e)
 {
-	return (aTexture / pow(2, tile.z) + tile.xy * 1000.0) * 0.001;
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if(n.z < 0.0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
 }
 
 void main()
 {
-	vTexture = get_real_uv();
+	vec3 aNormal = decode_normal(aNormalOct);
+	TileData t = tiles[aDrawID];
+	vTexture = get_real_uv(t);
 
-	vec4 wPos = deferred_tform * vec4(aPos, 1.0);
+	vec4 wPos = t.m_tform * vec4(aPos, 1.0);
 
-    gl_Position = tform * vec4(aPos, 1.0);
+    gl_Position = t.tform * vec4(aPos, 1.0);
 	gl_Position.z = log2(max(1e-6, 1.0 + gl_Position.w)) * f_coef - 1.0;
 
 	flogz = 1.0 + gl_Position.w;
@@ -43,7 +76,7 @@ void main()
 	vPos = wPos.xyz;
 
 	vNormal = vec3(normal_tform * vec4(aNormal, 1.0));
-	vPosNrm = vec3(rotm_tform * vec4(aPos, 1.0));
+	vPosNrm = vec3(t.rotm_tform * vec4(aPos, 1.0));
 	vDepth = aDepth;
 
 }
\ No newline at end of file
@@ -20,7 +20,16 @@ int main(int argc, char** argv)
 	osp = new OSP();
 	osp->init(argc, argv);
 
-	SerializeUtil::read_file_to("udata/saves/debug-save/save.toml", *osp->game_state);
+	// A snapshot (for example the autosave) may be loaded instead of the debug save
+	std::string snapshot = osp->settings->get_qualified_as<std::string>("game.load_snapshot").value_or("");
+	if(snapshot.empty() || !osp->game_state->load_snapshot(snapshot))
+	{
+		if(!snapshot.empty())
+		{
+			logger->warn("Could not load snapshot '{}', loading the debug save", snapshot);
+		}
+		SerializeUtil::read_file_to("udata/saves/debug-save/save.toml", *osp->game_state);
+	}
 
 	double fps_t = 0.0;
 	double dt_avg = 0.0;
@@ -8,6 +8,7 @@
 #include <lua/LuaCore.h>
 #include <game/GameState.h>
 #include <game/database/GameDatabase.h>
+#include <util/JobSystem.h>
 
 InputUtil* input;
 
@@ -67,7 +68,7 @@ bool is_number(const std::string& s)
 	return !s.empty() && it == s.end();
 }
 
-void OSP::init(int argc, char** argv)
+void OSP::init(int argc, char** argv, bool headless)
 {
 	argh::parser args(argc, argv);
 
@@ -167,12 +168,18 @@ void OSP::init(int argc, char** argv)
 		auto locale_toml = config->get_qualified_as<std::string>("locale.language");
 		current_locale = locale_toml ? *locale_toml : "en";
 
-		assets = new AssetManager(res_path, udata_path);
-		renderer = new Renderer(*config);
-		audio_engine = new AudioEngine(*config);
-		create_global_debug_drawer();
-		create_global_texture_drawer();
-		create_global_text_drawer();
+		settings = config;
+
+		jobs = new JobSystem(*config);
+		assets = new AssetManager(res_path, udata_path, *config);
+		if(!headless)
+		{
+			renderer = new Renderer(*config);
+			audio_engine = new AudioEngine(*config);
+			create_global_debug_drawer();
+			create_global_texture_drawer();
+			create_global_text_drawer();
+		}
 		create_global_lua_core();
 		create_global_profiler();
 
@@ -184,7 +191,10 @@ void OSP::init(int argc, char** argv)
 		assets->load_packages(lua_core, game_database);
 
 		input = new InputUtil();	
-		input->setup(renderer->window);
+		if(renderer != nullptr)
+		{
+			input->setup(renderer->window);
+		}
 
 		dt = 0.0;
 	}
@@ -202,6 +212,7 @@ void OSP::finish()
 	delete renderer;
 	delete audio_engine;
 	delete assets;
+	delete jobs;
 	destroy_global_logger();
 }
 
@@ -229,7 +240,13 @@ void OSP::start_frame()
 void OSP::update()
 {
 	PROFILE_FUNC();
+	// Uploads async loaded assets, with a time budget
+	assets->update();
 	game_state->update();
+	if(audio_engine != nullptr)
+	{
+		audio_engine->update();
+	}
 }
 
 void OSP::render()
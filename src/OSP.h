@@ -15,6 +15,7 @@ class LuaCore;
 class GameState;
 class GameDatabase;
 class AudioEngine;
+class JobSystem;
 
 // Initializes the different subsystems OSP has
 // It's a global class, only one OSP may exist at once (filesystem related)
@@ -39,9 +40,15 @@ public:
 	AudioEngine* audio_engine{};
 	GameState* game_state{};
 	GameDatabase* game_database{};
+	JobSystem* jobs{};
+
+	// The loaded settings file, with commandline overrides applied
+	std::shared_ptr<cpptoml::table> settings;
 
 	constexpr static const char* OSP_VERSION = "PRE-RELEASE";
-	void init(int argc, char** argv);
+	// Headless doesn't create a window, a GL context or audio (renderer and audio_engine
+	// stay null), for tools and benchmarks. Assets are loaded but never uploaded
+	void init(int argc, char** argv, bool headless = false);
 	void finish();
 	
 	bool should_loop();
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <atomic>
 
 // Macros to shorten the constructors a little bit
 #define ASSET_INFO const std::string& path, const std::string& name, const std::string& pkg
@@ -8,7 +9,8 @@
 #define GENERATED_ASSET_INFO "", Asset::get_generated_package_name(), "generated_assets"
 
 // Defined in AssetManager.cpp (It's a global variable)
-extern size_t generated_asset_counter;
+// Atomic as assets may be generated by loaders running in worker threads
+extern std::atomic<size_t> generated_asset_counter;
 
 // Base class for an asset, contains basic information and hashing
 class Asset
@@ -23,8 +25,7 @@ public:
 
 	static std::string get_generated_package_name()
 	{
-		generated_asset_counter++;
-		return "asset_" + std::to_string(generated_asset_counter);
+		return "asset_" + std::to_string(++generated_asset_counter);
 	}
 
 	const std::string& get_asset_id() const
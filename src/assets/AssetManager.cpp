@@ -12,6 +12,7 @@
 #include "AudioClip.h"
 
 #include <game/database/GameDatabase.h>
+#include <util/Profiler.h>
 
 #include "sol/sol.hpp"
 
@@ -19,33 +20,330 @@
 
 #include <istream>
 #include <fstream>
+#include <future>
+#include <algorithm>
 
 AssetManager* assets;
 
-size_t generated_asset_counter;
+std::atomic<size_t> generated_asset_counter;
 
-AssetManager::AssetManager(const std::string &res_path, const std::string &udata_path)
+thread_local std::string AssetManager::current_package = "core";
+thread_local PendingLoad* AssetManager::current_load = nullptr;
+
+AssetManager::AssetManager(const std::string &res_path, const std::string &udata_path, const cpptoml::table& settings)
+	: cache(udata_path + "cache/", settings.get_qualified_as<bool>("assets.baked_cache").value_or(true))
 {
 	generated_asset_counter = 0;
 	current_package = "core";
 	this->res_path = res_path;
 	this->udata_path = udata_path;
+	main_thread = std::this_thread::get_id();
 
 	preload();
 
-	create_asset_type<Shader>("Shader", load_shader);
-	create_asset_type<Image>("Image", load_image);
-	create_asset_type<Config>("Config", load_config);
-	create_asset_type<BitmapFont>("Bitmap Font", load_bitmap_font);
-	create_asset_type<Model>("Model", load_model);
-	create_asset_type<Material>("Material", load_material);
-	create_asset_type<PartPrototype>("Part Prototype", load_part_prototype);
-	create_asset_type<BuildingPrototype>("Building Prototype", load_building_prototype);
-	create_asset_type<Cubemap>("Cubemap", load_cubemap);
-	create_asset_type<PhysicalMaterial>("Physical Material", load_physical_material);
-	create_asset_type<AudioClip>("Audio Clip", load_audio_clip);
+	// Cubemaps render to generate the IBL maps, so they are loaded in the main thread
+	create_asset_type<Shader>("Shader", load_shader, true, true, R"(.*\.vs)");
+	create_asset_type<Image>("Image", load_image, true, true, R"(.*\.png)");
+	create_asset_type<Config>("Config", load_config, true);
+	create_asset_type<BitmapFont>("Bitmap Font", load_bitmap_font, true);
+	create_asset_type<Model>("Model", load_model, true, true, R"(.*\.(gltf|glb))");
+	create_asset_type<Material>("Material", load_material, true);
+	create_asset_type<PartPrototype>("Part Prototype", load_part_prototype, true);
+	create_asset_type<BuildingPrototype>("Building Prototype", load_building_prototype, true);
+	create_asset_type<Cubemap>("Cubemap", load_cubemap, false);
+	create_asset_type<PhysicalMaterial>("Physical Material", load_physical_material, true);
+	create_asset_type<AudioClip>("Audio Clip", load_audio_clip, true, true, R"(.*\.(wav|ogg|mp3|flac))");
 
 	check_packages();
+
+	auto worker_count = (size_t)settings.get_qualified_as<int64_t>("assets.worker_threads").value_or(0);
+	if(worker_count == 0)
+	{
+		// Leave one core for the main thread
+		worker_count = std::clamp((size_t)std::thread::hardware_concurrency(), (size_t)2, (size_t)5) - 1;
+	}
+	// In milliseconds in the config
+	upload_budget = settings.get_qualified_as<double>("assets.upload_budget").value_or(4.0) * 1e-3;
+
+	workers_run = true;
+	for(size_t i = 0; i < worker_count; i++)
+	{
+		workers.emplace_back(&AssetManager::worker_func, this);
+	}
+}
+
+void AssetManager::worker_func()
+{
+	while(true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(jobs_mtx);
+			jobs_cv.wait(lock, [this](){ return !jobs.empty() || !workers_run; });
+			if(!workers_run)
+			{
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
+
+void AssetManager::push_job(std::function<void()>&& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(jobs_mtx);
+		jobs.push_back(std::move(job));
+	}
+	jobs_cv.notify_one();
+}
+
+void AssetManager::run_main_loads()
+{
+	std::vector<std::function<void()>> to_run;
+	{
+		std::lock_guard<std::mutex> lock(main_loads_mtx);
+		to_run.swap(main_loads);
+	}
+
+	for(auto& f : to_run)
+	{
+		f();
+	}
+}
+
+void AssetManager::run_on_main(const std::function<void()>& f)
+{
+	std::promise<void> done;
+	std::future<void> fut = done.get_future();
+	{
+		std::lock_guard<std::mutex> lock(main_loads_mtx);
+		main_loads.emplace_back([&f, &done]()
+		{
+			f();
+			done.set_value();
+		});
+	}
+	fut.wait();
+}
+
+void AssetManager::gl_upload(std::function<void()>&& f)
+{
+	if(current_load == nullptr || is_main_thread())
+	{
+		f();
+	}
+	else
+	{
+		current_load->uploads.push_back(std::move(f));
+	}
+}
+
+bool AssetManager::finish_load(PendingLoad* load, std::chrono::steady_clock::time_point deadline)
+{
+	int st = load->state.load();
+	if(st == PendingLoad::READY || st == PendingLoad::FAILED)
+	{
+		return true;
+	}
+	else if(st != PendingLoad::DECODED)
+	{
+		return false;
+	}
+
+	for(const auto& dep : load->deps)
+	{
+		if(!finish_load(dep.get(), deadline))
+		{
+			return false;
+		}
+	}
+
+	while(load->uploads_done < load->uploads.size())
+	{
+		// Incremented first in case the upload itself needs this asset
+		load->uploads[load->uploads_done++]();
+		if(load->uploads_done < load->uploads.size() && std::chrono::steady_clock::now() >= deadline)
+		{
+			return false;
+		}
+	}
+
+	load->uploads.clear();
+	load->deps.clear();
+	load->state = PendingLoad::READY;
+	return true;
+}
+
+bool AssetManager::wait_load_locked(const std::shared_ptr<PendingLoad>& load, std::unique_lock<std::mutex>& lock)
+{
+	while(true)
+	{
+		int st = load->state.load();
+		if(st == PendingLoad::READY)
+		{
+			return true;
+		}
+		else if(st == PendingLoad::FAILED)
+		{
+			return false;
+		}
+		else if(st == PendingLoad::DECODED)
+		{
+			// Uploads may load other assets
+			lock.unlock();
+			finish_load(load.get(), std::chrono::steady_clock::time_point::max());
+			lock.lock();
+			continue;
+		}
+
+		// The worker may be waiting for us to load a main thread only asset
+		lock.unlock();
+		run_main_loads();
+		lock.lock();
+		load_cv.wait_for(lock, std::chrono::milliseconds(1), [&load]()
+		{
+			return load->state.load() >= PendingLoad::DECODED;
+		});
+	}
+}
+
+bool AssetManager::wait_load(const std::shared_ptr<PendingLoad>& load)
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	return wait_load_locked(load, lock);
+}
+
+bool AssetManager::is_load_ready(const std::shared_ptr<PendingLoad>& load)
+{
+	int st = load->state.load();
+	return st == PendingLoad::READY || st == PendingLoad::FAILED;
+}
+
+void AssetManager::update()
+{
+	PROFILE_FUNC();
+
+	run_main_loads();
+
+	{
+		std::lock_guard<std::mutex> lock(decoded_mtx);
+		uploading.insert(uploading.end(), decoded.begin(), decoded.end());
+		decoded.clear();
+	}
+
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(upload_budget));
+
+	size_t done = 0;
+	for(; done < uploading.size(); done++)
+	{
+		if(!finish_load(uploading[done].get(), deadline))
+		{
+			break;
+		}
+	}
+	uploading.erase(uploading.begin(), uploading.begin() + done);
+
+	// Swapped out, as the functions may free assets which drop their own futures
+	std::vector<std::pair<std::shared_ptr<PendingLoad>, std::function<void()>>> to_check;
+	to_check.swap(when_ready);
+	for(auto& pair : to_check)
+	{
+		int st = pair.first->state.load();
+		if(st == PendingLoad::READY)
+		{
+			pair.second();
+		}
+		else if(st != PendingLoad::FAILED)
+		{
+			when_ready.push_back(std::move(pair));
+		}
+	}
+}
+
+void AssetManager::call_when_ready(std::shared_ptr<PendingLoad> load, std::function<void()>&& f)
+{
+	logger->check(is_main_thread(), "call_when_ready must be called from the main thread");
+	when_ready.emplace_back(std::move(load), std::move(f));
+}
+
+void AssetManager::preload_assets()
+{
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::shared_ptr<PendingLoad>> loads;
+
+	for(auto& pkg_pair : packages)
+	{
+		const std::vector<std::string>& patterns = pkg_pair.second.metadata.preload;
+		if(patterns.empty())
+		{
+			continue;
+		}
+
+		std::vector<std::regex> regexes;
+		for(const std::string& pattern : patterns)
+		{
+			regexes.emplace_back(pattern);
+		}
+
+		std::string root = res_path + pkg_pair.first + "/";
+		for(const auto& entry : std::filesystem::recursive_directory_iterator(root))
+		{
+			if(!entry.is_regular_file())
+			{
+				continue;
+			}
+
+			std::string name = entry.path().string().substr(root.size());
+			std::replace(name.begin(), name.end(), '\\', '/');
+
+			bool wanted = false;
+			for(const std::regex& reg : regexes)
+			{
+				if(std::regex_match(name, reg))
+				{
+					wanted = true;
+					break;
+				}
+			}
+
+			if(!wanted)
+			{
+				continue;
+			}
+
+			for(auto& type_pair : pkg_pair.second.assets)
+			{
+				AssetTypeData& tdata = type_pair.second.first;
+				if(tdata.preload && std::regex_match(name, tdata.regex))
+				{
+					loads.push_back(tdata.start_async(this, pkg_pair.first, name));
+
+					std::lock_guard<std::mutex> lock(mtx);
+					auto item = type_pair.second.second.find(name);
+					if(item != type_pair.second.second.end())
+					{
+						item->second.preload = true;
+					}
+				}
+			}
+		}
+	}
+
+	size_t failed = 0;
+	for(const auto& load : loads)
+	{
+		if(!wait_load(load))
+		{
+			failed++;
+		}
+	}
+
+	std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+	logger->info("Preloaded {} assets ({} failed) in {}s using {} workers", loads.size(), failed, took.count(), workers.size());
 }
 
 bool AssetManager::file_exists(const std::string& path)
@@ -58,6 +356,46 @@ std::string AssetManager::load_string(const std::string& full_path, const std::s
 	return load_string_raw(resolve_path(full_path, def));
 }
 
+std::shared_ptr<cpptoml::table> AssetManager::load_toml(const std::string& path)
+{
+	if(!cache.is_enabled())
+	{
+		return SerializeUtil::load_file(path);
+	}
+
+	// Entries are named after the path inside res, or its hash for outside files
+	std::string key;
+	if(path.rfind(res_path, 0) == 0)
+	{
+		key = path.substr(res_path.size());
+	}
+	else
+	{
+		key = "external/" + std::to_string(BakedCache::hash_string(path));
+	}
+
+	BakedSource source(path);
+	BakedEntry entry = cache.read(key, "toml", source);
+	if(entry.payload)
+	{
+		BakedReader reader(entry.payload, entry.payload_size);
+		auto table = BakedCache::read_toml(reader);
+		if(table)
+		{
+			return table;
+		}
+	}
+
+	auto table = SerializeUtil::load_file(path);
+	BakedWriter writer;
+	if(table && BakedCache::write_toml(writer, *table))
+	{
+		cache.write(key, "toml", source, writer);
+	}
+
+	return table;
+}
+
 std::string AssetManager::load_string_raw(const std::string& path)
 {
 	std::ifstream t(path);
@@ -191,6 +529,9 @@ void AssetManager::load_packages(LuaCore* lua_core, GameDatabase* game_database)
 	// TODO: Maybe error handling, but a bad package
 	// is pretty much a full game crash
 
+	// Loads in parallel all assets the packages want preloaded
+	preload_assets();
+
 	// Pre-init, create all lua files
 	for(auto& pkg_pair : packages)
 	{
@@ -278,6 +619,17 @@ AssetManager::pfr AssetManager::load_script_to(sol::state& target,
 AssetManager::~AssetManager()
 {
 	logger->info("Asset manager is being destroyed");
+
+	{
+		std::lock_guard<std::mutex> lock(jobs_mtx);
+		workers_run = false;
+	}
+	jobs_cv.notify_all();
+	for(std::thread& th : workers)
+	{
+		th.join();
+	}
+
 	for(const auto& pkg_pair : packages)
 	{
 		for(const auto& ast_pair : pkg_pair.second.assets)
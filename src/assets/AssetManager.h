@@ -7,6 +7,13 @@
 #include <regex>
 #include <filesystem>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <functional>
+#include <chrono>
 
 #include <util/Logger.h>
 #include <util/SerializeUtil.h>
@@ -16,6 +23,7 @@
 
 #include <PackageMetadata.h>
 #include "Asset.h"
+#include "BakedCache.h"
 
 // You must allocate the new asset!
 // Return nullptr if not possible
@@ -25,19 +33,63 @@ using LoadAssetPtr = T*(*)(ASSET_INFO, const cpptoml::table& config);
 template<typename T>
 struct AssetHandle;
 
+template<typename T>
+class AssetFuture;
+
 class GameDatabase;
 
+// Tracks an asset being loaded. Loading happens in two steps: decoding (file reading,
+// parsing, anything CPU), which may run on a worker thread, and uploading (everything
+// which needs the GL context), which always runs on the main thread.
+// Assets loaded by the loader (nested loads) are dependencies, and are uploaded first.
+struct PendingLoad
+{
+	enum State
+	{
+		QUEUED,
+		DECODING,
+		// Only uploads remain
+		DECODED,
+		READY,
+		FAILED
+	};
+
+	std::atomic<int> state;
+
+	// Filled by the decoding thread, ran by the main thread in order
+	std::vector<std::function<void()>> uploads;
+	size_t uploads_done;
+
+	std::vector<std::shared_ptr<PendingLoad>> deps;
+
+	explicit PendingLoad(State st) : state(st), uploads_done(0) {}
+};
+
 // Organizes all assets into "packages", which are arbitrary
 // folders, and "directories", folders inside those packages
 // This could allow directly loading files from .zip packages 
 // in the future, but for now it uses the normal filesystem
+//
+// Assets can be loaded synchronously (get) or asynchronously (get_async), in which
+// case decoding happens in a worker thread and GL uploads are ran in update() with
+// a time budget. Loaders must put all their GL calls inside gl_upload, unless
+// their type is registered as not async, in which case they always run on the main thread.
 class AssetManager
 {
 private:
+	using AsyncStartPtr = std::shared_ptr<PendingLoad>(*)(AssetManager*, const std::string&, const std::string&);
+
 	struct AssetTypeData
 	{
 		void* loadPtr;
 		std::string name;
+
+		// Can it be loaded by a worker thread?
+		bool async;
+		// Preloaded if it matches the regex and the package preload list
+		bool preload;
+		std::regex regex;
+		AsyncStartPtr start_async;
 	};
 
 	struct Asset
@@ -47,6 +99,9 @@ private:
 
 		bool preload;
 		bool dont_unload;
+
+		// Non-null while the asset is being loaded
+		std::shared_ptr<PendingLoad> pending;
 	};
 
 
@@ -65,13 +120,71 @@ private:
 	
 	std::unordered_map<std::string, Package> packages;
 
+	// Loads the asset in the current thread, filling its entry
+	template<typename T>
+	bool load(const std::string& package, const std::string& name, const std::shared_ptr<PendingLoad>& pending);
+
+	// Shared by get and get_or_null
+	template<typename T>
+	T* get_internal(const std::string& package, const std::string& name, bool use, bool must_exist);
+
 	template<typename T>
-	bool load(const std::string& package, const std::string& name);
+	void run_async(const std::string& package, const std::string& name, std::shared_ptr<PendingLoad> pending);
 
-	std::string current_package;
+	template<typename T>
+	std::shared_ptr<PendingLoad> start_async(const std::string& package, const std::string& name, bool use);
+
+	// Per thread, as loaders running in workers change it
+	static thread_local std::string current_package;
+	// The asset being loaded by this thread, if any
+	static thread_local PendingLoad* current_load;
+
+	// Protects packages (the asset maps) and the PendingLoad states
+	std::mutex mtx;
+	std::condition_variable load_cv;
+
+	std::thread::id main_thread;
+	std::vector<std::thread> workers;
+	std::mutex jobs_mtx;
+	std::condition_variable jobs_cv;
+	std::deque<std::function<void()>> jobs;
+	bool workers_run;
+	void worker_func();
+	void push_job(std::function<void()>&& job);
+
+	// Loads from non-async asset types requested by workers, ran by the main thread
+	std::mutex main_loads_mtx;
+	std::vector<std::function<void()>> main_loads;
+	void run_main_loads();
+	// Blocks the worker until the main thread has ran the function
+	void run_on_main(const std::function<void()>& f);
+
+	// Async loads which finished decoding, uploaded in update()
+	std::mutex decoded_mtx;
+	std::vector<std::shared_ptr<PendingLoad>> decoded;
+	std::vector<std::shared_ptr<PendingLoad>> uploading;
+
+	double upload_budget;
+
+	// Ran in update() once their load is ready, if it didn't fail
+	std::vector<std::pair<std::shared_ptr<PendingLoad>, std::function<void()>>> when_ready;
+
+	// Main thread. Runs pending uploads (dependencies first) until the deadline
+	// passes, returns true once the load is ready. At least one upload is always ran.
+	bool finish_load(PendingLoad* load, std::chrono::steady_clock::time_point deadline);
+	// Main thread, waits for decoding and uploads everything. Returns false if it failed
+	bool wait_load_locked(const std::shared_ptr<PendingLoad>& load, std::unique_lock<std::mutex>& lock);
+
+	// Starts async loads for all preload assets of all packages and waits for them
+	void preload_assets();
 
 public:
 
+	// Runs f right now if on the main thread (or not loading anything), or queues it
+	// to be ran on the main thread before the asset being loaded is ready
+	// Use for all GL calls in loaders
+	void gl_upload(std::function<void()>&& f);
+
 	static bool file_exists(const std::string& path);
 
 	// Simply loads a string from given path, no packages or anything
@@ -82,8 +195,17 @@ public:
 	// load_string_raw, but package aware
 	std::string load_string(const std::string& full_path, const std::string& def = "");
 
+	// Parses a TOML file, using the baked cache if the file didn't change
+	std::shared_ptr<cpptoml::table> load_toml(const std::string& path);
+
+	// Processed asset data, see BakedCache
+	BakedCache cache;
+
+	// async types must put all their GL calls in gl_upload
+	// preload types are preloaded if the path matches regex and the package preload list
 	template<typename T>
-	void create_asset_type(const std::string& name, LoadAssetPtr<T> loadPtr, bool preload = false, const std::string& regex = "");
+	void create_asset_type(const std::string& name, LoadAssetPtr<T> loadPtr, bool async,
+						bool preload = false, const std::string& regex = "");
 
 	// If you use this manually make sure you free the asset if it's a heavy-weight resource
 	// It crashes if the asset does not exist (or it could not be loaded)
@@ -94,6 +216,23 @@ public:
 	template<typename T>
 	T* get_or_null(const std::string& package, const std::string name, bool use = true);
 
+	// Starts loading the asset in a worker thread, and returns immediately
+	// Main thread only. Uploads happen in update()
+	template<typename T>
+	AssetFuture<T> get_async(const std::string& package, const std::string& name);
+
+	// Main thread only. Finishes async loads with the upload time budget
+	void update();
+
+	bool is_main_thread() const { return std::this_thread::get_id() == main_thread; }
+
+	// Used by AssetFuture, main thread only
+	bool is_load_ready(const std::shared_ptr<PendingLoad>& load);
+	// Returns false if the load failed
+	bool wait_load(const std::shared_ptr<PendingLoad>& load);
+	// Runs f in update() once the load is ready, or never if it fails
+	void call_when_ready(std::shared_ptr<PendingLoad> load, std::function<void()>&& f);
+
 	// Frees a single use from an asset
 	template<typename T>
 	void free(const std::string& package, const std::string& name);
@@ -141,17 +280,28 @@ public:
 	std::string res_path;
 	std::string udata_path;
 
-	AssetManager(const std::string& res_path, const std::string& udata_path);
+	AssetManager(const std::string& res_path, const std::string& udata_path, const cpptoml::table& settings);
 	// We do a check to make sure all assets have been released, to prevent leaks!
 	~AssetManager();
 };
 
 template<typename T>
-// If preload is set to true, all files which match the given regex will be loaded
-inline void AssetManager::create_asset_type(const std::string& name, LoadAssetPtr<T> loadPtr, bool preload, const std::string& regex)
+// If preload is set to true, all files which match the given regex (and the package preload list) will be loaded
+inline void AssetManager::create_asset_type(const std::string& name, LoadAssetPtr<T> loadPtr, bool async,
+											bool preload, const std::string& regex)
 {
 	AssetTypeData tdata;
 	tdata.name = name;
+	tdata.async = async;
+	tdata.preload = preload && !regex.empty();
+	if(tdata.preload)
+	{
+		tdata.regex = std::regex(regex);
+	}
+	tdata.start_async = [](AssetManager* mng, const std::string& pkg, const std::string& nm)
+	{
+		return mng->start_async<T>(pkg, nm, false);
+	};
 
 	tdata.loadPtr = reinterpret_cast<void*>(loadPtr);
 
@@ -162,8 +312,10 @@ inline void AssetManager::create_asset_type(const std::string& name, LoadAssetPt
 }
 
 template<typename T>
-inline T* AssetManager::get(const std::string& package, const std::string& name, bool use)
+inline T* AssetManager::get_internal(const std::string& package, const std::string& name, bool use, bool must_exist)
 {
+	std::unique_lock<std::mutex> lock(mtx);
+
 	auto pkg = packages.find(package);
 	logger->check(pkg != packages.end(), "Invalid package ({}) given", package);
 
@@ -172,13 +324,87 @@ inline T* AssetManager::get(const std::string& package, const std::string& name,
 	auto it = assets->find(typeid(T));
 	logger->check(it != assets->end(), "Invalid type given");
 
+	std::shared_ptr<PendingLoad> pending;
 	auto item = it->second.second.find(name);
 
 	if (item == it->second.second.end())
 	{
-		bool result = load<T>(package, name);
-		logger->check(result, "Could not load asset ({}:{})", package, name);
+		Asset asset;
+		asset.uses = 0;
+		asset.data = nullptr;
+		asset.preload = false;
+		asset.dont_unload = false;
+		asset.pending = std::make_shared<PendingLoad>(PendingLoad::QUEUED);
+		item = it->second.second.emplace(name, std::move(asset)).first;
+	}
+
+	pending = item->second.pending;
+
+	if(pending)
+	{
+		int expected = PendingLoad::QUEUED;
+		if(pending->state.compare_exchange_strong(expected, PendingLoad::DECODING))
+		{
+			// Nobody is loading it yet (or it's queued for a worker), so we do it ourselves
+			lock.unlock();
+			if(is_main_thread())
+			{
+				load<T>(package, name, pending);
+			}
+			else if(it->second.first.async)
+			{
+				// Our gl_uploads were queued in pending, the main thread must run them
+				// even if nobody there is waiting for the asset
+				if(load<T>(package, name, pending))
+				{
+					std::lock_guard<std::mutex> dlock(decoded_mtx);
+					decoded.push_back(pending);
+				}
+			}
+			else
+			{
+				run_on_main([this, &package, &name, &pending]()
+				{
+					load<T>(package, name, pending);
+				});
+			}
+			lock.lock();
+		}
+
+		if(is_main_thread())
+		{
+			if(!wait_load_locked(pending, lock))
+			{
+				logger->check(!must_exist, "Could not load asset ({}:{})", package, name);
+				return nullptr;
+			}
+		}
+		else
+		{
+			// Workers only wait for decoding, the main thread uploads us later
+			load_cv.wait(lock, [&pending]()
+			{
+				return pending->state.load() >= PendingLoad::DECODED;
+			});
+
+			if(pending->state.load() == PendingLoad::FAILED)
+			{
+				logger->check(!must_exist, "Could not load asset ({}:{})", package, name);
+				return nullptr;
+			}
+
+			if(current_load && pending->state.load() != PendingLoad::READY)
+			{
+				current_load->deps.push_back(pending);
+			}
+		}
+
+		// Failed loads are removed, and maps don't invalidate references on insert
 		item = it->second.second.find(name);
+		if(pending->state.load() == PendingLoad::READY && item->second.pending == pending)
+		{
+			item->second.pending = nullptr;
+		}
 	}
 
 	if (use)
@@ -188,9 +414,23 @@ inline T* AssetManager::get(const std::string& package, const std::string& name,
 	return (T*)(item->second.data);
 }
 
+template<typename T>
+inline T* AssetManager::get(const std::string& package, const std::string& name, bool use)
+{
+	return get_internal<T>(package, name, use, true);
+}
+
 template<typename T>
 inline T * AssetManager::get_or_null(const std::string & package, const std::string name, bool use)
 {
+	return get_internal<T>(package, name, use, false);
+}
+
+template<typename T>
+inline std::shared_ptr<PendingLoad> AssetManager::start_async(const std::string& package, const std::string& name, bool use)
+{
+	std::unique_lock<std::mutex> lock(mtx);
+
 	auto pkg = packages.find(package);
 	logger->check(pkg != packages.end(), "Invalid package ({}) given", package);
 
@@ -200,27 +440,78 @@ inline T * AssetManager::get_or_null(const std::string & package, const std::str
 	logger->check(it != assets->end(), "Invalid type given");
 
 	auto item = it->second.second.find(name);
-
-	if (item == it->second.second.end())
-	{
-		bool result = load<T>(package, name);
-		if (!result)
+	if(item == it->second.second.end())
+	{
+		Asset asset;
+		asset.uses = 0;
+		asset.data = nullptr;
+		asset.preload = false;
+		asset.dont_unload = false;
+		asset.pending = std::make_shared<PendingLoad>(PendingLoad::QUEUED);
+		item = it->second.second.emplace(name, std::move(asset)).first;
+
+		std::shared_ptr<PendingLoad> pending = item->second.pending;
+		if(it->second.first.async)
 		{
-			return nullptr;
+			push_job([this, package, name, pending]()
+			{
+				run_async<T>(package, name, pending);
+			});
+		}
+		else
+		{
+			std::lock_guard<std::mutex> mlock(main_loads_mtx);
+			main_loads.emplace_back([this, package, name, pending]()
+			{
+				run_async<T>(package, name, pending);
+			});
 		}
-		item = it->second.second.find(name);
 	}
 
-	if (use)
+	if(use)
 	{
 		item->second.uses++;
 	}
-	return (T*)(item->second.data);
+
+	if(item->second.pending)
+	{
+		return item->second.pending;
+	}
+	else
+	{
+		return std::make_shared<PendingLoad>(PendingLoad::READY);
+	}
+}
+
+template<typename T>
+inline void AssetManager::run_async(const std::string& package, const std::string& name, std::shared_ptr<PendingLoad> pending)
+{
+	int expected = PendingLoad::QUEUED;
+	if(!pending->state.compare_exchange_strong(expected, PendingLoad::DECODING))
+	{
+		// Somebody needed it and loaded it synchronously
+		return;
+	}
+
+	if(load<T>(package, name, pending))
+	{
+		std::lock_guard<std::mutex> lock(decoded_mtx);
+		decoded.push_back(std::move(pending));
+	}
+}
+
+template<typename T>
+inline AssetFuture<T> AssetManager::get_async(const std::string& package, const std::string& name)
+{
+	logger->check(is_main_thread(), "get_async must be called from the main thread");
+	return AssetFuture<T>(package, name, start_async<T>(package, name, true));
 }
 
 template<typename T>
 inline void AssetManager::free(const std::string& package, const std::string& name)
 {
+	std::unique_lock<std::mutex> lock(mtx);
+
 	auto pkg = packages.find(package);
 	logger->check(pkg != packages.end(), "Invalid package ({}) given", package);
 
@@ -232,12 +523,16 @@ inline void AssetManager::free(const std::string& package, const std::string& na
 	auto item = it->second.second.find(name);
 	item->second.uses--;
 
-	// Check for de-allocation
-	if (item->second.uses <= 0 && !item->second.dont_unload)
+	// Check for de-allocation. Assets still loading are kept, as they are in use by the loading thread
+	bool loading = item->second.pending && item->second.pending->state.load() != PendingLoad::READY;
+	if (item->second.uses <= 0 && !item->second.dont_unload && !loading)
 	{
 		logger->debug("Unloaded unused asset '{}:{}'", package, name);
-		delete (T*)item->second.data;
+		T* data = (T*)item->second.data;
 		it->second.second.erase(item);
+		// The asset may free other assets on destruction
+		lock.unlock();
+		delete data;
 	}
 }
 
@@ -250,15 +545,13 @@ inline T* AssetManager::get_from_path(const std::string& full_path, const std::s
 
 
 template<typename T>
-inline bool AssetManager::load(const std::string& package, const std::string& name)
+inline bool AssetManager::load(const std::string& package, const std::string& name, const std::shared_ptr<PendingLoad>& pending)
 {
+	std::unique_lock<std::mutex> lock(mtx);
 	auto pkg = packages.find(package);
-	logger->check(pkg != packages.end(), "Invalid package ({}) given", package);
-
 	auto assets = &pkg->second.assets;
-
 	auto it = assets->find(typeid(T));
-	logger->check(it != assets->end(), "Invalid type given");
+	lock.unlock();
 
 	LoadAssetPtr<T> fptr = (LoadAssetPtr<T>)(it->second.first.loadPtr);
 
@@ -278,12 +571,12 @@ inline bool AssetManager::load(const std::string& package, const std::string& na
 	if (file_exists(full_folder + "folder.toml"))
 	{
 
-		folder_config = SerializeUtil::load_file(full_folder + "folder.toml");
+		folder_config = load_toml(full_folder + "folder.toml");
 	}
 
 	if (file_exists(full_path + ".toml"))
 	{
-		asset_config = SerializeUtil::load_file(full_path + ".toml");
+		asset_config = load_toml(full_path + ".toml");
 	}
 
 	// cfg prioritizes asset_config
@@ -303,25 +596,31 @@ inline bool AssetManager::load(const std::string& package, const std::string& na
 	
 
 	std::string old_pkg = get_current_package();
+	PendingLoad* old_load = current_load;
 	
 	logger->check(file_exists(full_path), "Asset file must exist ({})", full_path);
 
 	set_current_package(package);
+	current_load = pending.get();
 	T* ndata = fptr(full_path, name, package, *cfg);
+	current_load = old_load;
 	set_current_package(old_pkg);
 
+	lock.lock();
+	auto item = it->second.second.find(name);
+
 	if (ndata == nullptr)
 	{
+		pending->state = PendingLoad::FAILED;
+		it->second.second.erase(item);
+		load_cv.notify_all();
 		return false;
 	}
 
-	Asset asset;
-	asset.uses = 0;
-	asset.data = ndata;
-
-	asset.dont_unload = cfg->get_qualified_as<bool>("dont_unload").value_or(false);
-	
-	it->second.second[name] = asset;
+	item->second.data = ndata;
+	item->second.dont_unload = cfg->get_qualified_as<bool>("dont_unload").value_or(false);
+	pending->state = PendingLoad::DECODED;
+	load_cv.notify_all();
 	 
 	logger->debug("Loaded asset '{}:{}'", package, name);
 
@@ -411,6 +710,15 @@ public:
 	{
 	}
 
+	// Takes a use which was already obtained (used by AssetFuture)
+	struct Adopt {};
+	AssetHandle(Adopt, const std::string& pkg, const std::string& name, T* data)
+	{
+		this->pkg = pkg;
+		this->name = name;
+		this->data = data;
+	}
+
 	AssetHandle()
 	{
 		pkg = "null";
@@ -483,6 +791,79 @@ public:
 
 };
 
+// Returned by AssetManager::get_async, holds an use of the asset from the moment
+// it's requested. Main thread only.
+template<typename T>
+class AssetFuture
+{
+private:
+
+	std::string pkg, name;
+	std::shared_ptr<PendingLoad> load;
+
+public:
+
+	// Decoding and uploading is done
+	bool is_ready() const
+	{
+		return load == nullptr || osp->assets->is_load_ready(load);
+	}
+
+	// Blocks until ready, uploading everything remaining right away
+	// The future is empty afterwards. Returns a null handle if loading failed.
+	AssetHandle<T> get()
+	{
+		logger->check(load != nullptr, "Tried to get an empty asset future");
+		bool ok = osp->assets->wait_load(load);
+		load = nullptr;
+		if(!ok)
+		{
+			return AssetHandle<T>();
+		}
+		// The use we obtained on request is passed to the handle
+		T* data = osp->assets->get_or_null<T>(pkg, name, false);
+		if(data == nullptr)
+		{
+			return AssetHandle<T>();
+		}
+
+		return AssetHandle<T>(typename AssetHandle<T>::Adopt(), pkg, name, data);
+	}
+
+	AssetFuture(const std::string& pkg, const std::string& name, std::shared_ptr<PendingLoad> load)
+		: pkg(pkg), name(name), load(std::move(load))
+	{
+	}
+
+	AssetFuture() = default;
+	AssetFuture(AssetFuture&& b) = default;
+	AssetFuture& operator=(AssetFuture&& b) = default;
+
+	// If not taken, we must release our use. If it's still loading, that happens
+	// in AssetManager::update once it's done, so this never blocks
+	~AssetFuture()
+	{
+		if(load == nullptr)
+		{
+			return;
+		}
+
+		if(is_ready())
+		{
+			get();
+		}
+		else
+		{
+			std::string f_pkg = pkg;
+			std::string f_name = name;
+			osp->assets->call_when_ready(std::move(load), [f_pkg, f_name]()
+			{
+				osp->assets->free<T>(f_pkg, f_name);
+			});
+		}
+	}
+};
+
 namespace std
 {
 	template<typename T>
@@ -2,6 +2,8 @@
 #include <miniaudio/miniaudio.h>
 #include <OSP.h>
 #include <audio/AudioEngine.h>
+#include <audio/AudioMix.h>
+#include <audio/AudioStream.h>
 
 AudioClip* load_audio_clip(ASSET_INFO, const cpptoml::table &cfg)
 {
@@ -14,6 +16,19 @@ AudioClip* load_audio_clip(ASSET_INFO, const cpptoml::table &cfg)
 		return nullptr;
 	}
 
+	// Long clips are streamed instead of being decoded into memory
+	double threshold = cfg.get_qualified_as<double>("audio.stream_threshold").value_or(10.0);
+	ma_uint64 length = ma_decoder_get_length_in_pcm_frames(&decoder);
+	double seconds = decoder.outputSampleRate == 0 ? 0.0 : (double)length / (double)decoder.outputSampleRate;
+	bool stream = cfg.get_qualified_as<bool>("audio.stream").value_or(seconds > threshold);
+	if(stream)
+	{
+		size_t channels = std::min(decoder.outputChannels, (ma_uint32)2);
+		auto frames = (size_t)(seconds * (double)osp->audio_engine->get_sample_rate());
+		ma_decoder_uninit(&decoder);
+		return new AudioClip(ASSET_INFO_P, frames, channels);
+	}
+
 	// We load the frames in arbitrary chunks
 	constexpr size_t CHUNK_SIZE = 100000;
 
@@ -75,6 +90,31 @@ AudioClip::AudioClip(ASSET_INFO, void *samples, size_t frame_count, size_t chann
 	this->samples = samples;
 	this->frame_count = frame_count;
 	this->channel_count = channel_count;
+	this->streamed = false;
+}
+
+AudioClip::AudioClip(ASSET_INFO, size_t frame_count, size_t channel_count) : Asset(ASSET_INFO_P)
+{
+	this->samples = nullptr;
+	this->frame_count = frame_count;
+	this->channel_count = channel_count;
+	this->streamed = true;
+}
+
+AudioStream* AudioClip::create_stream() const
+{
+	logger->check(streamed, "Tried to create a stream from a non-streamed clip");
+	return new AudioStream(get_asset_resolved_path(), (uint32_t)osp->audio_engine->get_sample_rate());
+}
+
+size_t AudioClip::get_memory_usage() const
+{
+	if(streamed)
+	{
+		return 0;
+	}
+
+	return frame_count * channel_count * sizeof(float);
 }
 
 AudioClip::~AudioClip()
@@ -89,24 +129,42 @@ int32_t AudioClip::mix_samples(float* target, uint32_t count, uint32_t cur_frame
 	// May contain one or two samples per frame
 	float* fsamples = (float*)get_samples();
 
+	// Streamed clips are played by an AudioStream, and pitch is handled by the shared
+	// resampler, which always calls us with matching sample rates
+	if(streamed)
+	{
+		AudioMix::zero(target, count);
+		return -1;
+	}
+
 	if(sample_rate == target_sample_rate)
 	{
-		// Simple, we must add the two arrays
+		// We copy in contiguous runs until the end of the clip, so the
+		// channel count is only checked once per run and not once per frame
+		uint32_t end = (uint32_t)(frame_count / 2);
+		if(end == 0 || cur_frame >= end)
+		{
+			AudioMix::zero(target, count);
+			return -1;
+		}
+
 		uint32_t frm_ptr = cur_frame;
-		for(size_t i = 0; i < count; i++)
+		uint32_t done = 0;
+		while(done < count)
 		{
+			uint32_t run = std::min(count - done, end - frm_ptr);
 			if(channel_count == 1)
 			{
-				target[i * 2 + 0] = fsamples[frm_ptr];
-				target[i * 2 + 1] = fsamples[frm_ptr];
+				AudioMix::copy_mono(target + done * 2, fsamples + frm_ptr, run);
 			}
 			else
 			{
-				target[i * 2 + 0] = fsamples[frm_ptr * 2 + 0];
-				target[i * 2 + 1] = fsamples[frm_ptr * 2 + 1];
+				AudioMix::copy_stereo(target + done * 2, fsamples + frm_ptr * 2, run);
 			}
-			frm_ptr++;
-			if(frm_ptr >= frame_count / 2)
+			done += run;
+			frm_ptr += run;
+
+			if(frm_ptr >= end)
 			{
 				if(loop)
 				{
@@ -115,12 +173,7 @@ int32_t AudioClip::mix_samples(float* target, uint32_t count, uint32_t cur_frame
 				else
 				{
 					// We dont mix nothing more, fill with zeros and early exit
-					for(; i < count; i++)
-					{
-						target[i * 2 + 0] = 0.0f;
-						target[i * 2 + 1] = 0.0f;
-					}
-
+					AudioMix::zero(target + done * 2, count - done);
 					return -1;
 				}
 			}
@@ -128,10 +181,8 @@ int32_t AudioClip::mix_samples(float* target, uint32_t count, uint32_t cur_frame
 
 		return (int32_t)frm_ptr;
 	}
-	else
-	{
-		// TODO: Frequency mixing
-	}
 
-	return false;
+	// Different sample rates are handled by the Resampler in the audio engine
+	AudioMix::zero(target, count);
+	return -1;
 }
@@ -3,8 +3,12 @@
 #include <util/SerializeUtil.h>
 #include <audio/SampleSource.h>
 
+class AudioStream;
+
 // Audio clips. We support only mono and stereo sounds, higher channels are ignored, with a warning.
-// This loads the full audio file into memory and does no streaming
+// Short clips load the full audio file into memory. Long clips (longer than
+// audio.stream_threshold seconds, default 10, or with audio.stream = true in the asset config)
+// are streamed: the clip only holds the path, and every source playing it creates its own AudioStream.
 // Stereo sounds may be played in 3D sources BUT only their first channel (left) will be mixed.
 // All audio types are eventually converted to f32 samples
 class AudioClip : public Asset, public SampleSource
@@ -14,6 +18,7 @@ private:
 	size_t channel_count;
 	void* samples;
 	size_t frame_count;
+	bool streamed;
 
 public:
 
@@ -21,10 +26,18 @@ public:
 	size_t get_frame_count() const { return frame_count; }
 	void* get_samples() const { return samples; }
 
+	bool is_streamed() const { return streamed; }
+	// Only on streamed clips, you take ownership
+	AudioStream* create_stream() const;
+	// Resident memory used by the samples, 0 for streamed clips
+	size_t get_memory_usage() const;
+
 	int32_t mix_samples(float* target, uint32_t count, uint32_t cur_frame, bool loop, uint32_t sample_rate,
 						uint32_t target_sample_rate) override;
 
 	AudioClip(ASSET_INFO, void* samples, size_t frame_count, size_t channel_count);
+	// Creates a streamed clip
+	AudioClip(ASSET_INFO, size_t frame_count, size_t channel_count);
 	~AudioClip();
 };
 
@@ -0,0 +1,626 @@
+#include "BakedCache.h"
+#include <util/Logger.h>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <sstream>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Stored before every payload
+struct BakedHeader
+{
+	char magic[4];
+	uint32_t version;
+	// Sizes and modification times of the sources, checked before the hash
+	uint64_t source_stamp;
+	uint64_t source_hash;
+	uint64_t payload_size;
+};
+
+static constexpr char BAKED_MAGIC[4] = {'O', 'S', 'P', 'B'};
+
+MappedFile::MappedFile(const std::string& path)
+{
+	ptr = nullptr;
+	len = 0;
+
+#ifdef _WIN32
+	file_handle = nullptr;
+	map_handle = nullptr;
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+							  FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+	file_handle = file;
+
+	LARGE_INTEGER fsize;
+	if(!GetFileSizeEx(file, &fsize) || fsize.QuadPart == 0)
+	{
+		return;
+	}
+
+	HANDLE map = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(map == nullptr)
+	{
+		return;
+	}
+	map_handle = map;
+
+	ptr = (const uint8_t*)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+	if(ptr)
+	{
+		len = (size_t)fsize.QuadPart;
+	}
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+	{
+		return;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map != MAP_FAILED)
+		{
+			ptr = (const uint8_t*)map;
+			len = (size_t)st.st_size;
+		}
+	}
+
+	// The mapping stays valid after closing
+	close(fd);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if(ptr)
+	{
+		UnmapViewOfFile(ptr);
+	}
+	if(map_handle)
+	{
+		CloseHandle((HANDLE)map_handle);
+	}
+	if(file_handle)
+	{
+		CloseHandle((HANDLE)file_handle);
+	}
+#else
+	if(ptr)
+	{
+		munmap((void*)ptr, len);
+	}
+#endif
+}
+
+void BakedWriter::write(const void* data, size_t size)
+{
+	size_t start = bytes.size();
+	bytes.resize(start + size);
+	if(size != 0)
+	{
+		memcpy(&bytes[start], data, size);
+	}
+}
+
+void BakedWriter::write_string(const std::string& str)
+{
+	write_u32((uint32_t)str.size());
+	write(str.data(), str.size());
+}
+
+size_t BakedWriter::begin_block()
+{
+	size_t start = bytes.size();
+	write_u64(0);
+	return start;
+}
+
+void BakedWriter::end_block(size_t start)
+{
+	uint64_t size = bytes.size() - start - sizeof(uint64_t);
+	memcpy(&bytes[start], &size, sizeof(uint64_t));
+}
+
+void BakedWriter::align(size_t alignment)
+{
+	while(bytes.size() % alignment != 0)
+	{
+		bytes.push_back(0);
+	}
+}
+
+const uint8_t* BakedReader::read(size_t bytes)
+{
+	if(failed || pos + bytes > size)
+	{
+		failed = true;
+		return nullptr;
+	}
+
+	const uint8_t* out = data + pos;
+	pos += bytes;
+	return out;
+}
+
+uint32_t BakedReader::read_u32()
+{
+	uint32_t out = 0;
+	const uint8_t* ptr = read(sizeof(uint32_t));
+	if(ptr)
+	{
+		memcpy(&out, ptr, sizeof(uint32_t));
+	}
+	return out;
+}
+
+uint64_t BakedReader::read_u64()
+{
+	uint64_t out = 0;
+	const uint8_t* ptr = read(sizeof(uint64_t));
+	if(ptr)
+	{
+		memcpy(&out, ptr, sizeof(uint64_t));
+	}
+	return out;
+}
+
+std::string BakedReader::read_string()
+{
+	uint32_t len = read_u32();
+	const uint8_t* ptr = read(len);
+	if(!ptr)
+	{
+		return "";
+	}
+	return std::string((const char*)ptr, len);
+}
+
+BakedReader BakedReader::read_block()
+{
+	uint64_t len = read_u64();
+	if(failed || len > size - pos)
+	{
+		failed = true;
+		BakedReader out(nullptr, 0);
+		out.failed = true;
+		return out;
+	}
+
+	return BakedReader(read((size_t)len), (size_t)len);
+}
+
+void BakedReader::align(size_t alignment)
+{
+	size_t padded = (pos + alignment - 1) / alignment * alignment;
+	read(padded - pos);
+}
+
+uint64_t BakedCache::hash(const void* data, size_t size, uint64_t seed)
+{
+	auto* bytes = (const uint8_t*)data;
+	uint64_t h = seed;
+	for(size_t i = 0; i < size; i++)
+	{
+		h ^= bytes[i];
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+uint64_t BakedCache::hash_string(const std::string& str, uint64_t seed)
+{
+	return hash(str.data(), str.size(), seed);
+}
+
+uint64_t BakedCache::hash_file(const std::string& path, uint64_t seed)
+{
+	MappedFile file(path);
+	if(!file.is_valid())
+	{
+		return 0;
+	}
+
+	return hash(file.data(), file.size(), seed);
+}
+
+std::string BakedCache::get_entry_path(const std::string& asset_id, const std::string& kind) const
+{
+	std::string name = asset_id;
+	// core:images/a.png -> core/images/a.png
+	std::replace(name.begin(), name.end(), ':', '/');
+	return cache_path + name + "." + kind;
+}
+
+BakedEntry BakedCache::open_entry(const std::string& asset_id, const std::string& kind,
+								 uint64_t& source_stamp, uint64_t& source_hash) const
+{
+	BakedEntry out;
+	out.payload = nullptr;
+	out.payload_size = 0;
+
+	if(!enabled)
+	{
+		return out;
+	}
+
+	auto file = std::make_unique<MappedFile>(get_entry_path(asset_id, kind));
+	if(!file->is_valid() || file->size() < sizeof(BakedHeader))
+	{
+		return out;
+	}
+
+	BakedHeader header;
+	memcpy(&header, file->data(), sizeof(BakedHeader));
+	if(memcmp(header.magic, BAKED_MAGIC, 4) != 0 || header.version != VERSION ||
+	   header.payload_size != file->size() - sizeof(BakedHeader))
+	{
+		logger->debug("Baked {} for '{}' is stale", kind, asset_id);
+		return out;
+	}
+
+	source_stamp = header.source_stamp;
+	source_hash = header.source_hash;
+	out.payload = file->data() + sizeof(BakedHeader);
+	out.payload_size = (size_t)header.payload_size;
+	out.file = std::move(file);
+	return out;
+}
+
+BakedEntry BakedCache::read(const std::string& asset_id, const std::string& kind, uint64_t source_hash) const
+{
+	uint64_t entry_stamp, entry_hash;
+	BakedEntry entry = open_entry(asset_id, kind, entry_stamp, entry_hash);
+	if(entry.payload && entry_hash != source_hash)
+	{
+		logger->debug("Baked {} for '{}' is stale", kind, asset_id);
+		return BakedEntry{nullptr, nullptr, 0};
+	}
+
+	return entry;
+}
+
+BakedEntry BakedCache::read(const std::string& asset_id, const std::string& kind, const BakedSource& source) const
+{
+	uint64_t entry_stamp, entry_hash;
+	BakedEntry entry = open_entry(asset_id, kind, entry_stamp, entry_hash);
+	if(!entry.payload)
+	{
+		return entry;
+	}
+
+	uint64_t stamp = source.get_stamp();
+	if(stamp != 0 && stamp == entry_stamp)
+	{
+		return entry;
+	}
+
+	// Touched (or copied around), but it may still have the same contents
+	uint64_t hash = source.get_hash();
+	if(hash != 0 && hash == entry_hash)
+	{
+		// Best effort, if it fails we just hash again next time
+		std::fstream file(get_entry_path(asset_id, kind), std::ios::binary | std::ios::in | std::ios::out);
+		if(file)
+		{
+			file.seekp(offsetof(BakedHeader, source_stamp));
+			file.write((const char*)&stamp, sizeof(uint64_t));
+		}
+		return entry;
+	}
+
+	logger->debug("Baked {} for '{}' is stale", kind, asset_id);
+	return BakedEntry{nullptr, nullptr, 0};
+}
+
+void BakedCache::write(const std::string& asset_id, const std::string& kind, uint64_t source_hash,
+					   const BakedWriter& payload) const
+{
+	write_entry(asset_id, kind, source_hash, source_hash, payload);
+}
+
+void BakedCache::write(const std::string& asset_id, const std::string& kind, const BakedSource& source,
+					   const BakedWriter& payload) const
+{
+	if(!enabled)
+	{
+		return;
+	}
+
+	write_entry(asset_id, kind, source.get_stamp(), source.get_hash(), payload);
+}
+
+void BakedCache::write_entry(const std::string& asset_id, const std::string& kind, uint64_t source_stamp,
+							 uint64_t source_hash, const BakedWriter& payload) const
+{
+	if(!enabled)
+	{
+		return;
+	}
+
+	std::string path = get_entry_path(asset_id, kind);
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+	// Written to a temporary file and renamed, so a crash never leaves a half written entry
+	std::stringstream tmp_path;
+	tmp_path << path << ".tmp" << std::this_thread::get_id();
+
+	{
+		std::ofstream file(tmp_path.str(), std::ios::binary | std::ios::trunc);
+		if(!file)
+		{
+			logger->warn("Could not write baked {} for '{}'", kind, asset_id);
+			return;
+		}
+
+		BakedHeader header;
+		memcpy(header.magic, BAKED_MAGIC, 4);
+		header.version = VERSION;
+		header.source_stamp = source_stamp;
+		header.source_hash = source_hash;
+		header.payload_size = payload.bytes.size();
+		file.write((const char*)&header, sizeof(BakedHeader));
+		file.write((const char*)payload.bytes.data(), (std::streamsize)payload.bytes.size());
+	}
+
+	std::filesystem::rename(tmp_path.str(), path, ec);
+	if(ec)
+	{
+		std::filesystem::remove(tmp_path.str(), ec);
+	}
+}
+
+uint64_t BakedSource::get_stamp() const
+{
+	uint64_t h = BakedCache::hash(&seed, sizeof(uint64_t));
+	for(const std::string& path : paths)
+	{
+		std::error_code ec;
+		uint64_t size = (uint64_t)std::filesystem::file_size(path, ec);
+		if(ec)
+		{
+			return 0;
+		}
+		int64_t mtime = (int64_t)std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+		if(ec)
+		{
+			return 0;
+		}
+
+		h = BakedCache::hash(&size, sizeof(uint64_t), h);
+		h = BakedCache::hash(&mtime, sizeof(int64_t), h);
+	}
+	return h;
+}
+
+uint64_t BakedSource::get_hash() const
+{
+	uint64_t h = seed;
+	for(const std::string& path : paths)
+	{
+		h = BakedCache::hash_file(path, h);
+		if(h == 0)
+		{
+			return 0;
+		}
+	}
+	return h;
+}
+
+BakedSource::BakedSource()
+{
+	seed = 14695981039346656037ull;
+}
+
+BakedSource::BakedSource(const std::string& path, uint64_t seed) : seed(seed)
+{
+	paths.push_back(path);
+}
+
+// Node tags for baked TOML
+enum BakedTomlTag : uint32_t
+{
+	TOML_TABLE,
+	TOML_ARRAY,
+	TOML_TABLE_ARRAY,
+	TOML_STRING,
+	TOML_INT,
+	TOML_DOUBLE,
+	TOML_BOOL
+};
+
+static bool write_toml_node(BakedWriter& w, const std::shared_ptr<cpptoml::base>& node)
+{
+	if(node->is_table())
+	{
+		w.write_u32(TOML_TABLE);
+		return BakedCache::write_toml(w, *node->as_table());
+	}
+	else if(node->is_table_array())
+	{
+		const auto& tables = node->as_table_array()->get();
+		w.write_u32(TOML_TABLE_ARRAY);
+		w.write_u32((uint32_t)tables.size());
+		for(const auto& table : tables)
+		{
+			if(!BakedCache::write_toml(w, *table))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	else if(node->is_array())
+	{
+		const auto& values = node->as_array()->get();
+		w.write_u32(TOML_ARRAY);
+		w.write_u32((uint32_t)values.size());
+		for(const auto& value : values)
+		{
+			if(!write_toml_node(w, value))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	else if(auto str = node->as<std::string>())
+	{
+		w.write_u32(TOML_STRING);
+		w.write_string(str->get());
+		return true;
+	}
+	else if(auto i = node->as<int64_t>())
+	{
+		w.write_u32(TOML_INT);
+		w.write_u64((uint64_t)i->get());
+		return true;
+	}
+	else if(auto d = node->as<double>())
+	{
+		w.write_u32(TOML_DOUBLE);
+		double v = d->get();
+		w.write(&v, sizeof(double));
+		return true;
+	}
+	else if(auto b = node->as<bool>())
+	{
+		w.write_u32(TOML_BOOL);
+		w.write_u32(b->get() ? 1 : 0);
+		return true;
+	}
+
+	// Dates and times are not supported
+	return false;
+}
+
+static std::shared_ptr<cpptoml::base> read_toml_node(BakedReader& r)
+{
+	uint32_t tag = r.read_u32();
+	if(tag == TOML_TABLE)
+	{
+		return BakedCache::read_toml(r);
+	}
+	else if(tag == TOML_TABLE_ARRAY)
+	{
+		auto out = cpptoml::make_table_array();
+		uint32_t count = r.read_u32();
+		for(uint32_t i = 0; i < count && !r.failed; i++)
+		{
+			auto table = BakedCache::read_toml(r);
+			if(table)
+			{
+				out->push_back(table);
+			}
+		}
+		return out;
+	}
+	else if(tag == TOML_ARRAY)
+	{
+		auto out = cpptoml::make_array();
+		uint32_t count = r.read_u32();
+		for(uint32_t i = 0; i < count && !r.failed; i++)
+		{
+			auto value = read_toml_node(r);
+			if(value)
+			{
+				out->get().push_back(value);
+			}
+		}
+		return out;
+	}
+	else if(tag == TOML_STRING)
+	{
+		return cpptoml::make_value<std::string>(r.read_string());
+	}
+	else if(tag == TOML_INT)
+	{
+		return cpptoml::make_value<int64_t>((int64_t)r.read_u64());
+	}
+	else if(tag == TOML_DOUBLE)
+	{
+		double v = 0.0;
+		const uint8_t* ptr = r.read(sizeof(double));
+		if(ptr)
+		{
+			memcpy(&v, ptr, sizeof(double));
+		}
+		return cpptoml::make_value<double>(std::move(v));
+	}
+	else if(tag == TOML_BOOL)
+	{
+		return cpptoml::make_value<bool>(r.read_u32() != 0);
+	}
+
+	r.failed = true;
+	return nullptr;
+}
+
+bool BakedCache::write_toml(BakedWriter& w, const cpptoml::table& table)
+{
+	uint32_t count = 0;
+	for(auto it = table.begin(); it != table.end(); it++)
+	{
+		count++;
+	}
+
+	w.write_u32(count);
+	for(const auto& pair : table)
+	{
+		w.write_string(pair.first);
+		if(!write_toml_node(w, pair.second))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::shared_ptr<cpptoml::table> BakedCache::read_toml(BakedReader& r)
+{
+	auto out = cpptoml::make_table();
+	uint32_t count = r.read_u32();
+	for(uint32_t i = 0; i < count && !r.failed; i++)
+	{
+		std::string key = r.read_string();
+		auto value = read_toml_node(r);
+		if(value)
+		{
+			out->insert(key, value);
+		}
+	}
+
+	if(r.failed)
+	{
+		return nullptr;
+	}
+
+	return out;
+}
+
+BakedCache::BakedCache(const std::string& cache_path, bool enabled)
+{
+	this->cache_path = cache_path;
+	this->enabled = enabled;
+}
@@ -0,0 +1,180 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <cpptoml.h>
+
+// A read-only memory mapped file, the OS pages it in as it's read, so data can be
+// uploaded straight from it without copies
+class MappedFile
+{
+private:
+
+	const uint8_t* ptr;
+	size_t len;
+
+#ifdef _WIN32
+	void* file_handle;
+	void* map_handle;
+#endif
+
+public:
+
+	const uint8_t* data() const { return ptr; }
+	size_t size() const { return len; }
+	bool is_valid() const { return ptr != nullptr; }
+
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+};
+
+// An entry read from the cache, the payload is directly in the mapped file
+struct BakedEntry
+{
+	std::unique_ptr<MappedFile> file;
+	const uint8_t* payload;
+	size_t payload_size;
+};
+
+// Incrementally builds the payload of a cache entry
+// All values are written in native endianness, as the cache is never shared between machines
+class BakedWriter
+{
+public:
+
+	std::vector<uint8_t> bytes;
+
+	void write(const void* data, size_t size);
+	void write_u32(uint32_t v) { write(&v, sizeof(uint32_t)); }
+	void write_u64(uint64_t v) { write(&v, sizeof(uint64_t)); }
+	void write_f64(double v) { write(&v, sizeof(double)); }
+	// Plain data (numbers, glm vectors and quaternions...)
+	template<typename T>
+	void write_pod(const T& v)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "write_pod needs trivially copyable types");
+		write(&v, sizeof(T));
+	}
+	void write_string(const std::string& str);
+	// Length prefixed blocks, so readers can isolate (or skip) them. Returns the
+	// position to pass to end_block once the contents are written
+	size_t begin_block();
+	void end_block(size_t start);
+	// Pads to the given alignment, so data can be used in-place from the mapped file
+	void align(size_t alignment);
+};
+
+// Reads a payload written by BakedWriter. Reads out of bounds set failed and return zeroes
+class BakedReader
+{
+private:
+
+	const uint8_t* data;
+	size_t size;
+	size_t pos;
+
+public:
+
+	bool failed;
+
+	// Returns a pointer into the payload, or nullptr if out of bounds
+	const uint8_t* read(size_t bytes);
+	uint32_t read_u32();
+	uint64_t read_u64();
+	double read_f64() { return read_pod<double>(); }
+	template<typename T>
+	T read_pod()
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "read_pod needs trivially copyable types");
+		T out;
+		memset(&out, 0, sizeof(T));
+		const uint8_t* ptr = read(sizeof(T));
+		if(ptr)
+		{
+			memcpy(&out, ptr, sizeof(T));
+		}
+		return out;
+	}
+	std::string read_string();
+	// Reads a block written with begin_block / end_block, the returned reader is failed
+	// (and so is this one) if it's out of bounds
+	BakedReader read_block();
+	void align(size_t alignment);
+
+	bool at_end() const { return pos == size; }
+	size_t remaining() const { return size - pos; }
+
+	BakedReader(const uint8_t* data, size_t size) : data(data), size(size), pos(0), failed(false) {}
+};
+
+// The files a cache entry is generated from, plus a seed for anything else it
+// depends on (load flags...). Entries are matched by the size and modification
+// time of the files, their contents are only hashed if those changed, so reading
+// an unchanged asset never goes through the whole file twice.
+struct BakedSource
+{
+	std::vector<std::string> paths;
+	uint64_t seed;
+
+	// Hash of the sizes and modification times, 0 if a file is missing
+	uint64_t get_stamp() const;
+	// Hash of the contents, 0 if a file is missing
+	uint64_t get_hash() const;
+
+	BakedSource();
+	explicit BakedSource(const std::string& path, uint64_t seed = 14695981039346656037ull);
+};
+
+// Binary cache of processed asset data (decoded images with mips, interleaved
+// mesh buffers, parsed configs...), stored in udata/cache/. Each entry has a header
+// with the format version and a hash of everything it was generated from, if
+// either doesn't match the entry is ignored and rebuilt by the loader.
+// Thread safe, as long as two threads don't write the same entry.
+class BakedCache
+{
+private:
+
+	std::string cache_path;
+	bool enabled;
+
+	std::string get_entry_path(const std::string& asset_id, const std::string& kind) const;
+	// Maps the entry, and checks everything but its source. Returns an empty entry if invalid
+	BakedEntry open_entry(const std::string& asset_id, const std::string& kind,
+						uint64_t& source_stamp, uint64_t& source_hash) const;
+	void write_entry(const std::string& asset_id, const std::string& kind, uint64_t source_stamp,
+					uint64_t source_hash, const BakedWriter& payload) const;
+
+public:
+
+	// Bump if any baked format changes
+	static constexpr uint32_t VERSION = 2;
+
+	bool is_enabled() const { return enabled; }
+
+	// FNV-1a, can be chained through seed
+	static uint64_t hash(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+	static uint64_t hash_string(const std::string& str, uint64_t seed = 14695981039346656037ull);
+	// Returns 0 if the file could not be read
+	static uint64_t hash_file(const std::string& path, uint64_t seed = 14695981039346656037ull);
+
+	// Returns an empty entry if missing, stale or the cache is disabled
+	BakedEntry read(const std::string& asset_id, const std::string& kind, uint64_t source_hash) const;
+	void write(const std::string& asset_id, const std::string& kind, uint64_t source_hash,
+			const BakedWriter& payload) const;
+	// Same, for entries generated from files
+	BakedEntry read(const std::string& asset_id, const std::string& kind, const BakedSource& source) const;
+	void write(const std::string& asset_id, const std::string& kind, const BakedSource& source,
+			const BakedWriter& payload) const;
+
+	// Parsed TOML files. Returns false if the table has something we can't bake (dates)
+	static bool write_toml(BakedWriter& w, const cpptoml::table& table);
+	static std::shared_ptr<cpptoml::table> read_toml(BakedReader& r);
+
+	BakedCache(const std::string& cache_path, bool enabled);
+};
@@ -5,7 +5,7 @@ Config* load_config(ASSET_INFO, const cpptoml::table& ccfg)
 	logger->info("Loading config from file: '{}'", path);
 
 	Config* cfg = new Config(ASSET_INFO_P);
-	cfg->root = SerializeUtil::load_file(path);
+	cfg->root = osp->assets->load_toml(path);
 
 	return cfg;
 }
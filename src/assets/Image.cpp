@@ -5,6 +5,9 @@
 #include "../util/MathUtil.h"
 #include <nanovg/nanovg.h>
 #include <nanovg/nanovg_gl.h>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
 
 int Image::get_index(int x, int y)
 {
@@ -114,73 +117,163 @@ int Image::get_nvg_image(NVGcontext* vg)
 	return nanovg_image;
 }
 
-Image::Image(ImageConfig config, ASSET_INFO) : Asset(ASSET_INFO_P)
+// sRGB <-> linear for mip generation, so srgb textures don't darken as they shrink
+static float srgb_to_linear(uint8_t v)
 {
-	this->nanovg_image = 0;
-	this->in_vg = nullptr;
-	this->config = config;
+	float f = (float)v / 255.0f;
+	return f <= 0.04045f ? f / 12.92f : powf((f + 0.055f) / 1.055f, 2.4f);
+}
 
-	int c_dump;
+static uint8_t linear_to_srgb(float f)
+{
+	f = f <= 0.0031308f ? f * 12.92f : 1.055f * powf(f, 1.0f / 2.4f) - 0.055f;
+	return (uint8_t)glm::clamp(f * 255.0f + 0.5f, 0.0f, 255.0f);
+}
+
+// Appends the full RGBA8 mip chain (base level included) to out, returns the number of levels
+static uint32_t build_mip_chain(std::vector<uint8_t>& out, const uint8_t* base, int width, int height, bool srgb)
+{
+	float to_linear[256];
+	for(int i = 0; i < 256; i++)
+	{
+		to_linear[i] = srgb ? srgb_to_linear((uint8_t)i) : (float)i / 255.0f;
+	}
 
-	uint8_t* u8data;
+	size_t start = out.size();
+	out.insert(out.end(), base, base + (size_t)width * height * 4);
 
-	if(config.is_font)
+	uint32_t levels = 1;
+	size_t src_offset = start;
+	int w = width, h = height;
+	while(w > 1 || h > 1)
 	{
-		uint8_t* font_u8data = stbi_load(path.c_str(), &width, &height, &c_dump, 1);
-		// We now expand the buffer to full size RGBA, using alpha for blending
-		// TODO:
-		//  This is sub-optimal for memory, and it could be better to simply store
-		//  the texture as a 1-channel texture and modify NanoVG to handle it, but 
-		//  the perfomance hit is tiny
-		u8data = (uint8_t*)malloc(width * height * 4);
-		for(size_t i = 0; i < width * height; i++)
+		int nw = std::max(w / 2, 1);
+		int nh = std::max(h / 2, 1);
+		size_t dst_offset = out.size();
+		out.resize(dst_offset + (size_t)nw * nh * 4);
+		const uint8_t* src = &out[src_offset];
+		uint8_t* dst = &out[dst_offset];
+
+		// 2x2 box filter, edges are clamped for odd sizes
+		for(int y = 0; y < nh; y++)
 		{
-			uint8_t val = font_u8data[i];
-			uint8_t rgb = val == 0 ? 0 : 255;
-			u8data[i * 4 + 0] = rgb;
-			u8data[i * 4 + 1] = rgb;
-			u8data[i * 4 + 2] = rgb;
-			u8data[i * 4 + 3] = val; // < Alpha
+			int y0 = std::min(y * 2, h - 1);
+			int y1 = std::min(y * 2 + 1, h - 1);
+			for(int x = 0; x < nw; x++)
+			{
+				int x0 = std::min(x * 2, w - 1);
+				int x1 = std::min(x * 2 + 1, w - 1);
+				const uint8_t* p[4] = {
+					&src[((size_t)y0 * w + x0) * 4], &src[((size_t)y0 * w + x1) * 4],
+					&src[((size_t)y1 * w + x0) * 4], &src[((size_t)y1 * w + x1) * 4]};
+
+				uint8_t* d = &dst[((size_t)y * nw + x) * 4];
+				for(int c = 0; c < 3; c++)
+				{
+					float sum = to_linear[p[0][c]] + to_linear[p[1][c]] + to_linear[p[2][c]] + to_linear[p[3][c]];
+					d[c] = srgb ? linear_to_srgb(sum * 0.25f) : (uint8_t)(sum * 0.25f * 255.0f + 0.5f);
+				}
+				// Alpha is always linear
+				d[3] = (uint8_t)((p[0][3] + p[1][3] + p[2][3] + p[3][3] + 2) / 4);
+			}
 		}
 
+		src_offset = dst_offset;
+		w = nw;
+		h = nh;
+		levels++;
 	}
-	else
+
+	return levels;
+}
+
+Image::Image(ImageConfig config, ASSET_INFO) : Asset(ASSET_INFO_P)
+{
+	this->id = 0;
+	this->fdata = nullptr;
+	this->nanovg_image = 0;
+	this->in_vg = nullptr;
+	this->config = config;
+
+	// RGBA8 pixels of all levels, and whatever owns them (the mapped cache file,
+	// the generated mip chain or the stb buffer)
+	const uint8_t* pixels = nullptr;
+	uint32_t levels = 1;
+	std::shared_ptr<const void> pixels_owner;
+
+	// Baked images are stored decoded with their full mip chain, so loading them
+	// is just mapping the file and uploading
+	BakedCache& cache = osp->assets->cache;
+	uint32_t flags = (config.is_font ? 1 : 0) | (config.is_srgb ? 2 : 0);
+	BakedSource source(path, BakedCache::hash(&flags, sizeof(uint32_t)));
+	if(cache.is_enabled())
 	{
-		u8data = stbi_load(path.c_str(), &width, &height, &c_dump, 4);
-		fdata = nullptr;
+		auto entry = std::make_shared<BakedEntry>(cache.read(get_asset_id(), "image", source));
+		if(entry->payload)
+		{
+			BakedReader r(entry->payload, entry->payload_size);
+			width = (int)r.read_u32();
+			height = (int)r.read_u32();
+			levels = r.read_u32();
+			size_t size = entry->payload_size - 3 * sizeof(uint32_t);
+			const uint8_t* data = r.read(size);
+			if(!r.failed && width > 0 && height > 0 && levels > 0)
+			{
+				pixels = data;
+				pixels_owner = entry;
+			}
+		}
 	}
 
-	if (config.upload)
+	if(pixels == nullptr)
 	{
-		glGenTextures(1, &id);
-		glBindTexture(GL_TEXTURE_2D, id);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		if(config.filter == ImageConfig::NEAREST)
+		int c_dump;
+		uint8_t* u8data;
+		levels = 1;
+
+		if(config.is_font)
 		{
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			uint8_t* font_u8data = stbi_load(path.c_str(), &width, &height, &c_dump, 1);
+			// We now expand the buffer to full size RGBA, using alpha for blending
+			// TODO:
+			//  This is sub-optimal for memory, and it could be better to simply store
+			//  the texture as a 1-channel texture and modify NanoVG to handle it, but 
+			//  the perfomance hit is tiny
+			u8data = (uint8_t*)malloc(width * height * 4);
+			for(size_t i = 0; i < width * height; i++)
+			{
+				uint8_t val = font_u8data[i];
+				uint8_t rgb = val == 0 ? 0 : 255;
+				u8data[i * 4 + 0] = rgb;
+				u8data[i * 4 + 1] = rgb;
+				u8data[i * 4 + 2] = rgb;
+				u8data[i * 4 + 3] = val; // < Alpha
+			}
+			stbi_image_free(font_u8data);
+			pixels_owner = std::shared_ptr<const void>(u8data, [](const void* p){ free((void*)p); });
 		}
 		else
 		{
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			u8data = stbi_load(path.c_str(), &width, &height, &c_dump, 4);
+			pixels_owner = std::shared_ptr<const void>(u8data, [](const void* p){ stbi_image_free((void*)p); });
 		}
+		pixels = u8data;
 
-		GLenum source_format;
-		source_format = GL_RGBA;
-
-		GLenum target_format = GL_RGBA;
-
-		if(config.is_srgb)
+		if(cache.is_enabled() && u8data != nullptr)
 		{
-			target_format = GL_SRGB_ALPHA;
+			BakedWriter w;
+			w.write_u32((uint32_t)width);
+			w.write_u32((uint32_t)height);
+			w.write_u32(0);
+			levels = build_mip_chain(w.bytes, u8data, width, height, config.is_srgb);
+			memcpy(&w.bytes[2 * sizeof(uint32_t)], &levels, sizeof(uint32_t));
+			cache.write(get_asset_id(), "image", source, w);
+
+			// The chain is uploaded from the writer, the decoded image is no longer needed
+			auto chain = std::make_shared<BakedWriter>(std::move(w));
+			pixels = chain->bytes.data() + 3 * sizeof(uint32_t);
+			pixels_owner = chain;
 		}
-
-		glTexImage2D(GL_TEXTURE_2D, 0, target_format, width, height, 0, source_format, GL_UNSIGNED_BYTE, u8data);
-
-		
-		glGenerateMipmap(GL_TEXTURE_2D);
 	}
 
 	if (config.in_memory)
@@ -189,20 +282,63 @@ Image::Image(ImageConfig config, ASSET_INFO) : Asset(ASSET_INFO_P)
 		fdata = (float*)malloc(width * height * 4 * sizeof(float));
 		for (size_t i = 0; i < width * height; i++)
 		{
-			fdata[i * 4 + 0] = (float)u8data[i * 4 + 0] / 255.0f;
-			fdata[i * 4 + 1] = (float)u8data[i * 4 + 1] / 255.0f;
-			fdata[i * 4 + 2] = (float)u8data[i * 4 + 2] / 255.0f;
-			fdata[i * 4 + 3] = (float)u8data[i * 4 + 3] / 255.0f;
+			fdata[i * 4 + 0] = (float)pixels[i * 4 + 0] / 255.0f;
+			fdata[i * 4 + 1] = (float)pixels[i * 4 + 1] / 255.0f;
+			fdata[i * 4 + 2] = (float)pixels[i * 4 + 2] / 255.0f;
+			fdata[i * 4 + 3] = (float)pixels[i * 4 + 3] / 255.0f;
 		}
 	}
 
-	if(config.is_font)
-	{
-		free(u8data);
-	}
-	else
+	// Headless has no GL context, id stays 0
+	if (config.upload && osp->renderer != nullptr)
 	{
-		stbi_image_free(u8data);
+		// Decoding may have happened in a worker, the GL part runs in the main thread
+		osp->assets->gl_upload([this, pixels, levels, pixels_owner]()
+		{
+			glGenTextures(1, &id);
+			glBindTexture(GL_TEXTURE_2D, id);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			if(this->config.filter == ImageConfig::NEAREST)
+			{
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			}
+			else
+			{
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			}
+
+			GLenum source_format;
+			source_format = GL_RGBA;
+
+			GLenum target_format = GL_RGBA;
+
+			if(this->config.is_srgb)
+			{
+				target_format = GL_SRGB_ALPHA;
+			}
+
+			const uint8_t* level_data = pixels;
+			int w = width, h = height;
+			for(uint32_t level = 0; level < levels; level++)
+			{
+				glTexImage2D(GL_TEXTURE_2D, level, target_format, w, h, 0, source_format, GL_UNSIGNED_BYTE, level_data);
+				level_data += (size_t)w * h * 4;
+				w = std::max(w / 2, 1);
+				h = std::max(h / 2, 1);
+			}
+
+			if(levels == 1)
+			{
+				glGenerateMipmap(GL_TEXTURE_2D);
+			}
+			else
+			{
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+			}
+		});
 	}
 
 }
@@ -233,50 +369,58 @@ Image::~Image()
 Image::Image(const unsigned char* data, int width, int height, int bits, int component, int mag_filter, int min_filter,
 			 int wrapS, int wrapT, bool srgb, ASSET_INFO) : Asset(ASSET_INFO_P)
 {
-	glGenTextures(1, &id);
-	glBindTexture(GL_TEXTURE_2D, id);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
-
-	GLenum target_format = GL_RGBA;
-	if(srgb)
-	{
-		target_format = GL_SRGB_ALPHA;
-	}
+	this->id = 0;
+	this->fdata = nullptr;
+	this->nanovg_image = 0;
+	this->in_vg = nullptr;
+	this->width = width;
+	this->height = height;
 
- 	GLenum format = GL_RGBA;
+	config.in_memory = false;
+	config.upload = true;
+	// The rest doesn't matter
 
- 	if (component == 1)
- 	{
- 		format = GL_RED;
- 	}
- 	else if (component == 2)
- 	{
- 		format = GL_RG;
- 	}
- 	else if (component == 3)
- 	{
- 		format = GL_RGB;
- 	}
+	// data must be kept alive by the owner until uploaded (embedded model images live in the model)
+	osp->assets->gl_upload([this, data, bits, component, mag_filter, min_filter, wrapS, wrapT, srgb]()
+	{
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D, id);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
 
- 	GLenum type = GL_UNSIGNED_BYTE;
+		GLenum target_format = GL_RGBA;
+		if(srgb)
+		{
+			target_format = GL_SRGB_ALPHA;
+		}
 
- 	if (bits == 16)
-	{
-		type = GL_UNSIGNED_SHORT;
-	}
+		GLenum format = GL_RGBA;
 
-	glTexImage2D(GL_TEXTURE_2D, 0, target_format, width, height, 0, format, type, (void*)data);
-	glGenerateMipmap(GL_TEXTURE_2D);
+		if (component == 1)
+		{
+			format = GL_RED;
+		}
+		else if (component == 2)
+		{
+			format = GL_RG;
+		}
+		else if (component == 3)
+		{
+			format = GL_RGB;
+		}
 
-	this->width = width;
-	this->height = height;
+		GLenum type = GL_UNSIGNED_BYTE;
 
-	config.in_memory = false;
-	config.upload = true;
-	// The rest doesn't matter
+		if (bits == 16)
+		{
+			type = GL_UNSIGNED_SHORT;
+		}
+
+		glTexImage2D(GL_TEXTURE_2D, 0, target_format, this->width, this->height, 0, format, type, (void*)data);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	});
 
 }
 
@@ -176,8 +176,17 @@ bool Mesh::is_drawable() const
 }
 
 
-void Mesh::upload()
+uint32_t Mesh::get_vertex_layout() const
 {
+	const auto& cfg = material->cfg;
+	return (cfg.has_pos ? 1 : 0) | (cfg.has_nrm ? 2 : 0) | (cfg.has_uv0 ? 4 : 0) | (cfg.has_uv1 ? 8 : 0) |
+		(cfg.has_tgt ? 16 : 0) | (cfg.has_cl3 ? 32 : 0) | (cfg.has_cl4 ? 64 : 0) | (cfg.flip_uv ? 128 : 0);
+}
+
+bool Mesh::upload(const BakedMeshData* baked, BakedWriter* bake_out)
+{
+	bool used_baked = false;
+
 	if (drawable)
 	{
 		glGenVertexArrays(1, &vao);
@@ -261,68 +270,92 @@ void Mesh::upload()
 		}
 
 		size_t vert_count = in_model->gltf.accessors[prim.attributes["POSITION"]].count;
+		uint32_t layout = get_vertex_layout();
 
 		std::vector<float> tmp_buffer = std::vector<float>();
-		tmp_buffer.resize(stride * vert_count);
+		const float* vertex_data;
 
-		// We manually interleave the data and send it to a single VBO for perfomance reasons,
-		// convert everything to the float type and calculate the bitangents
-		size_t buff_ptr = 0;
-		for(size_t i = 0; i < vert_count; i++)
+		if(baked && baked->layout == layout && baked->stride == stride && baked->vert_count == vert_count)
 		{
-			for(const auto& tuple : order)
+			// Already interleaved, straight from the mapped cache file
+			vertex_data = baked->data;
+			used_baked = true;
+		}
+		else
+		{
+			tmp_buffer.resize(stride * vert_count);
+
+			// We manually interleave the data and send it to a single VBO for perfomance reasons,
+			// convert everything to the float type and calculate the bitangents
+			size_t buff_ptr = 0;
+			for(size_t i = 0; i < vert_count; i++)
 			{
-				tinygltf::Accessor* acc = std::get<1>(tuple);
-				for(size_t j = 0; j < std::get<2>(tuple); j++)
+				for(const auto& tuple : order)
 				{
-					if (acc)
+					tinygltf::Accessor* acc = std::get<1>(tuple);
+					for(size_t j = 0; j < std::get<2>(tuple); j++)
 					{
-						// Obtain data from gltf
-						size_t float_count = 1;
-						if(acc->type != TINYGLTF_TYPE_SCALAR) { float_count = acc->type; }
-
-						float val = 0.0f;
-						if(j < float_count)
+						if (acc)
 						{
-							val = get_subfloat_from_accessor(in_model->gltf, *acc, (i * float_count + j));
+							// Obtain data from gltf
+							size_t float_count = 1;
+							if(acc->type != TINYGLTF_TYPE_SCALAR) { float_count = acc->type; }
+
+							float val = 0.0f;
+							if(j < float_count)
+							{
+								val = get_subfloat_from_accessor(in_model->gltf, *acc, (i * float_count + j));
+							}
+
+							tmp_buffer[buff_ptr] = val;
+
+							if(std::get<0>(tuple) == "TEXCOORD_0" && j == 1 && material->cfg.flip_uv)
+							{
+								tmp_buffer[buff_ptr] = -tmp_buffer[buff_ptr];
+							}
+
+							if(std::get<0>(tuple) == "TANGENT" && j == 3)
+							{
+								// Calculate the bitangent for indices 3, 4, 5 and skip to the end
+								glm::vec3 normal;
+								glm::vec4 tangent;
+
+								for(size_t ti = 0; ti < 4; ti++)
+									tangent[ti] = get_subfloat_from_accessor(in_model->gltf, *acc, (i * float_count + ti));
+								for(size_t tn = 0; tn < 3; tn++)
+									normal[tn] = get_subfloat_from_accessor(in_model->gltf, *nrm_acc, (i * 3 + tn));
+
+								glm::vec3 bitangent = glm::cross(normal, glm::vec3(tangent)) * tangent.w;
+								tmp_buffer[buff_ptr + 0] = bitangent.x;
+								tmp_buffer[buff_ptr + 1] = bitangent.y;
+								tmp_buffer[buff_ptr + 2] = bitangent.z;
+
+								buff_ptr += 3;
+								break;
+							}
 						}
-
-						tmp_buffer[buff_ptr] = val;
-
-						if(std::get<0>(tuple) == "TEXCOORD_0" && j == 1 && material->cfg.flip_uv)
+						else
 						{
-							tmp_buffer[buff_ptr] = -tmp_buffer[buff_ptr];
+							// Default data (zeroes)
+							tmp_buffer[buff_ptr] = 0.0f;
 						}
 
-						if(std::get<0>(tuple) == "TANGENT" && j == 3)
-						{
-							// Calculate the bitangent for indices 3, 4, 5 and skip to the end
-							glm::vec3 normal;
-							glm::vec4 tangent;
-
-							for(size_t ti = 0; ti < 4; ti++)
-								tangent[ti] = get_subfloat_from_accessor(in_model->gltf, *acc, (i * float_count + ti));
-							for(size_t tn = 0; tn < 3; tn++)
-								normal[tn] = get_subfloat_from_accessor(in_model->gltf, *nrm_acc, (i * 3 + tn));
-
-							glm::vec3 bitangent = glm::cross(normal, glm::vec3(tangent)) * tangent.w;
-							tmp_buffer[buff_ptr + 0] = bitangent.x;
-							tmp_buffer[buff_ptr + 1] = bitangent.y;
-							tmp_buffer[buff_ptr + 2] = bitangent.z;
-
-							buff_ptr += 3;
-							break;
-						}
+						buff_ptr++;
 					}
-					else
-					{
-						// Default data (zeroes)
-						tmp_buffer[buff_ptr] = 0.0f;
-					}
-
-					buff_ptr++;
 				}
 			}
+
+			vertex_data = tmp_buffer.data();
+		}
+
+		if(bake_out && !used_baked)
+		{
+			bake_out->write_u32((uint32_t)mesh_idx);
+			bake_out->write_u32((uint32_t)prim_idx);
+			bake_out->write_u32(layout);
+			bake_out->write_u32((uint32_t)stride);
+			bake_out->write_u32((uint32_t)vert_count);
+			bake_out->write(vertex_data, sizeof(float) * stride * vert_count);
 		}
 
 		// Upload the buffer to the GPU
@@ -331,7 +364,7 @@ void Mesh::upload()
 		vbos.push_back(vbo);
 
 		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * stride * vert_count, tmp_buffer.data(), GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(float) * stride * vert_count, vertex_data, GL_STATIC_DRAW);
 
 		// And bind the vertex attributes in the order they appear
 		int idx = 0;
@@ -369,6 +402,8 @@ void Mesh::upload()
 
 		material.get();
 	}
+
+	return used_baked;
 }
 
 void Mesh::unload()
@@ -431,12 +466,72 @@ std::vector<glm::vec3> Mesh::get_verts()
 
 void Model::upload()
 {
+	BakedCache& cache = osp->assets->cache;
+
+	// Baked interleaved vertex buffers, indexed by (mesh_idx, prim_idx)
+	BakedEntry entry = cache.read(get_asset_id(), "mesh", baked_source);
+	std::unordered_map<uint64_t, BakedMeshData> baked;
+	if(entry.payload)
+	{
+		BakedReader r(entry.payload, entry.payload_size);
+		while(!r.at_end() && !r.failed)
+		{
+			uint64_t mesh_idx = r.read_u32();
+			uint64_t prim_idx = r.read_u32();
+			BakedMeshData data;
+			data.layout = r.read_u32();
+			data.stride = r.read_u32();
+			data.vert_count = r.read_u32();
+			data.data = (const float*)r.read(sizeof(float) * data.stride * data.vert_count);
+			if(!r.failed)
+			{
+				baked[(mesh_idx << 32) | prim_idx] = data;
+			}
+		}
+	}
+
+	// Rewritten if any mesh could not use the baked data
+	BakedWriter bake_out;
+	bool all_baked = true;
+	// Meshes which used the baked data, only copied to bake_out if it's rewritten
+	std::vector<uint64_t> used_keys;
+
 	for (auto it = node_by_name.begin(); it != node_by_name.end(); it++)
 	{
 		for (size_t i = 0; i < it->second->meshes.size(); i++)
 		{
-			it->second->meshes[i].upload();
+			Mesh& mesh = it->second->meshes[i];
+			if(!mesh.is_drawable())
+			{
+				continue;
+			}
+
+			uint64_t key = ((uint64_t)mesh.mesh_idx << 32) | (uint64_t)mesh.prim_idx;
+			auto bit = baked.find(key);
+			bool used = mesh.upload(bit == baked.end() ? nullptr : &bit->second,
+						   cache.is_enabled() ? &bake_out : nullptr);
+			all_baked = all_baked && used;
+			if(used)
+			{
+				used_keys.push_back(key);
+			}
+		}
+	}
+
+	if(!all_baked && cache.is_enabled())
+	{
+		// The entry is still mapped, so the baked data we used can be copied back
+		for(uint64_t key : used_keys)
+		{
+			const BakedMeshData& data = baked[key];
+			bake_out.write_u32((uint32_t)(key >> 32));
+			bake_out.write_u32((uint32_t)(key & 0xFFFFFFFF));
+			bake_out.write_u32(data.layout);
+			bake_out.write_u32((uint32_t)data.stride);
+			bake_out.write_u32((uint32_t)data.vert_count);
+			bake_out.write(data.data, sizeof(float) * data.stride * data.vert_count);
 		}
+		cache.write(get_asset_id(), "mesh", baked_source, bake_out);
 	}
 	
 	uploaded = true;
@@ -458,9 +553,19 @@ void Model::get_gpu()
 {
 	gpu_users++;
 
-	if (!uploaded)
+	// Headless has no GL context, the model is only used for its data
+	if (osp->renderer != nullptr)
 	{
-		upload();
+		// Assets loading in a worker (part prototypes...) queue this for the main
+		// thread, so uploaded is only ever touched there. Every user queues its own,
+		// as the asset which queued it first may finish loading after us
+		osp->assets->gl_upload([this]()
+		{
+			if (!uploaded && gpu_users > 0)
+			{
+				upload();
+			}
+		});
 	}
 }
 
@@ -481,6 +586,17 @@ Model::Model(tinygltf::Model&& model, ASSET_INFO) : Asset(ASSET_INFO_P)
 	gpu_users = 0;
 	uploaded = false;
 
+	// The gltf file and its external .bin buffers, embedded ones are in the file
+	std::string folder = path.substr(0, path.find_last_of('/') + 1);
+	baked_source.paths.push_back(path);
+	for(const tinygltf::Buffer& buffer : gltf.buffers)
+	{
+		if(!buffer.uri.empty() && buffer.uri.rfind("data:", 0) != 0)
+		{
+			baked_source.paths.push_back(folder + buffer.uri);
+		}
+	}
+
 	const tinygltf::Scene scene = gltf.scenes[gltf.defaultScene];
 	// Load recursively all the nodes
 	Node* scene_node = new Node();
@@ -724,6 +840,7 @@ void Model::load_mesh(const tinygltf::Model& model, const tinygltf::Primitive &p
 					m->min_bound[i] = model.accessors[it->second].minValues[i];
 					m->max_bound[i] = model.accessors[it->second].maxValues[i];
 				}
+				m->has_bounds = true;
 			}
 		}
 	}
@@ -798,11 +915,33 @@ GPUModelPointer::~GPUModelPointer()
 	}
 }
 
+// Counts and tests a mesh against the frustum, if the frustum is disabled
+// it does nothing
+static bool mesh_visible(const Mesh& mesh, const Frustum& frustum, const glm::dmat4& model)
+{
+	if(!frustum.enabled || !mesh.has_bounds)
+	{
+		return true;
+	}
+
+	bool visible = frustum.test_local_aabb(mesh.min_bound, mesh.max_bound, model);
+	if(frustum.stats)
+	{
+		frustum.stats->meshes_tested++;
+		if(!visible)
+		{
+			frustum.stats->meshes_culled++;
+		}
+	}
+
+	return visible;
+}
+
 void Node::draw_all_meshes(const CameraUniforms& uniforms, GLint did, glm::dmat4 model) const
 {
 	for (const Mesh& mesh : meshes)
 	{
-		if (mesh.is_drawable())
+		if (mesh.is_drawable() && mesh_visible(mesh, uniforms.frustum, model))
 		{
 			mesh.bind_uniforms(uniforms, model, did);
 			mesh.draw_command();
@@ -815,7 +954,7 @@ void Node::draw_all_meshes_shadow(const ShadowCamera& sh_cam, glm::dmat4 model)
 {
 	for(const Mesh& mesh : meshes)
 	{
-		if(mesh.is_drawable())
+		if(mesh.is_drawable() && mesh_visible(mesh, sh_cam.frustum, model))
 		{
 			glm::dmat4 tform = sh_cam.tform * model;
 
@@ -834,7 +973,7 @@ void Node::draw_all_meshes_override(const CameraUniforms& uniforms, const Materi
 {
 	for (const Mesh& mesh : meshes)
 	{
-		if (mesh.is_drawable())
+		if (mesh.is_drawable() && mesh_visible(mesh, uniforms.frustum, model))
 		{
 			const Material* def = mat;
 			if(mat == nullptr)
@@ -937,6 +1076,39 @@ void Node::draw_shadow(const ShadowCamera& sh_cam, glm::dmat4 model, bool ignore
 }
 
 
+bool Node::get_bounds(glm::dmat4 model, glm::dvec3& min, glm::dvec3& max, bool ignore_our_subtform) const
+{
+	glm::dmat4 n_model;
+	if(ignore_our_subtform)
+	{
+		n_model = model;
+	}
+	else
+	{
+		n_model = model * sub_transform;
+	}
+
+	bool any = false;
+	for(const Mesh& mesh : meshes)
+	{
+		if(mesh.is_drawable() && mesh.has_bounds)
+		{
+			glm::dvec3 mmin, mmax;
+			Frustum::transform_aabb(mesh.min_bound, mesh.max_bound, n_model, mmin, mmax);
+			min = glm::min(min, mmin);
+			max = glm::max(max, mmax);
+			any = true;
+		}
+	}
+
+	for(Node* node : children)
+	{
+		any |= node->get_bounds(n_model, min, max, false);
+	}
+
+	return any;
+}
+
 void ModelColliderExtractor::load_collider(btCollisionShape** target, Node* n)
 {
 
@@ -9,9 +9,21 @@
 #include <physics/glm/BulletGlmCompat.h>
 #include <tiny_gltf/tiny_gltf.h>
 #include <unordered_set>
+#include <atomic>
 #include "Asset.h"
 
 class Model;
+class BakedWriter;
+
+// Interleaved vertex data of a mesh, stored in the baked cache. layout identifies the
+// material vertex config it was built for
+struct BakedMeshData
+{
+	uint32_t layout;
+	uint32_t stride;
+	uint32_t vert_count;
+	const float* data;
+};
 
 class Mesh
 {
@@ -29,6 +41,9 @@ private:
 
 	bool drawable;
 
+	// Bitmask of the material vertex config, which determines the interleaved buffer
+	uint32_t get_vertex_layout() const;
+
 public:
 
 	Model* in_model;
@@ -37,6 +52,8 @@ public:
 
 	glm::vec3 min_bound;
 	glm::vec3 max_bound;
+	// False if the mesh has no POSITION bounds, it will never be culled
+	bool has_bounds;
 	
 	std::vector<glm::vec3> get_verts();
 	std::unordered_set<std::string> has_attributes;
@@ -48,7 +65,10 @@ public:
 	// Non-drawable stuff gets the aditional vertex positions loaded
 	bool is_drawable() const;
 
-	void upload();
+	// Uses the baked vertex data if present and matching, otherwise builds it.
+	// The vertex data built is appended to bake_out if not null (baked data which
+	// was used is not, the caller has it). Returns true if the baked data was used
+	bool upload(const BakedMeshData* baked, BakedWriter* bake_out);
 	void unload();
 
 
@@ -64,6 +84,7 @@ public:
 		in_model = rmodel;
 		vao = 0;
 		ebo = 0;
+		has_bounds = false;
 	}
 
 };
@@ -95,6 +116,10 @@ struct Node
 
 	void draw_shadow(const ShadowCamera& sh_cam, glm::dmat4 model, bool ignore_our_subtform = false) const;
 
+	// Grows min and max (absolute coordinates) to include all drawable meshes of us and
+	// our children. Returns true if any mesh had bounds
+	bool get_bounds(glm::dmat4 model, glm::dvec3& min, glm::dvec3& max, bool ignore_our_subtform = false) const;
+
 	// Draws everything using given material, is mat_override is null, the default material override will be
 	// used, if it's non-null, the given one will be used
 	// If mat is null then default materials are used, but the material override is applied
@@ -114,10 +139,14 @@ private:
 	friend class Mesh;
 	friend struct GPUModelPointer;
 
-	int gpu_users;
+	// Increased by workers loading assets which use us, the rest is main thread only
+	std::atomic<int> gpu_users;
 
 	bool uploaded;
 
+	// The gltf file and its buffers, for the baked vertex data
+	BakedSource baked_source;
+
 	Node* root;
 
 
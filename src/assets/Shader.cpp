@@ -152,70 +152,77 @@ Shader::Shader(const std::string& v, const std::string& f, ASSET_INFO) : Asset(A
 	std::string vproc = preprocessor(v);
 	std::string fproc = preprocessor(f);
 
-	int success = true;
-	char infoLog[1024];
+	id = 0;
 
-	const char* vproc_cstr = vproc.c_str();
-	const char* fproc_cstr = fproc.c_str();
+	// Preprocessing (which reads includes) may have happened in a worker, compiling
+	// needs the GL context
+	osp->assets->gl_upload([this, vproc, fproc]()
+	{
+		int success = true;
+		char infoLog[1024];
 
-	GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+		const char* vproc_cstr = vproc.c_str();
+		const char* fproc_cstr = fproc.c_str();
 
-	glShaderSource(vs, 1, &vproc_cstr, nullptr);
-	glCompileShader(vs);
+		GLuint vs = glCreateShader(GL_VERTEX_SHADER);
 
-	glGetShaderiv(vs, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(vs, 1024, nullptr, infoLog);
-		logger->error("Error compiling vertex shader:\n{}", std::string(infoLog));
-	}
+		glShaderSource(vs, 1, &vproc_cstr, nullptr);
+		glCompileShader(vs);
 
-	GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+		glGetShaderiv(vs, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(vs, 1024, nullptr, infoLog);
+			logger->error("Error compiling vertex shader:\n{}", std::string(infoLog));
+		}
 
-	glShaderSource(fs, 1, &fproc_cstr, nullptr);
-	glCompileShader(fs);
+		GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
 
-	glGetShaderiv(fs, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderInfoLog(fs, 1024, nullptr, infoLog);
-		logger->error("Error compiling fragment shader:\n{}", std::string(infoLog));
-	}
+		glShaderSource(fs, 1, &fproc_cstr, nullptr);
+		glCompileShader(fs);
+
+		glGetShaderiv(fs, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(fs, 1024, nullptr, infoLog);
+			logger->error("Error compiling fragment shader:\n{}", std::string(infoLog));
+		}
 
-	id = glCreateProgram();
-	glAttachShader(id, vs);
-	glAttachShader(id, fs);
-	glLinkProgram(id);
+		id = glCreateProgram();
+		glAttachShader(id, vs);
+		glAttachShader(id, fs);
+		glLinkProgram(id);
 
-	glGetProgramiv(id, GL_LINK_STATUS, &success);
-	if (!success)
-	{
-		glGetProgramInfoLog(id, 1024, nullptr, infoLog);
-		logger->error("Error linking shaders:\n{}", std::string(infoLog));
-	}
+		glGetProgramiv(id, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(id, 1024, nullptr, infoLog);
+			logger->error("Error linking shaders:\n{}", std::string(infoLog));
+		}
 
-	glDeleteShader(vs);
-	glDeleteShader(fs);
+		glDeleteShader(vs);
+		glDeleteShader(fs);
 
-	// Cache all uniforms
-	GLint count, length, size;
-	GLenum type;
-	constexpr GLsizei buf_size = 32;
-	GLchar uname[buf_size]; // variable name in GLSL
+		// Cache all uniforms
+		GLint count, length, size;
+		GLenum type;
+		constexpr GLsizei buf_size = 32;
+		GLchar uname[buf_size]; // variable name in GLSL
 
-	glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
 
-	uniform_locations = std::unordered_map<std::string, GLint>();
+		uniform_locations = std::unordered_map<std::string, GLint>();
 
-	for (GLint i = 0; i < count; i++)
-	{
-		glGetActiveUniform(id, (GLuint)i, buf_size, &length, &size, &type, uname);
-		std::string uname_str = uname;
-		GLint location = glGetUniformLocation(id, uname);
-		uniform_locations[uname_str] = location;
-	}
+		for (GLint i = 0; i < count; i++)
+		{
+			glGetActiveUniform(id, (GLuint)i, buf_size, &length, &size, &type, uname);
+			std::string uname_str = uname;
+			GLint location = glGetUniformLocation(id, uname);
+			uniform_locations[uname_str] = location;
+		}
 
-	logger->info("Shader {} has {} uniforms", get_asset_name(), count);
+		logger->info("Shader {} has {} uniforms", get_asset_name(), count);
+	});
 }
 
 
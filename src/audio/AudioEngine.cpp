@@ -4,8 +4,17 @@
 #include <GLFW/glfw3.h>
 #include <glm/gtc/constants.hpp>
 #include "AudioSource.h"
+#include "AudioMix.h"
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <imgui/imgui.h>
 
-AudioEngine::AudioEngine(const cpptoml::table &settings)
+// mix_buffer_size is the sample rate, which is not known yet. This is an upper bound
+// for the resampler scratch buffer, checked after the device is created
+static constexpr size_t MAX_MIX_FRAMES = 192000;
+
+AudioEngine::AudioEngine(const cpptoml::table &settings) : resampler(MAX_MIX_FRAMES)
 {
 
 	if(ma_context_init(nullptr, 0, nullptr, &context) != MA_SUCCESS)
@@ -15,11 +24,21 @@ AudioEngine::AudioEngine(const cpptoml::table &settings)
 
 	hdr_gain = 1.0f;
 	is_inside = false;
+	commands_pushed = 0;
+	commands_done = 0;
+	callback_time = 0.0;
+	callback_duration = 0.0;
+	stream_time = 0.0;
+	listener = AudioListener();
+	listener_buffer.back() = listener;
+	listener_buffer.publish();
 	// Set default values
 	for(size_t i = 0; i < channels.size(); i++)
 	{
 		channels[i].use_hdr = i != 0;
 		channels[i].gain = 1.0f;
+		// Avoids allocations in the audio thread for reasonable source counts
+		channels[i].mix_sources.reserve(256);
 		std::string ch = "audio_engine.channel_";
 		ch += std::to_string(i);
 		channels[i].external_gain = settings.get_qualified_as<double>(ch + "_ext_gain").value_or(1.0f);
@@ -79,11 +98,14 @@ AudioEngine::AudioEngine(const cpptoml::table &settings)
 	this->sample_rate = device.sampleRate;
 
 	// This may be an unnecesarly HUGE buffer. We could reduce it if perfomance is affected
-	mix_buffer_size = sample_rate;
+	mix_buffer_size = (uint32_t)std::min(sample_rate, MAX_MIX_FRAMES);
 
 	mix_buffer = (float*)calloc(mix_buffer_size, sizeof(float) * 2);
 	chmix_buffer = (float*)calloc(mix_buffer_size, sizeof(float) * 2);
 
+	stream_thread_run = true;
+	stream_thread = std::thread(&AudioEngine::stream_thread_func, this);
+
 	// From here on, the thread is running
 	ma_device_start(&device);
 }
@@ -91,25 +113,37 @@ AudioEngine::AudioEngine(const cpptoml::table &settings)
 AudioEngine::~AudioEngine()
 {
 	ma_device_uninit(&device);
+
+	stream_thread_run = false;
+	stream_thread.join();
+	// Sources unregister their streams on destruction, so the thread must be gone
+	retired_sources.clear();
+	for(AudioChannel& ch : channels)
+	{
+		ch.sources.clear();
+	}
+
 	ma_context_uninit(&context);
+	free(mix_buffer);
+	free(chmix_buffer);
 }
 
-std::pair<float, float> AudioEngine::get_panning(glm::dvec3 pos)
+std::pair<float, float> AudioEngine::get_panning(glm::dvec3 pos, const AudioListener& listener) const
 {
 	float left = 1.0f, right = 1.0f;
 	// We project the sound source through up into the plane of the camera, and obtain
 	// the angle. Then we either do simple panning or our custom, better sounding algorithm for headphones
-	glm::dvec3 from_to = pos - listener_pos;
-	double dist_along_normal = glm::dot(from_to, listener_up);
-	glm::dvec3 proy_point = pos - listener_up * dist_along_normal;
-	glm::dvec3 from_to_proy = glm::normalize(proy_point - listener_pos);
+	glm::dvec3 from_to = pos - listener.pos;
+	double dist_along_normal = glm::dot(from_to, listener.up);
+	glm::dvec3 proy_point = pos - listener.up * dist_along_normal;
+	glm::dvec3 from_to_proy = glm::normalize(proy_point - listener.pos);
 	// Right handed coordinate system!
 
 	// We now find the angle between the proyected point and forward
 	// (1 means it's forward, 0.0 means it's 90º right / left, -1.0 means it's behind)
 	// (Left or right is determined by cangle_right)
-	double cangle = glm::dot(listener_fwd, from_to_proy) * glm::half_pi<float>();
-	bool cangle_right = glm::dot(from_to_proy, listener_right) > 0.0;
+	double cangle = glm::dot(listener.fwd, from_to_proy) * glm::half_pi<float>();
+	bool cangle_right = glm::dot(from_to_proy, listener.right) > 0.0;
 
 	if(simple_panning)
 	{
@@ -142,24 +176,197 @@ std::pair<float, float> AudioEngine::get_panning(glm::dvec3 pos)
 
 void AudioEngine::set_listener(glm::dvec3 pos, glm::dvec3 fwd, glm::dvec3 up, glm::dvec3 vel, double sos)
 {
-	mtx.lock();
-	listener_pos = pos;
-	listener_fwd = fwd;
-	listener_up = up;
-	listener_right = glm::cross(listener_fwd, listener_up);
-	listener_vel = vel;
-	speed_of_sound = sos;
-	mtx.unlock();
+	listener.pos = pos;
+	listener.fwd = fwd;
+	listener.up = up;
+	listener.right = glm::cross(fwd, up);
+	listener.vel = vel;
+	listener.speed_of_sound = sos;
+
+	listener_buffer.back() = listener;
+	listener_buffer.publish();
+}
+
+void AudioEngine::push_command(const AudioCommand& cmd)
+{
+	while(!commands.push(cmd))
+	{
+		// The audio thread empties the queue many times per frame, this only
+		// happens if a huge amount of changes are done at once
+		std::this_thread::yield();
+	}
+	commands_pushed++;
+}
+
+void AudioEngine::process_commands()
+{
+	AudioCommand cmd;
+	uint64_t count = 0;
+	while(commands.pop(cmd))
+	{
+		count++;
+		if(cmd.type == AudioCommand::ADD_SOURCE)
+		{
+			channels[cmd.source->in_channel].mix_sources.push_back(cmd.source);
+		}
+		else if(cmd.type == AudioCommand::REMOVE_SOURCE)
+		{
+			auto& vec = channels[cmd.source->in_channel].mix_sources;
+			auto it = std::find(vec.begin(), vec.end(), cmd.source);
+			if(it != vec.end())
+			{
+				// Order doesn't matter
+				*it = vec.back();
+				vec.pop_back();
+			}
+		}
+		else if(cmd.type == AudioCommand::SET_SOURCE_STATE || cmd.type == AudioCommand::SET_SOURCE_PLAYING)
+		{
+			if(cmd.state.sample_source != cmd.source->mix_state.sample_source)
+			{
+				// New clip, start from the beginning
+				cmd.source->cur_sample = 0;
+				cmd.source->resampler_state.reset();
+			}
+
+			// A finished one-shot stays stopped until set_playing is called again
+			bool playing = cmd.source->mix_state.playing;
+			cmd.source->mix_state = cmd.state;
+			if(cmd.type == AudioCommand::SET_SOURCE_STATE)
+			{
+				cmd.source->mix_state.playing = playing;
+			}
+		}
+	}
+
+	if(count != 0)
+	{
+		commands_done.fetch_add(count, std::memory_order_release);
+	}
+}
+
+void AudioEngine::update()
+{
+	uint64_t done = commands_done.load(std::memory_order_acquire);
+
+	for(auto it = retired_sources.begin(); it != retired_sources.end();)
+	{
+		if(it->first <= done)
+		{
+			it = retired_sources.erase(it);
+		}
+		else
+		{
+			it++;
+		}
+	}
+
+	for(AudioChannel& ch : channels)
+	{
+		for(const auto& src : ch.sources)
+		{
+			if(!src->old_clips.empty())
+			{
+				src->release_old_clips(done);
+			}
+		}
+	}
+}
+
+void AudioEngine::stream_thread_func()
+{
+	while(stream_thread_run.load(std::memory_order_relaxed))
+	{
+		auto start = std::chrono::steady_clock::now();
+		size_t decoded = 0;
+		{
+			std::lock_guard<std::mutex> lock(streams_mtx);
+			for(AudioStream* stream : streams)
+			{
+				decoded += stream->decode();
+			}
+		}
+		std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+		if(decoded != 0)
+		{
+			stream_time.store(took.count(), std::memory_order_relaxed);
+		}
+
+		// Streams buffer RING_SECONDS ahead, so this is plenty
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+}
+
+void AudioEngine::register_stream(AudioStream* stream)
+{
+	// Prefill so the source can start playing right away. The stream thread doesn't
+	// know about it yet, so it's done without holding the lock
+	stream->decode();
+
+	std::lock_guard<std::mutex> lock(streams_mtx);
+	streams.push_back(stream);
+}
+
+void AudioEngine::unregister_stream(AudioStream* stream)
+{
+	std::lock_guard<std::mutex> lock(streams_mtx);
+	auto it = std::find(streams.begin(), streams.end(), stream);
+	if(it != streams.end())
+	{
+		streams.erase(it);
+	}
+}
+
+void AudioEngine::do_imgui()
+{
+	size_t clip_mem = 0, stream_mem = 0;
+	size_t clip_count = 0, stream_count = 0;
+	// Clips may be shared by many sources, only count each once
+	std::vector<const AudioClip*> counted;
+	for(const AudioChannel& ch : channels)
+	{
+		for(const auto& src : ch.sources)
+		{
+			if(src->is_streamed())
+			{
+				stream_mem += src->get_memory_usage();
+				stream_count++;
+			}
+			else if(!src->audio_clip_src.is_null())
+			{
+				const AudioClip* clip = src->audio_clip_src.data;
+				if(std::find(counted.begin(), counted.end(), clip) == counted.end())
+				{
+					counted.push_back(clip);
+					clip_mem += clip->get_memory_usage();
+					clip_count++;
+				}
+			}
+		}
+	}
+
+	double cb_time = callback_time.load(std::memory_order_relaxed);
+	double cb_dur = callback_duration.load(std::memory_order_relaxed);
+	double st_time = stream_time.load(std::memory_order_relaxed);
+
+	ImGui::Text("In-memory clips: %zu (%.2f MB)", clip_count, (double)clip_mem / (1024.0 * 1024.0));
+	ImGui::Text("Streams: %zu (%.2f MB)", stream_count, (double)stream_mem / (1024.0 * 1024.0));
+	ImGui::Text("Resampler: %.2f MB", (double)resampler.get_memory_usage() / (1024.0 * 1024.0));
+	ImGui::Separator();
+	ImGui::Text("Audio callback: %.3fms (%.1f%% of buffer)", cb_time * 1000.0,
+		 cb_dur > 0.0 ? cb_time / cb_dur * 100.0 : 0.0);
+	// The stream thread wakes every 5ms
+	ImGui::Text("Stream decode: %.3fms", st_time * 1000.0);
 }
 
 // As a little guide, this is expected to be called a few times per frame, although it could greatly
 // depend on platform. We are not a realtime audio application so it's no big deal
 // For example, on my (tatjam's) linux system it's called at around 350FPS
-// TODO: We could use many optimizations, such as SIMD if possible
 void AudioEngine::data_callback(ma_device* device, void* output, const void* input, ma_uint32 frames)
 {
 
 	auto* engine = (AudioEngine*)device->pUserData;
+	auto start = std::chrono::steady_clock::now();
 	float* foutput = (float*)output;
 	float* fmix = engine->mix_buffer;
 	float* fmixch = engine->chmix_buffer;
@@ -170,14 +377,16 @@ void AudioEngine::data_callback(ma_device* device, void* output, const void* inp
 		return;
 	}
 
-	engine->mtx.lock();
+	engine->process_commands();
+	const AudioListener& listener = engine->listener_buffer.read();
+	bool is_inside = engine->is_inside.load(std::memory_order_relaxed);
 
 	// Channels are mixed channel by channel and then master gain applied
 	for(size_t ch_i = 0; ch_i < engine->channels.size(); ch_i++)
 	{
 		AudioChannel* ch = &engine->channels[ch_i];
-		float gain = ch->gain *
-				(engine->is_inside ? ch->internal_gain : ch->external_gain) *
+		float gain = ch->gain.load(std::memory_order_relaxed) *
+				(is_inside ? ch->internal_gain : ch->external_gain) *
 				(ch->use_hdr ? engine->hdr_gain : 1.0f);
 
 		if(gain == 0.0f)
@@ -187,41 +396,38 @@ void AudioEngine::data_callback(ma_device* device, void* output, const void* inp
 
 
 		bool any = false;
-		bool first = true;
-		for(const auto& source : ch->sources)
+		for(AudioSource* source : ch->mix_sources)
 		{
+			const AudioSourceState& st = source->mix_state;
+			if(!st.playing || !st.sample_source)
+			{
+				continue;
+			}
+
 			float attenuation = 1.0f, left = 1.0f, right = 1.0f;
-			if(source->is_3d_source())
+			if(st.source_3d)
 			{
-				auto[nleft, nright] = engine->get_panning(source->get_position());
+				auto[nleft, nright] = engine->get_panning(st.pos, listener);
 				left = nleft; right = nright;
-				float distance = (float)glm::distance(source->get_position(), engine->listener_pos);
+				float distance = (float)glm::distance(st.pos, listener.pos);
 			}
 
 			// Source will NOT apply their own gain
 			bool written = source->mix_samples(fmix, frames);
-			any |= written;
 
 			// Apply directionality and attenuation, mixing into the channel
 			if(written)
 			{
-				float lgain = left * attenuation * source->get_gain();
-				float rgain = right * attenuation * source->get_gain();
-				for (ma_uint32 i = 0; i < frames; i++)
+				if(!any)
 				{
-					if(first)
-					{
-						// We must overwrite fmixch as it contains data from previous channels / audio requests
-						fmixch[i * 2 + 0] = fmix[i * 2 + 0] * lgain;
-						fmixch[i * 2 + 1] = fmix[i * 2 + 1] * rgain;
-					}
-					else
-					{
-						fmixch[i * 2 + 0] += fmix[i * 2 + 0] * lgain;
-						fmixch[i * 2 + 1] += fmix[i * 2 + 1] * rgain;
-					}
+					// We must clear fmixch as it contains data from previous channels / audio requests
+					AudioMix::zero(fmixch, frames);
+					any = true;
 				}
-				first = false;
+
+				float lgain = left * attenuation * st.gain;
+				float rgain = right * attenuation * st.gain;
+				AudioMix::mix_gain(fmixch, fmix, frames, lgain, rgain);
 			}
 
 		}
@@ -230,26 +436,49 @@ void AudioEngine::data_callback(ma_device* device, void* output, const void* inp
 		{
 			// Apply filters to fmixch
 
-			// Apply gain and HDR (*2 because we use stereo), and mix into the output
-			for (ma_uint32 i = 0; i < frames; i++)
-			{
-				foutput[i * 2 + 0] += fmixch[i * 2 + 0] * gain;
-				foutput[i * 2 + 1] += fmixch[i * 2 + 1] * gain;
-			}
+			// Apply gain and HDR, and mix into the output
+			AudioMix::mix_gain(foutput, fmixch, frames, gain, gain);
 		}
 
 	}
 
-	engine->mtx.unlock();
-
+	std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+	engine->callback_time.store(took.count(), std::memory_order_relaxed);
+	engine->callback_duration.store((double)frames / (double)engine->sample_rate, std::memory_order_relaxed);
 }
 
 std::weak_ptr<AudioSource> AudioEngine::create_audio_source(uint32_t in_channel)
 {
-	mtx.lock();
-	auto src = std::make_shared<AudioSource>(AudioSource(this, in_channel));
+	auto src = std::make_shared<AudioSource>(this, in_channel);
 	channels[in_channel].sources.push_back(src);
-	mtx.unlock();
+
+	AudioCommand cmd;
+	cmd.type = AudioCommand::ADD_SOURCE;
+	cmd.source = src.get();
+	push_command(cmd);
+
 	return src;
 }
 
+void AudioEngine::destroy_audio_source(AudioSource* source)
+{
+	auto& vec = channels[source->in_channel].sources;
+	for(auto it = vec.begin(); it != vec.end(); it++)
+	{
+		if(it->get() == source)
+		{
+			AudioCommand cmd;
+			cmd.type = AudioCommand::REMOVE_SOURCE;
+			cmd.source = source;
+			push_command(cmd);
+
+			// Kept alive until the audio thread processes the removal
+			retired_sources.emplace_back(commands_pushed, std::move(*it));
+			vec.erase(it);
+			return;
+		}
+	}
+
+	logger->warn("Tried to destroy an audio source which is not in the engine");
+}
+
@@ -1,16 +1,22 @@
 #pragma once
 #include <cpptoml.h>
 #include <miniaudio/miniaudio.h>
-#include <mutex>
+#include <atomic>
 #include <array>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <thread>
 #include <glm/glm.hpp>
-
-class AudioSource;
+#include <util/ThreadUtil.h>
+#include "AudioSource.h"
+#include "AudioStream.h"
+#include "Resampler.h"
 
 struct AudioChannel
 {
 	// Gain used for mixing
-	float gain;
+	std::atomic<float> gain;
 
 	// Gain of this channel while in external view, set in the config
 	float external_gain;
@@ -20,10 +26,42 @@ struct AudioChannel
 	bool use_hdr;
 
 	// We handle the lifetime of the sources, which must be created by the engine
+	// (Game thread only)
 	std::vector<std::shared_ptr<AudioSource>> sources;
+	// The sources the audio thread mixes (Audio thread only)
+	std::vector<AudioSource*> mix_sources;
 
 };
 
+// Sent from the game thread to the audio thread
+struct AudioCommand
+{
+	enum Type
+	{
+		ADD_SOURCE,
+		REMOVE_SOURCE,
+		// Everything but playing, which the audio thread clears when a clip ends
+		SET_SOURCE_STATE,
+		// The whole state, sent only by set_playing
+		SET_SOURCE_PLAYING
+	};
+
+	Type type;
+	AudioSource* source;
+	AudioSourceState state;
+};
+
+struct AudioListener
+{
+	glm::dvec3 pos;
+	glm::dvec3 fwd;
+	glm::dvec3 vel;
+	double speed_of_sound;
+	// Precomputed
+	glm::dvec3 right;
+	glm::dvec3 up;
+};
+
 // TODO: The AudioEngine should allow disabling audio, and then it will simulate playback
 // We always use f32 audio, as it seems to be convenient, if this supposes a big perfomance hit
 // it could be changed to s16, which is the typical internal format, at the cost of mixing precision!
@@ -33,6 +71,13 @@ struct AudioChannel
 // UI from real sounds, which are affected by HDR and effects.
 // TODO: Maybe AudioEngine should be lower level and care less about the game? Probably unnecesary
 // TODO: We could implement HRTF as this game could easily benefit from the 3D effects
+//
+// Threading: the audio thread never takes a lock. The game thread sends source changes
+// through a lock-free command queue, and the listener through a swap buffer. Destroyed
+// sources (and replaced clips) are kept alive until the audio thread has processed the
+// command that removes them, and are freed in update() on the game thread.
+// Streamed clips are decoded in a separate stream thread, which is the only one
+// that takes a lock (when streams are added or removed).
 class AudioEngine
 {
 private:
@@ -44,14 +89,43 @@ private:
 
 	friend class AudioSource;
 
-	glm::dvec3 listener_pos;
-	glm::dvec3 listener_fwd;
-	glm::dvec3 listener_vel;
-	double speed_of_sound;
-	// Precomputed
-	glm::dvec3 listener_right;
-	glm::dvec3 listener_up;
-
+	// Game thread copy, used by the getters
+	AudioListener listener;
+	// What the audio thread reads
+	SwapBuffer<AudioListener> listener_buffer;
+
+	SPSCQueue<AudioCommand, 4096> commands;
+	// Game thread only
+	uint64_t commands_pushed;
+	// Written by the audio thread
+	std::atomic<uint64_t> commands_done;
+
+	// Sources waiting for the audio thread to stop using them (command number, source)
+	std::vector<std::pair<uint64_t, std::shared_ptr<AudioSource>>> retired_sources;
+
+	// Blocks (yielding) if the queue is full, which should be very rare
+	void push_command(const AudioCommand& cmd);
+	uint64_t get_commands_pushed() const { return commands_pushed; }
+	// Audio thread
+	void process_commands();
+
+	// Shared by all sources, audio thread only
+	Resampler resampler;
+
+	// Streams are decoded here, so the audio thread never touches the disk
+	std::thread stream_thread;
+	std::mutex streams_mtx;
+	std::vector<AudioStream*> streams;
+	std::atomic<bool> stream_thread_run;
+	void stream_thread_func();
+	void register_stream(AudioStream* stream);
+	// Once this returns the stream thread will not touch the stream again
+	void unregister_stream(AudioStream* stream);
+
+	// Time spent in the last audio callback / stream thread iteration, in seconds
+	std::atomic<double> callback_time;
+	std::atomic<double> callback_duration;
+	std::atomic<double> stream_time;
 
 
 	ma_context context;
@@ -59,7 +133,7 @@ private:
 	size_t sample_rate;
 
 	// Are we inside the cockpit?
-	bool is_inside;
+	std::atomic<bool> is_inside;
 
 	// For the settings interface, and to store in the config. We compare
 	// the raw strings, and if missing, use the default device
@@ -69,7 +143,7 @@ private:
 	float hdr_gain;
 
 	// Gain applied after mixing
-	float master_gain;
+	std::atomic<float> master_gain;
 
 	// Channel layout:
 	// Channel 0: UI, Music, etc... (No effects, no HDR)
@@ -79,34 +153,38 @@ private:
 	std::array<AudioChannel, 4> channels;
 
 
-	// Remember that audio is in a different thread!
-	std::mutex mtx;
-
 	bool simple_panning;
 
 public:
 
 	// Returns left, right pair.
 	// TODO: HRTF filter? Could be CPU expensive but sounds awesome
-	std::pair<float, float> get_panning(glm::dvec3 pos);
+	std::pair<float, float> get_panning(glm::dvec3 pos, const AudioListener& listener) const;
 
 	size_t get_sample_rate() const { return sample_rate; }
 
 	bool get_is_inside() const { return is_inside; }
-	void set_is_inside(bool val) {mtx.lock(); is_inside = val; mtx.unlock(); }
+	void set_is_inside(bool val) { is_inside = val; }
 
 	float get_master_gain() const { return master_gain; }
-	void set_master_gain(float val) {mtx.lock(); master_gain = val; mtx.unlock(); }
+	void set_master_gain(float val) { master_gain = val; }
 
 	float get_channel_gain(int channel) const { return channels[channel].gain; }
-	void set_channel_gain(int channel, float val) { mtx.lock(); channels[channel].gain = val; mtx.unlock(); }
+	void set_channel_gain(int channel, float val) { channels[channel].gain = val; }
 
 	void set_listener(glm::dvec3 pos, glm::dvec3 fwd, glm::dvec3 up, glm::dvec3 vel, double speed_of_sound);
-	glm::dvec3 get_listener_pos() const { return listener_pos; }
-	glm::dvec3 get_listener_fwd() const { return listener_fwd; }
-	glm::dvec3 get_listener_up() const { return listener_up; }
+	glm::dvec3 get_listener_pos() const { return listener.pos; }
+	glm::dvec3 get_listener_fwd() const { return listener.fwd; }
+	glm::dvec3 get_listener_up() const { return listener.up; }
 
 	std::weak_ptr<AudioSource> create_audio_source(uint32_t in_channel);
+	void destroy_audio_source(AudioSource* source);
+
+	// Game thread, frees sources and clips no longer used by the audio thread
+	void update();
+
+	// Memory and CPU usage of the in-memory and streamed paths
+	void do_imgui();
 
 	static void data_callback(ma_device* device, void* output, const void* input, ma_uint32 frames);
 
@@ -0,0 +1,107 @@
+#include "AudioMix.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_MIX_SSE
+#include <emmintrin.h>
+#endif
+
+void AudioMix::zero(float* dst, size_t frames)
+{
+	memset(dst, 0, frames * 2 * sizeof(float));
+}
+
+void AudioMix::mix_gain_scalar(float* dst, const float* src, size_t frames, float lgain, float rgain)
+{
+	for(size_t i = 0; i < frames; i++)
+	{
+		dst[i * 2 + 0] += src[i * 2 + 0] * lgain;
+		dst[i * 2 + 1] += src[i * 2 + 1] * rgain;
+	}
+}
+
+void AudioMix::mix_gain(float* dst, const float* src, size_t frames, float lgain, float rgain)
+{
+#ifdef AUDIO_MIX_SSE
+	// Two stereo frames per register, so gains are (L R L R)
+	__m128 gain = _mm_setr_ps(lgain, rgain, lgain, rgain);
+	size_t i = 0;
+	size_t floats = frames * 2;
+	for(; i + 8 <= floats; i += 8)
+	{
+		__m128 a = _mm_loadu_ps(src + i);
+		__m128 b = _mm_loadu_ps(src + i + 4);
+		__m128 da = _mm_loadu_ps(dst + i);
+		__m128 db = _mm_loadu_ps(dst + i + 4);
+		_mm_storeu_ps(dst + i, _mm_add_ps(da, _mm_mul_ps(a, gain)));
+		_mm_storeu_ps(dst + i + 4, _mm_add_ps(db, _mm_mul_ps(b, gain)));
+	}
+	// Remaining frames
+	mix_gain_scalar(dst + i, src + i, (floats - i) / 2, lgain, rgain);
+#else
+	mix_gain_scalar(dst, src, frames, lgain, rgain);
+#endif
+}
+
+void AudioMix::copy_stereo(float* dst, const float* src, size_t frames)
+{
+	memcpy(dst, src, frames * 2 * sizeof(float));
+}
+
+void AudioMix::copy_mono_scalar(float* dst, const float* src, size_t frames)
+{
+	for(size_t i = 0; i < frames; i++)
+	{
+		dst[i * 2 + 0] = src[i];
+		dst[i * 2 + 1] = src[i];
+	}
+}
+
+void AudioMix::copy_mono(float* dst, const float* src, size_t frames)
+{
+#ifdef AUDIO_MIX_SSE
+	size_t i = 0;
+	for(; i + 4 <= frames; i += 4)
+	{
+		__m128 m = _mm_loadu_ps(src + i);
+		// (a b c d) -> (a a b b) and (c c d d)
+		_mm_storeu_ps(dst + i * 2, _mm_unpacklo_ps(m, m));
+		_mm_storeu_ps(dst + i * 2 + 4, _mm_unpackhi_ps(m, m));
+	}
+	copy_mono_scalar(dst + i * 2, src + i, frames - i);
+#else
+	copy_mono_scalar(dst, src, frames);
+#endif
+}
+
+void AudioMix::fir_stereo_scalar(const float* frames, const float* taps, size_t tap_count, float& l, float& r)
+{
+	float al = 0.0f, ar = 0.0f;
+	for(size_t i = 0; i < tap_count; i++)
+	{
+		al += frames[i * 2 + 0] * taps[i * 2 + 0];
+		ar += frames[i * 2 + 1] * taps[i * 2 + 1];
+	}
+	l = al;
+	r = ar;
+}
+
+void AudioMix::fir_stereo(const float* frames, const float* taps, size_t tap_count, float& l, float& r)
+{
+#ifdef AUDIO_MIX_SSE
+	// Each register holds two stereo frames, so we accumulate (L R L R)
+	__m128 acc = _mm_setzero_ps();
+	for(size_t i = 0; i < tap_count * 2; i += 4)
+	{
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(frames + i), _mm_loadu_ps(taps + i)));
+	}
+	// (L0 R0 L1 R1) + (L1 R1 L0 R0)
+	acc = _mm_add_ps(acc, _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	float out[4];
+	_mm_storeu_ps(out, acc);
+	l = out[0];
+	r = out[1];
+#else
+	fir_stereo_scalar(frames, taps, tap_count, l, r);
+#endif
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Mixing kernels used by the audio engine. All buffers are interleaved
+// stereo f32 (L R L R ...) unless noted otherwise, and counts are in frames.
+// They use SSE when available (always on x86-64) and a scalar fallback
+// otherwise. The scalar versions are always available as a reference
+// (and for benchmarking).
+namespace AudioMix
+{
+	// dst = 0
+	void zero(float* dst, size_t frames);
+
+	// dst += src * (lgain, rgain)
+	void mix_gain(float* dst, const float* src, size_t frames, float lgain, float rgain);
+	void mix_gain_scalar(float* dst, const float* src, size_t frames, float lgain, float rgain);
+
+	// dst = src (stereo source)
+	void copy_stereo(float* dst, const float* src, size_t frames);
+	// dst = (src, src) (mono source, duplicated to both channels)
+	void copy_mono(float* dst, const float* src, size_t frames);
+	void copy_mono_scalar(float* dst, const float* src, size_t frames);
+
+	// Dot product of stereo frames with stereo duplicated taps (t0 t0 t1 t1 ...),
+	// taps contains tap_count * 2 floats and tap_count must be even
+	void fir_stereo(const float* frames, const float* taps, size_t tap_count, float& l, float& r);
+	void fir_stereo_scalar(const float* frames, const float* taps, size_t tap_count, float& l, float& r);
+}
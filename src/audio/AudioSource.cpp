@@ -3,31 +3,79 @@
 
 bool AudioSource::mix_samples(void* target, size_t count)
 {
-	if(!sample_source || !playing || pitch <= 0.0f)
+	if(!mix_state.sample_source || !mix_state.playing || mix_state.pitch <= 0.0f)
 	{
 		return false;
 	}
 
-	size_t sample_rate = engine->get_sample_rate() * pitch;
+	auto sample_rate = (uint32_t)engine->get_sample_rate();
+	bool still_playing;
 
-	int32_t jump = sample_source->mix_samples((float*)target, count, cur_sample, loops, sample_rate, engine->get_sample_rate());
-	if(jump >= 0)
+	if(mix_state.pitch == 1.0f)
 	{
-		cur_sample = jump;
+		int32_t jump = mix_state.sample_source->mix_samples((float*)target, count, cur_sample, mix_state.loops,
+												  sample_rate, sample_rate);
+		still_playing = jump >= 0;
+		if(still_playing)
+		{
+			cur_sample = jump;
+		}
 	}
 	else
+	{
+		still_playing = engine->resampler.process(resampler_state, mix_state.sample_source, cur_sample,
+											  mix_state.loops, mix_state.pitch, sample_rate, (float*)target, count);
+	}
+
+	if(!still_playing)
 	{
 		// Audio playback is finished
-		playing = false;
+		mix_state.playing = false;
 		cur_sample = 0;
+		resampler_state.reset();
+		finished.store(true, std::memory_order_relaxed);
 	}
 
 	return true;
 }
 
+void AudioSource::push_state(bool with_playing)
+{
+	AudioCommand cmd;
+	cmd.type = with_playing ? AudioCommand::SET_SOURCE_PLAYING : AudioCommand::SET_SOURCE_STATE;
+	cmd.source = this;
+	cmd.state = state;
+	engine->push_command(cmd);
+}
+
+void AudioSource::release_clip(OldClip& clip)
+{
+	if(clip.stream)
+	{
+		engine->unregister_stream(clip.stream.get());
+		clip.stream.reset();
+	}
+}
+
+void AudioSource::release_old_clips(uint64_t commands_done)
+{
+	for(auto it = old_clips.begin(); it != old_clips.end();)
+	{
+		if(it->command <= commands_done)
+		{
+			release_clip(*it);
+			it = old_clips.erase(it);
+		}
+		else
+		{
+			it++;
+		}
+	}
+}
+
 void AudioSource::destroy()
 {
-	engine->mtx.lock();
+	engine->destroy_audio_source(this);
 }
 
 AudioSource::AudioSource(AudioEngine *eng, uint32_t channel)
@@ -35,62 +83,115 @@ AudioSource::AudioSource(AudioEngine *eng, uint32_t channel)
 	this->engine = eng;
 	this->in_channel = channel;
 	// By default we use a 2D audio source
-	source_3d = false;
-	playing = false;
-	gain = 1.0f;
-	pitch = 1.0f;
-	sample_source = nullptr;
-	loops = false;
+	state.source_3d = false;
+	state.playing = false;
+	state.gain = 1.0f;
+	state.pitch = 1.0f;
+	state.sample_source = nullptr;
+	state.loops = false;
+	state.pos = glm::dvec3(0.0);
+	state.vel = glm::dvec3(0.0);
+	mix_state = state;
+	cur_sample = 0;
+	finished = false;
+}
+
+AudioSource::~AudioSource()
+{
+	// By now the audio thread doesn't know about us
+	for(OldClip& clip : old_clips)
+	{
+		release_clip(clip);
+	}
+
+	if(stream)
+	{
+		engine->unregister_stream(stream.get());
+	}
+}
+
+size_t AudioSource::get_memory_usage() const
+{
+	if(stream)
+	{
+		return stream->get_memory_usage();
+	}
+	else if(!audio_clip_src.is_null())
+	{
+		return audio_clip_src->get_memory_usage();
+	}
+
+	return 0;
 }
 
 void AudioSource::set_playing(bool value)
 {
-	engine->mtx.lock();
-	playing = value;
-	engine->mtx.unlock();
+	if(value && stream && finished.load(std::memory_order_relaxed))
+	{
+		// The audio thread is done with the stream, so it can be rewound
+		stream->request_rewind();
+	}
+
+	state.playing = value;
+	finished.store(false, std::memory_order_relaxed);
+	push_state(true);
 }
 
 void AudioSource::set_3d_source(bool value)
 {
-	engine->mtx.lock();
-	source_3d = value;
-	engine->mtx.unlock();
+	state.source_3d = value;
+	push_state();
 }
 
 void AudioSource::set_position(glm::dvec3 pos)
 {
-	engine->mtx.lock();
-	this->pos = pos;
-	engine->mtx.unlock();
+	state.pos = pos;
+	push_state();
 }
 
 void AudioSource::set_gain(float val)
 {
-	engine->mtx.lock();
-	gain = val;
-	engine->mtx.unlock();
+	state.gain = val;
+	push_state();
 }
 
 void AudioSource::set_pitch(float val)
 {
-	engine->mtx.lock();
-	pitch = val;
-	engine->mtx.unlock();
+	state.pitch = val;
+	push_state();
 }
 
 void AudioSource::set_source_clip(const AssetHandle<AudioClip>& ast)
 {
+	// The audio thread may still be reading the old clip, so we keep it alive
+	// until the command that replaces it has been processed
+	if(!audio_clip_src.is_null())
+	{
+		OldClip old;
+		old.command = engine->get_commands_pushed() + 1;
+		old.clip = std::move(audio_clip_src);
+		old.stream = std::move(stream);
+		old_clips.push_back(std::move(old));
+	}
 	// We obtain a new reference
 	audio_clip_src = ast.duplicate();
-	// We can now safely store a pointer
-	engine->mtx.lock();
-	sample_source = ast.data;
-	engine->mtx.unlock();
+
+	if(audio_clip_src->is_streamed())
+	{
+		stream.reset(audio_clip_src->create_stream());
+		engine->register_stream(stream.get());
+		state.sample_source = stream.get();
+	}
+	else
+	{
+		// We can now safely store a pointer
+		state.sample_source = audio_clip_src.data;
+	}
+	push_state();
 }
 
 void AudioSource::set_looping(bool val)
 {
-	engine->mtx.lock();
-	loops = val;
-	engine->mtx.unlock();
+	state.loops = val;
+	push_state();
 }
@@ -2,18 +2,18 @@
 #include "SampleSource.h"
 #include "assets/AssetManager.h"
 #include "assets/AudioClip.h"
+#include "AudioStream.h"
+#include "Resampler.h"
+#include <atomic>
+#include <memory>
 
 class AudioEngine;
-// The audio source is the multi-purpose class used for all audio sources
-// It allows both 2D and 3D audio
-// Their lifetime is handled by AudioEngine, std::weak_ptr is recommended
-class AudioSource
-{
-private:
-
-	// Asset references, we actually use the sample_source pointer
-	AssetHandle<AudioClip> audio_clip_src;
 
+// Everything the audio thread needs to mix a source. The game thread keeps its
+// own copy (used by the getters), and sends a copy to the audio thread through
+// the engine command queue whenever anything changes
+struct AudioSourceState
+{
 	SampleSource* sample_source;
 
 	float gain;
@@ -21,46 +21,95 @@ private:
 	// Values other than 1 involve resampling as all audio is at the same frequency by default
 	float pitch;
 
-	AudioEngine* engine;
-	uint32_t in_channel;
 	bool source_3d;
 	bool playing;
 	bool loops;
 
+	glm::dvec3 pos, vel;
+};
+
+// The audio source is the multi-purpose class used for all audio sources
+// It allows both 2D and 3D audio
+// Their lifetime is handled by AudioEngine, std::weak_ptr is recommended
+// All functions (except mix_samples) must be called from the game thread, they
+// never block the audio thread
+class AudioSource
+{
+private:
+
+	friend class AudioEngine;
+
+	// Asset references, we actually use the sample_source pointer
+	AssetHandle<AudioClip> audio_clip_src;
+	// Only present if the clip is streamed, then it's our sample_source
+	std::unique_ptr<AudioStream> stream;
+
+	struct OldClip
+	{
+		// Command number after which the audio thread no longer uses it
+		uint64_t command;
+		AssetHandle<AudioClip> clip;
+		std::unique_ptr<AudioStream> stream;
+	};
+
+	// Clips replaced while the audio thread could still be using them, they are
+	// released once the engine has processed the command that replaced them
+	std::vector<OldClip> old_clips;
+
+	// Game thread copy
+	AudioSourceState state;
+	// Audio thread copy, only touched by the audio thread
+	AudioSourceState mix_state;
 	uint32_t cur_sample;
+	ResamplerState resampler_state;
 
-	glm::dvec3 pos, vel;
+	// Set by the audio thread when a non-looping source finishes playing
+	std::atomic<bool> finished;
+
+	AudioEngine* engine;
+	uint32_t in_channel;
+
+	// Sends our state to the audio thread, playing is only sent if with_playing
+	// (otherwise a finished one-shot would start again on any change)
+	void push_state(bool with_playing = false);
+	void release_old_clips(uint64_t commands_done);
+	void release_clip(OldClip& clip);
 
 public:
 
 
 	void set_playing(bool value);
-	bool is_playing() const {return playing;}
+	bool is_playing() const { return state.playing && !finished.load(std::memory_order_relaxed); }
 
-	// Return true if anything was played
+	// Audio thread only. Return true if anything was played
 	bool mix_samples(void* target, size_t count);
 
-	bool is_3d_source() const { return source_3d; }
+	bool is_3d_source() const { return state.source_3d; }
 	void set_3d_source(bool value);
 
 	// Only on 3d sources
-	glm::dvec3 get_position() { return pos; }
+	glm::dvec3 get_position() { return state.pos; }
 	void set_position(glm::dvec3 pos);
 
-	float get_gain() const { return gain; }
+	float get_gain() const { return state.gain; }
 	void set_gain(float val);
 
-	float get_pitch() const { return pitch; }
+	float get_pitch() const { return state.pitch; }
 	void set_pitch(float val);
 
-	bool is_looping() const { return loops; }
+	bool is_looping() const { return state.loops; }
 	void set_looping(bool val);
 
-	// We duplicate the asset
+	// We duplicate the asset. Streamed clips create a stream for this source
 	void set_source_clip(const AssetHandle<AudioClip>& ast);
+	bool is_streamed() const { return stream != nullptr; }
+	// Resident memory used by our clip or stream
+	size_t get_memory_usage() const;
 
 	// Be aware, all other pointers to this will be invalidated
+	// (The object itself is freed once the audio thread stops using it)
 	void destroy();
 	AudioSource(AudioEngine* eng, uint32_t channel);
+	~AudioSource();
 };
 
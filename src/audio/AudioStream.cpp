@@ -0,0 +1,191 @@
+#include "AudioStream.h"
+#include "AudioMix.h"
+#include <util/Logger.h>
+#include <algorithm>
+
+AudioStream::AudioStream(const std::string& path, uint32_t sample_rate)
+{
+	read_pos = 0;
+	write_pos = 0;
+	eof = false;
+	loop = false;
+	rewind_requested = false;
+	played = 0;
+	channel_count = 0;
+	ring_frames = 0;
+
+	// Miniaudio does the format and sample rate conversion for us
+	ma_decoder_config cfg = ma_decoder_config_init(ma_format_f32, 0, sample_rate);
+	decoder_valid = ma_decoder_init_file(path.c_str(), &cfg, &decoder) == MA_SUCCESS;
+
+	if(decoder_valid && decoder.outputChannels > 2)
+	{
+		// We support only mono and stereo, same as AudioClip
+		ma_decoder_uninit(&decoder);
+		cfg = ma_decoder_config_init(ma_format_f32, 2, sample_rate);
+		decoder_valid = ma_decoder_init_file(path.c_str(), &cfg, &decoder) == MA_SUCCESS;
+	}
+
+	if(!decoder_valid)
+	{
+		logger->error("Miniaudio failed to open stream {}", path);
+		return;
+	}
+
+	channel_count = decoder.outputChannels;
+	ring_frames = (size_t)(RING_SECONDS * sample_rate);
+	ring.resize(ring_frames * channel_count);
+}
+
+AudioStream::~AudioStream()
+{
+	if(decoder_valid)
+	{
+		ma_decoder_uninit(&decoder);
+	}
+}
+
+size_t AudioStream::decode()
+{
+	if(!decoder_valid)
+	{
+		return 0;
+	}
+
+	uint64_t r = read_pos.load(std::memory_order_acquire);
+	uint64_t w = write_pos.load(std::memory_order_relaxed);
+
+	if(rewind_requested.load(std::memory_order_acquire) && r == w)
+	{
+		ma_decoder_seek_to_pcm_frame(&decoder, 0);
+		// eof must be cleared first, the audio thread reads them in the opposite order
+		eof.store(false, std::memory_order_relaxed);
+		rewind_requested.store(false, std::memory_order_release);
+	}
+
+	if(eof.load(std::memory_order_relaxed))
+	{
+		if(loop.load(std::memory_order_relaxed))
+		{
+			// Loop was enabled after we reached the end
+			ma_decoder_seek_to_pcm_frame(&decoder, 0);
+			eof = false;
+		}
+		else
+		{
+			return 0;
+		}
+	}
+
+	size_t free = ring_frames - (size_t)(w - r);
+	if(free < CHUNK_FRAMES)
+	{
+		return 0;
+	}
+
+	size_t total = 0;
+	bool reached_end = false;
+	size_t want = std::min(free, CHUNK_FRAMES);
+	while(total < want)
+	{
+		// Contiguous space until the end of the ring
+		size_t start = (size_t)((w + total) % ring_frames);
+		size_t n = std::min(want - total, ring_frames - start);
+		auto read = (size_t)ma_decoder_read_pcm_frames(&decoder, &ring[start * channel_count], n);
+		total += read;
+
+		if(read < n)
+		{
+			if(loop.load(std::memory_order_relaxed))
+			{
+				ma_decoder_seek_to_pcm_frame(&decoder, 0);
+			}
+			else
+			{
+				reached_end = true;
+				break;
+			}
+
+			if(read == 0 && total == 0)
+			{
+				// Empty file, avoid spinning forever
+				reached_end = true;
+				break;
+			}
+		}
+	}
+
+	write_pos.store(w + total, std::memory_order_release);
+	// Must be set after the frames are visible, the audio thread relies on it
+	if(reached_end)
+	{
+		eof.store(true, std::memory_order_release);
+	}
+	return total;
+}
+
+void AudioStream::request_rewind()
+{
+	rewind_requested = true;
+}
+
+size_t AudioStream::get_memory_usage() const
+{
+	return ring.size() * sizeof(float) + sizeof(AudioStream);
+}
+
+int32_t AudioStream::mix_samples(float* target, uint32_t count, uint32_t cur_frame, bool nloop,
+								 uint32_t sample_rate, uint32_t target_sample_rate)
+{
+	loop.store(nloop, std::memory_order_relaxed);
+
+	if(!decoder_valid)
+	{
+		AudioMix::zero(target, count);
+		return -1;
+	}
+
+	// A pending rewind means we were asked to play again, but the stream thread is
+	// yet to seek (so eof is still set from the last time)
+	bool rewinding = rewind_requested.load(std::memory_order_acquire);
+	// eof is loaded first, if it's set write_pos is already final
+	bool at_end = eof.load(std::memory_order_acquire);
+	uint64_t r = read_pos.load(std::memory_order_relaxed);
+	uint64_t w = write_pos.load(std::memory_order_acquire);
+	auto avail = (size_t)(w - r);
+	size_t n = std::min((size_t)count, avail);
+
+	size_t done = 0;
+	while(done < n)
+	{
+		size_t start = (size_t)((r + done) % ring_frames);
+		size_t run = std::min(n - done, ring_frames - start);
+		if(channel_count == 1)
+		{
+			AudioMix::copy_mono(target + done * 2, &ring[start], run);
+		}
+		else
+		{
+			AudioMix::copy_stereo(target + done * 2, &ring[start * 2], run);
+		}
+		done += run;
+	}
+
+	read_pos.store(r + n, std::memory_order_release);
+	played += n;
+
+	if(n < count)
+	{
+		AudioMix::zero(target + n * 2, count - n);
+		if(at_end && !nloop && !rewinding)
+		{
+			// We have played everything
+			return -1;
+		}
+		// Otherwise it's an underrun, the stream thread is late (or the stream just started)
+	}
+
+	// cur_frame is not used by streams, the position only has to stay positive,
+	// as negative values mean we are done
+	return (int32_t)(played % (uint64_t)INT32_MAX);
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "SampleSource.h"
+#include <miniaudio/miniaudio.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// A SampleSource which decodes a file progressively into a ring buffer, used for
+// long clips (music, engine loops...) so they don't have to be fully resident in memory.
+// Decoding happens in the AudioEngine stream thread (decode), playback in the
+// audio thread (mix_samples). The ring buffer is lock-free between them.
+// Each AudioSource playing a streamed clip has its own AudioStream.
+class AudioStream : public SampleSource
+{
+private:
+
+	ma_decoder decoder;
+	bool decoder_valid;
+
+	size_t channel_count;
+
+	// Interleaved f32, ring_frames * channel_count
+	std::vector<float> ring;
+	size_t ring_frames;
+	// Monotonically increasing frame counters, read_pos written by audio thread
+	// and write_pos by the stream thread
+	std::atomic<uint64_t> read_pos;
+	std::atomic<uint64_t> write_pos;
+
+	std::atomic<bool> eof;
+	std::atomic<bool> loop;
+	std::atomic<bool> rewind_requested;
+
+	// Frames played, returned (wrapped to stay positive) as "position" to the AudioSource
+	uint64_t played;
+
+public:
+
+	// How much audio is buffered ahead, in seconds
+	static constexpr double RING_SECONDS = 1.0;
+	// Decoded at once by the stream thread, in frames
+	static constexpr size_t CHUNK_FRAMES = 4096;
+
+	size_t get_channel_count() const { return channel_count; }
+	bool is_valid() const { return decoder_valid; }
+
+	// Stream thread. Decodes if there's space, returns number of frames decoded
+	size_t decode();
+
+	// Game thread. Only safe once the audio thread finished playing us. Until the
+	// stream thread rewinds, the audio thread plays silence instead of finishing
+	void request_rewind();
+
+	size_t get_memory_usage() const;
+
+	int32_t mix_samples(float* target, uint32_t count, uint32_t cur_frame, bool loop, uint32_t sample_rate,
+						uint32_t target_sample_rate) override;
+
+	AudioStream(const std::string& path, uint32_t sample_rate);
+	~AudioStream();
+};
@@ -0,0 +1,117 @@
+#include "Resampler.h"
+#include "SampleSource.h"
+#include "AudioMix.h"
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <cstring>
+
+void ResamplerState::reset()
+{
+	memset(history, 0, sizeof(history));
+	phase = 0.0;
+}
+
+const float* Resampler::get_taps(size_t band, size_t phase) const
+{
+	constexpr size_t TAPS = ResamplerState::TAPS;
+	return &tables[(band * PHASES + phase) * TAPS * 2];
+}
+
+bool Resampler::process(ResamplerState& st, SampleSource* src, uint32_t& cur_frame, bool loop,
+						float pitch, uint32_t sample_rate, float* target, uint32_t count)
+{
+	constexpr size_t TAPS = ResamplerState::TAPS;
+
+	double step = (double)glm::clamp(pitch, MIN_PITCH, MAX_PITCH);
+	size_t band = step <= 1.0 ? 0 : (step <= 2.0 ? 1 : 2);
+
+	// Number of new frames we need from the source
+	auto m = (uint32_t)(st.phase + (double)count * step);
+
+	float* work = scratch.data();
+	memcpy(work, st.history, sizeof(st.history));
+
+	bool playing = true;
+	if(m > 0)
+	{
+		int32_t jump = src->mix_samples(work + TAPS * 2, m, cur_frame, loop, sample_rate, sample_rate);
+		if(jump >= 0)
+		{
+			cur_frame = (uint32_t)jump;
+		}
+		else
+		{
+			// The source zero-filled the rest, we can still output this block
+			cur_frame = 0;
+			playing = false;
+		}
+	}
+
+	for(uint32_t i = 0; i < count; i++)
+	{
+		double t = st.phase + (double)i * step;
+		auto n = (size_t)t;
+		auto p = (size_t)((t - (double)n) * (double)PHASES);
+		p = glm::min(p, PHASES - 1);
+		AudioMix::fir_stereo(work + n * 2, get_taps(band, p), TAPS, target[i * 2 + 0], target[i * 2 + 1]);
+	}
+
+	if(playing)
+	{
+		memcpy(st.history, work + m * 2, sizeof(st.history));
+		st.phase = st.phase + (double)count * step - (double)m;
+	}
+	else
+	{
+		st.reset();
+	}
+
+	return playing;
+}
+
+size_t Resampler::get_memory_usage() const
+{
+	return (tables.size() + scratch.size()) * sizeof(float);
+}
+
+Resampler::Resampler(size_t max_frames)
+{
+	constexpr size_t TAPS = ResamplerState::TAPS;
+	constexpr double HALF = (double)(TAPS / 2);
+
+	tables.resize(BANDS * PHASES * TAPS * 2);
+	scratch.resize((TAPS + (size_t)((double)max_frames * MAX_PITCH) + 2) * 2);
+
+	for(size_t band = 0; band < BANDS; band++)
+	{
+		// Cutoff relative to the input nyquist frequency
+		double cutoff = 0.9 / (double)(1 << band);
+
+		for(size_t p = 0; p < PHASES; p++)
+		{
+			double f = (double)p / (double)PHASES;
+			double taps[TAPS];
+			double sum = 0.0;
+			for(size_t k = 0; k < TAPS; k++)
+			{
+				// Distance from the interpolated point (between tap HALF - 1 and HALF)
+				double x = (double)k - (HALF - 1.0) - f;
+				double sx = cutoff * x * glm::pi<double>();
+				double sinc = glm::abs(sx) < 1e-9 ? 1.0 : glm::sin(sx) / sx;
+				// Blackman window
+				double w = 0.42 + 0.5 * glm::cos(glm::pi<double>() * x / HALF)
+						+ 0.08 * glm::cos(2.0 * glm::pi<double>() * x / HALF);
+				taps[k] = cutoff * sinc * glm::max(w, 0.0);
+				sum += taps[k];
+			}
+
+			float* out = &tables[(band * PHASES + p) * TAPS * 2];
+			for(size_t k = 0; k < TAPS; k++)
+			{
+				// Normalized so DC gain is exactly 1
+				out[k * 2 + 0] = (float)(taps[k] / sum);
+				out[k * 2 + 1] = (float)(taps[k] / sum);
+			}
+		}
+	}
+}
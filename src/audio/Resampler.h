@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class SampleSource;
+
+// Per-source resampler state, tiny so every AudioSource can have one
+struct ResamplerState
+{
+	static constexpr size_t TAPS = 16;
+
+	// Last TAPS stereo frames read from the source
+	float history[TAPS * 2];
+	// Fractional position in the input
+	double phase;
+
+	void reset();
+
+	ResamplerState() { reset(); }
+};
+
+// Windowed sinc polyphase resampler shared by all audio sources. It's used when
+// pitch != 1 (all clips and streams are already at the engine sample rate).
+// The filter tables and the scratch buffer are shared, sources only store a ResamplerState.
+// There is a table for each band (pitch <= 1, <= 2, <= MAX_PITCH) with lowered cutoff
+// so pitching up doesn't alias too badly.
+// Only used from the audio thread!
+class Resampler
+{
+private:
+
+	static constexpr size_t PHASES = 256;
+	static constexpr size_t BANDS = 3;
+
+	// [band][phase][tap * 2] (taps are duplicated for stereo)
+	std::vector<float> tables;
+	// Where the history and new frames are put together
+	std::vector<float> scratch;
+
+	const float* get_taps(size_t band, size_t phase) const;
+
+public:
+
+	static constexpr float MAX_PITCH = 4.0f;
+	static constexpr float MIN_PITCH = 1.0f / 64.0f;
+
+	// Pulls frames from src (which advances cur_frame as usual) and writes count resampled
+	// stereo frames to target. Returns false if the source finished.
+	bool process(ResamplerState& st, SampleSource* src, uint32_t& cur_frame, bool loop,
+			  float pitch, uint32_t sample_rate, float* target, uint32_t count);
+
+	size_t get_memory_usage() const;
+
+	// max_frames is the maximum count that will be requested on process
+	explicit Resampler(size_t max_frames);
+};
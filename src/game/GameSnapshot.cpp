@@ -0,0 +1,232 @@
+#include "GameSnapshot.h"
+#include "GameState.h"
+#include <OSP.h>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+
+void GameSnapshot::write(const GameState& state, BakedWriter& w)
+{
+	const Universe& universe = state.universe;
+	const PlanetarySystem& system = universe.system;
+
+	w.write_u32(MAGIC);
+	w.write_u32(VERSION);
+
+	// The system is loaded again from its definition, and then the states are overwritten
+	auto system_toml = cpptoml::make_table();
+	system_toml->insert("t", system.t0);
+	auto elements = cpptoml::make_table_array();
+	for(const SystemElement* elem : system.elements)
+	{
+		logger->check(elem->source_toml != nullptr, "Cannot save element '{}' without source", elem->name);
+		elements->push_back(elem->source_toml->clone()->as_table());
+	}
+	system_toml->insert("element", elements);
+	if(!BakedCache::write_toml(w, *system_toml))
+	{
+		logger->fatal("The planetary system has values that can't be saved");
+	}
+
+	w.write_f64(system.t);
+	w.write_f64(system.bt);
+	w.write_u64(system.states_now.size());
+	for(size_t i = 0; i < system.states_now.size(); i++)
+	{
+		w.write_pod(system.states_now[i]);
+		w.write_pod(system.bullet_states[i]);
+	}
+
+	w.write_pod(universe.uid);
+	w.write_u32((uint32_t)universe.entities.size());
+	for(Entity* ent : universe.entities)
+	{
+		w.write_pod(ent->get_uid());
+		w.write_string(ent->get_type());
+		size_t block = w.begin_block();
+		ent->write_snapshot(w);
+		w.end_block(block);
+	}
+
+	w.write_u32(END);
+}
+
+bool GameSnapshot::load(GameState& state, const uint8_t* data, size_t size)
+{
+	BakedReader r = BakedReader(data, size);
+	uint32_t magic = r.read_u32();
+	uint32_t version = r.read_u32();
+	if(r.failed || magic != MAGIC || version != VERSION)
+	{
+		return false;
+	}
+
+	Universe& universe = state.universe;
+	PlanetarySystem& system = universe.system;
+
+	auto system_toml = BakedCache::read_toml(r);
+	logger->check(system_toml != nullptr, "Malformed snapshot, invalid system");
+
+	system.load(*system_toml);
+	logger->info("Starting at: {}", Date(system.t0).to_string());
+	system.init(universe.bt_world);
+	system.update(0.0, universe.bt_world, false);
+
+	system.t = r.read_f64();
+	system.bt = r.read_f64();
+	uint64_t count = r.read_u64();
+	logger->check(!r.failed && count == system.states_now.size(),
+		"Malformed snapshot, saved {} states for {} elements", count, system.states_now.size());
+	for(size_t i = 0; i < count; i++)
+	{
+		system.states_now[i] = r.read_pod<CartesianState>();
+		system.bullet_states[i] = r.read_pod<CartesianState>();
+	}
+
+	// Places the colliders at the loaded states
+	system.update(0.0, universe.bt_world, true);
+
+	int64_t last_uid = r.read_pod<int64_t>();
+	uint32_t ent_count = r.read_u32();
+	std::vector<std::pair<Entity*, int64_t>> loaded;
+	for(uint32_t i = 0; i < ent_count && !r.failed; i++)
+	{
+		int64_t id = r.read_pod<int64_t>();
+		std::string type = r.read_string();
+		BakedReader ent_r = r.read_block();
+		if(r.failed)
+		{
+			break;
+		}
+
+		if(id > last_uid || id <= 0)
+		{
+			logger->fatal("Invalid UID {} in snapshot", id);
+		}
+
+		Entity* n_ent = Entity::load_entity(type, ent_r);
+		logger->check(!ent_r.failed && ent_r.at_end(), "Malformed snapshot, invalid entity {} ({})", id, type);
+		loaded.emplace_back(n_ent, id);
+	}
+
+	logger->check(!r.failed && r.read_u32() == END && r.at_end(), "Malformed snapshot, truncated");
+
+	state.add_loaded_entities(loaded, last_uid);
+
+	return true;
+}
+
+void SnapshotWriter::write_file(const std::string& path, const std::vector<uint8_t>& bytes)
+{
+	std::error_code ec;
+	std::filesystem::path fpath = std::filesystem::path(path);
+	if(fpath.has_parent_path())
+	{
+		std::filesystem::create_directories(fpath.parent_path(), ec);
+	}
+
+	// Written to a temporary file and renamed, so a crash never leaves a broken save
+	std::string tmp_path = path + ".tmp";
+	{
+		std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+		for(size_t i = 0; i < bytes.size() && file; i += CHUNK_SIZE)
+		{
+			size_t len = std::min(CHUNK_SIZE, bytes.size() - i);
+			file.write((const char*)bytes.data() + i, (std::streamsize)len);
+		}
+
+		if(!file)
+		{
+			logger->warn("Could not write snapshot '{}'", path);
+			file.close();
+			std::filesystem::remove(tmp_path, ec);
+			return;
+		}
+	}
+
+	std::filesystem::rename(tmp_path, path, ec);
+	if(ec)
+	{
+		logger->warn("Could not write snapshot '{}' ({})", path, ec.message());
+		std::filesystem::remove(tmp_path, ec);
+	}
+}
+
+void SnapshotWriter::thread_func()
+{
+	while(true)
+	{
+		std::string path;
+		std::vector<uint8_t> bytes;
+
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock, [this]()
+			{
+				return !run || has_job;
+			});
+
+			// Pending jobs are still written before quitting, that's the last save
+			if(!has_job)
+			{
+				return;
+			}
+
+			path = std::move(job_path);
+			bytes = std::move(job_bytes);
+			has_job = false;
+			working = true;
+		}
+
+		write_file(path, bytes);
+
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			working = false;
+		}
+		cv.notify_all();
+	}
+}
+
+void SnapshotWriter::submit(const std::string& path, std::vector<uint8_t>&& bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if(has_job)
+		{
+			logger->info("Dropping outdated snapshot '{}'", job_path);
+		}
+		job_path = path;
+		job_bytes = std::move(bytes);
+		has_job = true;
+	}
+	cv.notify_all();
+}
+
+void SnapshotWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+	cv.wait(lock, [this]()
+	{
+		return !has_job && !working;
+	});
+}
+
+SnapshotWriter::SnapshotWriter()
+{
+	run = true;
+	has_job = false;
+	working = false;
+
+	thread = std::thread(&SnapshotWriter::thread_func, this);
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		run = false;
+	}
+	cv.notify_all();
+	thread.join();
+}
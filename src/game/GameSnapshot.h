@@ -0,0 +1,68 @@
+#pragma once
+#include <assets/BakedCache.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class GameState;
+
+// Binary saves of the whole game: the planetary system (its definition and current
+// states), and every entity with its full state (vehicles include their plumbing
+// contents and the state of their machines). Much faster to write and load than
+// the TOML saves, which are still available through GameState::write for debugging.
+//
+// Layout, in native endianness:
+//	- Header: MAGIC, VERSION
+//	- System: baked TOML {t, element = [...]}, t, bt, states_now and bullet_states
+//	- Entities: last uid, count, then id, type and a block written by Entity::write_snapshot
+//	- END
+class GameSnapshot
+{
+public:
+
+	static constexpr uint32_t MAGIC = 0x5350534F; // "OSPS"
+	// Bump if the format (or any write_snapshot) changes
+	static constexpr uint32_t VERSION = 1;
+	static constexpr uint32_t END = 0x444E45; // "END"
+
+	// Must be called from the main thread, while nothing is updating
+	static void write(const GameState& state, BakedWriter& w);
+	// Returns false if the data is not a snapshot (or an old version), nothing is loaded then.
+	// Once the header is valid, errors are fatal
+	static bool load(GameState& state, const uint8_t* data, size_t size);
+};
+
+// Writes snapshots to disk in a background thread, so saving only costs the
+// capture in the main thread. If a snapshot is submitted while another is waiting,
+// the old one is dropped, as it's already outdated.
+class SnapshotWriter
+{
+private:
+
+	// Bytes written per call, so huge saves don't hold the disk for too long
+	static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+	std::thread thread;
+	std::mutex mtx;
+	std::condition_variable cv;
+
+	bool run;
+	bool has_job;
+	bool working;
+	std::string job_path;
+	std::vector<uint8_t> job_bytes;
+
+	void thread_func();
+	static void write_file(const std::string& path, const std::vector<uint8_t>& bytes);
+
+public:
+
+	void submit(const std::string& path, std::vector<uint8_t>&& bytes);
+	// Blocks until everything submitted has been written
+	void flush();
+
+	SnapshotWriter();
+	~SnapshotWriter();
+};
@@ -3,6 +3,10 @@
 
 GameState::GameState() : universe()
 {
+	scene = nullptr;
+	to_delete = nullptr;
+	autosave_interval = osp->settings->get_qualified_as<double>("game.autosave_interval").value_or(0.0);
+	autosave_timer = 0.0;
 }
 
 void GameState::load(const cpptoml::table& from)
@@ -26,7 +30,7 @@ void GameState::load(const cpptoml::table& from)
 
 
 	auto entities = from.get_table_array("entity");
-	std::unordered_map<Entity*, int64_t> ent_to_id;
+	std::vector<std::pair<Entity*, int64_t>> loaded;
 
 	if (entities)
 	{
@@ -40,37 +44,93 @@ void GameState::load(const cpptoml::table& from)
 			std::string type = *entity->get_as<std::string>("type");
 
 			Entity* n_ent = Entity::load_entity(type, *entity);
-			universe.entities.push_back(n_ent);
-
-			ent_to_id[n_ent] = id;
+			loaded.emplace_back(n_ent, id);
 		}
 	}
 
+	add_loaded_entities(loaded, last_uid);
+
+	scene = nullptr;
+	to_delete = nullptr;
+
+}
+
+void GameState::add_loaded_entities(const std::vector<std::pair<Entity*, int64_t>>& loaded, int64_t last_uid)
+{
 	// Init the universe entities (We have added them through special
 	// code)
-
-	// Init the hashtable
-	for(Entity* ent : universe.entities)
+	for(const auto& pair : loaded)
 	{
-		universe.entities_by_id[ent_to_id[ent]] = ent;
+		universe.entities.push_back(pair.first);
+		universe.entities_by_id[pair.second] = pair.first;
 	}
 
 	// Init the entities
-	for(Entity* ent : universe.entities)
+	for(const auto& pair : loaded)
 	{
-		ent->setup(&universe, ent_to_id[ent]);
+		pair.first->setup(&universe, pair.second);
 	}
 
 	universe.uid = last_uid;
+}
 
-	scene = nullptr;
-	to_delete = nullptr;
+void GameState::write(cpptoml::table& target) const
+{
+	const PlanetarySystem& system = universe.system;
+
+	// Elements are written as they are now, so the save starts at the current time
+	target.insert("t", system.t0 + system.t);
+	target.insert("uid", universe.uid);
 
+	auto elements = cpptoml::make_table_array();
+	for(size_t i = 0; i < system.elements.size(); i++)
+	{
+		const SystemElement* elem = system.elements[i];
+		logger->check(elem->source_toml != nullptr, "Cannot save element '{}' without source", elem->name);
+		auto elem_toml = elem->source_toml->clone()->as_table();
+		if(i < system.states_now.size())
+		{
+			serialize_to_table(system.states_now[i].pos, *elem_toml, "position");
+			serialize_to_table(system.states_now[i].vel, *elem_toml, "velocity");
+		}
+		elements->push_back(elem_toml);
+	}
+	target.insert("element", elements);
+
+	auto entities = cpptoml::make_table_array();
+	for(Entity* ent : universe.entities)
+	{
+		auto ent_toml = cpptoml::make_table();
+		ent_toml->insert("id", ent->get_uid());
+		ent_toml->insert("type", ent->get_type());
+		ent->write_toml(*ent_toml);
+		entities->push_back(ent_toml);
+	}
+	target.insert("entity", entities);
 }
 
-void GameState::write(cpptoml::table& target) const
+bool GameState::load_snapshot(const std::string& path)
 {
+	MappedFile file = MappedFile(path);
+	if(!file.is_valid())
+	{
+		return false;
+	}
+
+	if(!GameSnapshot::load(*this, file.data(), file.size()))
+	{
+		logger->warn("'{}' is not a valid snapshot", path);
+		return false;
+	}
 
+	return true;
+}
+
+void GameState::save_snapshot(const std::string& path)
+{
+	BakedWriter w;
+	GameSnapshot::write(*this, w);
+	snapshot_writer.submit(path, std::move(w.bytes));
 }
 
 void GameState::update()
@@ -81,7 +141,19 @@ void GameState::update()
 		to_delete = nullptr;
 	}
 	
+	replay_recorder.begin_frame(osp->dt);
 	universe.update(osp->dt);
+	replay_recorder.end_frame();
+
+	if(autosave_interval > 0.0)
+	{
+		autosave_timer += osp->dt;
+		if(autosave_timer >= autosave_interval)
+		{
+			autosave_timer = 0.0;
+			save_snapshot("udata/saves/autosave.osps");
+		}
+	}
 	
 	if(scene)
 	{
@@ -3,6 +3,8 @@
 #include <util/SerializeUtil.h>
 #include "universe/Date.h"
 #include "scenes/Scene.h"
+#include "GameSnapshot.h"
+#include "Replay.h"
 
 class OSP;
 
@@ -16,9 +18,27 @@ public:
 
 	Universe universe;
 
+	// Snapshots are written in the background, see GameSnapshot
+	SnapshotWriter snapshot_writer;
+	// Seconds between autosaves (game.autosave_interval), 0 disables them
+	double autosave_interval;
+	double autosave_timer;
+
+	// Only records if started (see game.record_replay)
+	ReplayRecorder replay_recorder;
+
 	void load(const cpptoml::table& from);
+	// TOML version of the save, slower than snapshots but readable for debugging
 	void write(cpptoml::table& target) const;
 
+	// Returns false if there's no valid snapshot in path
+	bool load_snapshot(const std::string& path);
+	// Captures the state now, and writes it in the background
+	void save_snapshot(const std::string& path);
+
+	// Adds entities (with their ids) created while loading
+	void add_loaded_entities(const std::vector<std::pair<Entity*, int64_t>>& loaded, int64_t last_uid);
+
 	void update();
 
 	void render();
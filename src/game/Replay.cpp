@@ -0,0 +1,467 @@
+#include "Replay.h"
+#include "GameState.h"
+#include "GameSnapshot.h"
+#include <OSP.h>
+#include <game/scenes/flight/InputContext.h>
+#include <universe/entity/entities/VehicleEntity.h>
+#include <universe/vehicle/Vehicle.h>
+#include <util/LuaUtil.h>
+#include <filesystem>
+#include <limits>
+
+void ReplayRecorder::thread_func()
+{
+	while(true)
+	{
+		std::vector<std::vector<uint8_t>> chunks;
+
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock, [this]()
+			{
+				return !run || !pending.empty();
+			});
+
+			// Pending chunks are still written before quitting
+			if(pending.empty())
+			{
+				return;
+			}
+
+			chunks = std::move(pending);
+			pending.clear();
+		}
+
+		for(const auto& chunk : chunks)
+		{
+			file.write((const char*)chunk.data(), (std::streamsize)chunk.size());
+		}
+		file.flush();
+	}
+}
+
+void ReplayRecorder::submit()
+{
+	if(w.bytes.empty())
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		pending.push_back(std::move(w.bytes));
+	}
+	w.bytes.clear();
+	cv.notify_all();
+}
+
+uint16_t ReplayRecorder::get_name(const std::string& name)
+{
+	auto it = names.find(name);
+	if(it != names.end())
+	{
+		return it->second;
+	}
+
+	logger->check(names.size() < std::numeric_limits<uint16_t>::max(), "Too many input names in replay");
+	uint16_t id = (uint16_t)names.size();
+	names[name] = id;
+	last_values.push_back(std::numeric_limits<double>::quiet_NaN());
+
+	w.write_pod<uint8_t>(ReplayLog::NAME);
+	w.write_pod<uint16_t>(id);
+	w.write_string(name);
+
+	return id;
+}
+
+void ReplayRecorder::write_value(ReplayLog::RecordType type, const std::string& name, double value)
+{
+	uint16_t id = get_name(name);
+	// NaN never compares equal, so new names are always written
+	if(last_values[id] == value)
+	{
+		return;
+	}
+	last_values[id] = value;
+
+	w.write_pod<uint8_t>(type);
+	w.write_pod<uint16_t>(id);
+	if(type == ReplayLog::AXIS)
+	{
+		w.write_f64(value);
+	}
+	else
+	{
+		w.write_pod<uint8_t>(value != 0.0 ? 1 : 0);
+	}
+}
+
+void ReplayRecorder::on_new_entity(EventArguments& args, const void* self)
+{
+	auto* self_r = (ReplayRecorder*)self;
+	int64_t id = std::get<int64_t>(args[0]);
+	Entity* ent = self_r->universe->get_entity(id);
+
+	self_r->w.write_pod<uint8_t>(ReplayLog::NEW_ENTITY);
+	self_r->w.write_pod<int64_t>(id);
+	self_r->w.write_string(ent ? ent->get_type() : "");
+}
+
+void ReplayRecorder::on_remove_entity(EventArguments& args, const void* self)
+{
+	auto* self_r = (ReplayRecorder*)self;
+	self_r->w.write_pod<uint8_t>(ReplayLog::REMOVE_ENTITY);
+	self_r->w.write_pod<int64_t>(std::get<int64_t>(args[0]));
+}
+
+bool ReplayRecorder::start(const std::string& path, GameState& state)
+{
+	if(recording)
+	{
+		stop();
+	}
+
+	std::error_code ec;
+	std::filesystem::path fpath = std::filesystem::path(path);
+	if(fpath.has_parent_path())
+	{
+		std::filesystem::create_directories(fpath.parent_path(), ec);
+	}
+
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if(!file)
+	{
+		logger->warn("Could not open replay '{}' for writing", path);
+		return false;
+	}
+
+	universe = &state.universe;
+	names.clear();
+	last_values.clear();
+	last_timewarp = universe->timewarp.get_requested_level();
+	frame_count = 0;
+
+	w.write_u32(ReplayLog::MAGIC);
+	w.write_u32(ReplayLog::VERSION);
+	size_t block = w.begin_block();
+	GameSnapshot::write(state, w);
+	w.end_block(block);
+
+	universe->sign_up_for_event("core:new_entity", EventHandler(&ReplayRecorder::on_new_entity, this));
+	universe->sign_up_for_event("core:remove_entity", EventHandler(&ReplayRecorder::on_remove_entity, this));
+
+	run = true;
+	thread = std::thread(&ReplayRecorder::thread_func, this);
+	submit();
+
+	recording = true;
+	logger->info("Recording replay to '{}'", path);
+	return true;
+}
+
+void ReplayRecorder::stop()
+{
+	if(!recording)
+	{
+		return;
+	}
+
+	universe->drop_out_of_event("core:new_entity", EventHandler(&ReplayRecorder::on_new_entity, this));
+	universe->drop_out_of_event("core:remove_entity", EventHandler(&ReplayRecorder::on_remove_entity, this));
+
+	w.write_pod<uint8_t>(ReplayLog::END);
+	submit();
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		run = false;
+	}
+	cv.notify_all();
+	thread.join();
+	file.close();
+
+	recording = false;
+	ctx = nullptr;
+	logger->info("Recorded {} replay frames", frame_count);
+}
+
+void ReplayRecorder::set_input(InputContext* n_ctx, int64_t entity, int64_t part, const std::string& machine)
+{
+	ctx = n_ctx;
+	if(!recording)
+	{
+		return;
+	}
+
+	w.write_pod<uint8_t>(ReplayLog::CONTROL);
+	w.write_pod<int64_t>(entity);
+	w.write_pod<int64_t>(part);
+	w.write_string(machine);
+
+	// The new context starts from scratch in the replay
+	for(double& v : last_values)
+	{
+		v = std::numeric_limits<double>::quiet_NaN();
+	}
+}
+
+void ReplayRecorder::begin_frame(double dt)
+{
+	if(!recording)
+	{
+		return;
+	}
+
+	w.write_pod<uint8_t>(ReplayLog::FRAME);
+	w.write_f64(dt);
+
+	size_t timewarp = universe->timewarp.get_requested_level();
+	if(timewarp != last_timewarp)
+	{
+		w.write_pod<uint8_t>(ReplayLog::TIMEWARP);
+		w.write_u32((uint32_t)timewarp);
+		last_timewarp = timewarp;
+	}
+
+	// This is the input the universe will see this frame, the scene reads it after
+	if(ctx)
+	{
+		for(const auto& pair : ctx->get_axes())
+		{
+			write_value(ReplayLog::AXIS, pair.first, pair.second);
+		}
+		for(const auto& pair : ctx->get_actions())
+		{
+			write_value(ReplayLog::ACTION, pair.first, pair.second ? 1.0 : 0.0);
+		}
+	}
+
+	frame_start = std::chrono::high_resolution_clock::now();
+}
+
+void ReplayRecorder::end_frame()
+{
+	if(!recording)
+	{
+		return;
+	}
+
+	auto now = std::chrono::high_resolution_clock::now();
+	w.write_pod<uint8_t>(ReplayLog::FRAME_END);
+	w.write_f64(std::chrono::duration<double>(now - frame_start).count());
+	frame_count++;
+
+	if(w.bytes.size() >= FLUSH_SIZE)
+	{
+		submit();
+	}
+}
+
+ReplayRecorder::ReplayRecorder()
+{
+	recording = false;
+	universe = nullptr;
+	ctx = nullptr;
+	last_timewarp = 0;
+	frame_count = 0;
+	run = false;
+}
+
+ReplayRecorder::~ReplayRecorder()
+{
+	stop();
+}
+
+InputContext* ReplayPlayer::find_context(int64_t entity, int64_t part, const std::string& machine)
+{
+	auto* ent = state->universe.get_entity_as<VehicleEntity>(entity);
+	if(ent == nullptr)
+	{
+		logger->warn("Replay controls entity {}, which is not a vehicle", entity);
+		return nullptr;
+	}
+
+	for(Part* p : ent->vehicle->parts)
+	{
+		if(p->id != part)
+		{
+			continue;
+		}
+
+		Machine* m = p->get_machine(machine);
+		auto result = LuaUtil::call_function_if_present(m->env["get_input_context"]);
+		if(result.has_value() && result->valid())
+		{
+			return result->get<InputContext*>();
+		}
+	}
+
+	logger->warn("Could not find the input context of machine '{}' (part {}) in entity {}", machine, part, entity);
+	return nullptr;
+}
+
+void ReplayPlayer::on_new_entity(EventArguments& args, const void* self)
+{
+	auto* self_p = (ReplayPlayer*)self;
+	int64_t id = std::get<int64_t>(args[0]);
+	Entity* ent = self_p->state->universe.get_entity(id);
+	self_p->events.emplace_back(id, ent ? ent->get_type() : "");
+}
+
+void ReplayPlayer::on_remove_entity(EventArguments& args, const void* self)
+{
+	auto* self_p = (ReplayPlayer*)self;
+	self_p->events.emplace_back(std::get<int64_t>(args[0]), "");
+}
+
+bool ReplayPlayer::load(const std::string& path, GameState& n_state)
+{
+	file = std::make_unique<MappedFile>(path);
+	if(!file->is_valid())
+	{
+		logger->warn("Could not open replay '{}'", path);
+		return false;
+	}
+
+	r = BakedReader(file->data(), file->size());
+	uint32_t magic = r.read_u32();
+	uint32_t version = r.read_u32();
+	if(r.failed || magic != ReplayLog::MAGIC || version != ReplayLog::VERSION)
+	{
+		logger->warn("'{}' is not a valid replay", path);
+		return false;
+	}
+
+	BakedReader snapshot = r.read_block();
+	size_t snapshot_size = snapshot.remaining();
+	if(r.failed || !GameSnapshot::load(n_state, snapshot.read(snapshot_size), snapshot_size))
+	{
+		logger->warn("Replay '{}' has an invalid snapshot", path);
+		return false;
+	}
+
+	state = &n_state;
+	state->universe.sign_up_for_event("core:new_entity", EventHandler(&ReplayPlayer::on_new_entity, this));
+	state->universe.sign_up_for_event("core:remove_entity", EventHandler(&ReplayPlayer::on_remove_entity, this));
+
+	return true;
+}
+
+bool ReplayPlayer::step()
+{
+	if(state == nullptr)
+	{
+		return false;
+	}
+
+	double dt = 0.0;
+	expected_events.clear();
+
+	while(true)
+	{
+		auto type = (ReplayLog::RecordType)r.read_pod<uint8_t>();
+		if(r.failed || type == ReplayLog::END)
+		{
+			return false;
+		}
+
+		if(type == ReplayLog::NAME)
+		{
+			uint16_t id = r.read_pod<uint16_t>();
+			if(id >= names.size())
+			{
+				names.resize(id + 1);
+			}
+			names[id] = r.read_string();
+		}
+		else if(type == ReplayLog::CONTROL)
+		{
+			int64_t entity = r.read_pod<int64_t>();
+			int64_t part = r.read_pod<int64_t>();
+			std::string machine = r.read_string();
+			ctx = find_context(entity, part, machine);
+			axes.clear();
+			actions.clear();
+		}
+		else if(type == ReplayLog::FRAME)
+		{
+			dt = r.read_f64();
+		}
+		else if(type == ReplayLog::AXIS || type == ReplayLog::ACTION)
+		{
+			uint16_t id = r.read_pod<uint16_t>();
+			logger->check(id < names.size(), "Malformed replay, unknown input name {}", id);
+			if(type == ReplayLog::AXIS)
+			{
+				axes[names[id]] = r.read_f64();
+			}
+			else
+			{
+				actions[names[id]] = r.read_pod<uint8_t>() != 0;
+			}
+		}
+		else if(type == ReplayLog::TIMEWARP)
+		{
+			state->universe.timewarp.set_level(r.read_u32());
+		}
+		else if(type == ReplayLog::NEW_ENTITY)
+		{
+			int64_t id = r.read_pod<int64_t>();
+			expected_events.emplace_back(id, r.read_string());
+		}
+		else if(type == ReplayLog::REMOVE_ENTITY)
+		{
+			expected_events.emplace_back(r.read_pod<int64_t>(), "");
+		}
+		else if(type == ReplayLog::FRAME_END)
+		{
+			recorded_time = r.read_f64();
+			break;
+		}
+		else
+		{
+			logger->fatal("Malformed replay, unknown record {}", (int)type);
+		}
+	}
+
+	if(ctx)
+	{
+		ctx->feed(axes, actions);
+	}
+
+	events.clear();
+	auto t0 = std::chrono::high_resolution_clock::now();
+	state->universe.update(dt);
+	auto t1 = std::chrono::high_resolution_clock::now();
+	last_time = std::chrono::duration<double>(t1 - t0).count();
+
+	if(events != expected_events)
+	{
+		logger->warn("Replay diverged on frame {}: {} entity events, {} recorded", frame,
+			events.size(), expected_events.size());
+		divergences++;
+	}
+	frame++;
+
+	return true;
+}
+
+ReplayPlayer::ReplayPlayer() : r(nullptr, 0)
+{
+	state = nullptr;
+	ctx = nullptr;
+	frame = 0;
+	last_time = 0.0;
+	recorded_time = 0.0;
+	divergences = 0;
+}
+
+ReplayPlayer::~ReplayPlayer()
+{
+	if(state)
+	{
+		state->universe.drop_out_of_event("core:new_entity", EventHandler(&ReplayPlayer::on_new_entity, this));
+		state->universe.drop_out_of_event("core:remove_entity", EventHandler(&ReplayPlayer::on_remove_entity, this));
+	}
+}
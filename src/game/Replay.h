@@ -0,0 +1,173 @@
+#pragma once
+#include <assets/BakedCache.h>
+#include <universe/Events.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <fstream>
+
+class GameState;
+class Universe;
+class InputContext;
+
+// Replays record a flight session so it can be run again (headless) to profile frame
+// time spikes offline. The log starts with a snapshot of the game, and then stores, for
+// every frame, the delta-time, the changes to the controlled InputContext and time warp
+// and the entities created or removed while it ran.
+//
+// Layout, in native endianness:
+//	- Header: MAGIC, VERSION, and a block with the GameSnapshot
+//	- Records: a RecordType (u8) followed by its data:
+//		NAME: u16 id, string (input names are only written once)
+//		CONTROL: i64 entity, i64 part, string machine (whose get_input_context is used)
+//		FRAME: f64 dt, starts a frame
+//		AXIS: u16 name, f64 value (only if it changed)
+//		ACTION: u16 name, u8 value (only if it changed)
+//		TIMEWARP: u32 requested level (only if it changed)
+//		NEW_ENTITY: i64 id, string type
+//		REMOVE_ENTITY: i64 id
+//		FRAME_END: f64 seconds Universe::update took while recording
+//		END
+//
+// Replays are only as deterministic as the simulation: machines updated in parallel or
+// anything the scene does apart from input and time warp will make them diverge. The
+// player reports entity events which don't match the recording.
+class ReplayLog
+{
+public:
+
+	static constexpr uint32_t MAGIC = 0x5250534F; // "OSPR"
+	// Bump if the format (or GameSnapshot::VERSION) changes
+	static constexpr uint32_t VERSION = 1;
+
+	enum RecordType : uint8_t
+	{
+		NAME,
+		CONTROL,
+		FRAME,
+		AXIS,
+		ACTION,
+		TIMEWARP,
+		NEW_ENTITY,
+		REMOVE_ENTITY,
+		FRAME_END,
+		END
+	};
+};
+
+// Records a replay while playing. Records are written to a memory buffer, which is
+// handed to a background thread to be appended to the file once big enough, so the
+// cost per frame is a few comparisons and copies.
+class ReplayRecorder
+{
+private:
+
+	// Bytes buffered before they are sent to the writer thread
+	static constexpr size_t FLUSH_SIZE = 64 * 1024;
+
+	bool recording;
+	Universe* universe;
+	InputContext* ctx;
+
+	BakedWriter w;
+	std::unordered_map<std::string, uint16_t> names;
+	// Last value written for each name, NaN if it must be written again
+	std::vector<double> last_values;
+	size_t last_timewarp;
+
+	std::chrono::high_resolution_clock::time_point frame_start;
+	size_t frame_count;
+
+	std::ofstream file;
+	std::thread thread;
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool run;
+	std::vector<std::vector<uint8_t>> pending;
+
+	void thread_func();
+	void submit();
+
+	uint16_t get_name(const std::string& name);
+	void write_value(ReplayLog::RecordType type, const std::string& name, double value);
+
+	static void on_new_entity(EventArguments& args, const void* self);
+	static void on_remove_entity(EventArguments& args, const void* self);
+
+public:
+
+	// Captures a snapshot of state (so call it while nothing is updating) and starts
+	// recording every frame into path. Returns false if the file can't be written
+	bool start(const std::string& path, GameState& state);
+	// Writes everything pending, called on destruction too
+	void stop();
+
+	// The context being read for controls, the replay finds it again by calling the
+	// machine's get_input_context
+	void set_input(InputContext* ctx, int64_t entity, int64_t part, const std::string& machine);
+
+	// Call around Universe::update
+	void begin_frame(double dt);
+	void end_frame();
+
+	bool is_recording() const { return recording; }
+	size_t get_frame_count() const { return frame_count; }
+
+	ReplayRecorder();
+	~ReplayRecorder();
+};
+
+// Runs a replay on a game state, without any scene, renderer or input reading.
+class ReplayPlayer
+{
+private:
+
+	std::unique_ptr<MappedFile> file;
+	BakedReader r;
+
+	GameState* state;
+	InputContext* ctx;
+
+	std::vector<std::string> names;
+	std::unordered_map<std::string, double> axes;
+	std::unordered_map<std::string, bool> actions;
+
+	// (id, type) of the entities created (or removed, with an empty type) in the frame
+	std::vector<std::pair<int64_t, std::string>> expected_events;
+	std::vector<std::pair<int64_t, std::string>> events;
+
+	size_t frame;
+	double last_time;
+	double recorded_time;
+	size_t divergences;
+
+	InputContext* find_context(int64_t entity, int64_t part, const std::string& machine);
+
+	static void on_new_entity(EventArguments& args, const void* self);
+	static void on_remove_entity(EventArguments& args, const void* self);
+
+public:
+
+	// Loads the snapshot into state, returns false if path is not a valid replay
+	bool load(const std::string& path, GameState& state);
+
+	// Feeds the recorded input and runs Universe::update for the next frame.
+	// Returns false once the replay is over
+	bool step();
+
+	// Frames stepped so far
+	size_t get_frame() const { return frame; }
+	// Seconds Universe::update took in the last frame, now and while recording
+	double get_last_time() const { return last_time; }
+	double get_recorded_time() const { return recorded_time; }
+	// Frames whose entity events didn't match the recording
+	size_t get_divergences() const { return divergences; }
+
+	ReplayPlayer();
+	~ReplayPlayer();
+};
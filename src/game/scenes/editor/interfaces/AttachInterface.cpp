@@ -547,6 +547,7 @@ void AttachInterface::reroot(Piece* current, Piece* new_root)
 			// Copy link stuff from next and invert link
 			(*it)->attached_to = (*next);
 			(*it)->link = std::move((*next)->link);
+			(*it)->link_type = (*next)->link_type;
 			// Note the inversion here, very important
 			(*it)->to_attachment = (*next)->from_attachment;
 			(*it)->from_attachment = (*next)->to_attachment;
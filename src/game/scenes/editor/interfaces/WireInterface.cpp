@@ -427,6 +427,7 @@ bool WireInterface::do_machine(NVGcontext* vg, GUIInput* gui_input, Machine* m,
 								break;
 							}
 						}
+						edveh->veh->wire_index.invalidate();
 
 					}
 				}
@@ -438,6 +439,7 @@ bool WireInterface::do_machine(NVGcontext* vg, GUIInput* gui_input, Machine* m,
 					{
 						edveh->veh->wires.insert(std::make_pair(selected, m));
 						edveh->veh->wires.insert(std::make_pair(m, selected));
+						edveh->veh->wire_index.invalidate();
 					}
 					else
 					{
@@ -16,6 +16,7 @@ void FlightScene::load()
 
 	game_state = osp->game_state;
 	universe = &game_state->universe;
+	drawn_generation = 0;
 	
 	debug_drawer->debug_enabled = true;
 
@@ -53,7 +54,8 @@ void FlightScene::load()
 	SerializeUtil::read_file_to("udata/vehicles/debug.toml", *n_vehicle);
 	n_vehicle->sort();
 
-	osp->game_state->universe.create_entity<VehicleEntity>(n_vehicle);
+	auto* n_vehicle_ent = osp->game_state->universe.create_entity<VehicleEntity>(n_vehicle);
+	n_vehicle_ent->physics_loader = true;
 
 	WorldState st = WorldState();
 	auto* lpad_ent = (BuildingEntity*)osp->game_state->universe.entities[0];
@@ -76,6 +78,13 @@ void FlightScene::load()
 		input.set_ctx(result->get<InputContext*>());		
 	}
 
+	std::string replay_path = osp->settings->get_qualified_as<std::string>("game.record_replay").value_or("");
+	if(!replay_path.empty() && game_state->replay_recorder.start(replay_path, *game_state))
+	{
+		InputContext* ctx = result.has_value() && result->valid() ? result->get<InputContext*>() : nullptr;
+		game_state->replay_recorder.set_input(ctx, n_vehicle_ent->get_uid(), capsule->in_part->id, "capsule");
+	}
+
 	Renderer* r = osp->renderer;
 	r->add_drawable(&sky);
 	r->set_ibl_source(nullptr);
@@ -113,6 +122,32 @@ void FlightScene::update()
 	VehicleEntity* v_ent =  universe->get_entity_as<VehicleEntity>(2);	
 	camera.center = v_ent->vehicle->unpacked_veh.get_center_of_mass(true);
 	v_ent->debug.show_imgui();
+	update_prediction(v_ent->vehicle);
+
+	if(!input.keyboard_blocked)
+	{
+		if(osp->input->key_down(GLFW_KEY_PERIOD))
+		{
+			universe->timewarp.increase();
+		}
+		if(osp->input->key_down(GLFW_KEY_COMMA))
+		{
+			universe->timewarp.decrease();
+		}
+	}
+
+	ImGui::Begin("Time warp");
+	universe->timewarp.do_imgui();
+	ImGui::End();
+
+	ImGui::Begin("Renderer");
+	osp->renderer->do_culling_imgui();
+	osp->renderer->scheduler.do_imgui();
+	ImGui::End();
+
+	ImGui::Begin("Audio");
+	osp->audio_engine->do_imgui();
+	ImGui::End();
 
 	if(!gui_input.mouse_blocked)
 	{
@@ -121,6 +156,42 @@ void FlightScene::update()
 
 }
 
+void FlightScene::update_prediction(Vehicle* vehicle)
+{
+	PlanetarySystem& system = universe->system;
+	if(system.bullet_states.empty())
+	{
+		return;
+	}
+
+	CartesianState vessel;
+	vessel.pos = to_dvec3(vehicle->root->get_global_transform().getOrigin());
+	vessel.vel = to_dvec3(vehicle->root->get_linear_velocity());
+	vessel.mass = 0.0;
+
+	std::vector<double> radii(system.elements.size());
+	std::vector<glm::dvec3> body_positions(system.elements.size());
+	for(size_t i = 0; i < system.elements.size(); i++)
+	{
+		radii[i] = system.elements[i]->config.radius;
+		body_positions[i] = system.bullet_states[i].pos;
+	}
+
+	// Only does work on the main thread when a prediction finishes
+	predictor.update(system.bt, vessel, system.bullet_states, radii, system.propagator, &system.ephemeris);
+
+	if(debug_drawer->debug_enabled)
+	{
+		// Patched polylines follow the bodies, so they only change with the prediction
+		if(predictor.get_flight_path_generation() != drawn_generation)
+		{
+			prediction_drawer.build(predictor.flight_path, PredictionDrawer::PATCHED);
+			drawn_generation = predictor.get_flight_path_generation();
+		}
+		prediction_drawer.draw_debug(glm::vec3(1.0, 0.6, 0.2), body_positions);
+	}
+}
+
 void FlightScene::render()
 {
 	osp->renderer->render(&osp->game_state->universe.system);
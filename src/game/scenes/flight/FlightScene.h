@@ -5,6 +5,8 @@
 #include "FlightInput.h"
 #include <renderer/lighting/SunLight.h>
 #include <renderer/util/Skybox.h>
+#include <universe/predictor/OrbitPredictor.h>
+#include <universe/predictor/PredictionDrawer.h>
 
 #include "gui/FlightGUI.h"
 
@@ -21,8 +23,15 @@ private:
 	Skybox sky;
 	SunLight sun;
 
+	// Of the controlled vehicle
+	OrbitPredictor predictor;
+	PredictionDrawer prediction_drawer;
+	// Flight path generation the drawer was built from
+	size_t drawn_generation;
+
 	void do_gui();
 	void prepare_gui();
+	void update_prediction(Vehicle* vehicle);
 
 public:
 
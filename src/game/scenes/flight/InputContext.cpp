@@ -311,6 +311,25 @@ void InputContext::update(GLFWwindow* window, double dt)
 
 }
 
+void InputContext::feed(const std::unordered_map<std::string, double>& n_axes, const std::unordered_map<std::string, bool>& n_actions)
+{
+	for(auto& pair : actions)
+	{
+		actions_previous[pair.first] = pair.second;
+		auto it = n_actions.find(pair.first);
+		pair.second = it != n_actions.end() && it->second;
+	}
+
+	for(auto& pair : axes)
+	{
+		auto it = n_axes.find(pair.first);
+		if(it != n_axes.end())
+		{
+			pair.second = it->second;
+		}
+	}
+}
+
 void InputContext::set_axis(const std::string& name, double value, double epsilon)
 {
 	if(value > 1.0 || value < -1.0)
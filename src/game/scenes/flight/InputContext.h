@@ -136,6 +136,12 @@ public:
 
 	// Reads all inputs, make sure you call it before everything that needs inputs
 	void update(GLFWwindow* window, double dt);
+	// Used by replays instead of update, sets the state as it was recorded.
+	// Names not in the context are ignored
+	void feed(const std::unordered_map<std::string, double>& n_axes, const std::unordered_map<std::string, bool>& n_actions);
+
+	const std::unordered_map<std::string, double>& get_axes() const { return axes; }
+	const std::unordered_map<std::string, bool>& get_actions() const { return actions; }
 
 	bool is_active(){ return input != nullptr; }
 
@@ -16,6 +16,7 @@
 #include "libs/LuaPlumbing.h"
 #include "libs/LuaGUI.h"
 #include "libs/LuaImGUI.h"
+#include "libs/LuaFFIGlm.h"
 
 
 LuaCore* lua_core;
@@ -130,6 +131,10 @@ LuaCore::LibraryID LuaCore::name_to_id(const std::string & name)
 	{
 		return LibraryID::IMGUI;
 	}
+	else if(name == "ffi_glm")
+	{
+		return LibraryID::FFI_GLM;
+	}
 	else
 	{
 		return LibraryID::UNKNOWN;
@@ -228,6 +233,7 @@ LuaCore::LuaCore()
 	libraries[LibraryID::PLUMBING] = new LuaPlumbing();
 	libraries[LibraryID::GUI] = new LuaGUI();
 	libraries[LibraryID::IMGUI] = new LuaImGUI();
+	libraries[LibraryID::FFI_GLM] = new LuaFFIGlm();
 }
 
 LuaCore::~LuaCore()
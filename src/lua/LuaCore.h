@@ -50,6 +50,7 @@ public:
 		PLUMBING,		// LuaPlumbing
 		GUI,			// LuaGUI
 		IMGUI,			// LuaImGUI
+		FFI_GLM,		// LuaFFIGlm
 		COUNT,
 	};
 
@@ -0,0 +1,62 @@
+#include "LuaGCPolicy.h"
+#include <chrono>
+
+void LuaGCPolicy::attach(sol::state& lua)
+{
+	lua_State* L = lua.lua_state();
+	if(config.mode == INCREMENTAL)
+	{
+		lua_gc(L, LUA_GCSETPAUSE, config.pause);
+		lua_gc(L, LUA_GCSETSTEPMUL, config.stepmul);
+	}
+	lua_gc(L, LUA_GCRESTART, 0);
+}
+
+void LuaGCPolicy::after_job(sol::state& lua)
+{
+	lua_State* L = lua.lua_state();
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	if(config.mode == FULL)
+	{
+		lua_gc(L, LUA_GCCOLLECT, 0);
+		full_collections++;
+	}
+	else
+	{
+		size_t mem = (size_t)lua_gc(L, LUA_GCCOUNT, 0);
+		if(mem > config.full_threshold_kb)
+		{
+			lua_gc(L, LUA_GCCOLLECT, 0);
+			full_collections++;
+		}
+		else
+		{
+			lua_gc(L, LUA_GCSTEP, config.step_kb);
+		}
+	}
+
+	auto t1 = std::chrono::high_resolution_clock::now();
+	gc_time.store(gc_time.load() + std::chrono::duration<double>(t1 - t0).count());
+	memory_kb.store((size_t)lua_gc(L, LUA_GCCOUNT, 0));
+	jobs++;
+}
+
+const char* LuaGCPolicy::get_mode_name(Mode mode)
+{
+	return mode == FULL ? "full" : "incremental";
+}
+
+LuaGCPolicy::Mode LuaGCPolicy::get_mode_from_name(const std::string& name)
+{
+	return name == "full" ? FULL : INCREMENTAL;
+}
+
+LuaGCPolicy::LuaGCPolicy(Config config)
+{
+	this->config = config;
+	gc_time = 0.0;
+	memory_kb = 0;
+	jobs = 0;
+	full_collections = 0;
+}
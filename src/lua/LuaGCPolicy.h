@@ -0,0 +1,65 @@
+#pragma once
+#include <sol/sol.hpp>
+#include <atomic>
+
+// Decides when the garbage collector of a lua state runs, for states that run
+// many short jobs in a row (planet tile generation). A full collection after every
+// job takes a good fraction of the job's own time, so by default we take small
+// incremental steps after each job, and only do a full cycle once memory goes
+// over a threshold. LuaJIT has no generational mode, so that's the best we can do.
+// Stats may be read from other threads.
+class LuaGCPolicy
+{
+public:
+
+	enum Mode
+	{
+		// Full collection after every job, the old behaviour
+		FULL,
+		// Automatic GC with tuned pause / stepmul, plus a step after every job
+		INCREMENTAL
+	};
+
+	struct Config
+	{
+		Mode mode = INCREMENTAL;
+		// Work done in the step after a job, in lua's KB units
+		int step_kb = 64;
+		// A full collection happens if we go over this
+		size_t full_threshold_kb = 32 * 1024;
+		// Automatic GC parameters (lua defaults are 200 / 200)
+		int pause = 150;
+		int stepmul = 200;
+	};
+
+private:
+
+	Config config;
+
+	std::atomic<double> gc_time;
+	std::atomic<size_t> memory_kb;
+	std::atomic<size_t> jobs;
+	std::atomic<size_t> full_collections;
+
+public:
+
+	// Applies the GC parameters to the state, call once before running jobs
+	void attach(sol::state& lua);
+	// Call after every job
+	void after_job(sol::state& lua);
+
+	const Config& get_config() const { return config; }
+	// Seconds spent collecting since creation
+	double get_gc_time() const { return gc_time.load(); }
+	// Memory used by the state after the last job
+	size_t get_memory_kb() const { return memory_kb.load(); }
+	size_t get_jobs() const { return jobs.load(); }
+	size_t get_full_collections() const { return full_collections.load(); }
+
+	static const char* get_mode_name(Mode mode);
+	// Returns INCREMENTAL for unknown names
+	static Mode get_mode_from_name(const std::string& name);
+
+	explicit LuaGCPolicy(Config config);
+	LuaGCPolicy() : LuaGCPolicy(Config()) {}
+};
@@ -0,0 +1,170 @@
+#include "LuaSerialize.h"
+#include <assets/BakedCache.h>
+#include <universe/vehicle/plumbing/StoredFluids.h>
+#include <util/Logger.h>
+
+enum LuaValueTag : uint32_t
+{
+	TAG_NIL,
+	TAG_BOOLEAN,
+	TAG_NUMBER,
+	TAG_STRING,
+	TAG_TABLE,
+	TAG_STORED_FLUIDS,
+	// Ends the key-value pairs of a table
+	TAG_TABLE_END
+};
+
+bool LuaSerialize::is_supported(const sol::object& obj)
+{
+	switch(obj.get_type())
+	{
+		case sol::type::lua_nil:
+		case sol::type::boolean:
+		case sol::type::number:
+		case sol::type::string:
+		case sol::type::table:
+			return true;
+		case sol::type::userdata:
+			return obj.is<StoredFluids>();
+		default:
+			return false;
+	}
+}
+
+bool LuaSerialize::write(BakedWriter& w, const sol::object& obj, int depth)
+{
+	if(depth > MAX_DEPTH)
+	{
+		logger->warn("Lua table too deep to serialize, maybe it has a cycle?");
+		w.write_u32(TAG_NIL);
+		return false;
+	}
+
+	switch(obj.get_type())
+	{
+		case sol::type::lua_nil:
+			w.write_u32(TAG_NIL);
+			return true;
+		case sol::type::boolean:
+			w.write_u32(TAG_BOOLEAN);
+			w.write_u32(obj.as<bool>() ? 1 : 0);
+			return true;
+		case sol::type::number:
+			w.write_u32(TAG_NUMBER);
+			w.write_f64(obj.as<double>());
+			return true;
+		case sol::type::string:
+			w.write_u32(TAG_STRING);
+			w.write_string(obj.as<std::string>());
+			return true;
+		case sol::type::table:
+		{
+			bool all = true;
+			w.write_u32(TAG_TABLE);
+			for(auto& pair : obj.as<sol::table>())
+			{
+				// Skipped as a whole, so tables keep their keys consistent
+				if(pair.first.get_type() == sol::type::table || !is_supported(pair.first) ||
+					!is_supported(pair.second))
+				{
+					all = false;
+					continue;
+				}
+				all &= write(w, pair.first, depth + 1);
+				all &= write(w, pair.second, depth + 1);
+			}
+			w.write_u32(TAG_TABLE_END);
+			return all;
+		}
+		default:
+			break;
+	}
+
+	if(obj.get_type() == sol::type::userdata && obj.is<StoredFluids>())
+	{
+		const StoredFluids& fluids = obj.as<const StoredFluids&>();
+		w.write_u32(TAG_STORED_FLUIDS);
+		w.write_pod(fluids.temperature);
+		w.write_u32((uint32_t)fluids.contents.size());
+		for(const auto& pair : fluids.contents)
+		{
+			w.write_string(pair.first->get_asset_id());
+			w.write_pod(pair.second.liquid_mass);
+			w.write_pod(pair.second.gas_mass);
+		}
+		return true;
+	}
+
+	w.write_u32(TAG_NIL);
+	return false;
+}
+
+void LuaSerialize::write_nil(BakedWriter& w)
+{
+	w.write_u32(TAG_NIL);
+}
+
+sol::object LuaSerialize::read(BakedReader& r, sol::state_view lua, int depth)
+{
+	if(depth > MAX_DEPTH)
+	{
+		r.failed = true;
+		return sol::make_object(lua, sol::lua_nil);
+	}
+
+	uint32_t tag = r.read_u32();
+	if(r.failed)
+	{
+		return sol::make_object(lua, sol::lua_nil);
+	}
+
+	switch(tag)
+	{
+		case TAG_NIL:
+			return sol::make_object(lua, sol::lua_nil);
+		case TAG_BOOLEAN:
+			return sol::make_object(lua, r.read_u32() != 0);
+		case TAG_NUMBER:
+			return sol::make_object(lua, r.read_f64());
+		case TAG_STRING:
+			return sol::make_object(lua, r.read_string());
+		case TAG_TABLE:
+		{
+			sol::table table = lua.create_table();
+			while(!r.failed)
+			{
+				sol::object key = read(r, lua, depth + 1);
+				if(key.get_type() == sol::type::lua_nil)
+				{
+					// Only TAG_TABLE_END may give a nil key
+					break;
+				}
+				table[key] = read(r, lua, depth + 1);
+			}
+			return table;
+		}
+		case TAG_TABLE_END:
+			return sol::make_object(lua, sol::lua_nil);
+		case TAG_STORED_FLUIDS:
+		{
+			StoredFluids fluids;
+			fluids.temperature = r.read_pod<float>();
+			uint32_t count = r.read_u32();
+			for(uint32_t i = 0; i < count && !r.failed; i++)
+			{
+				std::string mat = r.read_string();
+				float liquid = r.read_pod<float>();
+				float gas = r.read_pod<float>();
+				if(!r.failed)
+				{
+					fluids.add_fluid(AssetHandle<PhysicalMaterial>(mat), liquid, gas, fluids.temperature);
+				}
+			}
+			return sol::make_object(lua, std::move(fluids));
+		}
+		default:
+			r.failed = true;
+			return sol::make_object(lua, sol::lua_nil);
+	}
+}
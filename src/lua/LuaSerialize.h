@@ -0,0 +1,26 @@
+#pragma once
+#include <sol/sol.hpp>
+
+class BakedWriter;
+class BakedReader;
+
+// Stores lua values in baked payloads, used for the state of machines in game
+// snapshots. Supports nil, booleans, numbers, strings, tables and stored_fluids.
+// Tables are written by value, so they must not have cycles, and functions or
+// other userdata are skipped.
+class LuaSerialize
+{
+private:
+
+	static constexpr int MAX_DEPTH = 32;
+
+	static bool is_supported(const sol::object& obj);
+
+public:
+
+	// Returns false if something had to be skipped
+	static bool write(BakedWriter& w, const sol::object& obj, int depth = 0);
+	static void write_nil(BakedWriter& w);
+	// Returns nil if the data is not valid (and r.failed is set)
+	static sol::object read(BakedReader& r, sol::state_view lua, int depth = 0);
+};
@@ -8,6 +8,74 @@
 
 #include <glm/glm.hpp>
 #include "../../physics/glm/BulletGlmCompat.h"
+#include "LuaFFIGlm.h"
+
+// FFI versions of the hot rigidbody functions, they take ffi_glm types by pointer
+// so nothing is allocated. The body is the pointer returned by rigidbody:ffi_ptr()
+static void ffi_apply_force(btRigidBody* self, const glm::dvec3* force, const glm::dvec3* rel_pos)
+{
+	self->applyForce(to_btVector3(*force), to_btVector3(*rel_pos));
+}
+
+static void ffi_apply_central_force(btRigidBody* self, const glm::dvec3* force)
+{
+	self->applyCentralForce(to_btVector3(*force));
+}
+
+static void ffi_apply_torque(btRigidBody* self, const glm::dvec3* torque)
+{
+	self->applyTorque(to_btVector3(*torque));
+}
+
+static void ffi_apply_impulse(btRigidBody* self, const glm::dvec3* imp, const glm::dvec3* rel_pos)
+{
+	self->applyImpulse(to_btVector3(*imp), to_btVector3(*rel_pos));
+}
+
+static void ffi_apply_central_impulse(btRigidBody* self, const glm::dvec3* imp)
+{
+	self->applyCentralImpulse(to_btVector3(*imp));
+}
+
+static void ffi_apply_torque_impulse(btRigidBody* self, const glm::dvec3* torque)
+{
+	self->applyTorqueImpulse(to_btVector3(*torque));
+}
+
+static void ffi_set_linear_velocity(btRigidBody* self, const glm::dvec3* vel)
+{
+	self->setLinearVelocity(to_btVector3(*vel));
+}
+
+static void ffi_set_angular_velocity(btRigidBody* self, const glm::dvec3* vel)
+{
+	self->setAngularVelocity(to_btVector3(*vel));
+}
+
+static void ffi_get_linear_velocity(btRigidBody* self, glm::dvec3* out)
+{
+	*out = to_dvec3(self->getLinearVelocity());
+}
+
+static void ffi_get_angular_velocity(btRigidBody* self, glm::dvec3* out)
+{
+	*out = to_dvec3(self->getAngularVelocity());
+}
+
+static void ffi_get_velocity_in_local_point(btRigidBody* self, const glm::dvec3* point, glm::dvec3* out)
+{
+	*out = to_dvec3(self->getVelocityInLocalPoint(to_btVector3(*point)));
+}
+
+static void ffi_get_com_position(btRigidBody* self, glm::dvec3* out)
+{
+	*out = to_dvec3(self->getCenterOfMassPosition());
+}
+
+static void ffi_get_orientation(btRigidBody* self, glm::dquat* out)
+{
+	*out = to_dquat(self->getOrientation());
+}
 
 void LuaBullet::load_to(sol::table& table)
 {
@@ -109,10 +177,31 @@ void LuaBullet::load_to(sol::table& table)
 		"remove_from_world", [](btRigidBody* self, btDynamicsWorld& world)
 		{
 			world.removeRigidBody(self);
+		},
+		"ffi_ptr", [](btRigidBody* self)
+		{
+			return (void*)self;
 		}
 
 	);
 
+	sol::table ffi_table = table.create_named("ffi");
+	LuaFFIGlm::export_functions(ffi_table, {
+		{"apply_force", "void(*)(void*, const osp_dvec3*, const osp_dvec3*)", (void*)&ffi_apply_force},
+		{"apply_central_force", "void(*)(void*, const osp_dvec3*)", (void*)&ffi_apply_central_force},
+		{"apply_torque", "void(*)(void*, const osp_dvec3*)", (void*)&ffi_apply_torque},
+		{"apply_impulse", "void(*)(void*, const osp_dvec3*, const osp_dvec3*)", (void*)&ffi_apply_impulse},
+		{"apply_central_impulse", "void(*)(void*, const osp_dvec3*)", (void*)&ffi_apply_central_impulse},
+		{"apply_torque_impulse", "void(*)(void*, const osp_dvec3*)", (void*)&ffi_apply_torque_impulse},
+		{"set_linear_velocity", "void(*)(void*, const osp_dvec3*)", (void*)&ffi_set_linear_velocity},
+		{"set_angular_velocity", "void(*)(void*, const osp_dvec3*)", (void*)&ffi_set_angular_velocity},
+		{"get_linear_velocity", "void(*)(void*, osp_dvec3*)", (void*)&ffi_get_linear_velocity},
+		{"get_angular_velocity", "void(*)(void*, osp_dvec3*)", (void*)&ffi_get_angular_velocity},
+		{"get_velocity_in_local_point", "void(*)(void*, const osp_dvec3*, osp_dvec3*)",
+			(void*)&ffi_get_velocity_in_local_point},
+		{"get_com_position", "void(*)(void*, osp_dvec3*)", (void*)&ffi_get_com_position},
+		{"get_orientation", "void(*)(void*, osp_dquat*)", (void*)&ffi_get_orientation}});
+
 	// btTypedConstaint is the base for all constraints
 	// You cannot actually instantiate it, but you can use the
 	// other subclasses which inherit from it
@@ -0,0 +1,475 @@
+#include "LuaFFIGlm.h"
+#include "LuaGlm.h"
+#include <glm/gtc/quaternion.hpp>
+
+// The FFI structs must match the glm types exactly, as they are passed by pointer
+static_assert(sizeof(glm::dvec2) == 2 * sizeof(double), "glm::dvec2 is not packed");
+static_assert(sizeof(glm::dvec3) == 3 * sizeof(double), "glm::dvec3 is not packed");
+static_assert(sizeof(glm::dvec4) == 4 * sizeof(double), "glm::dvec4 is not packed");
+static_assert(sizeof(glm::dquat) == 4 * sizeof(double), "glm::dquat is not packed");
+static_assert(sizeof(glm::dmat4) == 16 * sizeof(double), "glm::dmat4 is not packed");
+
+static const char* FFI_TYPES =
+	"typedef struct osp_dvec2 { double x, y; } osp_dvec2;"
+	"typedef struct osp_dvec3 { double x, y, z; } osp_dvec3;"
+	"typedef struct osp_dvec4 { double x, y, z, w; } osp_dvec4;"
+	"typedef struct osp_dquat { double x, y, z, w; } osp_dquat;"
+	"typedef struct osp_dmat4 { osp_dvec4 c[4]; } osp_dmat4;";
+
+// The library itself is written in lua, so the JIT can see through everything
+// (Split in two literals because of MSVC string literal limits)
+static const char* FFI_GLM_SOURCE_TYPES = R"LUA(
+local ffi, glm, native = ...
+local istype = ffi.istype
+local sqrt, sin, cos, abs = math.sqrt, math.sin, math.cos, math.abs
+local floor, ceil, fmin, fmax, format = math.floor, math.ceil, math.min, math.max, string.format
+
+-- Constructors, assigned once the metatypes are created (metamethods see them as upvalues)
+local vec2, vec3, vec4, quat, mat4
+
+local function num(v) return type(v) == "number" end
+
+-- Arithmetic is component-wise with scalars on either side, same as glm
+local function vec2_op(op)
+	return function(a, b)
+		if num(a) then return vec2(op(a, b.x), op(a, b.y)) end
+		if num(b) then return vec2(op(a.x, b), op(a.y, b)) end
+		return vec2(op(a.x, b.x), op(a.y, b.y))
+	end
+end
+
+local function vec3_op(op)
+	return function(a, b)
+		if num(a) then return vec3(op(a, b.x), op(a, b.y), op(a, b.z)) end
+		if num(b) then return vec3(op(a.x, b), op(a.y, b), op(a.z, b)) end
+		return vec3(op(a.x, b.x), op(a.y, b.y), op(a.z, b.z))
+	end
+end
+
+local function vec4_op(op)
+	return function(a, b)
+		if num(a) then return vec4(op(a, b.x), op(a, b.y), op(a, b.z), op(a, b.w)) end
+		if num(b) then return vec4(op(a.x, b), op(a.y, b), op(a.z, b), op(a.w, b)) end
+		return vec4(op(a.x, b.x), op(a.y, b.y), op(a.z, b.z), op(a.w, b.w))
+	end
+end
+
+local function add(a, b) return a + b end
+local function sub(a, b) return a - b end
+local function mul(a, b) return a * b end
+local function div(a, b) return a / b end
+
+-- vec2
+local vec2_methods = {}
+function vec2_methods:unpack() return self.x, self.y end
+function vec2_methods:set(x, y) self.x, self.y = x, y return self end
+function vec2_methods:copy() return vec2(self.x, self.y) end
+function vec2_methods:to_glm() return glm.vec2.new(self.x, self.y) end
+
+vec2 = ffi.metatype("osp_dvec2", {
+	__add = vec2_op(add), __sub = vec2_op(sub), __mul = vec2_op(mul), __div = vec2_op(div),
+	__unm = function(a) return vec2(-a.x, -a.y) end,
+	__tostring = function(v) return format("(%.14g, %.14g)", v.x, v.y) end,
+	__index = vec2_methods,
+})
+
+-- vec3
+local vec3_methods = {}
+function vec3_methods:unpack() return self.x, self.y, self.z end
+function vec3_methods:set(x, y, z) self.x, self.y, self.z = x, y, z return self end
+function vec3_methods:copy() return vec3(self.x, self.y, self.z) end
+function vec3_methods:to_vec2() return vec2(self.x, self.y) end
+function vec3_methods:to_glm() return glm.vec3.new(self.x, self.y, self.z) end
+
+vec3 = ffi.metatype("osp_dvec3", {
+	__add = vec3_op(add), __sub = vec3_op(sub), __mul = vec3_op(mul), __div = vec3_op(div),
+	__unm = function(a) return vec3(-a.x, -a.y, -a.z) end,
+	__tostring = function(v) return format("(%.14g, %.14g, %.14g)", v.x, v.y, v.z) end,
+	__index = vec3_methods,
+})
+
+-- vec4
+local vec4_methods = {}
+function vec4_methods:unpack() return self.x, self.y, self.z, self.w end
+function vec4_methods:set(x, y, z, w) self.x, self.y, self.z, self.w = x, y, z, w return self end
+function vec4_methods:copy() return vec4(self.x, self.y, self.z, self.w) end
+function vec4_methods:to_vec2() return vec2(self.x, self.y) end
+function vec4_methods:to_vec3() return vec3(self.x, self.y, self.z) end
+function vec4_methods:to_glm() return glm.vec4.new(self.x, self.y, self.z, self.w) end
+
+local vec4_mul = vec4_op(mul)
+vec4 = ffi.metatype("osp_dvec4", {
+	__add = vec4_op(add), __sub = vec4_op(sub), __div = vec4_op(div),
+	__mul = function(a, b)
+		if istype(mat4, b) then
+			-- Row vector times matrix
+			local c = b.c
+			return vec4(
+				a.x * c[0].x + a.y * c[0].y + a.z * c[0].z + a.w * c[0].w,
+				a.x * c[1].x + a.y * c[1].y + a.z * c[1].z + a.w * c[1].w,
+				a.x * c[2].x + a.y * c[2].y + a.z * c[2].z + a.w * c[2].w,
+				a.x * c[3].x + a.y * c[3].y + a.z * c[3].z + a.w * c[3].w)
+		end
+		return vec4_mul(a, b)
+	end,
+	__unm = function(a) return vec4(-a.x, -a.y, -a.z, -a.w) end,
+	__tostring = function(v) return format("(%.14g, %.14g, %.14g, %.14g)", v.x, v.y, v.z, v.w) end,
+	__index = vec4_methods,
+})
+
+-- quat, stored x, y, z, w like glm::dquat but constructed as (w, x, y, z)
+local quat_methods = {}
+function quat_methods:unpack() return self.w, self.x, self.y, self.z end
+function quat_methods:set(w, x, y, z) self.w, self.x, self.y, self.z = w, x, y, z return self end
+function quat_methods:copy() return quat(self.x, self.y, self.z, self.w) end
+function quat_methods:conjugate() return quat(-self.x, -self.y, -self.z, self.w) end
+function quat_methods:length() return sqrt(self.x * self.x + self.y * self.y + self.z * self.z + self.w * self.w) end
+function quat_methods:normalize()
+	local l = self:length()
+	if l <= 0.0 then return quat(0.0, 0.0, 0.0, 1.0) end
+	return quat(self.x / l, self.y / l, self.z / l, self.w / l)
+end
+function quat_methods:inverse()
+	local d = self.x * self.x + self.y * self.y + self.z * self.z + self.w * self.w
+	return quat(-self.x / d, -self.y / d, -self.z / d, self.w / d)
+end
+function quat_methods:to_mat4()
+	local x, y, z, w = self.x, self.y, self.z, self.w
+	local out = mat4()
+	local c = out.c
+	c[0].x = 1.0 - 2.0 * (y * y + z * z); c[0].y = 2.0 * (x * y + w * z); c[0].z = 2.0 * (x * z - w * y)
+	c[1].x = 2.0 * (x * y - w * z); c[1].y = 1.0 - 2.0 * (x * x + z * z); c[1].z = 2.0 * (y * z + w * x)
+	c[2].x = 2.0 * (x * z + w * y); c[2].y = 2.0 * (y * z - w * x); c[2].z = 1.0 - 2.0 * (x * x + y * y)
+	c[3].w = 1.0
+	return out
+end
+
+quat = ffi.metatype("osp_dquat", {
+	__mul = function(a, b)
+		if num(b) then return quat(a.x * b, a.y * b, a.z * b, a.w * b) end
+		if num(a) then return quat(b.x * a, b.y * a, b.z * a, b.w * a) end
+		if istype(vec3, b) then
+			-- Rotates the vector, same as glm (v + 2w(q x v) + 2q x (q x v))
+			local qx, qy, qz, qw = a.x, a.y, a.z, a.w
+			local tx = 2.0 * (qy * b.z - qz * b.y)
+			local ty = 2.0 * (qz * b.x - qx * b.z)
+			local tz = 2.0 * (qx * b.y - qy * b.x)
+			return vec3(
+				b.x + qw * tx + (qy * tz - qz * ty),
+				b.y + qw * ty + (qz * tx - qx * tz),
+				b.z + qw * tz + (qx * ty - qy * tx))
+		end
+		return quat(
+			a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+			a.w * b.y + a.y * b.w + a.z * b.x - a.x * b.z,
+			a.w * b.z + a.z * b.w + a.x * b.y - a.y * b.x,
+			a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z)
+	end,
+	__unm = function(a) return quat(-a.x, -a.y, -a.z, -a.w) end,
+	__tostring = function(q) return format("(%.14g, {%.14g, %.14g, %.14g})", q.w, q.x, q.y, q.z) end,
+	__index = quat_methods,
+})
+
+-- mat4, column major with 0 based columns (m.c[3] is the translation) like glm::dmat4
+local mat4_methods = {}
+
+function mat4_methods:copy() return mat4(self) end
+function mat4_methods:transpose()
+	local out = mat4()
+	local a, o = self.c, out.c
+	o[0].x, o[0].y, o[0].z, o[0].w = a[0].x, a[1].x, a[2].x, a[3].x
+	o[1].x, o[1].y, o[1].z, o[1].w = a[0].y, a[1].y, a[2].y, a[3].y
+	o[2].x, o[2].y, o[2].z, o[2].w = a[0].z, a[1].z, a[2].z, a[3].z
+	o[3].x, o[3].y, o[3].z, o[3].w = a[0].w, a[1].w, a[2].w, a[3].w
+	return out
+end
+-- Returns the point transformed with w = 1
+function mat4_methods:transform_point(v)
+	local c = self.c
+	return vec3(
+		c[0].x * v.x + c[1].x * v.y + c[2].x * v.z + c[3].x,
+		c[0].y * v.x + c[1].y * v.y + c[2].y * v.z + c[3].y,
+		c[0].z * v.x + c[1].z * v.y + c[2].z * v.z + c[3].z)
+end
+-- Returns the direction transformed with w = 0
+function mat4_methods:transform_dir(v)
+	local c = self.c
+	return vec3(
+		c[0].x * v.x + c[1].x * v.y + c[2].x * v.z,
+		c[0].y * v.x + c[1].y * v.y + c[2].y * v.z,
+		c[0].z * v.x + c[1].z * v.y + c[2].z * v.z)
+end
+-- Done in C++ through glm, the matrices are passed by pointer
+local native_mat4_inverse = ffi.cast("void(*)(const osp_dmat4*, osp_dmat4*)", native.mat4_inverse)
+function mat4_methods:inverse() local out = mat4() native_mat4_inverse(self, out) return out end
+function mat4_methods:get_translation() local t = self.c[3] return vec3(t.x, t.y, t.z) end
+function mat4_methods:to_glm()
+	local c = self.c
+	return glm.mat4.new(c[0]:to_glm(), c[1]:to_glm(), c[2]:to_glm(), c[3]:to_glm())
+end
+
+mat4 = ffi.metatype("osp_dmat4", {
+	__mul = function(a, b)
+		if num(b) or num(a) then
+			if num(a) then a, b = b, a end
+			local out = mat4()
+			for i = 0, 3 do
+				local s, o = a.c[i], out.c[i]
+				o.x, o.y, o.z, o.w = s.x * b, s.y * b, s.z * b, s.w * b
+			end
+			return out
+		end
+		local c = a.c
+		if istype(vec4, b) then
+			return vec4(
+				c[0].x * b.x + c[1].x * b.y + c[2].x * b.z + c[3].x * b.w,
+				c[0].y * b.x + c[1].y * b.y + c[2].y * b.z + c[3].y * b.w,
+				c[0].z * b.x + c[1].z * b.y + c[2].z * b.z + c[3].z * b.w,
+				c[0].w * b.x + c[1].w * b.y + c[2].w * b.z + c[3].w * b.w)
+		end
+		local out = mat4()
+		for i = 0, 3 do
+			local bc, o = b.c[i], out.c[i]
+			o.x = c[0].x * bc.x + c[1].x * bc.y + c[2].x * bc.z + c[3].x * bc.w
+			o.y = c[0].y * bc.x + c[1].y * bc.y + c[2].y * bc.z + c[3].y * bc.w
+			o.z = c[0].z * bc.x + c[1].z * bc.y + c[2].z * bc.z + c[3].z * bc.w
+			o.w = c[0].w * bc.x + c[1].w * bc.y + c[2].w * bc.z + c[3].w * bc.w
+		end
+		return out
+	end,
+	__tostring = function(m)
+		local c = m.c
+		return format("(%s | %s | %s | %s)", tostring(c[0]), tostring(c[1]), tostring(c[2]), tostring(c[3]))
+	end,
+	__index = mat4_methods,
+})
+)LUA";
+
+static const char* FFI_GLM_SOURCE_FUNCTIONS = R"LUA(
+-- Constructors, same overloads as the glm library
+local M = {}
+
+M.vec2 = {type = vec2}
+function M.vec2.new(x, y)
+	if x == nil then return vec2(0.0, 0.0) end
+	if not num(x) then return vec2(x.x, x.y) end
+	if y == nil then return vec2(x, x) end
+	return vec2(x, y)
+end
+function M.vec2.from_glm(v) return vec2(v.x, v.y) end
+
+M.vec3 = {type = vec3}
+function M.vec3.new(x, y, z)
+	if x == nil then return vec3(0.0, 0.0, 0.0) end
+	if not num(x) then
+		if y ~= nil then return vec3(x.x, x.y, y) end
+		return vec3(x.x, x.y, x.z)
+	end
+	if y == nil then return vec3(x, x, x) end
+	return vec3(x, y, z)
+end
+function M.vec3.from_glm(v) return vec3(v.x, v.y, v.z) end
+
+M.vec4 = {type = vec4}
+function M.vec4.new(x, y, z, w)
+	if x == nil then return vec4(0.0, 0.0, 0.0, 0.0) end
+	if not num(x) then
+		if istype(vec3, x) then return vec4(x.x, x.y, x.z, y) end
+		if istype(vec2, x) then return vec4(x.x, x.y, y, z) end
+		return vec4(x.x, x.y, x.z, x.w)
+	end
+	if y == nil then return vec4(x, x, x, x) end
+	return vec4(x, y, z, w)
+end
+function M.vec4.from_glm(v) return vec4(v.x, v.y, v.z, v.w) end
+
+M.quat = {type = quat}
+function M.quat.new(w, x, y, z)
+	if w == nil then return quat(0.0, 0.0, 0.0, 1.0) end
+	return quat(x, y, z, w)
+end
+function M.quat.angle_axis(angle, axis)
+	local s = sin(angle * 0.5)
+	return quat(axis.x * s, axis.y * s, axis.z * s, cos(angle * 0.5))
+end
+
+M.mat4 = {type = mat4}
+-- mat4.new() is zero, mat4.new(s) is a diagonal matrix and mat4.new(c0, c1, c2, c3) takes the columns
+function M.mat4.new(c0, c1, c2, c3)
+	local out = mat4()
+	local c = out.c
+	if c0 == nil then return out end
+	if num(c0) then
+		c[0].x, c[1].y, c[2].z, c[3].w = c0, c0, c0, c0
+		return out
+	end
+	c[0], c[1], c[2], c[3] = c0, c1, c2, c3
+	return out
+end
+function M.mat4.translate(m, v)
+	local out = m:copy()
+	local c = out.c
+	c[3] = c[0] * v.x + c[1] * v.y + c[2] * v.z + c[3]
+	return out
+end
+function M.mat4.scale(m, v)
+	local out = m:copy()
+	local c = out.c
+	c[0], c[1], c[2] = c[0] * v.x, c[1] * v.y, c[2] * v.z
+	return out
+end
+
+-- Generic functions, they work on numbers and all vector types
+local function dot(a, b)
+	if num(a) then return a * b end
+	if istype(vec3, a) then return a.x * b.x + a.y * b.y + a.z * b.z end
+	if istype(vec2, a) then return a.x * b.x + a.y * b.y end
+	return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w
+end
+M.dot = dot
+
+function M.cross(a, b)
+	return vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x)
+end
+
+local function length(a)
+	if num(a) then return abs(a) end
+	return sqrt(dot(a, a))
+end
+M.length = length
+
+function M.distance(a, b) return length(b - a) end
+function M.normalize(a) return a / length(a) end
+function M.mix(a, b, t) return a + (b - a) * t end
+function M.reflect(i, n) return i - n * (2.0 * dot(n, i)) end
+
+-- Apply a scalar function to each component, the other arguments may be vectors or numbers
+local function componentwise1(f)
+	return function(a)
+		if num(a) then return f(a) end
+		if istype(vec3, a) then return vec3(f(a.x), f(a.y), f(a.z)) end
+		if istype(vec2, a) then return vec2(f(a.x), f(a.y)) end
+		return vec4(f(a.x), f(a.y), f(a.z), f(a.w))
+	end
+end
+
+local function componentwise2(f)
+	return function(a, b)
+		if num(a) then return f(a, b) end
+		if num(b) then
+			if istype(vec3, a) then return vec3(f(a.x, b), f(a.y, b), f(a.z, b)) end
+			if istype(vec2, a) then return vec2(f(a.x, b), f(a.y, b)) end
+			return vec4(f(a.x, b), f(a.y, b), f(a.z, b), f(a.w, b))
+		end
+		if istype(vec3, a) then return vec3(f(a.x, b.x), f(a.y, b.y), f(a.z, b.z)) end
+		if istype(vec2, a) then return vec2(f(a.x, b.x), f(a.y, b.y)) end
+		return vec4(f(a.x, b.x), f(a.y, b.y), f(a.z, b.z), f(a.w, b.w))
+	end
+end
+
+local function componentwise3(f)
+	local function arg(v, c) if num(v) then return v end return v[c] end
+	return function(a, b, c)
+		if num(a) then return f(a, b, c) end
+		if istype(vec2, a) then return vec2(f(a.x, arg(b, "x"), arg(c, "x")), f(a.y, arg(b, "y"), arg(c, "y"))) end
+		if istype(vec3, a) then
+			return vec3(f(a.x, arg(b, "x"), arg(c, "x")), f(a.y, arg(b, "y"), arg(c, "y")),
+						f(a.z, arg(b, "z"), arg(c, "z")))
+		end
+		return vec4(f(a.x, arg(b, "x"), arg(c, "x")), f(a.y, arg(b, "y"), arg(c, "y")),
+					f(a.z, arg(b, "z"), arg(c, "z")), f(a.w, arg(b, "w"), arg(c, "w")))
+	end
+end
+
+M.abs = componentwise1(abs)
+M.floor = componentwise1(floor)
+M.ceil = componentwise1(ceil)
+M.sqrt = componentwise1(sqrt)
+M.min = componentwise2(fmin)
+M.max = componentwise2(fmax)
+M.clamp = componentwise3(function(v, lo, hi) return fmin(fmax(v, lo), hi) end)
+
+M.pi = math.pi
+M.half_pi = math.pi * 0.5
+M.two_pi = math.pi * 2.0
+
+return M
+)LUA";
+
+static void ffi_mat4_inverse(const glm::dmat4* m, glm::dmat4* out)
+{
+	*out = glm::inverse(*m);
+}
+
+sol::table LuaFFIGlm::get_module(sol::state_view sv)
+{
+	sol::object cached = sv.registry()["__ffi_glm"];
+	if(cached.get_type() == sol::type::table)
+	{
+		return cached.as<sol::table>();
+	}
+
+	sv.open_libraries(sol::lib::ffi);
+	sol::table ffi = sv["ffi"];
+	// Unload ffi to avoid security risks, we keep our own reference
+	sv["ffi"] = sol::nil;
+
+	sol::function cdef = ffi["cdef"];
+	cdef(FFI_TYPES);
+
+	// Used for the conversions
+	sol::table glm_table = sv.create_table();
+	LuaGlm().load_to(glm_table);
+
+	sol::table native = sv.create_table();
+	native["mat4_inverse"] = (void*)&ffi_mat4_inverse;
+
+	std::string source = std::string(FFI_GLM_SOURCE_TYPES) + FFI_GLM_SOURCE_FUNCTIONS;
+	sol::load_result chunk = sv.load(source, "internal: LuaFFIGlm");
+	if(!chunk.valid())
+	{
+		sol::error err = chunk;
+		throw(err);
+	}
+
+	sol::protected_function chunk_fnc = chunk;
+	sol::protected_function_result result = chunk_fnc(ffi, glm_table, native);
+	if(!result.valid())
+	{
+		sol::error err = result;
+		throw(err);
+	}
+
+	sol::table module = result;
+	sv.registry()["__ffi_glm"] = module;
+	sv.registry()["__ffi_glm_ffi"] = ffi;
+
+	return module;
+}
+
+void LuaFFIGlm::export_functions(sol::table& to, const std::vector<NativeFunction>& fncs)
+{
+	sol::state_view sv(to.lua_state());
+	// The types must exist before any signature uses them
+	get_module(sv);
+
+	sol::table ffi = sv.registry()["__ffi_glm_ffi"];
+	sol::function cast = ffi["cast"];
+
+	for(const NativeFunction& fnc : fncs)
+	{
+		sol::object ptr = cast(fnc.signature, fnc.ptr);
+		to[fnc.name] = ptr;
+	}
+}
+
+void LuaFFIGlm::load_to(sol::table& table)
+{
+	sol::table module = get_module(sol::state_view(table.lua_state()));
+
+	// The module is shared by everyone in the same lua state
+	for(const auto& pair : module)
+	{
+		table[pair.first] = pair.second;
+	}
+}
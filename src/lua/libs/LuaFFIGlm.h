@@ -0,0 +1,51 @@
+#pragma once
+#include "../LuaLib.h"
+#include <vector>
+
+/*
+	Same types as the glm library (vec2, vec3, vec4, quat, mat4), but implemented
+	as LuaJIT FFI structs with the same memory layout as glm::dvecN, glm::dquat and glm::dmat4.
+
+	The glm library creates a full userdata for every operation, which makes math heavy
+	scripts (machines, planet generators) churn the GC. These are plain cdata, so the JIT
+	compiles the operators to unboxed math and temporaries are usually never allocated.
+
+	Differences with the glm library:
+	- quat.new(w, x, y, z) like glm, but fields are stored x, y, z, w
+	- mat4 columns are accessed with m.c[i], 0 based (m.c[3] is the translation)
+	- Mutators ':set(...)' to reuse a vector instead of creating a new one
+	- ':to_glm()' and 'vecN.from_glm(v)' convert from / to the glm library for functions
+	  which take glm types
+
+	C++ functions can take these types by pointer, without any conversion. Libraries which
+	have such functions expose them in an 'ffi' subtable (ex. bullet.ffi.apply_force), taking
+	the object as returned by 'ffi_ptr()'. Results are written to a vector given as the last
+	argument:
+
+		local rb_ptr = rigidbody:ffi_ptr()
+		local vel = vec3.new()
+		bullet.ffi.get_linear_velocity(rb_ptr, vel)
+
+	These are raw pointers, keep the object alive while you use them!
+*/
+class LuaFFIGlm : public LuaLib
+{
+public:
+
+	// A C++ function callable from lua, the signature is a FFI function pointer
+	// type, which may use osp_dvec2, osp_dvec3, osp_dvec4, osp_dquat and osp_dmat4
+	struct NativeFunction
+	{
+		const char* name;
+		const char* signature;
+		void* ptr;
+	};
+
+	// Creates the FFI types and the module table, only once per lua state
+	static sol::table get_module(sol::state_view sv);
+
+	// Adds the functions to the table
+	static void export_functions(sol::table& to, const std::vector<NativeFunction>& fncs);
+
+	virtual void load_to(sol::table& table) override;
+};
@@ -1,6 +1,49 @@
 #include "LuaVehicle.h"
+#include "LuaFFIGlm.h"
 #include "../../universe/vehicle/Vehicle.h"
 
+// FFI versions of the hot piece functions, see LuaFFIGlm. The piece
+// is the pointer returned by piece:ffi_ptr()
+static void ffi_get_linear_velocity(Piece* self, glm::dvec3* out)
+{
+	*out = to_dvec3(self->get_linear_velocity());
+}
+
+static void ffi_get_angular_velocity(Piece* self, glm::dvec3* out)
+{
+	*out = to_dvec3(self->get_angular_velocity());
+}
+
+static void ffi_get_global_position(Piece* self, glm::dvec3* out)
+{
+	*out = to_dvec3(self->get_global_transform().getOrigin());
+}
+
+static void ffi_get_forward(Piece* self, glm::dvec3* out)
+{
+	*out = self->get_forward();
+}
+
+static void ffi_get_up(Piece* self, glm::dvec3* out)
+{
+	*out = self->get_up();
+}
+
+static void ffi_get_right(Piece* self, glm::dvec3* out)
+{
+	*out = self->get_right();
+}
+
+static void ffi_transform_axis(Piece* self, const glm::dvec3* axis, glm::dvec3* out)
+{
+	*out = self->transform_axis(*axis);
+}
+
+static void ffi_transform_point_to_rigidbody(Piece* self, const glm::dvec3* p, glm::dvec3* out)
+{
+	*out = self->transform_point_to_rigidbody(*p);
+}
+
 void LuaVehicle::load_to(sol::table& table)
 {
 	table.new_usertype<Vehicle>("vehicle");//,
@@ -67,6 +110,10 @@ void LuaVehicle::load_to(sol::table& table)
 		"get_attached_to_marker", [](Piece& self, const std::string& marker)
 		{
 			return self.in_vehicle->get_connected_with(&self, marker);
+		},
+		"ffi_ptr", [](Piece* self)
+		{
+			return (void*)self;
 		});
 
 	table.new_usertype<Part>("part",
@@ -147,5 +194,17 @@ void LuaVehicle::load_to(sol::table& table)
 		
 	);
 
+	sol::table ffi_table = table.create_named("ffi");
+	LuaFFIGlm::export_functions(ffi_table, {
+		{"get_linear_velocity", "void(*)(void*, osp_dvec3*)", (void*)&ffi_get_linear_velocity},
+		{"get_angular_velocity", "void(*)(void*, osp_dvec3*)", (void*)&ffi_get_angular_velocity},
+		{"get_global_position", "void(*)(void*, osp_dvec3*)", (void*)&ffi_get_global_position},
+		{"get_forward", "void(*)(void*, osp_dvec3*)", (void*)&ffi_get_forward},
+		{"get_up", "void(*)(void*, osp_dvec3*)", (void*)&ffi_get_up},
+		{"get_right", "void(*)(void*, osp_dvec3*)", (void*)&ffi_get_right},
+		{"transform_axis", "void(*)(void*, const osp_dvec3*, osp_dvec3*)", (void*)&ffi_transform_axis},
+		{"transform_point_to_rigidbody", "void(*)(void*, const osp_dvec3*, osp_dvec3*)",
+			(void*)&ffi_transform_point_to_rigidbody}});
+
 
 }
@@ -0,0 +1,55 @@
+#include "JobTaskScheduler.h"
+#include <util/JobSystem.h>
+#include <algorithm>
+#include <vector>
+
+void JobTaskScheduler::parallelFor(int begin, int end, int grain_size, const btIParallelForBody& body)
+{
+	int grain = std::max(grain_size, 1);
+	size_t chunks = (size_t)((end - begin + grain - 1) / grain);
+	if(chunks <= 1 || JobSystem::is_in_job())
+	{
+		body.forLoop(begin, end);
+		return;
+	}
+
+	jobs->parallel_for(chunks, [begin, end, grain, &body](size_t i)
+	{
+		int from = begin + (int)i * grain;
+		body.forLoop(from, std::min(from + grain, end));
+	});
+}
+
+btScalar JobTaskScheduler::parallelSum(int begin, int end, int grain_size, const btIParallelSumBody& body)
+{
+	int grain = std::max(grain_size, 1);
+	size_t chunks = (size_t)((end - begin + grain - 1) / grain);
+	if(chunks <= 1 || JobSystem::is_in_job())
+	{
+		return body.sumLoop(begin, end);
+	}
+
+	// Summed in order, so results don't depend on scheduling
+	std::vector<btScalar> sums(chunks, btScalar(0));
+	jobs->parallel_for(chunks, [begin, end, grain, &body, &sums](size_t i)
+	{
+		int from = begin + (int)i * grain;
+		sums[i] = body.sumLoop(from, std::min(from + grain, end));
+	});
+
+	btScalar out = btScalar(0);
+	for(btScalar s : sums)
+	{
+		out += s;
+	}
+	return out;
+}
+
+JobTaskScheduler::JobTaskScheduler(JobSystem* jobs) : btITaskScheduler("JobSystem")
+{
+	this->jobs = jobs;
+	// Bullet keeps per thread data indexed by its own thread indices, the calling
+	// (main) thread must be the first one, workers get theirs on first use
+	btGetCurrentThreadIndex();
+	num_threads = std::min((int)jobs->get_worker_count() + 1, BT_MAX_THREAD_COUNT);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#pragma warning(push, 0)
+#include <LinearMath/btThreads.h>
+#pragma warning(pop)
+
+class JobSystem;
+
+// Runs the parallel loops of the multithreaded bullet world (btDiscreteDynamicsWorldMt)
+// on the engine's JobSystem, instead of bullet spawning its own threads.
+// Loops started while already inside a job (bullet may nest them) run serially.
+// Bullet must be built with BT_THREADSAFE for any of this to actually run in parallel.
+class JobTaskScheduler : public btITaskScheduler
+{
+private:
+
+	JobSystem* jobs;
+	int num_threads;
+
+public:
+
+	int getMaxNumThreads() const override { return num_threads; }
+	int getNumThreads() const override { return num_threads; }
+	// The number of threads is that of the JobSystem, this does nothing
+	void setNumThreads(int n) override {}
+
+	void parallelFor(int begin, int end, int grain_size, const btIParallelForBody& body) override;
+	btScalar parallelSum(int begin, int end, int grain_size, const btIParallelSumBody& body) override;
+
+	// Must be created from the main thread, so it gets bullet's thread index 0
+	explicit JobTaskScheduler(JobSystem* jobs);
+};
@@ -0,0 +1,29 @@
+#include "LinkBreakSolver.h"
+#include <universe/vehicle/part/Link.h>
+#include <mutex>
+
+// In the multithreaded world islands are solved in parallel, and pieces of the same
+// vehicle may be in different islands. Breaks are rare, so they are simply serialized
+static std::mutex notify_mtx;
+
+btScalar LinkBreakSolver::solveGroup(btCollisionObject** bodies, int num_bodies,
+	btPersistentManifold** manifolds, int num_manifolds,
+	btTypedConstraint** constraints, int num_constraints,
+	const btContactSolverInfo& info, btIDebugDraw* debug_drawer, btDispatcher* dispatcher)
+{
+	btScalar out = btSequentialImpulseConstraintSolver::solveGroup(bodies, num_bodies, manifolds, num_manifolds,
+		constraints, num_constraints, info, debug_drawer, dispatcher);
+
+	// Only a flag check per constraint, the link ignores repeated notifications
+	for(int i = 0; i < num_constraints; i++)
+	{
+		btTypedConstraint* constraint = constraints[i];
+		if(!constraint->isEnabled() && constraint->getUserConstraintType() == Link::USER_CONSTRAINT_TYPE)
+		{
+			std::lock_guard<std::mutex> lock(notify_mtx);
+			((Link*)constraint->getUserConstraintPtr())->notify_broken();
+		}
+	}
+
+	return out;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#pragma warning(push, 0)
+#include <btBulletDynamicsCommon.h>
+#pragma warning(pop)
+
+// Same as the default bullet solver, but reports watched link constraints
+// which got disabled during the solve (bullet disables constraints whose applied
+// impulse exceeds their breaking threshold) to their Link.
+// This way vehicles don't need to ask every link if it broke every frame.
+class LinkBreakSolver : public btSequentialImpulseConstraintSolver
+{
+public:
+
+	virtual btScalar solveGroup(btCollisionObject** bodies, int num_bodies,
+		btPersistentManifold** manifolds, int num_manifolds,
+		btTypedConstraint** constraints, int num_constraints,
+		const btContactSolverInfo& info, btIDebugDraw* debug_drawer, btDispatcher* dispatcher) override;
+};
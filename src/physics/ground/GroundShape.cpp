@@ -14,6 +14,35 @@ void GroundShape::getAabb(const btTransform& t, btVector3& aabbMin, btVector3& a
 
 #include <imgui/imgui.h>
 
+void GroundShape::process_tile(const GroundShapeServer::PhysicsTile* tile, btTriangleCallback* callback, 
+	const btVector3* aabb_b0, const btVector3* aabb_b1) const
+{
+	const std::vector<uint16_t>& indices = server->get_indices();
+	btVector3 tri[3];
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		tri[0] = tile->get_vertex(indices[i + 0]);
+		tri[1] = tile->get_vertex(indices[i + 1]);
+		tri[2] = tile->get_vertex(indices[i + 2]);
+
+		// Bullet does the narrow test, but most triangles are far from the query
+		if (aabb_b0 != nullptr)
+		{
+			btVector3 tmin = tri[0];
+			btVector3 tmax = tri[0];
+			tmin.setMin(tri[1]); tmin.setMin(tri[2]);
+			tmax.setMax(tri[1]); tmax.setMax(tri[2]);
+			if (!TestAabbAgainstAabb2(tmin, tmax, *aabb_b0, *aabb_b1))
+			{
+				continue;
+			}
+		}
+
+		callback->processTriangle(tri, (int)0, (int)(i / 3));
+	}
+}
+
 void GroundShape::processAllTriangles(btTriangleCallback* callback, const btVector3& aabb_b0, const btVector3& aabb_b1) const
 {
 	btVector3 debug_b0(btScalar(-BT_LARGE_FLOAT), btScalar(-BT_LARGE_FLOAT), btScalar(-BT_LARGE_FLOAT));
@@ -25,13 +54,7 @@ void GroundShape::processAllTriangles(btTriangleCallback* callback, const btVect
 		// We draw all loaded tiles
 		for (auto it = server->cache.begin(); it != server->cache.end(); it++)
 		{
-			btVector3* verts = it->second->verts;
-
-			// Return the triangles
-			for (size_t i = 0; i < PlanetTile::PHYSICS_INDEX_COUNT; i += 3)
-			{
-				callback->processTriangle(&verts[i], (int)0, (int)(i / 3));
-			}
+			process_tile(it->second, callback, nullptr, nullptr);
 		}
 	}
 	else
@@ -64,7 +87,8 @@ void GroundShape::processAllTriangles(btTriangleCallback* callback, const btVect
 
 		glm::dvec3 normalized[8];
 
-		size_t wanted_depth = body->config.surface.max_depth + PlanetTile::PHYSICS_GRAPHICS_RELATION - 1;
+		// Physics tiles match the deepest render tiles, only their resolution differs
+		size_t wanted_depth = body->config.surface.max_depth;
 
 		glm::dvec3 rel = glm::normalize(aabb_box[0]);
 
@@ -102,12 +126,8 @@ void GroundShape::processAllTriangles(btTriangleCallback* callback, const btVect
 		
 		for (QuadTreeNode* leaf : leafs)
 		{
-			btVector3* verts = server->query(leaf, 1.0);
-			// Return the triangles
-			for (size_t i = 0; i < PlanetTile::PHYSICS_INDEX_COUNT; i+=3)
-			{
-				callback->processTriangle(&verts[i], (int)0, (int)(i / 3));
-			}
+			GroundShapeServer::PhysicsTile* tile = server->query(leaf, 1.0);
+			process_tile(tile, callback, &aabb_b0, &aabb_b1);
 		}
 		
 	}
@@ -17,6 +17,10 @@ private:
 	SystemElement* body;
 	GroundShapeServer* server;
 
+	// Builds the triangles of the tile and passes them to the callback, skipping
+	// those outside the aabb (if given)
+	void process_tile(const GroundShapeServer::PhysicsTile* tile, btTriangleCallback* callback,
+		const btVector3* aabb_b0, const btVector3* aabb_b1) const;
 
 public:
 	
@@ -44,6 +48,8 @@ public:
 
 	virtual const char*	getName() const { return "PROCTERRAIN"; }
 
+	GroundShapeServer* get_server() { return server; }
+
 	GroundShape(SystemElement* body);
 	~GroundShape();
 };
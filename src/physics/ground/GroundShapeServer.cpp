@@ -1,64 +1,94 @@
 #include "GroundShapeServer.h"
+#include <OSP.h>
 
 
 
 
-btVector3* GroundShapeServer::query(QuadTreeNode* node, double time)
+GroundShapeServer::PhysicsTile* GroundShapeServer::query(QuadTreeNode* node, double time)
 {
 	PlanetTilePath path = PlanetTilePath(node->get_path(), node->planetside);
 
-	if (cache.find(path) != cache.end())
+	std::lock_guard<std::mutex> lock(cache_mtx);
+	auto it = cache.find(path);
+	if (it != cache.end())
 	{
-		return &cache[path]->verts[0];
+		return it->second;
 	}
 	else
 	{
 		// We must generate a new cache entry
-		TileAndTriangles* n_tile = new TileAndTriangles(path, time, this);
+		PhysicsTile* n_tile = new PhysicsTile(path, time, this);
 		cache[path] = n_tile;
 
-		return &n_tile->verts[0];
+		return n_tile;
 	}
 }
 
+size_t GroundShapeServer::get_cache_bytes() const
+{
+	return cache.size() * (sizeof(PhysicsTile) + sizeof(glm::vec3) * tile_size * tile_size);
+}
+
 GroundShapeServer::GroundShapeServer(SystemElement* body)
 {
 	this->body = body;
 
+	int64_t size = PlanetTile::DEFAULT_PHYSICS_SIZE;
+	if (osp->settings)
+	{
+		size = osp->settings->get_qualified_as<int64_t>("universe.ground_tile_size").value_or(size);
+	}
+	if (size < 2 || size > PlanetTile::MAX_PHYSICS_SIZE)
+	{
+		logger->warn("Invalid universe.ground_tile_size ({}), using {}", size, PlanetTile::DEFAULT_PHYSICS_SIZE);
+		size = PlanetTile::DEFAULT_PHYSICS_SIZE;
+	}
+	tile_size = (size_t)size;
+
 	bool wrote_error = false;
 
 	std::string script = AssetManager::load_string_raw(body->config.surface.script_path);
 
 	PlanetTile::prepare_lua(lua);
 	LuaUtil::safe_lua(lua, script, wrote_error, body->config.surface.script_path);
+	gc = new LuaGCPolicy(PlanetTile::get_gc_config());
+	gc->attach(lua);
 
-	PlanetTile::generate_physics_index_array(indices);
+	PlanetTile::generate_physics_index_array(tile_size, indices);
 }
 
 
 GroundShapeServer::~GroundShapeServer()
 {
+	delete gc;
 }
 
-GroundShapeServer::TileAndTriangles::TileAndTriangles(PlanetTilePath npath, double time, GroundShapeServer* server) 
+GroundShapeServer::PhysicsTile::PhysicsTile(PlanetTilePath npath, double time, GroundShapeServer* server) 
 	: path(npath)
 {
+	time_remaining = time;
+
 	//double growth = -2.1500;
 	double growth = -2.5; // A little excessive so vehicles "sink" a little and dont float
 	double planet_radius = server->body->config.radius + growth;
 
-	PlanetTile::generate_physics(npath, server->body->config.radius, server->lua, &server->work_array);
+	PlanetTile::generate_physics(npath, server->body->config.radius, server->lua, server->tile_size, server->work_array);
+	server->gc->after_job(server->lua);
 
 	glm::dmat4 model = glm::dmat4(1.0);
 	model = glm::scale(model, glm::dvec3(planet_radius));
 	model = model * path.get_model_spheric_matrix();
 
-	for (size_t i = 0; i < server->indices.size(); i++)
+	// Tiles are small, so floats relative to the center are plenty
+	origin = model * glm::dvec4(0.5, 0.5, 0.0, 1.0);
+
+	verts.resize(server->work_array.size());
+	for (size_t i = 0; i < verts.size(); i++)
 	{
-		glm::dvec3 v = server->work_array[server->indices[i]].pos;
+		glm::dvec3 v = server->work_array[i].pos;
 		// Transform to real position relative to planet
 		v = model * glm::dvec4(v, 1.0);
 
-		verts[i] = to_btVector3(v);
+		verts[i] = (glm::vec3)(v - origin);
 	}
 }
@@ -6,6 +6,8 @@
 #include "../glm/BulletGlmCompat.h"
 #include <glm/glm.hpp>
 #include <unordered_map>
+#include <vector>
+#include <mutex>
 
 // Handles generation of the ground shape triangles,
 // and, most importantly, caching of them using the
@@ -23,31 +25,45 @@
 class GroundShapeServer
 {
 public:
-	static constexpr size_t PHYSICS_VERT_COUNT = PlanetTile::PHYSICS_SIZE * PlanetTile::PHYSICS_SIZE;
-	static constexpr size_t PHYSICS_TRI_COUNT = PHYSICS_VERT_COUNT * 3;
 
-private:
-	
-	std::array<uint16_t, PlanetTile::PHYSICS_INDEX_COUNT> indices;
-
-	struct TileAndTriangles
+	// Physics tiles are a grid of tile_size * tile_size vertices, independent of the
+	// render tiles. Triangles are built from them and the shared index array as bullet
+	// asks for them (like btHeightfieldTerrainShape does), so we never store them
+	struct PhysicsTile
 	{
 		PlanetTilePath path;
 		double time_remaining;
 
-		btVector3 verts[PlanetTile::PHYSICS_INDEX_COUNT];
+		// Planet relative, double so big planets stay precise
+		glm::dvec3 origin;
+		// Relative to origin
+		std::vector<glm::vec3> verts;
+
+		// Returns the vertex relative to the planet, for bullet
+		btVector3 get_vertex(size_t i) const
+		{
+			return to_btVector3(origin + (glm::dvec3)verts[i]);
+		}
 
-		TileAndTriangles(PlanetTilePath npath, double time, GroundShapeServer* server);
+		PhysicsTile(PlanetTilePath npath, double time, GroundShapeServer* server);
 	};
 
+private:
+	
+	size_t tile_size;
+	std::vector<uint16_t> indices;
 
 public:
 	
-	std::unordered_map<PlanetTilePath, TileAndTriangles*, PlanetTilePathHasher> cache;
+	std::unordered_map<PlanetTilePath, PhysicsTile*, PlanetTilePathHasher> cache;
+	// Bullet may query from many threads at once (multithreaded physics, or
+	// many physics scenes sharing the shape). Entries are never freed while stepping
+	std::mutex cache_mtx;
 
-	PlanetTile::SimpleVertexArray<PlanetTile::PHYSICS_SIZE> work_array;
+	std::vector<PlanetTileSimpleVertex> work_array;
 
 	sol::state lua;
+	LuaGCPolicy* gc;
 
 	SystemElement* body;
 
@@ -56,9 +72,13 @@ public:
 	void update(double pdt);
 
 	
-	btVector3* query(QuadTreeNode* node, double time = 1.0);
+	PhysicsTile* query(QuadTreeNode* node, double time = 1.0);
+
+	size_t get_tile_size() const { return tile_size; }
+	const std::vector<uint16_t>& get_indices() const { return indices; }
+	// Memory used by the cached tiles
+	size_t get_cache_bytes() const;
 
 	GroundShapeServer(SystemElement* body);
 	~GroundShapeServer();
 };
-
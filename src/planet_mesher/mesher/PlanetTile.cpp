@@ -1,6 +1,8 @@
 #include "PlanetTile.h"
 #include <util/Logger.h>
 #include <util/LuaUtil.h>
+#include "../renderer/TileSlab.h"
+#include <renderer/util/StagingRing.h>
 
 template<int S>
 constexpr std::array<uint16_t, (S + 2) * (S + 2) * 6> get_nrm_indices()
@@ -115,15 +117,6 @@ void generate_vertices(T* verts, glm::dmat4 model, glm::dmat4 inverse_model_sphe
 			vert.pos = (glm::vec3)(inverse_model_spheric * glm::dvec4(world_pos_spheric, 1.0));
 			vert.nrm = glm::vec3(0.0f, 0.0f, 0.0f);
 
-			if constexpr (std::is_same<T, PlanetTileVertex>::value)
-			{
-				// We find the points spherical coordinates (= to the equirrectangular projection in our case!)
-				glm::vec2 sph = MathUtil::euclidean_to_spherical_r1(world_pos_spheric_nrm);
-				// Clip to 0->1
-				vert.planet_uv_tex.x = (sph.x + glm::half_pi<float>()) / glm::pi<float>();
-				vert.planet_uv_tex.y = sph.y / glm::pi<float>();
-			}
-
 			verts[r_index] = vert;
 		}
 	}
@@ -131,17 +124,17 @@ void generate_vertices(T* verts, glm::dmat4 model, glm::dmat4 inverse_model_sphe
 
 
 template<typename T>
-void generate_vertices_simple(T* verts, glm::dmat4 model, glm::dmat4 inverse_model_spheric, double* heights)
+void generate_vertices_simple(T* verts, size_t size, glm::dmat4 model, glm::dmat4 inverse_model_spheric, double* heights)
 {
 	// We need some small tricks to keep the render and physics vertices aligned
-	for (int y = 0; y < PlanetTile::PHYSICS_SIZE; y++)
+	for (size_t y = 0; y < size; y++)
 	{
-		for (int x = 0; x < PlanetTile::PHYSICS_SIZE; x++)
+		for (size_t x = 0; x < size; x++)
 		{
-			size_t r_index = y * PlanetTile::PHYSICS_SIZE + x;
+			size_t r_index = y * size + x;
 
-			double tx = (double)x / ((double)PlanetTile::PHYSICS_SIZE - 1.0);
-			double ty = (double)y / ((double)PlanetTile::PHYSICS_SIZE - 1.0);
+			double tx = (double)x / ((double)size - 1.0);
+			double ty = (double)y / ((double)size - 1.0);
 
 			double height = heights[r_index];
 
@@ -160,8 +153,8 @@ void generate_vertices_simple(T* verts, glm::dmat4 model, glm::dmat4 inverse_mod
 	}
 }
 
-template<int S, typename T, typename Q>
-void copy_vertices(T* origin, Q* destination)
+template<int S, typename T>
+void copy_vertices(T* origin, T* destination)
 {
 	for (int y = 0; y < S; y++)
 	{
@@ -170,28 +163,53 @@ void copy_vertices(T* origin, Q* destination)
 			size_t o_index = (y + 1) * (S + 2) + (x + 1);
 			size_t f_index = y * S + x;
 
-			destination[f_index].pos = origin[o_index].pos;
-			destination[f_index].nrm = origin[o_index].nrm;
-			if constexpr (!std::is_same<Q, PlanetTileSimpleVertex>::value)
-			{
-				if constexpr (std::is_same<Q, PlanetTileWaterVertex>::value)
-				{
-					destination[f_index].depth = origin[o_index].col.x;
-				}
-				else
-				{
-					destination[f_index].col = origin[o_index].col;
-					destination[f_index].planet_uv_tex = origin[o_index].planet_uv_tex;
-				}
-			}
+			destination[f_index] = origin[o_index];
 		}
 	}
 }
 
+static uint16_t quantize_unorm16(float v)
+{
+	return (uint16_t)glm::round(glm::clamp(v, 0.0f, 1.0f) * 65535.0f);
+}
 
-void generate_skirt(PlanetTileVertex* target, glm::dmat4 model, glm::dmat4 inverse_model_spheric, PlanetTileVertex& copy_vert)
+static uint8_t quantize_unorm8(float v)
 {
-	PlanetTileVertex vert;
+	return (uint8_t)glm::round(glm::clamp(v, 0.0f, 1.0f) * 255.0f);
+}
+
+static int16_t quantize_snorm16(float v)
+{
+	return (int16_t)glm::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+// Octahedral normal encoding, decoded in the planet shaders
+static void encode_normal(glm::vec3 n, int16_t* out)
+{
+	n /= glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z);
+	glm::vec2 e = glm::vec2(n.x, n.y);
+	if (n.z < 0.0f)
+	{
+		glm::vec2 sign = glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+		e = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * sign;
+	}
+
+	out[0] = quantize_snorm16(e.x);
+	out[1] = quantize_snorm16(e.y);
+}
+
+static void encode_position(glm::vec3 pos, glm::vec3 box_min, glm::vec3 box_size, uint16_t* out)
+{
+	glm::vec3 rel = (pos - box_min) / box_size;
+	out[0] = quantize_unorm16(rel.x);
+	out[1] = quantize_unorm16(rel.y);
+	out[2] = quantize_unorm16(rel.z);
+	out[3] = 0;
+}
+
+void generate_skirt(PlanetTileGenVertex* target, glm::dmat4 model, glm::dmat4 inverse_model_spheric, PlanetTileGenVertex& copy_vert)
+{
+	PlanetTileGenVertex vert;
 
 	double tx = 0.5;
 	double ty = 0.5;
@@ -303,8 +321,6 @@ bool PlanetTile::generate(PlanetTilePath path, double planet_radius, sol::state&
 		colors[i] = (glm::vec3)gen_out[i].color;
 	}
 
-	lua_state.collect_garbage();
-
 	// Detail texture adjustements
 	glm::dvec2 min = path.get_min(), max;
 	double detail_size = 1.0f / glm::pow(2.0f, DETAIL_DEPTH);
@@ -314,21 +330,21 @@ bool PlanetTile::generate(PlanetTilePath path, double planet_radius, sol::state&
 	max.x = min.x + tile_size / detail_size;
 	max.y = min.y + tile_size / detail_size;
 	// We can finally generate the vertices
-	generate_vertices<TILE_SIZE, PlanetTileVertex, false>(work_array.data(), model, inverse_model_spheric,
+	auto& land = arrays->land;
+	auto& water = arrays->water;
+	generate_vertices<TILE_SIZE, PlanetTileGenVertex, false>(work_array.data(), model, inverse_model_spheric,
 	  &heights[0], &colors[0], min.x, max.x, min.y, max.y);
 	generate_normals<TILE_SIZE>(work_array.data(), work_array.size(), model_spheric, clockwise);
-	copy_vertices<TILE_SIZE>(work_array.data(), vertices.data());
+	copy_vertices<TILE_SIZE>(work_array.data(), land.data());
 
-	water_vertices = nullptr;
-	water_vbo = 0;
-	if (has_water && needs_water)
+	bool gen_water = has_water && needs_water;
+	if (gen_water)
 	{
-		generate_vertices<TILE_SIZE, PlanetTileVertex, true>(work_array.data(), 
+		generate_vertices<TILE_SIZE, PlanetTileGenVertex, true>(work_array.data(), 
 				model, inverse_model_spheric, &heights[0], nullptr);
 
 		generate_normals<TILE_SIZE>(work_array.data(), work_array.size(), model_spheric, clockwise);
-		water_vertices = new std::array<PlanetTileWaterVertex, VERTEX_COUNT>();
-		copy_vertices<TILE_SIZE>(work_array.data(), water_vertices->data());
+		copy_vertices<TILE_SIZE>(work_array.data(), water.data());
 	}
 
 	// We generate the up vector easily
@@ -337,23 +353,68 @@ bool PlanetTile::generate(PlanetTilePath path, double planet_radius, sol::state&
 	glm::dvec3 world_pos_center = world_pos_spheric * 0.5;
 	up = glm::normalize(world_pos_spheric);
 
-	std::array<PlanetTileVertex, 4> skirts;
+	std::array<PlanetTileGenVertex, 4> skirts;
 	// Up
-	generate_skirt(&skirts[0], model, inverse_model_spheric, vertices[0 * TILE_SIZE + 0]);
+	generate_skirt(&skirts[0], model, inverse_model_spheric, land[0 * TILE_SIZE + 0]);
 
 	// Down
-	generate_skirt(&skirts[1], model, inverse_model_spheric, vertices[(TILE_SIZE - 1) * TILE_SIZE + 0]);
+	generate_skirt(&skirts[1], model, inverse_model_spheric, land[(TILE_SIZE - 1) * TILE_SIZE + 0]);
 
 	// Left
-	generate_skirt(&skirts[2], model, inverse_model_spheric, vertices[0 * TILE_SIZE + 0]);
+	generate_skirt(&skirts[2], model, inverse_model_spheric, land[0 * TILE_SIZE + 0]);
 
 	// Right
-	generate_skirt(&skirts[3], model, inverse_model_spheric, vertices[0 * TILE_SIZE + (TILE_SIZE - 1)]);
+	generate_skirt(&skirts[3], model, inverse_model_spheric, land[0 * TILE_SIZE + (TILE_SIZE - 1)]);
 
 	// Copy skirts
 	for (size_t i = 0; i < skirts.size(); i++)
 	{
-		vertices[i + TILE_SIZE * TILE_SIZE] = skirts[i];
+		land[i + TILE_SIZE * TILE_SIZE] = skirts[i];
+	}
+
+	// The quantization box only covers the bulk vertices. Skirts go deep into the planet
+	// (way more than the tile size on small tiles), so they are clamped to a tile size 
+	// away from it, which still hides the gaps
+	glm::vec3 box_max = glm::vec3(-HUGE_VALF);
+	box_min = glm::vec3(HUGE_VALF);
+	for (size_t i = 0; i < TILE_SIZE * TILE_SIZE; i++)
+	{
+		box_min = glm::min(box_min, land[i].pos);
+		box_max = glm::max(box_max, land[i].pos);
+		if (gen_water)
+		{
+			box_min = glm::min(box_min, water[i].pos);
+			box_max = glm::max(box_max, water[i].pos);
+		}
+	}
+	box_min.z -= 1.0f;
+	box_max.z += 1.0f;
+	box_size = glm::max(box_max - box_min, glm::vec3(1e-6f));
+
+	vertices = new std::array<PlanetTileVertex, VERTEX_COUNT>();
+	for (size_t i = 0; i < VERTEX_COUNT; i++)
+	{
+		PlanetTileVertex& v = (*vertices)[i];
+		encode_position(land[i].pos, box_min, box_size, v.pos);
+		encode_normal(land[i].nrm, v.nrm);
+		v.col[0] = quantize_unorm8(land[i].col.r);
+		v.col[1] = quantize_unorm8(land[i].col.g);
+		v.col[2] = quantize_unorm8(land[i].col.b);
+		v.col[3] = 255;
+	}
+
+	water_vertices = nullptr;
+	if (gen_water)
+	{
+		// Water only draws the bulk
+		water_vertices = new std::array<PlanetTileWaterVertex, VERTEX_COUNT>();
+		for (size_t i = 0; i < TILE_SIZE * TILE_SIZE; i++)
+		{
+			PlanetTileWaterVertex& v = (*water_vertices)[i];
+			encode_position(water[i].pos, box_min, box_size, v.pos);
+			encode_normal(water[i].nrm, v.nrm);
+			v.depth = water[i].col.x;
+		}
 	}
 
 	return errors;
@@ -362,7 +423,7 @@ bool PlanetTile::generate(PlanetTilePath path, double planet_radius, sol::state&
 
 
 bool PlanetTile::generate_physics(PlanetTilePath path, double planet_radius, sol::state& lua_state,
-	SimpleVertexArray<PlanetTile::PHYSICS_SIZE>* work_array)
+	size_t size, std::vector<PlanetTileSimpleVertex>& work_array)
 {
 	bool errors = false;
 
@@ -371,27 +432,27 @@ bool PlanetTile::generate_physics(PlanetTilePath path, double planet_radius, sol
 	glm::dmat4 inverse_model = glm::inverse(model);
 	glm::dmat4 inverse_model_spheric = glm::inverse(model_spheric);
 
-	constexpr size_t ARR_SIZE = PHYSICS_SIZE * PHYSICS_SIZE;
+	size_t arr_size = size * size;
 
-	std::array<double, ARR_SIZE> heights;
+	std::vector<double> heights(arr_size);
 
 	size_t depth = path.get_depth();
 
-	std::array<GeneratorInfo, ARR_SIZE> info;
-	std::array<GeneratorOut, ARR_SIZE> out;
+	std::vector<GeneratorInfo> info(arr_size);
+	std::vector<GeneratorOut> out(arr_size);
 
 	sol::protected_function func = lua_state["generate"];
 
 	 
 	// We need some small tricks to keep the render and physics vertices aligned
-	for (int y = 0; y < PlanetTile::PHYSICS_SIZE; y++)
+	for (size_t y = 0; y < size; y++)
 	{
-		for (int x = 0; x < PlanetTile::PHYSICS_SIZE; x++)
+		for (size_t x = 0; x < size; x++)
 		{
-			size_t r_index = y * PlanetTile::PHYSICS_SIZE + x;
+			size_t r_index = y * size + x;
 
-			double tx = (double)x / ((double)PlanetTile::PHYSICS_SIZE - 1.0);
-			double ty = (double)y / ((double)PlanetTile::PHYSICS_SIZE - 1.0);
+			double tx = (double)x / ((double)size - 1.0);
+			double ty = (double)y / ((double)size - 1.0);
 
 			glm::dvec3 in_tile = glm::dvec3(tx, ty, 0.0);
 
@@ -428,12 +489,29 @@ bool PlanetTile::generate_physics(PlanetTilePath path, double planet_radius, sol
 		heights[i] = (out[i].height) / planet_radius;
 	}
 
-	lua_state.collect_garbage();
-	generate_vertices_simple<PlanetTileSimpleVertex>(work_array->data(), model, inverse_model_spheric, heights.data());
+	work_array.resize(arr_size);
+	generate_vertices_simple<PlanetTileSimpleVertex>(work_array.data(), size, model, inverse_model_spheric, heights.data());
 
 	return errors;
 }
 
+LuaGCPolicy::Config PlanetTile::get_gc_config()
+{
+	LuaGCPolicy::Config config;
+	if (osp->settings)
+	{
+		auto& settings = *osp->settings;
+		std::string mode = settings.get_qualified_as<std::string>("lua_gc.mode").value_or("incremental");
+		config.mode = LuaGCPolicy::get_mode_from_name(mode);
+		config.step_kb = (int)settings.get_qualified_as<int64_t>("lua_gc.step_kb").value_or(config.step_kb);
+		config.full_threshold_kb = (size_t)(settings.get_qualified_as<double>("lua_gc.full_threshold_mb")
+			.value_or(config.full_threshold_kb / 1024.0) * 1024.0);
+		config.pause = (int)settings.get_qualified_as<int64_t>("lua_gc.pause").value_or(config.pause);
+		config.stepmul = (int)settings.get_qualified_as<int64_t>("lua_gc.stepmul").value_or(config.stepmul);
+	}
+	return config;
+}
+
 void PlanetTile::prepare_lua(sol::state& lua_state)
 {
 	lua_core->load(lua_state, osp->assets->get_current_package());
@@ -451,22 +529,59 @@ void PlanetTile::prepare_lua(sol::state& lua_state)
 		"color", &GeneratorOut::color);
 }
 
-void PlanetTile::upload()
+void PlanetTile::upload(TileSlab* slab, TileSlab* water_slab, StagingRing& staging)
 {
 	logger->check(!is_uploaded(), "Tried to upload an already uploaded tile");
 
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(PlanetTileVertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	this->slab = slab;
+	slot = slab->allocate();
+	slab->upload(slot, vertices->data(), staging);
 
 	if (water_vertices != nullptr)
 	{
-		glGenBuffers(1, &water_vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, water_vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(PlanetTileWaterVertex) * (*water_vertices).size(), (*water_vertices).data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		this->water_slab = water_slab;
+		water_slot = water_slab->allocate();
+		water_slab->upload(water_slot, water_vertices->data(), staging);
 	}
+
+	// Nothing reads them back
+	delete vertices;
+	vertices = nullptr;
+	delete water_vertices;
+	water_vertices = nullptr;
+}
+
+glm::dmat4 PlanetTile::get_dequantize_matrix() const
+{
+	return glm::scale(glm::translate(glm::dmat4(1.0), (glm::dvec3)box_min), (glm::dvec3)box_size);
+}
+
+size_t PlanetTile::get_cpu_bytes() const
+{
+	size_t out = 0;
+	if (vertices != nullptr)
+	{
+		out += sizeof(*vertices);
+	}
+	if (water_vertices != nullptr)
+	{
+		out += sizeof(*water_vertices);
+	}
+	return out;
+}
+
+size_t PlanetTile::get_gpu_bytes() const
+{
+	size_t out = 0;
+	if (slab != nullptr)
+	{
+		out += sizeof(PlanetTileVertex) * VERTEX_COUNT;
+	}
+	if (water_slab != nullptr)
+	{
+		out += sizeof(PlanetTileWaterVertex) * VERTEX_COUNT;
+	}
+	return out;
 }
 
 
@@ -543,35 +658,33 @@ void PlanetTile::generate_index_array_with_skirts(std::array<uint16_t, INDEX_COU
 	}
 }
 
-void PlanetTile::generate_physics_index_array(std::array<uint16_t, PHYSICS_INDEX_COUNT>& indices)
+void PlanetTile::generate_physics_index_array(size_t size, std::vector<uint16_t>& indices)
 {
-	for (size_t i = 0; i < indices.size(); i++)
-	{
-		indices[i] = 65535;
-	}
+	indices.clear();
+	indices.resize((size - 1) * (size - 1) * 6, 65535);
 
 	// Only Bulk indices
-	for (size_t y = 0; y < PlanetTile::PHYSICS_SIZE - 1; y++)
+	for (size_t y = 0; y < size - 1; y++)
 	{
-		for (size_t x = 0; x < PlanetTile::PHYSICS_SIZE - 1; x++)
+		for (size_t x = 0; x < size - 1; x++)
 		{
-			uint16_t vi = (uint16_t)(y * PlanetTile::PHYSICS_SIZE + x);
-			size_t i = (y * (PlanetTile::PHYSICS_SIZE - 1) + x) * 6;
+			uint16_t vi = (uint16_t)(y * size + x);
+			size_t i = (y * (size - 1) + x) * 6;
 
 			// Right
 			indices[i + 0] = vi + 1;
 			// Center
 			indices[i + 1] = vi;
 			// Bottom
-			indices[i + 2] = vi + PlanetTile::PHYSICS_SIZE;
+			indices[i + 2] = (uint16_t)(vi + size);
 
 
 			// Bottom Right
-			indices[i + 0 + 3] = vi + 1 + PlanetTile::PHYSICS_SIZE;
+			indices[i + 0 + 3] = (uint16_t)(vi + 1 + size);
 			// Right
 			indices[i + 1 + 3] = vi + 1;
 			// Bottom
-			indices[i + 2 + 3] = vi + PlanetTile::PHYSICS_SIZE;
+			indices[i + 2 + 3] = (uint16_t)(vi + size);
 
 		}
 	}
@@ -579,8 +692,11 @@ void PlanetTile::generate_physics_index_array(std::array<uint16_t, PHYSICS_INDEX
 
 PlanetTile::PlanetTile()
 {
-	vbo = 0;
-	water_vbo = 0;
+	slab = nullptr;
+	water_slab = nullptr;
+	slot = 0;
+	water_slot = 0;
+	vertices = nullptr;
 	water_vertices = nullptr;
 
 }
@@ -588,20 +704,16 @@ PlanetTile::PlanetTile()
 PlanetTile::~PlanetTile()
 {
 
-	if (water_vertices != nullptr)
-	{
-		delete water_vertices;
-	}
+	delete vertices;
+	delete water_vertices;
 
-	if (vbo != 0)
+	if (slab != nullptr)
 	{
-		glDeleteBuffers(1, &vbo);
-		vbo = 0;
+		slab->free(slot);
 	}
 
-	if (water_vbo != 0)
+	if (water_slab != nullptr)
 	{
-		glDeleteBuffers(1, &water_vbo);
-		water_vbo = 0;
+		water_slab->free(water_slot);
 	}
 }
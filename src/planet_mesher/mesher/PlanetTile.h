@@ -1,5 +1,7 @@
 #pragma once
 #include <array>
+#include <vector>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include "PlanetTilePath.h"
 #include <glad/glad.h>
@@ -7,23 +9,36 @@
 #include <sol/sol.hpp>
 #include <functional>
 #include <lua/LuaCore.h>
+#include <lua/LuaGCPolicy.h>
 #include <assets/AssetManager.h>
 
-// TODO: Tile vertex structure
-// We may not even use colors
-struct PlanetTileVertex
+class TileSlab;
+class StagingRing;
+
+// Vertices as generated, before packing them for the GPU
+// (for water, col.x is the depth)
+struct PlanetTileGenVertex
 {
 	glm::vec3 pos;
 	glm::vec3 nrm;
 	glm::vec3 col;
-	// Planet's global UV map and texture chooser float
-	glm::vec3 planet_uv_tex;
+};
+
+// Packed vertices (16 bytes, from 48 as floats). Positions are quantized inside the
+// box of the tile (see PlanetTile::get_dequantize_matrix), normals are octahedral
+// encoded, and the planet's global UVs are derived in the shader from the position.
+// The .w / .a components are padding
+struct PlanetTileVertex
+{
+	uint16_t pos[4];
+	int16_t nrm[2];
+	uint8_t col[4];
 };
 
 struct PlanetTileWaterVertex
 {
-	glm::vec3 pos;
-	glm::vec3 nrm;
+	uint16_t pos[4];
+	int16_t nrm[2];
 	float depth;
 };
 
@@ -55,19 +70,23 @@ struct PlanetTile
 
 	bool clockwise;
 
-	GLuint vbo, water_vbo;
+	// Where our vertices are in the planet's slabs (only once uploaded)
+	TileSlab* slab;
+	TileSlab* water_slab;
+	size_t slot, water_slot;
 	// The average up vector of the tile, for texturing
 	glm::dvec3 up;
+	// Box (in tile space) the vertex positions are quantized into
+	glm::vec3 box_min, box_size;
 
 	// Keep below ~128, for OpenGL reasons (index buffer too big)
 	static const int TILE_SIZE = 32;
 	static const size_t GEN_ARRAY_SIZE = (TILE_SIZE + 2) * (TILE_SIZE + 2);
-	// TODO: Make it possible for this number to be different, the whole tile is overkill
-	static const int PHYSICS_SIZE = TILE_SIZE;
-	static const int PHYSICS_GRAPHICS_RELATION = TILE_SIZE / (PHYSICS_SIZE - 1);
+	// Physics tiles have their own resolution (vertices per side), see GroundShapeServer
+	static const int DEFAULT_PHYSICS_SIZE = 17;
+	static const int MAX_PHYSICS_SIZE = 256;
 	static const int VERTEX_COUNT = TILE_SIZE * TILE_SIZE + 4;
 	static const int INDEX_COUNT = (TILE_SIZE - 1) * (TILE_SIZE - 1) * 6 + (TILE_SIZE - 1) * 4 * 3;
-	static const int PHYSICS_INDEX_COUNT = (PHYSICS_SIZE - 1) * (PHYSICS_SIZE - 1) * 6;
 	// Depth at which the detail texture tiles
 	// TODO: May need to be adjustable per-planet
 	static const int DETAIL_DEPTH = 10;
@@ -76,40 +95,59 @@ struct PlanetTile
 	template <typename T, size_t S>
 	using VertexArray = std::array<T, (S + 2) * (S + 2)>;
 
-	template<size_t S>
-	using SimpleVertexArray = std::array<PlanetTileSimpleVertex, S * S>;
-
-	std::array<PlanetTileVertex, VERTEX_COUNT> vertices;
+	// Size of the vertices as floats (PlanetTileGenVertex plus the planet UVs), to
+	// compare memory usage with the packed ones
+	static const size_t FLOAT_VERTEX_SIZE = 48;
+	static const size_t FLOAT_WATER_VERTEX_SIZE = 28;
 
-	// This one is optional, so we only allocate it if needed
+	// Both are freed once uploaded, water ones are optional so we only allocate them if needed
+	std::array<PlanetTileVertex, VERTEX_COUNT>* vertices;
 	std::array<PlanetTileWaterVertex, VERTEX_COUNT>* water_vertices;
 
 	struct GeneratorArrays
 	{
-		VertexArray<PlanetTileVertex, PlanetTile::TILE_SIZE> work_array;
+		VertexArray<PlanetTileGenVertex, PlanetTile::TILE_SIZE> work_array;
 		std::array<double, GEN_ARRAY_SIZE> heights;
 		std::array<glm::vec3, GEN_ARRAY_SIZE> colors;
+		// Final vertices, before packing
+		std::array<PlanetTileGenVertex, VERTEX_COUNT> land;
+		std::array<PlanetTileGenVertex, VERTEX_COUNT> water;
 	};
 
 	// Return true if errors happened
 	bool generate(PlanetTilePath path, double planet_radius, sol::state& lua_state, bool has_water,
 		GeneratorArrays* arrays);
 
-	// Simply generates stuff to the output_array, that's it, we can be static 
+	// Simply generates size * size vertices to work_array, that's it, we can be static 
 	static bool generate_physics(PlanetTilePath path, double planet_radius, sol::state& lua_state,
-		SimpleVertexArray<PHYSICS_SIZE>* work_array);
+		size_t size, std::vector<PlanetTileSimpleVertex>& work_array);
 
 	static void prepare_lua(sol::state& lua_state);
+	// Generation doesn't collect garbage, run a policy with this config after each tile
+	static LuaGCPolicy::Config get_gc_config();
+
+	// Copies the vertices into a slot of the slabs, and frees them
+	void upload(TileSlab* slab, TileSlab* water_slab, StagingRing& staging);
+
+	bool is_uploaded() const { return slab != nullptr; }
+
+	bool has_water() const { return water_slab != nullptr; }
 
-	void upload();
+	// Base vertices in the slab buffers, for drawing
+	GLint get_base_vertex() const { return (GLint)(slot * VERTEX_COUNT); }
+	GLint get_water_base_vertex() const { return (GLint)(water_slot * VERTEX_COUNT); }
 
-	bool is_uploaded() { return vbo != 0; }
+	// Takes the packed positions (0->1 in the box) to tile space, apply before the model matrix
+	glm::dmat4 get_dequantize_matrix() const;
 
-	bool has_water() { return water_vbo != 0; }
+	// Memory used by the vertices in RAM (only until uploaded) and in the GPU
+	size_t get_cpu_bytes() const;
+	size_t get_gpu_bytes() const;
 
 	static void generate_index_array_with_skirts(std::array<uint16_t, INDEX_COUNT>& target, size_t& bulk_index_count);
 
-	static void generate_physics_index_array(std::array<uint16_t, PHYSICS_INDEX_COUNT>& target);
+	// (size - 1)^2 * 6 indices, shared by every physics tile of said size
+	static void generate_physics_index_array(size_t size, std::vector<uint16_t>& target);
 
 
 	PlanetTile();
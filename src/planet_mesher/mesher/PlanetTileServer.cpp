@@ -1,23 +1,15 @@
 #include "PlanetTileServer.h"
 #include <imgui/imgui.h>
 #include "../../util/Logger.h"
+#include <OSP.h>
+#include <renderer/Renderer.h>
 
 void PlanetTileServer::update(QuadTreePlanet& planet)
 {
-	if (dirty)
+	if (uploaded)
 	{
 		planet.iteration++;
-		auto tiles_w = tiles.get();
-
-		for (auto it = tiles_w->begin(); it != tiles_w->end(); it++)
-		{
-			if (!it->second->is_uploaded())
-			{
-				it->second->upload();
-			}
-		}
-
-		dirty = false;
+		uploaded = false;
 	}
 
 	if (!planet.dirty)
@@ -94,6 +86,40 @@ void PlanetTileServer::update(QuadTreePlanet& planet)
 
 }
 
+bool PlanetTileServer::upload_step(FrameScheduler& sched)
+{
+	if (!dirty)
+	{
+		return false;
+	}
+
+	// Cleared before looking at the tiles, so tiles finished meanwhile set it again
+	dirty = false;
+	bool any = false;
+	auto tiles_w = tiles.get();
+
+	for (auto it = tiles_w->begin(); it != tiles_w->end(); it++)
+	{
+		if (it->second->is_uploaded())
+		{
+			continue;
+		}
+
+		if (any && !sched.has_time())
+		{
+			// The rest go next frame
+			dirty = true;
+			break;
+		}
+
+		it->second->upload(slab, water_slab, *staging);
+		any = true;
+		uploaded = true;
+	}
+
+	return dirty;
+}
+
 void PlanetTileServer::set_depth_for_unload(int depth)
 {
 	depth_for_unload = depth;
@@ -141,17 +167,29 @@ PlanetTileServer::PlanetTileServer(const std::string& script, const std::string&
 	threads_run = true;
 	depth_for_unload = 0;
 
+	slab = new TileSlab(sizeof(PlanetTileVertex) * PlanetTile::VERTEX_COUNT);
+	water_slab = new TileSlab(sizeof(PlanetTileWaterVertex) * PlanetTile::VERTEX_COUNT);
+	// Enough for a few dozen tiles per segment
+	staging = new StagingRing(1024 * 1024);
+
+	dirty = false;
+	uploaded = false;
+	// Before LOD updates, which wait for uploads to go deeper (see is_built)
+	upload_task = osp->renderer->scheduler.add_task("planet_tiles", FrameScheduler::HIGH, [this](FrameScheduler& sched)
+	{
+		return upload_step(sched);
+	});
+
 	bool wrote_error = false;
 
 	PlanetTile::prepare_lua(lua_state);
 	LuaUtil::safe_lua(lua_state, script, wrote_error, script_path);
 
 	threads.resize(thread_count);
+	LuaGCPolicy::Config gc_config = PlanetTile::get_gc_config();
 
 	for (size_t i = 0; i < threads.size(); i++)
 	{
-
-		threads[i].thread = new std::thread(thread_func, this, &threads[i]);
 		PlanetTile::prepare_lua(threads[i].lua_state);
 		
 		LuaUtil::safe_lua(threads[i].lua_state, script, wrote_error, script_path);
@@ -160,12 +198,18 @@ PlanetTileServer::PlanetTileServer(const std::string& script, const std::string&
 		{
 			has_errors = true;
 		}
+
+		threads[i].gc = new LuaGCPolicy(gc_config);
+		threads[i].gc->attach(threads[i].lua_state);
+		// Started once the state is ready
+		threads[i].thread = new std::thread(thread_func, this, &threads[i]);
 	}
 }
 
 
 PlanetTileServer::~PlanetTileServer()
 {
+	osp->renderer->scheduler.remove_task(upload_task);
 	threads_run = false;
 
 
@@ -176,6 +220,7 @@ PlanetTileServer::~PlanetTileServer()
 
 		threads[i].thread->join();
 		delete threads[i].thread;
+		delete threads[i].gc;
 	}
 
 	// Tiles are now only managed by us so this is actually safe
@@ -184,16 +229,51 @@ PlanetTileServer::~PlanetTileServer()
 		delete it->second;
 	}
 
-
-
+	delete slab;
+	delete water_slab;
+	delete staging;
 }
 
 void PlanetTileServer::do_imgui()
 {
-	// (Not really unsafe!)
-	size_t tiles_size = tiles.get_unsafe()->size();
+	size_t tiles_size, cpu_bytes = 0, gpu_bytes = 0, float_bytes = 0;
+	{
+		auto tiles_w = tiles.get();
+		tiles_size = tiles_w->size();
+		for (auto it = tiles_w->begin(); it != tiles_w->end(); it++)
+		{
+			const PlanetTile* tile = it->second;
+			cpu_bytes += tile->get_cpu_bytes();
+			gpu_bytes += tile->get_gpu_bytes();
+
+			// With float vertices, kept in RAM after upload
+			bool water = tile->has_water() || tile->water_vertices != nullptr;
+			size_t tile_float = PlanetTile::FLOAT_VERTEX_SIZE * PlanetTile::VERTEX_COUNT;
+			if (water)
+			{
+				tile_float += PlanetTile::FLOAT_WATER_VERTEX_SIZE * PlanetTile::VERTEX_COUNT;
+			}
+			float_bytes += tile_float * 2;
+		}
+	}
+
 	ImGui::Text("Loaded tiles: %i (%.2fMB)", (int)tiles_size, (float)(tiles_size * sizeof(PlanetTile)) / 1000000.0f);
+	ImGui::Text("Vertices: %.2fMB GPU, %.2fMB CPU (%.2fMB as floats)", 
+		(float)gpu_bytes / 1000000.0f, (float)cpu_bytes / 1000000.0f, (float)float_bytes / 1000000.0f);
+	ImGui::Text("Slabs: %.2f / %.2fMB land, %.2f / %.2fMB water", 
+		(float)slab->get_used_bytes() / 1000000.0f, (float)slab->get_total_bytes() / 1000000.0f,
+		(float)water_slab->get_used_bytes() / 1000000.0f, (float)water_slab->get_total_bytes() / 1000000.0f);
 	ImGui::Text("Work List: %i", (int)work_list.get_unsafe()->size());
+
+	for (size_t i = 0; i < threads.size(); i++)
+	{
+		const LuaGCPolicy* gc = threads[i].gc;
+		size_t jobs = gc->get_jobs();
+		double ms_per_tile = jobs == 0 ? 0.0 : gc->get_gc_time() * 1000.0 / (double)jobs;
+		ImGui::Text("Worker %i: %.2fMB lua, GC (%s) %.3fms/tile, %i tiles, %i full", (int)i,
+			(float)gc->get_memory_kb() / 1024.0f, LuaGCPolicy::get_mode_name(gc->get_config().mode),
+			ms_per_tile, (int)jobs, (int)gc->get_full_collections());
+	}
 }
 
 void PlanetTileServer::thread_func(PlanetTileServer* server, PlanetTileThread* thread)
@@ -233,6 +313,7 @@ void PlanetTileServer::thread_func(PlanetTileServer* server, PlanetTileThread* t
 			PlanetTile* ntile = new PlanetTile();
 			bool has_errors = ntile->generate(target, server->config->radius, 
 				thread->lua_state, server->has_water, &arrays);
+			thread->gc->after_job(thread->lua_state);
 
 			if (has_errors)
 			{
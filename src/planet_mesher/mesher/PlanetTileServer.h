@@ -12,6 +12,8 @@
 #include "PlanetTilePath.h"
 #include "PlanetTile.h"
 #include "../quadtree/QuadTreePlanet.h"
+#include "../renderer/TileSlab.h"
+#include <renderer/util/StagingRing.h>
 #include <util/ThreadUtil.h>
 #include <assets/AssetManager.h>
 
@@ -19,10 +21,13 @@
 
 
 
+class FrameScheduler;
+
 struct PlanetTileThread
 {
 	sol::state lua_state;
 	std::thread* thread;
+	LuaGCPolicy* gc;
 };
 
 // The tile server handles storage, creation and removal
@@ -50,6 +55,14 @@ private:
 	// everybody can query to find stuff about the script
 	sol::state lua_state;
 
+	StagingRing* staging;
+
+	// Tiles are uploaded by a task in the renderer's FrameScheduler, within the frame budget
+	size_t upload_task;
+	// Set when tiles were uploaded since the last update
+	bool uploaded;
+	bool upload_step(FrameScheduler& sched);
+
 public:
 
 	bool has_water;
@@ -72,6 +85,11 @@ public:
 	std::unordered_map<std::string, AssetHandle<Image>> images;
 
 	Atomic<TileMap> tiles;
+
+	// The vertices of every uploaded tile, so they can be drawn at once
+	TileSlab* slab;
+	TileSlab* water_slab;
+
 	// Threads always try to work on the highest priority
 	// (ie. lowest detail tile) first
 	Atomic<std::multiset<PlanetTilePath, PlanetTilePathLess>> work_list;
@@ -88,9 +106,10 @@ public:
 
 	void do_imgui();
 
+	// No tiles being generated or waiting for upload
 	bool is_built()
 	{
-		return work_list.get_unsafe()->size() == 0;
+		return work_list.get_unsafe()->size() == 0 && !dirty;
 	}
 	
 	double get_height(glm::dvec3 pos_3d, size_t depth = 1);
@@ -207,7 +207,8 @@ void QuadTreePlanet::update(PlanetTileServer& server)
 			{
 				auto tiles_m = server.tiles.get();
 				auto it = tiles_m->find(path);
-				if (it == tiles_m->end())
+				// Tiles are uploaded as the frame budget allows, until then we keep the parent
+				if (it == tiles_m->end() || !it->second->is_uploaded())
 				{
 					found = false;
 				}
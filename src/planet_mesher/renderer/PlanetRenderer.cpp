@@ -68,9 +68,6 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 			shader->setInt("cliff_nrm", 3);
 		}
 
-		bool cw_mode = false;
-		glFrontFace(GL_CCW);
-
 		if(osp->renderer->quality.use_planet_detail_normal || osp->renderer->quality.use_planet_detail_map)
 		{
 			// Adjust triplanar up so it's tiled
@@ -99,6 +96,10 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 			shader->setMat4("inverse_tri_nrm_matrix", glm::inverse(tri_normal_matrix));
 		}
 
+		// Every visible tile goes out in a single multi draw (two, as front faces change),
+		// per tile data is read from a buffer indexed with the draw id
+		draw_data.clear();
+		std::vector<DrawCommand> cw_cmds, ccw_cmds;
 		for (size_t i = 0; i < render_tiles.size(); i++)
 		{
 			auto it = tiles_w->find(render_tiles[i]);
@@ -114,53 +115,42 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 			auto tile = it->second;
 			auto path = it->first;
 
-			glm::dmat4 model = path.get_model_spheric_matrix();
-			// We also apply the camera tform, used by the deferred renderer
-			glm::dmat4 deferred_model = tforms.wmodel * model;
-
 			if (!tile->is_uploaded())
 			{
 				continue;
 			}
 
-			if (tile->clockwise && !cw_mode)
-			{
-				glFrontFace(GL_CW);
-				cw_mode = true;
-			}
-
-			if (!tile->clockwise && cw_mode)
-			{
-				glFrontFace(GL_CCW);
-				cw_mode = false;
-			}
-
-
-
-
-			shader->setMat4("tform", (glm::mat4)(tforms.proj_view * tforms.wmodel * model));
-			shader->setMat4("m_tform", (glm::mat4)(deferred_model));
-			shader->setMat4("rotm_tform", (glm::mat4)(tforms.rot_tform * model));
+			// Vertices are quantized inside the tile's box
+			glm::dmat4 model = path.get_model_spheric_matrix() * tile->get_dequantize_matrix();
+			// We also apply the camera tform, used by the deferred renderer
+			glm::dmat4 deferred_model = tforms.wmodel * model;
 
-			glm::dvec3 tile_or = tforms.wmodel * model * glm::dvec4(0.5, 0.5, 0.0, 1.0);
+			glm::dvec3 tile_or = tforms.wmodel * model * glm::dvec4(0.5, 0.5, 0.5, 1.0);
 			// We use a reasonalbe distance to prevent gaps but also not show detail very far away
 			// to reduce GPU load
 			bool do_detail = glm::dot(tile_or, tile_or) < detail_fade * 20;
-			shader->setInt("do_detail", do_detail);
-
-			glm::vec3 tile_i = glm::vec3(path.get_min(), (float)path.get_depth());
-
-			shader->setVec3("tile", tile_i);
-			glBindVertexArray(vao);
-			glBindVertexBuffer(0, tile->vbo, 0, sizeof(PlanetTileVertex));
-			glBindVertexBuffer(1, uv_bo, 0, sizeof(glm::vec2));
-			glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_SHORT, (void*)0);
-			glBindVertexArray(0);
-
-
 
+			TileDrawData data;
+			data.tform = (glm::mat4)(tforms.proj_view * tforms.wmodel * model);
+			data.m_tform = (glm::mat4)deferred_model;
+			data.rotm_tform = (glm::mat4)(tforms.rot_tform * model);
+			data.sph_tform = (glm::mat4)model;
+			data.tile = glm::vec4((glm::vec2)path.get_min(), (float)path.get_depth(), 0.0f);
+			data.flag = do_detail ? 1 : 0;
+			data.base_vertex = tile->get_base_vertex();
+
+			DrawCommand cmd;
+			cmd.count = (GLuint)indices.size();
+			cmd.instance_count = 1;
+			cmd.first_index = 0;
+			cmd.base_vertex = tile->get_base_vertex();
+			cmd.base_instance = (GLuint)draw_data.size();
+			(tile->clockwise ? cw_cmds : ccw_cmds).push_back(cmd);
+			draw_data.push_back(data);
 		}
 
+		issue_draws(vao, server.slab->get_buffer(), sizeof(PlanetTileVertex), cw_cmds, ccw_cmds);
+
 		if (config.surface.has_water)
 		{
 			// Draw water, another pass to only switch shaders once
@@ -176,8 +166,14 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 			water_shader->setFloat("sunset_exponent", (float)config.atmo.sunset_exponent);
 			water_shader->setVec3("light_dir", tforms.light_dir);
 
-			cw_mode = false;
-			glFrontFace(GL_CCW);
+			// Can be used for tides, or simple waves as we do here
+			double sfactor = 1.0 + sin(tforms.time * 0.3) * 0.000000025;
+			glm::dmat4 t_model = glm::dmat4(1.0f);
+			t_model = glm::scale(t_model, glm::dvec3(sfactor, sfactor, sfactor));
+
+			draw_data.clear();
+			cw_cmds.clear();
+			ccw_cmds.clear();
 			for (size_t i = 0; i < render_tiles.size(); i++)
 			{
 				auto it = tiles_w->find(render_tiles[i]);
@@ -188,48 +184,34 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 				auto tile = it->second;
 				auto path = it->first;
 
-				glm::dmat4 model = path.get_model_spheric_matrix();
-				glm::dmat4 deferred_model = tforms.wmodel * model;
-
-				if (tile->water_vbo == 0)
+				if (!tile->has_water())
 				{
 					continue;
 				}
 
-				if (tile->clockwise && !cw_mode)
-				{
-					glFrontFace(GL_CW);
-					cw_mode = true;
-				}
-
-				if (!tile->clockwise && cw_mode)
-				{
-					glFrontFace(GL_CCW);
-					cw_mode = false;
-				}
-
-				// Can be used for tides, or simple waves as we do here
-				double sfactor = 1.0 + sin(tforms.time * 0.3) * 0.000000025;
-
-				glm::dmat4 t_model = glm::dmat4(1.0f);
-				t_model = glm::scale(t_model, glm::dvec3(sfactor, sfactor, sfactor));
-
-				water_shader->setMat4("tform", (glm::mat4)(tforms.proj_view * tforms.wmodel * t_model * model));
-				water_shader->setMat4("deferred_tform", (glm::mat4)(deferred_model));
-				water_shader->setMat4("rotm_tform", (glm::mat4)(tforms.rot_tform * model));
-				water_shader->setInt("clockwise", tile->clockwise ? 1 : 0);
-			
-				glm::vec3 tile_i = glm::vec3(path.get_min(), (float)path.get_depth());
-
-				water_shader->setVec3("tile", tile_i);
-
-				glBindVertexArray(water_vao);
-				glBindVertexBuffer(0, tile->water_vbo, 0, sizeof(PlanetTileWaterVertex));
-				glBindVertexBuffer(1, uv_bo, 0, sizeof(glm::vec2));
-				glDrawElements(GL_TRIANGLES, (GLsizei)bulk_index_count, GL_UNSIGNED_SHORT, (void*)0);
-				glBindVertexArray(0);
+				glm::dmat4 model = path.get_model_spheric_matrix() * tile->get_dequantize_matrix();
+				glm::dmat4 deferred_model = tforms.wmodel * model;
 
+				TileDrawData data;
+				data.tform = (glm::mat4)(tforms.proj_view * tforms.wmodel * t_model * model);
+				data.m_tform = (glm::mat4)deferred_model;
+				data.rotm_tform = (glm::mat4)(tforms.rot_tform * model);
+				data.sph_tform = (glm::mat4)model;
+				data.tile = glm::vec4((glm::vec2)path.get_min(), (float)path.get_depth(), 0.0f);
+				data.flag = tile->clockwise ? 1 : 0;
+				data.base_vertex = tile->get_water_base_vertex();
+
+				DrawCommand cmd;
+				cmd.count = (GLuint)bulk_index_count;
+				cmd.instance_count = 1;
+				cmd.first_index = 0;
+				cmd.base_vertex = tile->get_water_base_vertex();
+				cmd.base_instance = (GLuint)draw_data.size();
+				(tile->clockwise ? cw_cmds : ccw_cmds).push_back(cmd);
+				draw_data.push_back(data);
 			}
+
+			issue_draws(water_vao, server.water_slab->get_buffer(), sizeof(PlanetTileWaterVertex), cw_cmds, ccw_cmds);
 		}
 		
 	}
@@ -237,62 +219,98 @@ void PlanetRenderer::render(PlanetTileServer &server, QuadTreePlanet &planet,
 	glFrontFace(GL_CCW);
 }
 
-
-void PlanetRenderer::generate_and_upload_index_buffer()
+void PlanetRenderer::issue_draws(GLuint in_vao, GLuint vertex_buffer, GLsizei stride,
+	const std::vector<DrawCommand>& cw_cmds, const std::vector<DrawCommand>& ccw_cmds)
 {
-	PlanetTile::generate_index_array_with_skirts(indices, bulk_index_count);
-
-	std::array<glm::vec2, PlanetTile::TILE_SIZE * PlanetTile::TILE_SIZE> uvs;
+	if (draw_data.empty())
+	{
+		return;
+	}
 
-	// Bulk UVs
-	for (size_t y = 0; y < PlanetTile::TILE_SIZE; y++)
+	// Draw ids are the instance indices, the commands' base instance offsets them
+	if (draw_id_count < draw_data.size())
 	{
-		for (size_t x = 0; x < PlanetTile::TILE_SIZE; x++)
+		draw_id_count = draw_data.size() * 2;
+		std::vector<GLuint> ids(draw_id_count);
+		for (size_t i = 0; i < ids.size(); i++)
 		{
-			uint16_t vi = (uint16_t)(y * PlanetTile::TILE_SIZE + x);
+			ids[i] = (GLuint)i;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, draw_id_bo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * ids.size(), ids.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
 
-			uvs[vi] = glm::vec2(
-				((double)x / (double)PlanetTile::TILE_SIZE) * 1000.0,
-				((double)y / (double)PlanetTile::TILE_SIZE) * 1000.0);
+	// Buffers are orphaned, so we don't wait for the previous frame
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_data_bo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(TileDrawData) * draw_data.size(), draw_data.data(), GL_STREAM_DRAW);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, tile_data_bo);
 
-		}
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, draw_cmd_bo);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand) * (cw_cmds.size() + ccw_cmds.size()), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawCommand) * cw_cmds.size(), cw_cmds.data());
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawCommand) * cw_cmds.size(), 
+		sizeof(DrawCommand) * ccw_cmds.size(), ccw_cmds.data());
+
+	glBindVertexArray(in_vao);
+	glBindVertexBuffer(0, vertex_buffer, 0, stride);
+	glBindVertexBuffer(1, draw_id_bo, 0, sizeof(GLuint));
+
+	if (!cw_cmds.empty())
+	{
+		glFrontFace(GL_CW);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)0, (GLsizei)cw_cmds.size(), 0);
 	}
 
+	if (!ccw_cmds.empty())
+	{
+		glFrontFace(GL_CCW);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, 
+			(void*)(sizeof(DrawCommand) * cw_cmds.size()), (GLsizei)ccw_cmds.size(), 0);
+	}
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+
+void PlanetRenderer::generate_and_upload_index_buffer()
+{
+	PlanetTile::generate_index_array_with_skirts(indices, bulk_index_count);
+
 	glGenVertexArrays(1, &vao);
 	glGenVertexArrays(1, &water_vao);
-	glGenBuffers(1, &uv_bo);
 	glGenBuffers(1, &ebo);
+	glGenBuffers(1, &draw_id_bo);
+	glGenBuffers(1, &tile_data_bo);
+	glGenBuffers(1, &draw_cmd_bo);
+	draw_id_count = 0;
 
 	glBindVertexArray(vao);
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * indices.size(), indices.data(), GL_STATIC_DRAW);
 
-	glBindBuffer(GL_ARRAY_BUFFER, uv_bo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(uvs[0]) * uvs.size(), uvs.data(), GL_STATIC_DRAW);
 
-
-	// position
+	// position, quantized in the tile box
 	glEnableVertexAttribArray(0);
-	glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileVertex, pos));
+	glVertexAttribFormat(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PlanetTileVertex, pos));
 	glVertexAttribBinding(0, 0);
-	// normal
+	// normal, octahedral encoded
 	glEnableVertexAttribArray(1);
-	glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileVertex, nrm));
+	glVertexAttribFormat(1, 2, GL_SHORT, GL_TRUE, offsetof(PlanetTileVertex, nrm));
 	glVertexAttribBinding(1, 0);
 	// color
 	glEnableVertexAttribArray(2);
-	glVertexAttribFormat(2, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileVertex, col));
+	glVertexAttribFormat(2, 3, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(PlanetTileVertex, col));
 	glVertexAttribBinding(2, 0);
-	// Planet's global UV and texture chooser
-	glEnableVertexAttribArray(3);
-	glVertexAttribFormat(3, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileVertex, planet_uv_tex));
-	glVertexAttribBinding(3, 0);
 
-	// PBR sourced from buffer 1 (PBR pipeline)
-	glEnableVertexAttribArray(4);
-	glVertexAttribFormat(4, 2, GL_FLOAT, GL_FALSE, 0);
-	glVertexAttribBinding(4, 1);
+	// draw id, one per instance from buffer 1
+	glEnableVertexAttribArray(3);
+	glVertexAttribIFormat(3, 1, GL_UNSIGNED_INT, 0);
+	glVertexAttribBinding(3, 1);
+	glVertexBindingDivisor(1, 1);
 
 	glBindVertexArray(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -302,23 +320,24 @@ void PlanetRenderer::generate_and_upload_index_buffer()
 
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
 
-	// position
+	// position, quantized in the tile box
 	glEnableVertexAttribArray(0);
-	glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileWaterVertex, pos));
+	glVertexAttribFormat(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PlanetTileWaterVertex, pos));
 	glVertexAttribBinding(0, 0);
-	// normal
+	// normal, octahedral encoded
 	glEnableVertexAttribArray(1);
-	glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, offsetof(PlanetTileWaterVertex, nrm));
+	glVertexAttribFormat(1, 2, GL_SHORT, GL_TRUE, offsetof(PlanetTileWaterVertex, nrm));
 	glVertexAttribBinding(1, 0);
 	// depth
 	glEnableVertexAttribArray(2);
 	glVertexAttribFormat(2, 1, GL_FLOAT, GL_FALSE, offsetof(PlanetTileWaterVertex, depth));
 	glVertexAttribBinding(2, 0);
 
-	// PBR sourced from buffer 1
+	// draw id, one per instance from buffer 1 (UVs are derived from gl_VertexID)
 	glEnableVertexAttribArray(3);
-	glVertexAttribFormat(3, 2, GL_FLOAT, GL_FALSE, 0);
+	glVertexAttribIFormat(3, 1, GL_UNSIGNED_INT, 0);
 	glVertexAttribBinding(3, 1);
+	glVertexBindingDivisor(1, 1);
 
 	glBindVertexArray(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
@@ -340,7 +359,11 @@ PlanetRenderer::PlanetRenderer()
 PlanetRenderer::~PlanetRenderer()
 {
 	glDeleteBuffers(1, &ebo);
+	glDeleteBuffers(1, &draw_id_bo);
+	glDeleteBuffers(1, &tile_data_bo);
+	glDeleteBuffers(1, &draw_cmd_bo);
 	glDeleteVertexArrays(1, &vao);
+	glDeleteVertexArrays(1, &water_vao);
 }
 
 
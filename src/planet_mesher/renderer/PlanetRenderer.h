@@ -23,12 +23,47 @@ private:
 	// The VAO is also shaded
 	std::array<uint16_t, PlanetTile::INDEX_COUNT> indices;
 	size_t bulk_index_count;
-	GLuint ebo, vao, uv_bo;
+	GLuint ebo, vao;
 
 	// Water only uses a different vao, same index buffer
 	GLuint water_vao;
 
+	// Per tile data, read by the shaders indexed by draw id (std430 layout!)
+	struct TileDrawData
+	{
+		glm::mat4 tform;
+		// Camera relative, used by the deferred renderer
+		glm::mat4 m_tform;
+		glm::mat4 rotm_tform;
+		glm::mat4 sph_tform;
+		// xy = tile min, z = depth
+		glm::vec4 tile;
+		// land: do_detail, water: clockwise
+		int32_t flag;
+		int32_t base_vertex;
+		int32_t pad[2];
+	};
+
+	// Matches the layout expected by glMultiDrawElementsIndirect
+	struct DrawCommand
+	{
+		GLuint count;
+		GLuint instance_count;
+		GLuint first_index;
+		GLint base_vertex;
+		GLuint base_instance;
+	};
+
+	std::vector<TileDrawData> draw_data;
+	// The draw id buffer simply holds 0->draw_id_count, as we
+	// are on GL 4.3 and cannot use gl_DrawID
+	GLuint draw_id_bo, tile_data_bo, draw_cmd_bo;
+	size_t draw_id_count;
+
 	void generate_and_upload_index_buffer();
+	// Draws clockwise commands and then counter-clockwise ones, with draw_data already filled
+	void issue_draws(GLuint in_vao, GLuint vertex_buffer, GLsizei stride,
+		const std::vector<DrawCommand>& cw_cmds, const std::vector<DrawCommand>& ccw_cmds);
 
 
 	// Current detail up means which direction is up pointing
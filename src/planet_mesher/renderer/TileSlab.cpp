@@ -0,0 +1,67 @@
+#include "TileSlab.h"
+#include <renderer/util/StagingRing.h>
+
+void TileSlab::grow()
+{
+	size_t n_slot_count = slot_count == 0 ? INITIAL_SLOTS : slot_count * 2;
+
+	GLuint n_buffer;
+	glGenBuffers(1, &n_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, n_buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)(n_slot_count * slot_size), nullptr, GL_STATIC_DRAW);
+
+	if (buffer != 0)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)(slot_count * slot_size));
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// Lower slots are handed out first
+	for (size_t i = n_slot_count; i > slot_count; i--)
+	{
+		free_slots.push_back(i - 1);
+	}
+
+	buffer = n_buffer;
+	slot_count = n_slot_count;
+}
+
+size_t TileSlab::allocate()
+{
+	if (free_slots.empty())
+	{
+		grow();
+	}
+
+	size_t slot = free_slots.back();
+	free_slots.pop_back();
+	return slot;
+}
+
+void TileSlab::free(size_t slot)
+{
+	// The GPU may still be drawing from it, but writes are GL commands too, so they
+	// happen after said draws
+	free_slots.push_back(slot);
+}
+
+void TileSlab::upload(size_t slot, const void* data, StagingRing& staging)
+{
+	staging.copy(buffer, slot * slot_size, data, slot_size);
+}
+
+TileSlab::TileSlab(size_t slot_size)
+{
+	this->slot_size = slot_size;
+	buffer = 0;
+	slot_count = 0;
+	grow();
+}
+
+TileSlab::~TileSlab()
+{
+	glDeleteBuffers(1, &buffer);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+
+class StagingRing;
+
+// A single vertex buffer for all tiles of a planet (of a given kind: land or water),
+// split in fixed size slots, so every visible tile can go out in a single multi draw
+// using base vertices. It doubles its size when full (copying on the GPU).
+class TileSlab
+{
+private:
+
+	GLuint buffer;
+	size_t slot_size;
+	size_t slot_count;
+	std::vector<size_t> free_slots;
+
+	void grow();
+
+public:
+
+	static constexpr size_t INITIAL_SLOTS = 128;
+
+	// Returns the slot, growing if needed
+	size_t allocate();
+	void free(size_t slot);
+
+	void upload(size_t slot, const void* data, StagingRing& staging);
+
+	// May change after allocate!
+	GLuint get_buffer() const { return buffer; }
+	size_t get_slot_size() const { return slot_size; }
+	size_t get_used_bytes() const { return (slot_count - free_slots.size()) * slot_size; }
+	size_t get_total_bytes() const { return slot_count * slot_size; }
+
+	// Call once an OpenGL context is available
+	explicit TileSlab(size_t slot_size);
+	~TileSlab();
+};
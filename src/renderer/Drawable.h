@@ -37,6 +37,11 @@ public:
 	// Objects with higher priority get drawn first
 	virtual int get_forward_priority() { return 0.0; }
 
+	// Return true and write an absolute coordinates AABB if the drawable can
+	// be culled. Drawables which return false are drawn on every pass
+	// (planets, skyboxes, etc...)
+	virtual bool get_bounds(glm::dvec3& min, glm::dvec3& max) { return false; }
+
 	bool is_in_renderer() 
 	{
 		return added;
@@ -99,10 +99,17 @@ void Renderer::do_shadows(PlanetarySystem* system, glm::dvec3 camera_pos)
 			glViewport(0, 0, shadow_cam.size, shadow_cam.size);
 			glClear(GL_DEPTH_BUFFER_BIT);
 
+			// Depth clamp is disabled, so near and far planes are also tested
+			shadow_cam.frustum = make_frustum(shadow_cam.proj * shadow_cam.view, shadow_cam.cam_pos,
+									 true, false, &shadow_cull_stats);
+			cull(shadow_cam.frustum);
 
 			for(Drawable* d : shadow)
 			{
-				d->shadow_pass(shadow_cam);
+				if(is_visible(d, &shadow_cull_stats))
+				{
+					d->shadow_pass(shadow_cam);
+				}
 			}
 
 			if(light->get_type() == Light::SUN)
@@ -264,6 +271,8 @@ void Renderer::render_env_face(glm::dvec3 sample_pos, size_t face)
 
 	c_uniforms.screen_size = glm::vec2(ibl_source->resolution, ibl_source->resolution);
 	c_uniforms.iscreen_size = glm::ivec2(c_uniforms.screen_size);
+	c_uniforms.frustum = make_frustum(proj_view, sample_pos, false, true, &env_cull_stats);
+	cull(c_uniforms.frustum);
 
 
 	glm::dvec4 vport = glm::dvec4(0, 0, ibl_source->resolution, ibl_source->resolution);
@@ -271,7 +280,10 @@ void Renderer::render_env_face(glm::dvec3 sample_pos, size_t face)
 
 	for (Drawable* d : env_map)
 	{
-		d->deferred_pass(c_uniforms, true);
+		if(is_visible(d, &env_cull_stats))
+		{
+			d->deferred_pass(c_uniforms, true);
+		}
 	}
 
 	// TODO: Disable texture creation in the framebuffer to avoid unused space
@@ -289,7 +301,10 @@ void Renderer::render_env_face(glm::dvec3 sample_pos, size_t face)
 
 	for (Drawable* d : env_map)
 	{
-		d->forward_pass(c_uniforms, true);
+		if(is_visible(d, nullptr))
+		{
+			d->forward_pass(c_uniforms, true);
+		}
 	}
 
 	// TODO: Find a way to generate the mipmap only for one face
@@ -347,6 +362,11 @@ void Renderer::render(PlanetarySystem* system)
 	}
 	c_uniforms.brdf = brdf->id;
 
+	main_cull_stats.reset();
+	shadow_cull_stats.reset();
+	env_cull_stats.reset();
+	bvh.build(all_drawables, c_uniforms.cam_pos);
+
 
 	if(quality.pbr.quality != RendererQuality::PBR::Quality::SIMPLE && env_enabled && render_enabled)
 	{
@@ -362,7 +382,8 @@ void Renderer::render(PlanetarySystem* system)
 		{
 			if(quality.pbr.simple_sampling)
 			{
-				env_map_sample();
+				// Rendered by env_map_step as the frame budget allows
+				env_faces_pending = std::min<size_t>(6, env_faces_pending + quality.pbr.faces_per_sample);
 			}
 			else
 			{
@@ -373,18 +394,30 @@ void Renderer::render(PlanetarySystem* system)
 		}
 	}
 
+	scheduler.run();
+
 
 
 	prepare_deferred();
 
 	if (render_enabled)
 	{
+		// The main camera uses depth clamping, so only side planes are tested
+		c_uniforms.frustum = make_frustum(c_uniforms.proj_view, c_uniforms.cam_pos, false, true, &main_cull_stats);
+
+		// Shadows and env map faces overwrite the visible set, so we cull
+		// again after them
+		cull(c_uniforms.frustum);
 		for (Drawable* d : deferred)
 		{
-			d->deferred_pass(c_uniforms);
+			if(is_visible(d, &main_cull_stats))
+			{
+				d->deferred_pass(c_uniforms);
+			}
 		}
 
 		do_shadows(system, c_uniforms.cam_pos);
+		cull(c_uniforms.frustum);
 		prepare_forward(c_uniforms);
 
 		// Sort forward drawables
@@ -396,7 +429,10 @@ void Renderer::render(PlanetarySystem* system)
 
 		for (Drawable* d : forward)
 		{
-			d->forward_pass(c_uniforms);
+			if(is_visible(d, nullptr))
+			{
+				d->forward_pass(c_uniforms);
+			}
 		}
 
 		if (debug_drawer->debug_enabled)
@@ -429,6 +465,65 @@ void Renderer::render(PlanetarySystem* system)
 }
 
 
+Frustum Renderer::make_frustum(const glm::dmat4& proj_view, glm::dvec3 origin, bool test_depth,
+							   bool use_angular_size, CullStats* stats)
+{
+	if(!quality.culling.enabled)
+	{
+		return Frustum();
+	}
+
+	double angular = use_angular_size ? quality.culling.min_angular_size : 0.0;
+	return Frustum::from_proj_view(proj_view, origin, test_depth, angular, stats);
+}
+
+void Renderer::cull(const Frustum& frustum)
+{
+	visible.clear();
+
+	if(frustum.enabled)
+	{
+		bvh.query(frustum, visible);
+	}
+}
+
+bool Renderer::is_visible(Drawable* d, CullStats* stats)
+{
+	if(!quality.culling.enabled || !bvh.is_tracked(d))
+	{
+		return true;
+	}
+
+	bool vis = visible.find(d) != visible.end();
+	if(stats)
+	{
+		stats->drawables_tested++;
+		if(!vis)
+		{
+			stats->drawables_culled++;
+		}
+	}
+
+	return vis;
+}
+
+void Renderer::do_culling_imgui()
+{
+	ImGui::Checkbox("Culling enabled", &quality.culling.enabled);
+	ImGui::Text("BVH: %i drawables, %i nodes", (int)bvh.get_item_count(), (int)bvh.get_node_count());
+
+	auto show = [](const char* name, const CullStats& st)
+	{
+		ImGui::Text("%s: drawables %i/%i culled, meshes %i/%i culled, %i nodes visited", name,
+			  (int)st.drawables_culled, (int)st.drawables_tested,
+			  (int)st.meshes_culled, (int)st.meshes_tested, (int)st.bvh_nodes_visited);
+	};
+
+	show("Main", main_cull_stats);
+	show("Shadow", shadow_cull_stats);
+	show("Env map", env_cull_stats);
+}
+
 void Renderer::add_drawable(Drawable* d, std::string n_id)
 {
 	logger->check(!d->is_in_renderer(), "Tried to add an already added drawable");
@@ -618,6 +713,7 @@ Renderer::Renderer(cpptoml::table& settings)
 	env_first = true;
 	env_last_pos = glm::dvec3(0.0, 0.0, 0.0);
 	env_last_time = 0.0;
+	env_faces_pending = 0;
 
 
 	override_viewport = glm::dvec4(0.0, 0.0, 1.0, 1.0);
@@ -636,6 +732,12 @@ Renderer::Renderer(cpptoml::table& settings)
 	height = settings.get_qualified_as<int>("renderer.height").value_or(512);
 	scale = (float)settings.get_qualified_as<double>("renderer.scale").value_or(1.0);
 	type = settings.get_qualified_as<std::string>("renderer.type").value_or("windowed");
+	scheduler.budget = settings.get_qualified_as<double>("renderer.frame_budget").value_or(2.0) * 1e-3;
+	// Below planet tiles and LOD, as a late env map face is barely noticeable
+	scheduler.add_task("env_map", FrameScheduler::LOW, [this](FrameScheduler& sched)
+	{
+		return env_map_step(sched);
+	});
 
 
 
@@ -764,11 +866,34 @@ void Renderer::set_ibl_source(Cubemap* cubemap)
 #include <universe/entity/entities/VehicleEntity.h>
 #include <game/GameState.h>
 
-void Renderer::env_map_sample()
+glm::dvec3 Renderer::get_env_sample_pos()
 {
 	auto* vent = (VehicleEntity*)osp->game_state->universe.entities[1];
 	// TODO: Adjust so we avoid being underground, etc...
-	glm::dvec3 sample_pos = to_dvec3(vent->vehicle->root->get_global_transform().getOrigin());
+	return to_dvec3(vent->vehicle->root->get_global_transform().getOrigin());
+}
+
+bool Renderer::env_map_step(FrameScheduler& sched)
+{
+	if(env_faces_pending == 0)
+	{
+		return false;
+	}
+
+	glm::dvec3 sample_pos = get_env_sample_pos();
+	do
+	{
+		render_env_face(sample_pos, env_face);
+		env_face = (env_face + 1) % 6;
+		env_faces_pending--;
+	} while(env_faces_pending > 0 && sched.has_time());
+
+	return env_faces_pending > 0;
+}
+
+void Renderer::env_map_sample()
+{
+	glm::dvec3 sample_pos = get_env_sample_pos();
 
 	size_t samples = quality.pbr.faces_per_sample;
 	if(env_first)
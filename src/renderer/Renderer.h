@@ -19,6 +19,8 @@
 #include <assets/Cubemap.h>
 
 #include "RendererQuality.h"
+#include "culling/DrawableBVH.h"
+#include "util/FrameScheduler.h"
 
 //#define ENABLE_GL_DEBUG
 
@@ -95,6 +97,19 @@ private:
 
 	std::vector<Light*> lights;
 
+	// Rebuilt every frame, queried on every pass
+	DrawableBVH bvh;
+	// Reused to avoid allocations
+	std::unordered_set<Drawable*> visible;
+
+	// Builds a frustum for the pass if culling is enabled, otherwise it's disabled
+	Frustum make_frustum(const glm::dmat4& proj_view, glm::dvec3 origin, bool test_depth,
+					  bool use_angular_size, CullStats* stats);
+	// Fills visible with the drawables that pass the frustum
+	void cull(const Frustum& frustum);
+	// Call after cull, also counts culled drawables
+	bool is_visible(Drawable* d, CullStats* stats);
+
 	// Used for env_map sampling
 	glm::dvec3 env_last_pos;
 	double env_last_time;
@@ -102,6 +117,11 @@ private:
 	size_t env_face;
 	bool env_first;
 	bool env_enabled;
+	// Faces left for the current sample, rendered by a scheduler task
+	size_t env_faces_pending;
+
+	glm::dvec3 get_env_sample_pos();
+	bool env_map_step(FrameScheduler& sched);
 
 public:
 	Cubemap* ibl_source = nullptr;
@@ -112,6 +132,13 @@ public:
 
 	RendererQuality quality;
 
+	// Non-critical work done within renderer.frame_budget, run every frame
+	// before rendering
+	FrameScheduler scheduler;
+
+	// Statistics of the last rendered frame (env_map accumulates all faces rendered)
+	CullStats main_cull_stats, shadow_cull_stats, env_cull_stats;
+
 	// If it's not (0,0,1,1), it will apply a glViewport
 	// to forward and deferred (GUI is always full) adjusted
 	// for these coeficitents
@@ -143,6 +170,9 @@ public:
 	// is rendering to the screen
 	void do_imgui();
 
+	// Shows culling statistics, call inside an ImGui window
+	void do_culling_imgui();
+
 	void finish();
 
 
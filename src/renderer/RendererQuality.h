@@ -48,6 +48,16 @@ struct RendererQuality
 
 	Atmosphere atmosphere;
 
+	struct Culling
+	{
+		bool enabled;
+		// Objects whose bounding sphere is smaller than this (radians) are not
+		// drawn on the main camera and env map passes
+		double min_angular_size;
+	};
+
+	Culling culling;
+
 
 	std::string get_shader_defines() const
 	{
@@ -148,6 +158,9 @@ public:
 		SAFE_TOML_GET(to.atmosphere.sub_iterations, "atmosphere.sub_iterations", int);
 		SAFE_TOML_GET(to.atmosphere.low_end, "atmosphere.low_end", bool);
 
+		SAFE_TOML_GET_OR(to.culling.enabled, "culling.enabled", bool, true);
+		SAFE_TOML_GET_OR(to.culling.min_angular_size, "culling.min_angular_size", double, 0.0);
+
 		SAFE_TOML_GET(to.use_planet_detail_normal, "planet.use_detail_normal", bool);
 		SAFE_TOML_GET(to.use_planet_detail_map, "planet.use_detail_map", bool);
 	}
@@ -1,6 +1,7 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <glad/glad.h>
+#include "../culling/Frustum.h"
 
 struct CameraUniforms
 {
@@ -23,6 +24,9 @@ struct CameraUniforms
 	GLuint specular;
 	GLuint brdf;
 
+	// Disabled (everything passes) unless the renderer sets it up
+	Frustum frustum;
+
 	CameraUniforms()
 	{
 		irradiance = 0;
@@ -0,0 +1,128 @@
+#include "DrawableBVH.h"
+#include "../Drawable.h"
+#include <algorithm>
+
+void DrawableBVH::build(const std::vector<Drawable*>& drawables, glm::dvec3 n_origin)
+{
+	origin = n_origin;
+	items.clear();
+	nodes.clear();
+	tracked.clear();
+
+	for(Drawable* d : drawables)
+	{
+		glm::dvec3 min, max;
+		if(d->get_bounds(min, max))
+		{
+			Item it;
+			it.drawable = d;
+			it.min = min - origin;
+			it.max = max - origin;
+			it.center = (it.min + it.max) * 0.5;
+			items.push_back(it);
+			tracked.insert(d);
+		}
+	}
+
+	if(!items.empty())
+	{
+		nodes.reserve(items.size() * 2);
+		build_recursive(0, items.size());
+	}
+}
+
+int DrawableBVH::build_recursive(size_t first, size_t count)
+{
+	int idx = (int)nodes.size();
+	nodes.emplace_back();
+
+	glm::dvec3 min = items[first].min;
+	glm::dvec3 max = items[first].max;
+	glm::dvec3 cmin = items[first].center;
+	glm::dvec3 cmax = items[first].center;
+	for(size_t i = first + 1; i < first + count; i++)
+	{
+		min = glm::min(min, items[i].min);
+		max = glm::max(max, items[i].max);
+		cmin = glm::min(cmin, items[i].center);
+		cmax = glm::max(cmax, items[i].center);
+	}
+
+	nodes[idx].min = min;
+	nodes[idx].max = max;
+	nodes[idx].left = -1;
+	nodes[idx].right = -1;
+	nodes[idx].first = first;
+	nodes[idx].count = count;
+
+	if(count <= MAX_LEAF_ITEMS)
+	{
+		return idx;
+	}
+
+	// Median split along the axis where the centers are most spread
+	glm::dvec3 spread = cmax - cmin;
+	int axis = 0;
+	if(spread.y > spread[axis]) { axis = 1; }
+	if(spread.z > spread[axis]) { axis = 2; }
+
+	size_t half = count / 2;
+	std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+	[axis](const Item& a, const Item& b)
+	{
+		return a.center[axis] < b.center[axis];
+	});
+
+	// Careful, nodes may be reallocated while recursing
+	int left = build_recursive(first, half);
+	int right = build_recursive(first + half, count - half);
+	nodes[idx].left = left;
+	nodes[idx].right = right;
+	nodes[idx].count = 0;
+
+	return idx;
+}
+
+void DrawableBVH::query(const Frustum& frustum, std::unordered_set<Drawable*>& visible) const
+{
+	if(nodes.empty())
+	{
+		return;
+	}
+
+	// Our coordinates are relative to origin, the frustum wants them relative
+	// to its own origin (they are different for shadow cameras)
+	query_recursive(0, frustum, origin - frustum.origin, visible);
+}
+
+void DrawableBVH::query_recursive(int idx, const Frustum& frustum, glm::dvec3 offset,
+								  std::unordered_set<Drawable*>& visible) const
+{
+	const BVHNode& node = nodes[idx];
+	if(frustum.stats)
+	{
+		frustum.stats->bvh_nodes_visited++;
+	}
+
+	if(!frustum.test_aabb_relative(node.min + offset, node.max + offset))
+	{
+		return;
+	}
+
+	if(node.left < 0)
+	{
+		for(size_t i = node.first; i < node.first + node.count; i++)
+		{
+			const Item& it = items[i];
+			if(node.count == 1 || frustum.test_aabb_relative(it.min + offset, it.max + offset))
+			{
+				visible.insert(it.drawable);
+			}
+		}
+	}
+	else
+	{
+		query_recursive(node.left, frustum, offset, visible);
+		query_recursive(node.right, frustum, offset, visible);
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "Frustum.h"
+#include <vector>
+#include <unordered_set>
+
+class Drawable;
+
+// Bounding volume hierarchy over all drawables which report bounds.
+// Drawables move every frame (and there are not that many of them) so it's
+// rebuilt every frame, which is cheap, and then queried once per pass
+// (main camera, every shadow cascade and every env map face).
+// Bounds are stored relative to the build origin (the camera) so precision
+// is good near the camera, where it matters.
+class DrawableBVH
+{
+private:
+
+	struct Item
+	{
+		Drawable* drawable;
+		glm::dvec3 min, max;
+		glm::dvec3 center;
+	};
+
+	struct BVHNode
+	{
+		glm::dvec3 min, max;
+		// Children are only valid on non-leaf nodes
+		int left, right;
+		// Range of items, only valid on leaf nodes
+		size_t first, count;
+	};
+
+	static constexpr size_t MAX_LEAF_ITEMS = 4;
+
+	glm::dvec3 origin;
+	std::vector<Item> items;
+	std::vector<BVHNode> nodes;
+	// Drawables which are culled, anything not here is always drawn
+	std::unordered_set<Drawable*> tracked;
+
+	int build_recursive(size_t first, size_t count);
+	void query_recursive(int node, const Frustum& frustum, glm::dvec3 offset,
+					  std::unordered_set<Drawable*>& visible) const;
+
+public:
+
+	void build(const std::vector<Drawable*>& drawables, glm::dvec3 origin);
+
+	// Appends to visible all tracked drawables which pass the frustum test
+	void query(const Frustum& frustum, std::unordered_set<Drawable*>& visible) const;
+
+	// Untracked drawables (no bounds) must always be drawn
+	bool is_tracked(Drawable* d) const { return tracked.find(d) != tracked.end(); }
+
+	size_t get_item_count() const { return items.size(); }
+	size_t get_node_count() const { return nodes.size(); }
+};
@@ -0,0 +1,107 @@
+#include "Frustum.h"
+
+bool Frustum::test_aabb(glm::dvec3 min, glm::dvec3 max) const
+{
+	return test_aabb_relative(min - origin, max - origin);
+}
+
+bool Frustum::test_aabb_relative(glm::dvec3 rmin, glm::dvec3 rmax) const
+{
+	if(!enabled)
+	{
+		return true;
+	}
+
+	glm::dvec3 center = (rmin + rmax) * 0.5;
+	glm::dvec3 extent = (rmax - rmin) * 0.5;
+
+	if(min_angular_size > 0.0)
+	{
+		double radius = glm::length(extent);
+		double dist = glm::length(center);
+		// If we are inside the sphere it's obviously visible
+		if(dist > radius && radius / dist < min_angular_size)
+		{
+			return false;
+		}
+	}
+
+	size_t count = test_depth ? 6 : 4;
+	for(size_t i = 0; i < count; i++)
+	{
+		glm::dvec3 n = glm::dvec3(planes[i]);
+		double r = glm::dot(glm::abs(n), extent);
+		if(glm::dot(n, center) + planes[i].w < -r)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Frustum::test_local_aabb(glm::dvec3 lmin, glm::dvec3 lmax, const glm::dmat4& model) const
+{
+	if(!enabled)
+	{
+		return true;
+	}
+
+	glm::dvec3 min, max;
+	transform_aabb(lmin, lmax, model, min, max);
+	return test_aabb(min, max);
+}
+
+void Frustum::transform_aabb(glm::dvec3 lmin, glm::dvec3 lmax, const glm::dmat4& model,
+							 glm::dvec3& out_min, glm::dvec3& out_max)
+{
+	// Arvo's method: transform the center and accumulate the
+	// absolute value of the matrix times the extents
+	glm::dvec3 center = (lmin + lmax) * 0.5;
+	glm::dvec3 extent = (lmax - lmin) * 0.5;
+
+	glm::dvec3 n_center = glm::dvec3(model * glm::dvec4(center, 1.0));
+	glm::dvec3 n_extent = glm::dvec3(0.0);
+	for(int col = 0; col < 3; col++)
+	{
+		n_extent += glm::abs(glm::dvec3(model[col])) * extent[col];
+	}
+
+	out_min = n_center - n_extent;
+	out_max = n_center + n_extent;
+}
+
+Frustum Frustum::from_proj_view(const glm::dmat4& m, glm::dvec3 origin, bool test_depth,
+								double min_angular_size, CullStats* stats)
+{
+	Frustum out;
+	out.origin = origin;
+	out.test_depth = test_depth;
+	out.min_angular_size = min_angular_size;
+	out.stats = stats;
+	out.enabled = true;
+
+	// Gribb-Hartmann extraction, glm is column major so m[c][r]
+	glm::dvec4 row0 = glm::dvec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::dvec4 row1 = glm::dvec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::dvec4 row2 = glm::dvec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::dvec4 row3 = glm::dvec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	out.planes[0] = row3 + row0;
+	out.planes[1] = row3 - row0;
+	out.planes[2] = row3 + row1;
+	out.planes[3] = row3 - row1;
+	out.planes[4] = row3 + row2;
+	out.planes[5] = row3 - row2;
+
+	for(glm::dvec4& plane : out.planes)
+	{
+		double len = glm::length(glm::dvec3(plane));
+		if(len > 0.0)
+		{
+			plane /= len;
+		}
+	}
+
+	return out;
+}
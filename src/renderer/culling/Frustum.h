@@ -0,0 +1,81 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// Counters filled while culling, a single one is used for each kind of pass
+// so we can see how much work each of them skips
+struct CullStats
+{
+	size_t drawables_tested;
+	size_t drawables_culled;
+	size_t meshes_tested;
+	size_t meshes_culled;
+	size_t bvh_nodes_visited;
+
+	void reset()
+	{
+		drawables_tested = 0; drawables_culled = 0;
+		meshes_tested = 0; meshes_culled = 0;
+		bvh_nodes_visited = 0;
+	}
+
+	CullStats()
+	{
+		reset();
+	}
+};
+
+// A view frustum in camera relative double precision coordinates.
+// The planes are obtained from a proj * view matrix WITHOUT the camera
+// translation (c_model), so absolute coordinates must be translated
+// by -origin before testing them. This keeps precision good enough
+// even at planetary scales.
+//
+// If the pass uses GL_DEPTH_CLAMP the near and far planes don't clip
+// anything, so only the side planes must be tested (test_depth = false)
+//
+// Distance culling is done using angular size: objects whose bounding
+// sphere subtends an angle (radians) smaller than min_angular_size are culled
+class Frustum
+{
+public:
+
+	// Planes are stored as (normal, distance), normal pointing inside
+	// Order: left, right, bottom, top, near, far
+	glm::dvec4 planes[6];
+	glm::dvec3 origin;
+
+	bool test_depth;
+	double min_angular_size;
+
+	// If false everything passes, used for passes which are not culled
+	// (part icons, editor, etc...)
+	bool enabled;
+
+	// Optional, may be nullptr. Mutable so const users (Node drawing) can count
+	CullStats* stats;
+
+	// Tests an absolute coordinates AABB
+	bool test_aabb(glm::dvec3 min, glm::dvec3 max) const;
+	// Same as before but the box is given relative to the origin already
+	bool test_aabb_relative(glm::dvec3 rmin, glm::dvec3 rmax) const;
+	// Transforms a local AABB by model (which may include rotation and
+	// scale) and tests the enclosing absolute AABB
+	bool test_local_aabb(glm::dvec3 lmin, glm::dvec3 lmax, const glm::dmat4& model) const;
+
+	// Transforms a local AABB into an absolute AABB
+	static void transform_aabb(glm::dvec3 lmin, glm::dvec3 lmax, const glm::dmat4& model,
+							glm::dvec3& out_min, glm::dvec3& out_max);
+
+	static Frustum from_proj_view(const glm::dmat4& proj_view, glm::dvec3 origin, bool test_depth,
+							   double min_angular_size = 0.0, CullStats* stats = nullptr);
+
+	Frustum()
+	{
+		enabled = false;
+		test_depth = false;
+		min_angular_size = 0.0;
+		stats = nullptr;
+		origin = glm::dvec3(0.0);
+	}
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <glad/glad.h>
+#include "../culling/Frustum.h"
 
 struct ShadowCamera
 {
@@ -13,4 +14,7 @@ struct ShadowCamera
 
 	glm::dmat4 tform;
 	glm::dvec3 cam_pos;
+
+	// Set by the renderer before each shadow pass
+	Frustum frustum;
 };
@@ -0,0 +1,135 @@
+#include "FrameScheduler.h"
+#include <imgui/imgui.h>
+#include <util/Profiler.h>
+#include <algorithm>
+
+size_t FrameScheduler::add_task(const std::string& name, Priority priority, TaskFn fn)
+{
+	Task task;
+	task.id = next_id++;
+	task.name = name;
+	task.priority = (int)priority;
+	task.age = 0;
+	task.pending = false;
+	task.time = 0.0;
+	task.removed = false;
+	task.fn = std::move(fn);
+
+	// Added tasks wait until run is done, as we may be iterating (and calling) tasks
+	std::vector<Task>& target = running ? added : tasks;
+	target.push_back(std::move(task));
+	return target.back().id;
+}
+
+void FrameScheduler::remove_task(size_t id)
+{
+	for(auto it = added.begin(); it != added.end(); it++)
+	{
+		if(it->id == id)
+		{
+			added.erase(it);
+			return;
+		}
+	}
+
+	for(auto it = tasks.begin(); it != tasks.end(); it++)
+	{
+		if(it->id != id)
+		{
+			continue;
+		}
+
+		if(running)
+		{
+			// Erased once run is done, as we are iterating (maybe inside it)
+			it->removed = true;
+		}
+		else
+		{
+			tasks.erase(it);
+		}
+		return;
+	}
+}
+
+void FrameScheduler::run()
+{
+	PROFILE_FUNC();
+
+	auto start = std::chrono::steady_clock::now();
+	deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(budget));
+	running = true;
+	skipped = 0;
+
+	order.clear();
+	for(size_t i = 0; i < tasks.size(); i++)
+	{
+		order.push_back(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b)
+	{
+		return tasks[a].priority + tasks[a].age > tasks[b].priority + tasks[b].age;
+	});
+
+	// Removed tasks are only marked while running, so indices stay valid
+	for(size_t idx : order)
+	{
+		if(tasks[idx].removed)
+		{
+			continue;
+		}
+
+		if(!has_time())
+		{
+			tasks[idx].age++;
+			skipped++;
+			continue;
+		}
+
+		auto t0 = std::chrono::steady_clock::now();
+		bool pending = tasks[idx].fn(*this);
+		auto t1 = std::chrono::steady_clock::now();
+
+		tasks[idx].pending = pending;
+		tasks[idx].time = std::chrono::duration<double>(t1 - t0).count();
+		tasks[idx].age = 0;
+	}
+
+	running = false;
+	tasks.erase(std::remove_if(tasks.begin(), tasks.end(), [](const Task& task)
+	{
+		return task.removed;
+	}), tasks.end());
+	for(Task& task : added)
+	{
+		tasks.push_back(std::move(task));
+	}
+	added.clear();
+
+	used_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool FrameScheduler::has_time() const
+{
+	return !running || std::chrono::steady_clock::now() < deadline;
+}
+
+void FrameScheduler::do_imgui()
+{
+	ImGui::Text("Frame budget: %.2f / %.2fms, %i tasks left out", used_time * 1000.0, budget * 1000.0, (int)skipped);
+	for(const Task& task : tasks)
+	{
+		ImGui::Text("%s: %.3fms%s (priority %i + %i)", task.name.c_str(), task.time * 1000.0,
+			task.pending ? ", pending" : "", task.priority, task.age);
+	}
+}
+
+FrameScheduler::FrameScheduler()
+{
+	next_id = 0;
+	running = false;
+	used_time = 0.0;
+	skipped = 0;
+	budget = 2.0 * 1e-3;
+}
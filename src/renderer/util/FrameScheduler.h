@@ -0,0 +1,75 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Runs deferrable per frame work (tile uploads, env map faces, planet LOD updates...)
+// within a time budget, so the frame time stays steady instead of spiking when lots
+// of work arrives at once. Work that doesn't fit rolls over to the next frame.
+//
+// Tasks are called once per frame, in priority order, while there's time left. A task
+// does at least one small step (a tile, a face), then keeps going while has_time(),
+// and returns true if it still has pending work. Tasks left out because the budget ran
+// out go up in priority every frame until they run, so nothing starves.
+class FrameScheduler
+{
+public:
+
+	// Spaced so a task left out for a few frames outranks higher priorities
+	enum Priority
+	{
+		LOW = 0,
+		NORMAL = 4,
+		HIGH = 8
+	};
+
+	using TaskFn = std::function<bool(FrameScheduler&)>;
+
+private:
+
+	struct Task
+	{
+		size_t id;
+		std::string name;
+		int priority;
+		// Frames in a row it has been left out
+		int age;
+		bool pending;
+		// Seconds it took in the last frame it ran
+		double time;
+		bool removed;
+		TaskFn fn;
+	};
+
+	std::vector<Task> tasks;
+	std::vector<Task> added;
+	std::vector<size_t> order;
+	size_t next_id;
+
+	bool running;
+	std::chrono::steady_clock::time_point deadline;
+
+	// Last frame statistics
+	double used_time;
+	size_t skipped;
+
+public:
+
+	// Seconds per frame, the renderer reads it from renderer.frame_budget
+	double budget;
+
+	// Returns an id for remove_task. Tasks may be added and removed from other tasks
+	size_t add_task(const std::string& name, Priority priority, TaskFn fn);
+	void remove_task(size_t id);
+
+	// Call once per frame
+	void run();
+	// True while the frame budget is not spent, always true outside of run
+	bool has_time() const;
+
+	// Call inside an ImGui window
+	void do_imgui();
+
+	FrameScheduler();
+};
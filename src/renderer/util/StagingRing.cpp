@@ -0,0 +1,77 @@
+#include "StagingRing.h"
+#include <cstring>
+
+void StagingRing::next_segment()
+{
+	fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	segment = (segment + 1) % SEGMENT_COUNT;
+	head = segment * segment_size;
+
+	if (fences[segment] != 0)
+	{
+		// Only blocks if the GPU is a whole ring behind us
+		GLenum result = glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (result == GL_TIMEOUT_EXPIRED)
+		{
+			result = glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+		glDeleteSync(fences[segment]);
+		fences[segment] = 0;
+	}
+}
+
+void StagingRing::copy(GLuint dst, size_t dst_offset, const void* data, size_t bytes)
+{
+	if (bytes > segment_size)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)dst_offset, (GLsizeiptr)bytes, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return;
+	}
+
+	if (head + bytes > (segment + 1) * segment_size)
+	{
+		next_segment();
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	void* ptr = glMapBufferRange(GL_COPY_READ_BUFFER, (GLintptr)head, (GLsizeiptr)bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	memcpy(ptr, data, bytes);
+	glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)head, (GLintptr)dst_offset, (GLsizeiptr)bytes);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	// Keep copies aligned, some drivers are picky
+	head += (bytes + 63) & ~(size_t)63;
+}
+
+StagingRing::StagingRing(size_t segment_size)
+{
+	this->segment_size = segment_size;
+	segment = 0;
+	head = 0;
+	fences.fill(0);
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glBufferData(GL_COPY_READ_BUFFER, (GLsizeiptr)get_size(), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+StagingRing::~StagingRing()
+{
+	for (GLsync fence : fences)
+	{
+		if (fence != 0)
+		{
+			glDeleteSync(fence);
+		}
+	}
+
+	glDeleteBuffers(1, &buffer);
+}
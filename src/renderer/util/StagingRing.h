@@ -0,0 +1,36 @@
+#pragma once
+#include <glad/glad.h>
+#include <array>
+
+// Streams data into GL buffers: data is written into a region of a ring buffer,
+// mapped unsynchronized (so the driver doesn't stall), and then copied to the
+// destination by the GPU. The ring is split in segments, fenced when we leave them,
+// so we never write over data the GPU has yet to copy.
+// Uploads bigger than a segment go straight through glBufferSubData.
+class StagingRing
+{
+public:
+
+	static constexpr size_t SEGMENT_COUNT = 4;
+
+private:
+
+	GLuint buffer;
+	size_t segment_size;
+	size_t segment;
+	size_t head;
+	std::array<GLsync, SEGMENT_COUNT> fences;
+
+	void next_segment();
+
+public:
+
+	// Copies bytes from data into dst (any GL buffer) at dst_offset
+	void copy(GLuint dst, size_t dst_offset, const void* data, size_t bytes);
+
+	size_t get_size() const { return segment_size * SEGMENT_COUNT; }
+
+	// Call once an OpenGL context is available
+	explicit StagingRing(size_t segment_size);
+	~StagingRing();
+};
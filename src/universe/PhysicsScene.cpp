@@ -0,0 +1,149 @@
+#include "PhysicsScene.h"
+#include "PlanetarySystem.h"
+#include <physics/LinkBreakSolver.h>
+#include <physics/ground/GroundShape.h>
+#pragma warning(push, 0)
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#pragma warning(pop)
+
+// Bullet keeps its own time accumulator for interpolation, which has no setter.
+// Scenes are stepped one tick at a time by the universe, so we set it ourselves
+template<typename T>
+class SceneWorld : public T
+{
+public:
+
+	using T::T;
+
+	void set_local_time(btScalar t)
+	{
+		this->m_localTime = t;
+	}
+};
+
+void PhysicsScene::set_local_time(btScalar t)
+{
+	if(multithreaded)
+	{
+		((SceneWorld<btDiscreteDynamicsWorldMt>*)world)->set_local_time(t);
+	}
+	else
+	{
+		((SceneWorld<btDiscreteDynamicsWorld>*)world)->set_local_time(t);
+	}
+}
+
+void PhysicsScene::update_planet_bodies()
+{
+	if(primary)
+	{
+		return;
+	}
+
+	// The system may be loaded (or reloaded) after we are created
+	if(planet_bodies.size() != system->elements.size())
+	{
+		for(btRigidBody* body : planet_bodies)
+		{
+			if(body)
+			{
+				world->removeRigidBody(body);
+				delete body;
+			}
+		}
+		planet_bodies.clear();
+
+		for(SystemElement* elem : system->elements)
+		{
+			btRigidBody* body = nullptr;
+			if(elem->config.has_surface && elem->rigid_body)
+			{
+				body = new btRigidBody(1000000000.0, nullptr, elem->ground_shape, btVector3(0, 0, 0));
+				body->setCollisionFlags(body->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
+				body->setFriction(elem->rigid_body->getFriction());
+				body->setRestitution(elem->rigid_body->getRestitution());
+				body->setActivationState(DISABLE_DEACTIVATION);
+				world->addRigidBody(body);
+			}
+			planet_bodies.push_back(body);
+		}
+	}
+
+	for(size_t i = 0; i < planet_bodies.size(); i++)
+	{
+		if(planet_bodies[i])
+		{
+			planet_bodies[i]->setWorldTransform(system->elements[i]->rigid_body->getWorldTransform());
+		}
+	}
+}
+
+void PhysicsScene::step(double pdt)
+{
+	update_planet_bodies();
+
+	// With the accumulator at zero this is exactly one tick, leaving it at zero
+	set_local_time(0.0);
+	world->stepSimulation(pdt, 1, pdt);
+}
+
+void PhysicsScene::interpolate(double t)
+{
+	set_local_time(t);
+	world->synchronizeMotionStates();
+}
+
+PhysicsScene::PhysicsScene(PlanetarySystem* system, bool multithreaded, bool primary)
+{
+	this->system = system;
+	this->multithreaded = multithreaded;
+	this->primary = primary;
+	center = glm::dvec3(0.0);
+	loader_count = 0;
+
+	collision_config = new btDefaultCollisionConfiguration();
+	broadphase = new btDbvtBroadphase();
+	solver_pool = nullptr;
+	if(multithreaded)
+	{
+		for(int i = 0; i < btGetTaskScheduler()->getNumThreads(); i++)
+		{
+			solvers.push_back(new LinkBreakSolver());
+		}
+		solver_pool = new btConstraintSolverPoolMt(solvers.data(), (int)solvers.size());
+
+		dispatcher = new btCollisionDispatcherMt(collision_config);
+		world = new SceneWorld<btDiscreteDynamicsWorldMt>(dispatcher, broadphase, solver_pool,
+			nullptr, collision_config);
+	}
+	else
+	{
+		solvers.push_back(new LinkBreakSolver());
+		dispatcher = new btCollisionDispatcher(collision_config);
+		world = new SceneWorld<btDiscreteDynamicsWorld>(dispatcher, broadphase, solvers[0], collision_config);
+	}
+
+	world->setGravity({ 0.0, 0.0, 0.0 });
+}
+
+PhysicsScene::~PhysicsScene()
+{
+	for(btRigidBody* body : planet_bodies)
+	{
+		if(body)
+		{
+			world->removeRigidBody(body);
+			delete body;
+		}
+	}
+
+	delete world;
+	delete solver_pool;
+	for(btConstraintSolver* solver : solvers)
+	{
+		delete solver;
+	}
+	delete dispatcher;
+	delete broadphase;
+	delete collision_config;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#pragma warning(push, 0)
+#include <btBulletDynamicsCommon.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#pragma warning(pop)
+
+class PlanetarySystem;
+
+// A bullet world simulating the entities around a cluster of physics loaders
+// (Entity::is_physics_loader). Loaders far away from each other (say, a lander on the
+// moon and a booster falling back to earth) can't possibly interact, so every cluster
+// gets its own world: broadphases and islands stay small and scenes are stepped in
+// parallel. The universe merges and splits scenes as loaders approach or separate
+// (see Universe::update_physics_loading).
+//
+// Every scene has its own rigidbodies for the planet surfaces (sharing the GroundShapes),
+// except the primary scene (Universe::bt_world), which holds those of the system.
+// All scenes use the same coordinates as the rest of the universe: bullet is built with
+// double precision and the whole engine (pieces, lua, colliders) expects them.
+class PhysicsScene
+{
+private:
+
+	btDefaultCollisionConfiguration* collision_config;
+	btCollisionDispatcher* dispatcher;
+	btBroadphaseInterface* broadphase;
+	// A single solver, or one per thread for the pool of the multithreaded world
+	std::vector<btConstraintSolver*> solvers;
+	btConstraintSolverPoolMt* solver_pool;
+	bool multithreaded;
+
+	PlanetarySystem* system;
+	bool primary;
+	// Copies of the system's surface rigidbodies, in element order (null without surface)
+	std::vector<btRigidBody*> planet_bodies;
+
+	void update_planet_bodies();
+	void set_local_time(btScalar t);
+
+public:
+
+	btDiscreteDynamicsWorld* world;
+
+	// Mean position and count of the loaders in the scene, as of the last clustering
+	glm::dvec3 center;
+	size_t loader_count;
+
+	bool is_primary() const { return primary; }
+
+	// Does a single bullet step of pdt. The system (and the entities physics_update)
+	// must already be at the start of it, see Universe::physics_update
+	void step(double pdt);
+	// Interpolates motion states (used for graphics) to t after the last step
+	void interpolate(double t);
+
+	// The multithreaded world needs the bullet task scheduler to be already set
+	PhysicsScene(PlanetarySystem* system, bool multithreaded, bool primary);
+	~PhysicsScene();
+};
@@ -4,6 +4,8 @@
 #include "../physics/glm/BulletGlmCompat.h"
 #include "../physics/ground/GroundShape.h"
 #include <game/GameState.h>
+#include <OSP.h>
+#include <renderer/Renderer.h>
 
 glm::dvec3 PlanetarySystem::get_gravity_vector(glm::dvec3 p, StateVector* states)
 {
@@ -157,28 +159,56 @@ void PlanetarySystem::update_physics(double dt, bool bullet)
 	if (bullet)
 	{
 		bt += dt;
-		// Give data to colliders
-		for(size_t i = 0; i < elements.size(); i++)
+		update_colliders();
+	}
+	else
+	{ 
+		t += dt;
+	}
+
+}
+
+void PlanetarySystem::update_colliders()
+{
+	for(size_t i = 0; i < elements.size(); i++)
+	{
+		SystemElement* elem = elements[i];
+		if(elem->config.has_surface)
 		{
-			SystemElement* elem = elements[i];
-			if(elem->config.has_surface)
-			{
-				btTransform tform = btTransform::getIdentity();
-				tform.setOrigin(to_btVector3(bullet_states[i].pos));
-				glm::dmat4 mat = elem->build_rotation_matrix(t0, bt);
-				glm::dquat quat = glm::dquat(mat);
+			btTransform tform = btTransform::getIdentity();
+			tform.setOrigin(to_btVector3(bullet_states[i].pos));
+			glm::dmat4 mat = elem->build_rotation_matrix(t0, bt);
+			glm::dquat quat = glm::dquat(mat);
 
-				tform.setRotation(to_btQuaternion(quat));
+			tform.setRotation(to_btQuaternion(quat));
 
-				elem->rigid_body->setWorldTransform(tform);
-			}
+			elem->rigid_body->setWorldTransform(tform);
 		}
 	}
+}
+
+void PlanetarySystem::update_rails(double dt, btDynamicsWorld* world)
+{
+	if(states_now.empty())
+	{
+		update(0.0, world, true);
+	}
+
+	// Both times are joined, they only differ by a fraction of a frame
+	double n_t = bt + dt;
+	if(ephemeris.covers(n_t))
+	{
+		ephemeris.states_at(n_t, bullet_states);
+	}
 	else
-	{ 
-		t += dt;
+	{
+		propagator->propagate(bullet_states, dt);
 	}
 
+	bt = n_t;
+	t = n_t;
+	states_now = bullet_states;
+	update_colliders();
 }
 
 void PlanetarySystem::init_physics(btDynamicsWorld* world)
@@ -244,7 +274,69 @@ void PlanetarySystem::update(double dt, btDynamicsWorld* world, bool bullet)
 void PlanetarySystem::init(btDynamicsWorld* world)
 {
 	propagator->initialize(this);
+	init_ephemeris();
+}
 
+void PlanetarySystem::init_ephemeris()
+{
+	if(osp->settings)
+	{
+		auto& settings = *osp->settings;
+		ephemeris.duration = settings.get_qualified_as<double>("universe.ephemeris_days")
+			.value_or(ephemeris.duration / 86400.0) * 86400.0;
+		ephemeris.step = settings.get_qualified_as<double>("universe.ephemeris_step").value_or(ephemeris.step);
+		ephemeris.substeps = (size_t)settings.get_qualified_as<int64_t>("universe.ephemeris_substeps")
+			.value_or((int64_t)ephemeris.substeps);
+		ephemeris.tolerance = settings.get_qualified_as<double>("universe.ephemeris_tolerance")
+			.value_or(ephemeris.tolerance);
+	}
+
+	if(elements.empty() || ephemeris.duration <= 0.0)
+	{
+		return;
+	}
+
+	logger->check(ephemeris.step > 0.0 && ephemeris.substeps > 0 && ephemeris.tolerance > 0.0,
+		"Invalid ephemeris step, substeps or tolerance");
+
+	std::vector<CartesianState> initial;
+	initial.reserve(elements.size());
+	uint64_t system_hash = BakedCache::hash(&nbody_count, sizeof(size_t));
+	for(SystemElement* elem : elements)
+	{
+		initial.emplace_back(elem->position_at_epoch, elem->velocity_at_epoch, elem->get_mass());
+		system_hash = BakedCache::hash(&initial.back().pos, sizeof(glm::dvec3), system_hash);
+		system_hash = BakedCache::hash(&initial.back().vel, sizeof(glm::dvec3), system_hash);
+		system_hash = BakedCache::hash(&initial.back().mass, sizeof(double), system_hash);
+		system_hash = BakedCache::hash(&elem->nbody, sizeof(bool), system_hash);
+	}
+
+	// The entry is per system, and is rebuilt if the parameters change
+	BakedCache& cache = osp->assets->cache;
+	std::string id = "ephemeris:" + std::to_string(system_hash);
+	double params[4] = {ephemeris.duration, ephemeris.step, (double)ephemeris.substeps, ephemeris.tolerance};
+	uint64_t source_hash = BakedCache::hash(params, sizeof(params));
+
+	BakedEntry entry = cache.read(id, "ephemeris", source_hash);
+	if(entry.file && ephemeris.read(entry.payload, entry.payload_size))
+	{
+		logger->info("Loaded ephemeris ({} segments) from cache", ephemeris.get_segment_count());
+		return;
+	}
+
+	logger->info("Building ephemeris for {} days", ephemeris.duration / 86400.0);
+	ephemeris.build(initial, 0.0, [this](std::vector<CartesianState>& states, double dt)
+	{
+		propagator->propagate(states, dt);
+	});
+	logger->info("Built ephemeris ({} segments)", ephemeris.get_segment_count());
+
+	if(cache.is_enabled())
+	{
+		BakedWriter w;
+		ephemeris.write(w.bytes);
+		cache.write(id, "ephemeris", source_hash, w);
+	}
 }
 
 static void load_body(SystemElement* body)
@@ -371,14 +463,56 @@ void PlanetarySystem::update_render(glm::dvec3 camera_pos, float fov)
 		{
 			unload_body(elements[i]);
 		}
+	}
 
-		if (elements[i]->renderer.rocky != nullptr)
+	lod_camera_pos = camera_pos;
+	if (lod_pending.empty())
+	{
+		for (size_t i = 0; i < elements.size(); i++)
 		{
-			update_render_body_rocky(elements[i], states_now[i].pos, camera_pos, t, t0);
+			if (elements[i]->renderer.rocky != nullptr)
+			{
+				lod_pending.push_back(i);
+			}
 		}
+
+		std::sort(lod_pending.begin(), lod_pending.end(), [this, camera_pos](size_t a, size_t b)
+		{
+			return glm::distance2(camera_pos, states_now[a].pos) < glm::distance2(camera_pos, states_now[b].pos);
+		});
+	}
+
+	if (!has_lod_task)
+	{
+		lod_task = osp->renderer->scheduler.add_task("planet_lod", FrameScheduler::NORMAL, [this](FrameScheduler& sched)
+		{
+			return lod_step(sched);
+		});
+		has_lod_task = true;
 	}
 }
 
+bool PlanetarySystem::lod_step(FrameScheduler& sched)
+{
+	while (!lod_pending.empty())
+	{
+		size_t i = lod_pending.front();
+		lod_pending.erase(lod_pending.begin());
+
+		// It may have been unloaded since
+		if (i < elements.size() && elements[i]->renderer.rocky != nullptr)
+		{
+			update_render_body_rocky(elements[i], states_now[i].pos, lod_camera_pos, t, t0);
+			if (!sched.has_time())
+			{
+				break;
+			}
+		}
+	}
+
+	return !lod_pending.empty();
+}
+
 #include "propagator/RK4Propagator.h"
 
 PlanetarySystem::PlanetarySystem(Universe* universe)
@@ -387,6 +521,8 @@ PlanetarySystem::PlanetarySystem(Universe* universe)
 
 	states_now.resize(0);
 	propagator = new RK4Propagator();
+	has_lod_task = false;
+	lod_task = 0;
 }
 
 
@@ -394,6 +530,11 @@ PlanetarySystem::~PlanetarySystem()
 {
 	delete propagator;
 
+	if (has_lod_task)
+	{
+		osp->renderer->scheduler.remove_task(lod_task);
+	}
+
 	// Remove physics stuff
 	
 	for(auto elem : elements)
@@ -421,6 +562,7 @@ void PlanetarySystem::load(const cpptoml::table &root)
 	{
 		auto elem = new SystemElement();
 		SerializeUtil::read_to(*toml_element, *elem);
+		elem->source_toml = toml_element;
 		elements.push_back(elem);
 
 		if(elem->nbody)
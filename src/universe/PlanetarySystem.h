@@ -4,6 +4,7 @@
 #include "../util/SerializeUtil.h"
 #include "element/SystemElement.h"
 #include "propagator/SystemPropagator.h"
+#include "propagator/Ephemeris.h"
 
 #include <renderer/Drawable.h>
 
@@ -14,6 +15,7 @@
 #include <util/Logger.h>
 
 class Universe;
+class FrameScheduler;
 
 // The planetary system holds all the SystemElements and draws and updates them
 class PlanetarySystem : public Drawable
@@ -32,10 +34,23 @@ private:
 	static void update_render_body_rocky(SystemElement* body, glm::dvec3 body_pos, glm::dvec3 camera_pos, double t, double t0);
 
 	void update_physics(double dt, bool bullet);
+	// Places the colliders of the elements at the bullet states
+	void update_colliders();
 	void init_physics(btDynamicsWorld* world);
+	// Loads the ephemeris from the cache, or builds (and caches) it
+	void init_ephemeris();
 
 	std::vector<glm::dvec3> pts;
 
+	// Rocky bodies whose LOD is yet to be updated, closest to the camera first. It's
+	// done by a task in the renderer's FrameScheduler, so it may take a few frames
+	std::vector<size_t> lod_pending;
+	glm::dvec3 lod_camera_pos;
+	bool has_lod_task;
+	size_t lod_task;
+
+	bool lod_step(FrameScheduler& sched);
+
 public:
 
 	double bt, t, t0;
@@ -59,6 +74,10 @@ public:
 	StateVector bullet_states;
 
 	SystemPropagator* propagator;
+
+	// States of the elements for a while after the start (system time 0), so
+	// predictions and plotting can query them instead of propagating
+	Ephemeris ephemeris;
 	
 	glm::dvec3 get_gravity_vector(glm::dvec3 point, StateVector* states);
 
@@ -69,6 +88,9 @@ public:
 	bool needs_env_map_pass() override { return true; }
 
 	void update(double dt, btDynamicsWorld* world, bool bullet);
+	// Advances both the states and bullet states by a (big) dt, for time warp on rails.
+	// The ephemeris is used if it covers the new time
+	void update_rails(double dt, btDynamicsWorld* world);
 
 	void init(btDynamicsWorld* world);
 
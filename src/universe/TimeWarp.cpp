@@ -0,0 +1,116 @@
+#include "TimeWarp.h"
+#include "Universe.h"
+#include <OSP.h>
+#include <imgui/imgui.h>
+
+size_t TimeWarp::get_max_physics_level() const
+{
+	size_t out = 0;
+	for(size_t i = 0; i < LEVEL_COUNT; i++)
+	{
+		if(LEVELS[i] <= MAX_PHYSICS_FACTOR)
+		{
+			out = i;
+		}
+	}
+	return out;
+}
+
+void TimeWarp::set_level(size_t n_level)
+{
+	requested_level = n_level >= LEVEL_COUNT ? LEVEL_COUNT - 1 : n_level;
+}
+
+void TimeWarp::update(Universe* universe, double dt)
+{
+	bool was_rails = is_rails();
+	level = requested_level;
+
+	if(is_rails())
+	{
+		for(Entity* e : universe->entities)
+		{
+			if(!e->timewarp_safe())
+			{
+				level = std::min(requested_level, get_max_physics_level());
+				break;
+			}
+		}
+	}
+
+	if(is_rails() && !was_rails)
+	{
+		for(Entity* e : universe->entities)
+		{
+			e->enter_rails();
+		}
+	}
+
+	if(is_rails() != was_rails)
+	{
+		logger->info("Time warp x{} ({})", get_factor(), is_rails() ? "rails" : "physics");
+	}
+
+	stat_sim_time += dt * get_factor();
+	stat_real_time += dt;
+	if(stat_real_time >= 1.0)
+	{
+		sim_days_per_second = (stat_sim_time / (24.0 * 60.0 * 60.0)) / stat_real_time;
+		stat_sim_time = 0.0;
+		stat_real_time = 0.0;
+	}
+}
+
+void TimeWarp::drop_to_physics()
+{
+	if(!is_rails())
+	{
+		return;
+	}
+
+	level = std::min(requested_level, get_max_physics_level());
+	logger->info("Time warp x{} (physics), an entity is no longer safe", get_factor());
+}
+
+void TimeWarp::do_imgui()
+{
+	ImGui::Text("Warp: x%.0f (%s)", get_factor(), is_rails() ? "rails" : "physics");
+	if(is_limited())
+	{
+		ImGui::Text("Limited from x%.0f, an entity is not safe", LEVELS[requested_level]);
+	}
+	ImGui::Text("%.4f days/s", sim_days_per_second);
+
+	if(ImGui::Button("<<"))
+	{
+		decrease();
+	}
+	ImGui::SameLine();
+	if(ImGui::Button(">>"))
+	{
+		increase();
+	}
+	ImGui::SameLine();
+	if(ImGui::Button("Stop"))
+	{
+		set_level(0);
+	}
+}
+
+TimeWarp::TimeWarp()
+{
+	requested_level = 0;
+	level = 0;
+	stat_sim_time = 0.0;
+	stat_real_time = 0.0;
+	sim_days_per_second = 0.0;
+
+	rails_step = 1.0;
+	min_altitude = 10000.0;
+	if(osp->settings)
+	{
+		auto& settings = *osp->settings;
+		rails_step = settings.get_qualified_as<double>("universe.warp_rails_step").value_or(rails_step);
+		min_altitude = settings.get_qualified_as<double>("universe.warp_min_altitude").value_or(min_altitude);
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+
+class Universe;
+
+// Makes the universe run faster than real time. There are two kinds of warp:
+// - Physics warp (factors up to MAX_PHYSICS_FACTOR): everything is simulated as usual,
+//   bullet simply does more fixed steps every frame.
+// - Rails warp: entities are put on rails (vehicles pack and leave the bullet world),
+//   and the system and every trajectory are advanced with steps of up to rails_step,
+//   without bullet. Machines don't run.
+// Rails warp needs every entity to be timewarp_safe, otherwise the factor drops to
+// the highest physics warp level (until they are safe again).
+class TimeWarp
+{
+public:
+
+	static constexpr size_t LEVEL_COUNT = 9;
+	static constexpr double LEVELS[LEVEL_COUNT] = {1.0, 2.0, 3.0, 4.0, 10.0, 100.0, 1000.0, 10000.0, 100000.0};
+	static constexpr double MAX_PHYSICS_FACTOR = 4.0;
+
+	// Maximum step while on rails, in seconds
+	double rails_step;
+	// Vehicles closer than this to a surface (or inside an atmosphere) are unsafe for rails warp
+	double min_altitude;
+
+private:
+
+	size_t requested_level;
+	size_t level;
+
+	// Warp performance, measured over about a second of real time
+	double stat_sim_time;
+	double stat_real_time;
+	double sim_days_per_second;
+
+	size_t get_max_physics_level() const;
+
+public:
+
+	// Chooses the level for this frame, entering rails if needed. dt is real time
+	void update(Universe* universe, double dt);
+
+	// Leaves rails warp (keeping the requested level) until the entities are safe again,
+	// called by the universe if an entity becomes unsafe in the middle of the rails steps
+	void drop_to_physics();
+
+	void set_level(size_t level);
+	void increase() { set_level(requested_level + 1); }
+	void decrease() { set_level(requested_level == 0 ? 0 : requested_level - 1); }
+	size_t get_level() const { return level; }
+	size_t get_requested_level() const { return requested_level; }
+	// True if the requested level can't be used right now as some entity is not safe
+	bool is_limited() const { return level != requested_level; }
+
+	double get_factor() const { return LEVELS[level]; }
+	bool is_rails() const { return get_factor() > MAX_PHYSICS_FACTOR; }
+
+	// Simulated days per real second, the actual speed of the warp (frames take time!)
+	double get_sim_days_per_second() const { return sim_days_per_second; }
+
+	void do_imgui();
+
+	TimeWarp();
+};
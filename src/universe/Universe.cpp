@@ -1,19 +1,15 @@
 #include "Universe.h"
 #include <util/Profiler.h>
+#include <util/JobSystem.h>
+#include <physics/JobTaskScheduler.h>
+#include <OSP.h>
+#include <unordered_map>
+#include <algorithm>
 
 #ifdef OSPGL_LRDB
 #include <LRDB/server.hpp>
 #endif
 
-static void bullet_tick(btDynamicsWorld* world, btScalar tstep)
-{
-	Universe* uv = (Universe*)world->getWorldUserInfo();
-
-	// Call the system physics tick
-	uv->physics_update(tstep);
-}
-
-
 std::unordered_set<EventHandler, EventHandlerHasher>& Universe::index_event_receivers(const std::string& str)
 {
 	auto it = event_receivers.find(str);
@@ -30,6 +26,13 @@ std::unordered_set<EventHandler, EventHandlerHasher>& Universe::index_event_rece
 
 void Universe::emit_event(const std::string& event_id, EventArguments args)
 {
+	if(in_parallel_update)
+	{
+		std::lock_guard<std::mutex> lock(deferred_events_mtx);
+		deferred_events.emplace_back(event_id, std::move(args));
+		return;
+	}
+
 	auto& rc = index_event_receivers(event_id);
 
 	for (EventHandler ev : rc)
@@ -41,6 +44,7 @@ void Universe::emit_event(const std::string& event_id, EventArguments args)
 
 void Universe::sign_up_for_event(const std::string& event_id, EventHandler id)
 {
+	std::lock_guard<std::mutex> lock(event_receivers_mtx);
 	auto& rc = index_event_receivers(event_id);
 	rc.insert(id);
 }
@@ -48,11 +52,268 @@ void Universe::sign_up_for_event(const std::string& event_id, EventHandler id)
 
 void Universe::drop_out_of_event(const std::string& event_id, EventHandler id)
 {
+	std::lock_guard<std::mutex> lock(event_receivers_mtx);
 	auto& rc = index_event_receivers(event_id);
 	rc.erase(id);
 }
 
 
+void Universe::flush_deferred_events()
+{
+	// Handlers may emit more events, these run immediately
+	std::vector<std::pair<std::string, EventArguments>> events;
+	events.swap(deferred_events);
+	for(auto& pair : events)
+	{
+		emit_event(pair.first, std::move(pair.second));
+	}
+}
+
+void Universe::update_physics_loading()
+{
+	loaders.clear();
+	loader_origins.clear();
+	for(Entity* e : entities)
+	{
+		if(e->is_physics_loader())
+		{
+			loaders.push_back(e);
+			loader_origins.push_back(e->get_physics_origin());
+		}
+	}
+
+	// Without loaders, physics are left as they are
+	if(loaders.empty())
+	{
+		return;
+	}
+
+	if(separate_physics_scenes)
+	{
+		update_physics_scenes();
+	}
+
+	for(Entity* e : entities)
+	{
+		glm::dvec3 origin = e->get_physics_origin();
+		double dist = HUGE_VAL;
+		size_t nearest = 0;
+		for(size_t i = 0; i < loader_origins.size(); i++)
+		{
+			double loader_dist = glm::distance(origin, loader_origins[i]);
+			if(loader_dist < dist)
+			{
+				dist = loader_dist;
+				nearest = i;
+			}
+		}
+		dist = glm::max(dist - e->get_physics_radius(), 0.0);
+
+		if(separate_physics_scenes)
+		{
+			// Same distance at which vehicles leave the world, so nothing out of
+			// a scene is ever in bullet
+			PhysicsScene* scene = dist < unload_distance ? loader_scenes[nearest] : nullptr;
+			if(scene != e->physics_scene)
+			{
+				move_to_scene(e, scene);
+			}
+		}
+
+		e->update_physics_distance(dist);
+	}
+
+	// Scenes left without loaders have no entities now
+	for(auto it = physics_scenes.begin(); it != physics_scenes.end();)
+	{
+		if((*it)->loader_count == 0 && !(*it)->is_primary())
+		{
+			delete *it;
+			it = physics_scenes.erase(it);
+		}
+		else
+		{
+			it++;
+		}
+	}
+}
+
+void Universe::update_physics_scenes()
+{
+	// Loaders go in the same cluster if anything loaded around one of them could
+	// touch what's loaded around the other. Tiny union-find over the loaders
+	size_t count = loaders.size();
+	std::vector<size_t> parent(count);
+	for(size_t i = 0; i < count; i++)
+	{
+		parent[i] = i;
+	}
+
+	auto find_root = [&parent](size_t i)
+	{
+		while(parent[i] != i)
+		{
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	};
+
+	for(size_t i = 0; i < count; i++)
+	{
+		for(size_t j = i + 1; j < count; j++)
+		{
+			double reach = 2.0 * unload_distance + loaders[i]->get_physics_radius() + loaders[j]->get_physics_radius();
+			if(glm::distance(loader_origins[i], loader_origins[j]) < reach)
+			{
+				parent[find_root(i)] = find_root(j);
+			}
+		}
+	}
+
+	// Index the clusters
+	std::vector<size_t> loader_cluster(count);
+	std::vector<std::vector<size_t>> clusters;
+	std::unordered_map<size_t, size_t> root_to_cluster;
+	for(size_t i = 0; i < count; i++)
+	{
+		size_t root = find_root(i);
+		auto it = root_to_cluster.find(root);
+		if(it == root_to_cluster.end())
+		{
+			it = root_to_cluster.emplace(root, clusters.size()).first;
+			clusters.emplace_back();
+		}
+		loader_cluster[i] = it->second;
+		clusters[it->second].push_back(i);
+	}
+
+	// Bigger clusters choose first, so when a scene splits the most loaders stay
+	std::vector<size_t> order(clusters.size());
+	for(size_t i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&clusters](size_t a, size_t b)
+	{
+		return clusters[a].size() > clusters[b].size();
+	});
+
+	for(PhysicsScene* scene : physics_scenes)
+	{
+		scene->loader_count = 0;
+		scene->center = glm::dvec3(0.0);
+	}
+
+	// Every cluster keeps the scene most of its loaders are in (when scenes merge,
+	// the others move there), unless it was already taken
+	std::vector<PhysicsScene*> cluster_scene(clusters.size(), nullptr);
+	for(size_t c : order)
+	{
+		std::unordered_map<PhysicsScene*, size_t> votes;
+		for(size_t i : clusters[c])
+		{
+			PhysicsScene* scene = loaders[i]->physics_scene;
+			if(scene && scene->loader_count == 0)
+			{
+				votes[scene]++;
+			}
+		}
+
+		PhysicsScene* chosen = nullptr;
+		size_t chosen_votes = 0;
+		for(const auto& pair : votes)
+		{
+			if(pair.second > chosen_votes)
+			{
+				chosen = pair.first;
+				chosen_votes = pair.second;
+			}
+		}
+
+		if(chosen == nullptr)
+		{
+			for(PhysicsScene* scene : physics_scenes)
+			{
+				if(scene->loader_count == 0)
+				{
+					chosen = scene;
+					break;
+				}
+			}
+		}
+
+		if(chosen == nullptr)
+		{
+			chosen = new PhysicsScene(&system, multithreaded_physics && bt_scheduler, false);
+			physics_scenes.push_back(chosen);
+		}
+
+		for(size_t i : clusters[c])
+		{
+			chosen->center += loader_origins[i];
+		}
+		chosen->loader_count = clusters[c].size();
+		chosen->center /= (double)chosen->loader_count;
+		cluster_scene[c] = chosen;
+	}
+
+	loader_scenes.resize(count);
+	for(size_t i = 0; i < count; i++)
+	{
+		loader_scenes[i] = cluster_scene[loader_cluster[i]];
+	}
+}
+
+void Universe::move_to_scene(Entity* e, PhysicsScene* scene)
+{
+	if(e->physics_scene)
+	{
+		e->disable_bullet(e->physics_scene->world);
+	}
+
+	e->physics_scene = scene;
+
+	if(scene)
+	{
+		e->enable_bullet(scene->world);
+	}
+}
+
+void Universe::step_physics(double dt, int max_ticks)
+{
+	PROFILE_BLOCK("physics");
+
+	// Same as bullet's own fixed stepping, time over the maximum ticks is lost
+	physics_time += dt;
+	int ticks = (int)(physics_time / PHYSICS_STEPSIZE);
+	physics_time -= ticks * PHYSICS_STEPSIZE;
+	ticks = std::min(ticks, max_ticks);
+
+	for(int i = 0; i < ticks; i++)
+	{
+		physics_update(PHYSICS_STEPSIZE);
+
+		if(physics_scenes.size() == 1)
+		{
+			// So a multithreaded world can use the job system itself
+			physics_scenes[0]->step(PHYSICS_STEPSIZE);
+		}
+		else
+		{
+			osp->jobs->parallel_for(physics_scenes.size(), [this](size_t i)
+			{
+				physics_scenes[i]->step(PHYSICS_STEPSIZE);
+			});
+		}
+	}
+
+	for(PhysicsScene* scene : physics_scenes)
+	{
+		scene->interpolate(physics_time);
+	}
+}
+
 void Universe::physics_update(double pdt)
 {
 	// Do the physics update on the system
@@ -70,20 +331,82 @@ void Universe::update(double dt)
 
 	if(!paused)
 	{
+		timewarp.update(this, dt);
+		if(timewarp.is_rails())
+		{
+			update_rails(dt * timewarp.get_factor());
+			return;
+		}
+
+		// Physics warp, bullet still uses a fixed step so it simply steps more times
+		int warp_steps = (int)std::ceil(timewarp.get_factor());
+		dt *= timewarp.get_factor();
+
 		// update BEFORE the physics!
 		system.update(dt, bt_world, false);
 
+		update_physics_loading();
+
+		parallel_entities.clear();
 		for (Entity* e : entities)
 		{
-			e->update(dt);
+			if(e->can_update_in_parallel())
+			{
+				parallel_entities.push_back(e);
+			}
+			else
+			{
+				e->update(dt);
+			}
+		}
+
+		if(!parallel_entities.empty())
+		{
+			PROFILE_BLOCK("parallel entities");
+			in_parallel_update = true;
+			osp->jobs->parallel_for(parallel_entities.size(), [this, dt](size_t i)
+			{
+				parallel_entities[i]->update(dt);
+			});
+			in_parallel_update = false;
+			flush_deferred_events();
 		}
 
-		bt_world->stepSimulation(dt, MAX_PHYSICS_STEPS, PHYSICS_STEPSIZE);
+		step_physics(dt, MAX_PHYSICS_STEPS * warp_steps);
 
 	}
 
 }
 
+void Universe::update_rails(double dt)
+{
+	PROFILE_BLOCK("rails");
+
+	// Entities are moved with the system states at the start of every step
+	size_t steps = (size_t)std::ceil(dt / timewarp.rails_step);
+	double step = dt / (double)steps;
+	for(size_t i = 0; i < steps; i++)
+	{
+		for(Entity* e : entities)
+		{
+			e->update_rails(step);
+		}
+
+		system.update_rails(step, bt_world);
+
+		// A single frame may be thousands of steps, so vehicles can reach an atmosphere
+		// or a surface in the middle of it. The rest of the frame is dropped then
+		for(Entity* e : entities)
+		{
+			if(!e->timewarp_safe())
+			{
+				timewarp.drop_to_physics();
+				return;
+			}
+		}
+	}
+}
+
 int64_t Universe::get_uid()
 {
 	// Increase BEFORE, uid=0 is the "nullptr" of ids
@@ -102,19 +425,59 @@ Entity* Universe::get_entity(int64_t uid)
 	return it->second;
 }
 
+PhysicsScene* Universe::get_physics_scene(btDynamicsWorld* world)
+{
+	for(PhysicsScene* scene : physics_scenes)
+	{
+		if(scene->world == world)
+		{
+			return scene;
+		}
+	}
+
+	return nullptr;
+}
+
 
 Universe::Universe() : system(this)
 {
 	uid = 0;
 	paused = false;
+	in_parallel_update = false;
+	parallel_vehicles = false;
+	multithreaded_physics = false;
+	separate_physics_scenes = true;
+	physics_time = 0.0;
+	unpack_distance = 200.0;
+	pack_distance = 250.0;
+	load_distance = 2000.0;
+	unload_distance = 2500.0;
+	if(osp->settings)
+	{
+		auto& settings = *osp->settings;
+		parallel_vehicles = settings.get_qualified_as<bool>("universe.parallel_vehicles").value_or(false);
+		multithreaded_physics = settings.get_qualified_as<bool>("universe.multithreaded_physics").value_or(false);
+		separate_physics_scenes = settings.get_qualified_as<bool>("universe.physics_scenes").value_or(true);
+		unpack_distance = settings.get_qualified_as<double>("universe.unpack_distance").value_or(unpack_distance);
+		pack_distance = settings.get_qualified_as<double>("universe.pack_distance").value_or(pack_distance);
+		load_distance = settings.get_qualified_as<double>("universe.load_distance").value_or(load_distance);
+		unload_distance = settings.get_qualified_as<double>("universe.unload_distance").value_or(unload_distance);
+	}
 
-	bt_collision_config = new btDefaultCollisionConfiguration();
-	bt_dispatcher = new btCollisionDispatcher(bt_collision_config);
-	bt_brf_interface = new btDbvtBroadphase();
-	bt_solver = new btSequentialImpulseConstraintSolver();
-	bt_world = new btDiscreteDynamicsWorld(bt_dispatcher, bt_brf_interface, bt_solver, bt_collision_config);
-	
-	bt_world->setGravity({ 0.0, 0.0, 0.0 });
+	logger->check(unpack_distance <= pack_distance && load_distance <= unload_distance,
+		"Physics unload distances must be greater than the load ones");
+
+	bt_scheduler = nullptr;
+	if(multithreaded_physics && osp->jobs)
+	{
+		// The task scheduler is global to bullet, so this should be the only universe
+		bt_scheduler = new JobTaskScheduler(osp->jobs);
+		btSetTaskScheduler(bt_scheduler);
+		logger->info("Using multithreaded physics with {} threads", bt_scheduler->getNumThreads());
+	}
+
+	physics_scenes.push_back(new PhysicsScene(&system, bt_scheduler != nullptr, true));
+	bt_world = physics_scenes[0]->world;
 
 	bt_debug = new BulletDebugDrawer();
 	bt_world->setDebugDrawer(bt_debug);
@@ -128,7 +491,6 @@ Universe::Universe() : system(this)
 		btIDebugDraw::DBG_DrawAabb);
 	
 
-	bt_world->setInternalTickCallback(bullet_tick, this, true);
 
 	lua_core->load(lua_state, "__UNDEFINED__");
 
@@ -145,6 +507,19 @@ Universe::~Universe()
 		delete ent;
 	}
 
+	for(PhysicsScene* scene : physics_scenes)
+	{
+		delete scene;
+	}
+
+	if(bt_scheduler)
+	{
+		// bullet keeps it as a global, which would outlive us (and our job system)
+		btSetTaskScheduler(btGetSequentialTaskScheduler());
+		delete bt_scheduler;
+		bt_scheduler = nullptr;
+	}
+
 #ifdef OSPGL_LRDB
 	disable_debugging();
 #endif
@@ -2,8 +2,11 @@
 #include "PlanetarySystem.h"
 #include "entity/Entity.h"
 #include <any>
+#include <mutex>
 #include <unordered_set>
 #include "Events.h"
+#include "TimeWarp.h"
+#include "PhysicsScene.h"
 #pragma warning(push, 0)
 #include <btBulletDynamicsCommon.h>
 #include <BulletDynamics/ConstraintSolver/btNNCGConstraintSolver.h>
@@ -28,6 +31,19 @@
 // This will hopefully avoid event name clashing.
 // 
 // It's the responsability of the event receiver to remove the handler once it's deleted / not needed!
+//
+// Parallel vehicles:
+// If enabled in settings (universe.parallel_vehicles), every vehicle gets its own lua state,
+// and entities which allow it are updated concurrently on the job system. While that happens
+// events emitted are queued and ran on the main thread once all entities are updated, as
+// handlers may belong to any other vehicle. Machines in different vehicles can't share lua
+// globals in this mode, they must communicate through events.
+//
+// Physics scenes:
+// If enabled in settings (universe.physics_scenes), every cluster of physics loaders gets
+// its own bullet world (see PhysicsScene), and these are stepped in parallel. bt_world is
+// always the primary scene, entities start there and the universe moves them around.
+// Entities away from every loader are in no scene at all.
 class GameState;
 
 class Universe
@@ -38,11 +54,37 @@ private:
 
 	std::unordered_set<EventHandler, EventHandlerHasher>& index_event_receivers(const std::string& str);
 
+	// Signing up may happen from any thread during the parallel update
+	std::mutex event_receivers_mtx;
+	bool in_parallel_update;
+	std::mutex deferred_events_mtx;
+	std::vector<std::pair<std::string, EventArguments>> deferred_events;
+	std::vector<Entity*> parallel_entities;
+
+	void flush_deferred_events();
+
+	std::vector<Entity*> loaders;
+	std::vector<glm::dvec3> loader_origins;
+	// Scene for the cluster of every loader, as found by update_physics_scenes
+	std::vector<PhysicsScene*> loader_scenes;
+	// Tells every entity its distance to the nearest physics loader,
+	// and moves it into the scene of said loader
+	void update_physics_loading();
+	// Clusters the loaders and gives every cluster a scene, merging and splitting them
+	void update_physics_scenes();
+	// Takes the entity out of its scene (if any) and into the new one (which may be null)
+	void move_to_scene(Entity* e, PhysicsScene* scene);
 
-	btDefaultCollisionConfiguration* bt_collision_config;
-	btCollisionDispatcher* bt_dispatcher;
-	btBroadphaseInterface* bt_brf_interface;
-	btSequentialImpulseConstraintSolver* bt_solver;
+	// Time since the last physics tick
+	double physics_time;
+	// Does as many fixed physics ticks as fit in dt (up to max_ticks) on every scene
+	void step_physics(double dt, int max_ticks);
+
+	// Advances everything by dt (usually big) in steps, without bullet
+	void update_rails(double dt);
+
+
+	btITaskScheduler* bt_scheduler;
 
 	BulletDebugDrawer* bt_debug;
 
@@ -52,9 +94,23 @@ public:
 
 	// Should updates run?
 	bool paused;
+	// Is the bullet world a btDiscreteDynamicsWorldMt running on the job system?
+	// Read from settings (universe.multithreaded_physics) on creation
+	bool multithreaded_physics;
+	// Does every cluster of loaders get its own physics scene? Read from settings on creation
+	bool separate_physics_scenes;
+	// Does every vehicle get its own lua state? Read from settings on creation
+	bool parallel_vehicles;
+	// Distances to the nearest physics loader (universe.*_distance in settings):
+	// vehicles get full piece physics below unpack_distance, and are packed
+	// again above pack_distance. Packed vehicles are in the physics world
+	// as a single rigidbody below load_distance, until they go above unload_distance
+	double unpack_distance, pack_distance;
+	double load_distance, unload_distance;
 
 	friend class Entity;
 	friend class GameState;
+	friend class GameSnapshot;
 
 	static constexpr double PHYSICS_STEPSIZE = 1.0 / 30.0;
 	static constexpr int MAX_PHYSICS_STEPS = 1;
@@ -83,9 +139,12 @@ public:
 	}
 
 
+	// The world of the primary scene, physics_scenes[0]
 	btDiscreteDynamicsWorld* bt_world;
+	std::vector<PhysicsScene*> physics_scenes;
 
 	PlanetarySystem system;
+	TimeWarp timewarp;
 	std::vector<Entity*> entities;
 	std::unordered_map<int64_t, Entity*> entities_by_id;
 
@@ -98,10 +157,13 @@ public:
 	// Returns nullptr if not found
 	Entity* get_entity(int64_t id);
 
+	// The scene simulated in world, nullptr if not found
+	PhysicsScene* get_physics_scene(btDynamicsWorld* world);
+
 	template<typename T> 
 	T* get_entity_as(int64_t id);
 
-	// Note: This is automatically called from bullet
+	// Called before every physics tick, for all scenes at once
 	void physics_update(double pdt);
 	void update(double dt);
 	
@@ -18,6 +18,9 @@ public:
 
 	ElementConfig config;
 
+	// What the element was loaded from, saves write it back
+	std::shared_ptr<const cpptoml::table> source_toml;
+
 	PlanetaryBodyRenderer renderer;
 
 	// Externally managed, these are not present on gas giants
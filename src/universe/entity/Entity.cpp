@@ -8,6 +8,8 @@ void Entity::setup(Universe* universe, int64_t uid)
 {
 	this->universe = universe;
 	this->uid = uid;
+	// Entities start in the primary scene, the universe moves them as needed
+	this->physics_scene = universe->physics_scenes[0];
 	init();
 }
 
@@ -34,3 +36,23 @@ Entity* Entity::load_entity(std::string type, cpptoml::table& toml)
 
 	return n_ent;
 }
+
+Entity* Entity::load_entity(std::string type, BakedReader& r)
+{
+	Entity* n_ent = nullptr;
+
+	if (type == "vehicle")
+	{
+		n_ent = new VehicleEntity(r);
+	}
+	else if (type == "building")
+	{
+		n_ent = new BuildingEntity(r);
+	}
+	else
+	{
+		logger->fatal("Unknown entity type '{}'", type);
+	}
+
+	return n_ent;
+}
@@ -10,6 +10,10 @@
 
 #include <cpptoml.h>
 
+class BakedWriter;
+class BakedReader;
+class PhysicsScene;
+
 // An entity is something which exists on the world, 
 // it has graphics, and can exists on the bullet physics
 // world.
@@ -33,14 +37,24 @@ private:
 
 	Universe* universe;
 	bool bullet_enabled;
+	PhysicsScene* physics_scene;
 
 	int64_t uid;
 
+	friend class Universe;
+
+protected:
+
+	// Only tells which scene we are already in, use when created inside another
+	// scene's world (for example, vehicles separated from others)
+	void set_physics_scene(PhysicsScene* scene) { physics_scene = scene; }
+
 public:
 
 	// You should start simulating bullet physics here
+	// Also called when moved to another physics scene (see PhysicsScene)
 	virtual void enable_bullet(btDynamicsWorld* world) {}
-	// You must stop simulating bullet physics here
+	// You must stop simulating bullet physics here, removing everything from world
 	virtual void disable_bullet(btDynamicsWorld* world) {}
 
 	// Return our position to be used by physics loading
@@ -54,10 +68,18 @@ public:
 	// (This entity will also be loaded)
 	virtual bool is_physics_loader() { return false; }
 
+	// Called every update with the distance to the nearest physics loader, only
+	// if there is any loader
+	virtual void update_physics_distance(double dist) {}
+
 	// Visual update, always realtime
 	virtual void update(double dt) {};
 
-	// Ticks alongside bullet (bullet tick callback)
+	// Return true if update may run in a job thread, concurrently with other
+	// entities. Only touch your own data (and lua state) then, events are fine
+	virtual bool can_update_in_parallel() { return false; }
+
+	// Ticks alongside bullet, for every entity whatever its scene
 	// Note: Ticks before bullet update! (pretick)
 	virtual void physics_update(double pdt) {};
 
@@ -70,6 +92,12 @@ public:
 	// or in atmospheric flight
 	virtual bool timewarp_safe() { return true; }
 
+	// Called when rails time warp starts (see TimeWarp), leave the bullet world here
+	virtual void enter_rails() {}
+	// Replaces update and physics_update while on rails, dt may be big.
+	// The system states are those at the start of the step
+	virtual void update_rails(double dt) {}
+
 	void setup(Universe* universe, int64_t uid);
 
 	inline int64_t get_uid()
@@ -82,6 +110,12 @@ public:
 		return universe;
 	}
 
+	// Null if we are too far from every physics loader
+	inline PhysicsScene* get_physics_scene()
+	{
+		return physics_scene;
+	}
+
 	void enable_bullet_wrapper(bool value, btDynamicsWorld* world)
 	{
 		bullet_enabled = value;
@@ -100,6 +134,13 @@ public:
 
 	// Used while loading saves 
 	static Entity* load_entity(std::string type, cpptoml::table& toml);
+	// Used while loading snapshots, r only contains the entity data
+	static Entity* load_entity(std::string type, BakedReader& r);
+
+	// Write whatever the toml constructor needs to restore the entity
+	virtual void write_toml(cpptoml::table& target) {}
+	// Same as write_toml, for the binary snapshots (see GameSnapshot)
+	virtual void write_snapshot(BakedWriter& w) {}
 
 	virtual ~Entity();
 };
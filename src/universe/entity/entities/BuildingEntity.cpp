@@ -1,5 +1,6 @@
 #include "BuildingEntity.h"
 #include <util/serializers/glm.h>
+#include <assets/BakedCache.h>
 
 
 glm::dmat4 BuildingEntity::get_model_matrix(bool bullet)
@@ -20,11 +21,13 @@ glm::dmat4 BuildingEntity::get_model_matrix(bool bullet)
 
 BuildingEntity::BuildingEntity(AssetHandle<BuildingPrototype>&& proto)
 {
+	rigid = nullptr;
 	this->proto = std::move(proto);
 }
 
 BuildingEntity::BuildingEntity(cpptoml::table& toml) 
 {
+	rigid = nullptr;
 	this->proto = AssetHandle<BuildingPrototype>(*toml.get_as<std::string>("building"));
 
 	std::string body = *toml.get_as<std::string>("in_body");
@@ -33,6 +36,33 @@ BuildingEntity::BuildingEntity(cpptoml::table& toml)
 	this->traj.set_parameters(body, rel_pos, rel_rot);
 }
 
+BuildingEntity::BuildingEntity(BakedReader& r)
+{
+	rigid = nullptr;
+	this->proto = AssetHandle<BuildingPrototype>(r.read_string());
+
+	std::string body = r.read_string();
+	glm::dvec3 rel_pos = r.read_pod<glm::dvec3>();
+	glm::dquat rel_rot = r.read_pod<glm::dquat>();
+	this->traj.set_parameters(body, rel_pos, rel_rot);
+}
+
+void BuildingEntity::write_toml(cpptoml::table& target)
+{
+	target.insert("building", proto.pkg + ":" + proto.name);
+	target.insert("in_body", traj.get_body_name());
+	serialize_to_table(traj.get_relative_pos(), target, "rel_pos");
+	serialize_to_table(traj.get_relative_rot(), target, "rel_rot");
+}
+
+void BuildingEntity::write_snapshot(BakedWriter& w)
+{
+	w.write_string(proto.pkg + ":" + proto.name);
+	w.write_string(traj.get_body_name());
+	w.write_pod(traj.get_relative_pos());
+	w.write_pod(traj.get_relative_rot());
+}
+
 
 BuildingEntity::~BuildingEntity()
 {
@@ -53,7 +83,9 @@ void BuildingEntity::enable_bullet(btDynamicsWorld* world)
 
 void BuildingEntity::disable_bullet(btDynamicsWorld* world)
 {
-
+	world->removeRigidBody(rigid);
+	delete rigid;
+	rigid = nullptr;
 }
 
 void BuildingEntity::init()
@@ -66,6 +98,12 @@ void BuildingEntity::init()
 
 void BuildingEntity::physics_update(double pdt)
 {
+	// Out of every physics scene
+	if(rigid == nullptr)
+	{
+		return;
+	}
+
 	WorldState now = traj.get_state(get_universe()->system.bt, 0, true);
 	btTransform trans = btTransform::getIdentity();
 	
@@ -86,3 +124,12 @@ void BuildingEntity::shadow_pass(ShadowCamera& cu)
 	const Node* node = proto->model->node_by_name.find("building")->second;
 	node->draw_shadow(cu, get_model_matrix(false), true);
 }
+
+bool BuildingEntity::get_bounds(glm::dvec3& min, glm::dvec3& max)
+{
+	min = glm::dvec3(HUGE_VAL);
+	max = glm::dvec3(-HUGE_VAL);
+
+	const Node* node = proto->model->node_by_name.find("building")->second;
+	return node->get_bounds(get_model_matrix(false), min, max, true);
+}
@@ -21,6 +21,7 @@ public:
 
 	BuildingEntity(AssetHandle<BuildingPrototype>&& proto);
 	BuildingEntity(cpptoml::table& toml);
+	BuildingEntity(BakedReader& r);
 
 	~BuildingEntity();
 
@@ -32,11 +33,15 @@ public:
 	virtual void physics_update(double pdt) override;
 
 	virtual std::string get_type() override { return "building"; }
+	virtual void write_toml(cpptoml::table& target) override;
+	virtual void write_snapshot(BakedWriter& w) override;
 
 	virtual void deferred_pass(CameraUniforms& cu, bool is_env) override;
 	virtual void shadow_pass(ShadowCamera& cu) override;
 
 	virtual bool needs_deferred_pass() override { return true; }
 	virtual bool needs_shadow_pass() override { return true; }
+
+	virtual bool get_bounds(glm::dvec3& min, glm::dvec3& max) override;
 };
 
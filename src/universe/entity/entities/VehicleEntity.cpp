@@ -2,10 +2,20 @@
 
 #include "../../../renderer/Renderer.h"
 #include "../../Universe.h"
+#include "../../vehicle/VehicleLoader.h"
+#include "../../vehicle/VehicleSnapshot.h"
 
 void VehicleEntity::init()
 {
-	this->vehicle->set_world(get_universe()->bt_world);
+	// Vehicles separated from another are already in its world
+	if(vehicle->get_world())
+	{
+		set_physics_scene(get_universe()->get_physics_scene(vehicle->get_world()));
+	}
+	else
+	{
+		vehicle->set_world(get_universe()->bt_world);
+	}
 	this->vehicle->init(get_universe());
 }
 
@@ -19,14 +29,106 @@ void VehicleEntity::physics_update(double pdt)
 	vehicle->physics_update(pdt);
 }
 
+bool VehicleEntity::timewarp_safe()
+{
+	const PlanetarySystem& system = get_universe()->system;
+	double min_altitude = get_universe()->timewarp.min_altitude;
+	glm::dvec3 pos = get_physics_origin();
+
+	for(size_t i = 0; i < system.elements.size() && i < system.bullet_states.size(); i++)
+	{
+		const ElementConfig& config = system.elements[i]->config;
+		if(!config.has_surface)
+		{
+			continue;
+		}
+
+		double limit = config.radius + min_altitude;
+		if(config.has_atmo)
+		{
+			limit = glm::max(limit, config.atmo.radius);
+		}
+
+		if(glm::distance(pos, system.bullet_states[i].pos) < limit)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+glm::dvec3 VehicleEntity::get_physics_origin()
+{
+	return to_dvec3(vehicle->root->get_global_transform().getOrigin());
+}
+
+void VehicleEntity::update_physics_distance(double dist)
+{
+	vehicle->update_physics_distance(dist);
+}
+
 VehicleEntity::VehicleEntity(Vehicle* vehicle) : debug(this)
 {
 	this->vehicle = vehicle;
+	physics_loader = false;
 }
 
 VehicleEntity::VehicleEntity(cpptoml::table& toml) : debug(this)
 {
+	physics_loader = toml.get_as<bool>("physics_loader").value_or(false);
+
+	vehicle = new Vehicle();
+	auto vehicle_toml = toml.get_table("vehicle");
+	logger->check(vehicle_toml != nullptr, "Vehicle entity without vehicle");
+	VehicleLoader(*vehicle_toml, *vehicle);
+
+	// The loader leaves the vehicle at the origin
+	auto state_toml = toml.get_table("state");
+	if(state_toml)
+	{
+		WorldState st;
+		SerializeUtil::read_to(*state_toml, st.cartesian.pos, "pos");
+		SerializeUtil::read_to(*state_toml, st.cartesian.vel, "vel");
+		SerializeUtil::read_to(*state_toml, st.rotation, "rot");
+		SerializeUtil::read_to(*state_toml, st.angular_velocity, "angvel");
+		vehicle->packed_veh.set_world_state(st);
+	}
+
+	vehicle->sort();
+}
+
+VehicleEntity::VehicleEntity(BakedReader& r) : debug(this)
+{
+	physics_loader = r.read_u32() != 0;
+
+	vehicle = new Vehicle();
+	VehicleSnapshotLoader(r, *vehicle);
+	vehicle->sort();
+}
+
+void VehicleEntity::write_toml(cpptoml::table& target)
+{
+	target.insert("physics_loader", physics_loader);
+
+	auto vehicle_toml = cpptoml::make_table();
+	VehicleSaver(*vehicle_toml, *vehicle);
+	target.insert("vehicle", vehicle_toml);
+
+	std::vector<btTransform> tforms;
+	WorldState st = vehicle->get_packed_state(tforms);
+	auto state_toml = cpptoml::make_table();
+	serialize_to_table(st.cartesian.pos, *state_toml, "pos");
+	serialize_to_table(st.cartesian.vel, *state_toml, "vel");
+	serialize_to_table(st.rotation, *state_toml, "rot");
+	serialize_to_table(st.angular_velocity, *state_toml, "angvel");
+	target.insert("state", state_toml);
+}
 
+void VehicleEntity::write_snapshot(BakedWriter& w)
+{
+	w.write_u32(physics_loader ? 1 : 0);
+	VehicleSnapshotSaver(w, *vehicle);
 }
 
 
@@ -37,10 +139,14 @@ VehicleEntity::~VehicleEntity()
 
 void VehicleEntity::enable_bullet(btDynamicsWorld * world)
 {
+	// We get into the world once update_physics_distance activates or unpacks us
+	vehicle->set_world(world);
 }
 
 void VehicleEntity::disable_bullet(btDynamicsWorld * world)
 {
+	vehicle->leave_world();
+	vehicle->set_world(nullptr);
 }
 
 
@@ -63,3 +169,18 @@ void VehicleEntity::shadow_pass(ShadowCamera& sh_cam)
 		p->model_node->draw_shadow(sh_cam, tform, true);
 	}
 }
+
+bool VehicleEntity::get_bounds(glm::dvec3& min, glm::dvec3& max)
+{
+	min = glm::dvec3(HUGE_VAL);
+	max = glm::dvec3(-HUGE_VAL);
+
+	bool any = false;
+	for(Piece* p : vehicle->all_pieces)
+	{
+		glm::dmat4 tform = to_dmat4(p->get_graphics_transform()) * glm::inverse(p->collider_offset);
+		any |= p->model_node->get_bounds(tform, min, max, true);
+	}
+
+	return any;
+}
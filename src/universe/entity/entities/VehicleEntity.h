@@ -13,25 +13,43 @@ public:
 	// including pieces
 	Vehicle* vehicle;
 	VehicleDebug debug;
+	// Vehicles near this one get full physics (usually the controlled vehicle)
+	bool physics_loader;
 
 
+	bool is_physics_loader() override { return physics_loader; }
+	glm::dvec3 get_physics_origin() override;
+	void update_physics_distance(double dist) override;
+
 	void enable_bullet(btDynamicsWorld * world) override;
 	void disable_bullet(btDynamicsWorld * world) override;
 
 	void init() override;
 	void update(double dt) override;
+	// Only if the vehicle has its own lua state
+	bool can_update_in_parallel() override { return vehicle->has_own_lua_state(); }
 	void physics_update(double pdt) override;
 
+	// Unsafe inside atmospheres or close to surfaces
+	bool timewarp_safe() override;
+	void enter_rails() override { vehicle->leave_world(); }
+	void update_rails(double dt) override { vehicle->update_rails(dt); }
+
 	void deferred_pass(CameraUniforms& camera_uniforms, bool is_env) override;
 	bool needs_deferred_pass() override { return true; }
 
 	void shadow_pass(ShadowCamera& sh_camera) override;
 	bool needs_shadow_pass() override { return true; }
 
+	bool get_bounds(glm::dvec3& min, glm::dvec3& max) override;
+
 	VehicleEntity(Vehicle* vehicle);
 	VehicleEntity(cpptoml::table& toml);
+	VehicleEntity(BakedReader& r);
 	~VehicleEntity();
 
 	virtual std::string get_type() override { return "vehicle"; }
+	virtual void write_toml(cpptoml::table& target) override;
+	virtual void write_snapshot(BakedWriter& w) override;
 };
 
@@ -26,6 +26,10 @@ public:
 	virtual WorldState get_state(double t0, double t, bool use_bullet = false) override;
 	void set_parameters(std::string body_name, glm::dvec3 rel_pos, glm::dquat rel_rot);
 
+	const std::string& get_body_name() const { return elem_name; }
+	glm::dvec3 get_relative_pos() const { return initial_relative_pos; }
+	glm::dquat get_relative_rot() const { return initial_rotation; }
+
 	LandedTrajectory();
 	~LandedTrajectory();
 
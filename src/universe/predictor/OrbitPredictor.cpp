@@ -1,12 +1,419 @@
 #include "OrbitPredictor.h"
+#include "../propagator/SystemPropagator.h"
+#include "../propagator/Ephemeris.h"
+#include <glm/gtx/norm.hpp>
+#include <algorithm>
+#include <cmath>
 
+static glm::dvec3 gravity_at(glm::dvec3 pos, const std::vector<glm::dvec3>& body_pos,
+	const std::vector<CartesianState>& bodies)
+{
+	glm::dvec3 acc = glm::dvec3(0.0);
+	for(size_t i = 0; i < bodies.size(); i++)
+	{
+		glm::dvec3 dx = body_pos[i] - pos;
+		double dist = glm::length(dx);
+		acc += G * (bodies[i].mass / (dist * dist * dist)) * dx;
+	}
+
+	return acc;
+}
+
+static size_t find_closest(glm::dvec3 pos, const std::vector<CartesianState>& bodies)
+{
+	size_t closest = 0;
+	double closest_dist2 = HUGE_VAL;
+	for(size_t i = 0; i < bodies.size(); i++)
+	{
+		double dist2 = glm::length2(bodies[i].pos - pos);
+		if(dist2 < closest_dist2)
+		{
+			closest = i;
+			closest_dist2 = dist2;
+		}
+	}
+
+	return closest;
+}
+
+static void push_point(Prediction* seg, double t, const CartesianState& vessel,
+	const std::vector<CartesianState>& bodies)
+{
+	seg->times.push_back(t);
+	seg->positions.push_back(vessel.pos);
+	if(seg->has_velocities)
+	{
+		seg->velocities.push_back(vessel.vel);
+	}
+	seg->body_positions.push_back(bodies[seg->body].pos);
+	seg->t1 = t;
+	seg->v_last = vessel.vel;
+}
+
+static void start_segment(Prediction* seg, bool has_velocities, size_t body, double t,
+	const CartesianState& vessel, const std::vector<CartesianState>& bodies)
+{
+	seg->has_velocities = has_velocities;
+	seg->body = body;
+	seg->t0 = t;
+	seg->p0 = vessel.pos;
+	seg->v0 = vessel.vel;
+	push_point(seg, t, vessel, bodies);
+}
+
+const Prediction* Prediction::get_segment(double t) const
+{
+	const Prediction* seg = this;
+	while(seg != nullptr)
+	{
+		if(!seg->times.empty() && t >= seg->t0 && t <= seg->t1)
+		{
+			return seg;
+		}
+		seg = seg->next.get();
+	}
+
+	return nullptr;
+}
+
+glm::dvec3 Prediction::get_position(double t) const
+{
+	auto it = std::upper_bound(times.begin(), times.end(), t);
+	if(it == times.begin())
+	{
+		return positions.front();
+	}
+	if(it == times.end())
+	{
+		return positions.back();
+	}
 
+	size_t i1 = it - times.begin();
+	size_t i0 = i1 - 1;
+	double h = times[i1] - times[i0];
+	double s = (t - times[i0]) / h;
+
+	if(has_velocities)
+	{
+		// Cubic hermite
+		double s2 = s * s;
+		double s3 = s2 * s;
+		return (2.0 * s3 - 3.0 * s2 + 1.0) * positions[i0] + (s3 - 2.0 * s2 + s) * h * velocities[i0] +
+			(-2.0 * s3 + 3.0 * s2) * positions[i1] + (s3 - s2) * h * velocities[i1];
+	}
+	else
+	{
+		return glm::mix(positions[i0], positions[i1], s);
+	}
+}
+
+Prediction OrbitPredictor::integrate(const Request& req) const
+{
+	std::vector<CartesianState> bodies = req.bodies;
+	std::vector<CartesianState> next_bodies;
+	std::vector<glm::dvec3> start_pos(bodies.size());
+	std::vector<glm::dvec3> mid_pos(bodies.size());
+	std::vector<glm::dvec3> end_pos(bodies.size());
+
+	CartesianState vessel = req.vessel;
+	double t = req.t;
+	double t_end = req.t + req.duration;
+
+	bool use_ephemeris = req.ephemeris != nullptr && req.ephemeris->covers(t) && req.ephemeris->covers(t_end) &&
+		req.ephemeris->get_body_count() == bodies.size();
+
+	Prediction out;
+	Prediction* seg = &out;
+	start_segment(seg, req.with_velocities, find_closest(vessel.pos, bodies), t, vessel, bodies);
+	size_t points = 1;
+
+	while(t < t_end && points < max_points && run)
+	{
+		// Adaptive step from the orbital time scale around the closest body
+		size_t closest = find_closest(vessel.pos, bodies);
+		double r = glm::distance(vessel.pos, bodies[closest].pos);
+		double gm = G * bodies[closest].mass;
+		double dt = gm > 0.0 ? step_factor * glm::sqrt(r * r * r / gm) : max_step;
+		dt = glm::clamp(dt, min_step, max_step);
+		dt = glm::min(dt, t_end - t);
+
+		next_bodies = bodies;
+		if(use_ephemeris)
+		{
+			req.ephemeris->states_at(t + dt, next_bodies);
+			for(size_t i = 0; i < bodies.size(); i++)
+			{
+				start_pos[i] = bodies[i].pos;
+				end_pos[i] = next_bodies[i].pos;
+				mid_pos[i] = req.ephemeris->position_at(i, t + dt * 0.5);
+			}
+		}
+		else
+		{
+			// The system is propagated with its own propagator, as the game does
+			size_t substeps = (size_t)glm::ceil(dt / system_step);
+			for(size_t i = 0; i < substeps; i++)
+			{
+				req.propagator->propagate(next_bodies, dt / (double)substeps);
+			}
+
+			for(size_t i = 0; i < bodies.size(); i++)
+			{
+				start_pos[i] = bodies[i].pos;
+				end_pos[i] = next_bodies[i].pos;
+				// Hermite interpolation at the middle of the step
+				mid_pos[i] = (start_pos[i] + end_pos[i]) * 0.5 + (bodies[i].vel - next_bodies[i].vel) * (dt / 8.0);
+			}
+		}
+
+		// RK4 for the vessel
+		glm::dvec3 k1v = gravity_at(vessel.pos, start_pos, bodies);
+		glm::dvec3 k1x = vessel.vel;
+		glm::dvec3 k2v = gravity_at(vessel.pos + k1x * (dt * 0.5), mid_pos, bodies);
+		glm::dvec3 k2x = vessel.vel + k1v * (dt * 0.5);
+		glm::dvec3 k3v = gravity_at(vessel.pos + k2x * (dt * 0.5), mid_pos, bodies);
+		glm::dvec3 k3x = vessel.vel + k2v * (dt * 0.5);
+		glm::dvec3 k4v = gravity_at(vessel.pos + k3x * dt, end_pos, bodies);
+		glm::dvec3 k4x = vessel.vel + k3v * dt;
+
+		vessel.pos += (k1x + 2.0 * k2x + 2.0 * k3x + k4x) * (dt / 6.0);
+		vessel.vel += (k1v + 2.0 * k2v + 2.0 * k3v + k4v) * (dt / 6.0);
+
+		bodies.swap(next_bodies);
+		t += dt;
+
+		// A new segment starts when another body becomes the closest one,
+		// the point is in both segments so the path is continuous
+		closest = find_closest(vessel.pos, bodies);
+		if(closest != seg->body)
+		{
+			push_point(seg, t, vessel, bodies);
+			seg->next = std::make_unique<Prediction>();
+			seg = seg->next.get();
+			start_segment(seg, req.with_velocities, closest, t, vessel, bodies);
+		}
+		else
+		{
+			push_point(seg, t, vessel, bodies);
+		}
+		points++;
+
+		if(closest < req.radii.size() && glm::distance(vessel.pos, bodies[closest].pos) < req.radii[closest])
+		{
+			// Impact
+			break;
+		}
+	}
+
+	return out;
+}
+
+void OrbitPredictor::thread_func()
+{
+	while(true)
+	{
+		Request req;
+		Kind kind;
+
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock, [this]()
+			{
+				return !run || requests[FLIGHT_PATH].valid || requests[PLANNED].valid;
+			});
+
+			if(!run)
+			{
+				return;
+			}
+
+			// The flight path is what's being shown, so it goes first, but a planned
+			// prediction always runs after a flight path so it can't be starved
+			bool plan_turn = requests[PLANNED].valid && working_kind == FLIGHT_PATH;
+			kind = requests[FLIGHT_PATH].valid && !plan_turn ? FLIGHT_PATH : PLANNED;
+			req = std::move(requests[kind]);
+			requests[kind].valid = false;
+			working = true;
+			working_kind = kind;
+		}
+
+		Prediction pred = integrate(req);
+
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			results[kind] = std::make_unique<Prediction>(std::move(pred));
+			working = false;
+		}
+	}
+}
+
+bool OrbitPredictor::needs_prediction(double t, const CartesianState& vessel, const std::vector<CartesianState>& bodies)
+{
+	// One flight path at a time, and not too often, so while thrusting the planned
+	// prediction gets its turn, and a vessel resting on the ground (the normal force
+	// reads as thrust) doesn't integrate a whole path every frame
+	if(flight_path_pending)
+	{
+		return false;
+	}
+	if(has_requested && t >= last_request_t && t - last_request_t < min_request_interval)
+	{
+		return false;
+	}
+
+	// Thrusting, the velocity changes more than what gravity explains
+	if(has_last && t > last_t)
+	{
+		std::vector<glm::dvec3> body_pos(bodies.size());
+		for(size_t i = 0; i < bodies.size(); i++)
+		{
+			body_pos[i] = bodies[i].pos;
+		}
+
+		glm::dvec3 acc = (vessel.vel - last_vessel.vel) / (t - last_t);
+		glm::dvec3 non_grav = acc - gravity_at(vessel.pos, body_pos, bodies);
+		if(glm::length(non_grav) > thrust_threshold)
+		{
+			return true;
+		}
+	}
+
+	const Prediction* seg = flight_path.get_segment(t);
+	if(seg == nullptr)
+	{
+		return true;
+	}
+
+	// Refresh once half of the prediction is in the past
+	if(t - flight_path.t0 > flight_path_duration * 0.5)
+	{
+		return true;
+	}
+
+	double dist_to_body = glm::distance(vessel.pos, bodies[seg->body].pos);
+	double deviation = glm::distance(vessel.pos, seg->get_position(t));
+	return deviation > deviation_threshold * dist_to_body;
+}
+
+void OrbitPredictor::update_history(double t, glm::dvec3 pos)
+{
+	if(!history.empty() && t - last_history_t < history_interval)
+	{
+		return;
+	}
+
+	last_history_t = t;
+	if(history.size() < max_history_points)
+	{
+		history.push_back(pos);
+	}
+	else
+	{
+		history_loop_point = (history_loop_point + 1) % (int)max_history_points;
+		history[history_loop_point] = pos;
+	}
+}
+
+void OrbitPredictor::update(double t, const CartesianState& vessel, const std::vector<CartesianState>& bodies,
+	const std::vector<double>& radii, SystemPropagator* propagator, const Ephemeris* ephemeris)
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		if(results[FLIGHT_PATH])
+		{
+			flight_path = std::move(*results[FLIGHT_PATH]);
+			results[FLIGHT_PATH].reset();
+			flight_path_generation++;
+			flight_path_pending = requests[FLIGHT_PATH].valid || (working && working_kind == FLIGHT_PATH);
+		}
+
+		if(results[PLANNED])
+		{
+			planned = std::move(*results[PLANNED]);
+			results[PLANNED].reset();
+		}
+
+		// Most frames request nothing, the states are only copied if something is
+		bool wants_flight_path = needs_prediction(t, vessel, bodies);
+		if(wants_flight_path || has_plan_request)
+		{
+			Request req;
+			req.valid = true;
+			req.t = t;
+			req.vessel = vessel;
+			req.bodies = bodies;
+			req.radii = radii;
+			req.propagator = propagator;
+			req.ephemeris = ephemeris;
+
+			if(wants_flight_path)
+			{
+				req.duration = flight_path_duration;
+				req.with_velocities = false;
+				requests[FLIGHT_PATH] = req;
+				flight_path_pending = true;
+				has_requested = true;
+				last_request_t = t;
+				cv.notify_one();
+			}
+
+			if(has_plan_request)
+			{
+				req.duration = plan_duration;
+				req.with_velocities = true;
+				requests[PLANNED] = std::move(req);
+				has_plan_request = false;
+				cv.notify_one();
+			}
+		}
+	}
+
+	update_history(t, vessel.pos);
+
+	has_last = true;
+	last_t = t;
+	last_vessel = vessel;
+}
+
+void OrbitPredictor::request_plan(double duration)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	has_plan_request = true;
+	plan_duration = duration;
+}
+
+bool OrbitPredictor::is_busy()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return working || requests[FLIGHT_PATH].valid || requests[PLANNED].valid;
+}
 
 OrbitPredictor::OrbitPredictor()
 {
+	run = true;
+	working = false;
+	working_kind = FLIGHT_PATH;
+	has_last = false;
+	last_t = 0.0;
+	last_history_t = 0.0;
+	has_plan_request = false;
+	plan_duration = 0.0;
+	flight_path_pending = false;
+	flight_path_generation = 0;
+	has_requested = false;
+	last_request_t = 0.0;
+
+	thread = std::thread(&OrbitPredictor::thread_func, this);
 }
 
 
 OrbitPredictor::~OrbitPredictor()
 {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		run = false;
+	}
+	cv.notify_all();
+	thread.join();
 }
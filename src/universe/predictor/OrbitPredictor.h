@@ -1,7 +1,15 @@
 #pragma once
+#include "../CartesianState.h"
 #include <glm/glm.hpp>
 #include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
+class SystemPropagator;
+class Ephemeris;
 
 // Coordinates are GLOBAL, and are adjusted
 // to the plotting frame when creating
@@ -9,37 +17,56 @@
 // Changing the plotting frame just requires
 // re-doing the rendering stuff, not re-simulating
 // so that's faster
+//
+// A prediction is split in segments, one per dominant (closest) body, linked
+// through next. Steps are adaptive so every point stores its time.
 struct Prediction
 {
 
 	// If true, then velocity for every single point
 	// is stored, alognside position. This is enabled
 	// for flight plan, as maneuvers need velocity.
-	// The flight path prediction just needs position 
-	// as it's a more coarse estimation, which doesn't 
+	// The flight path prediction just needs position
+	// as it's a more coarse estimation, which doesn't
 	// allow maneuvers
-	bool has_velocities;
+	bool has_velocities = false;
 
-	double t0;
-	double tstep;
-	double t1;
+	double t0 = 0.0;
+	double t1 = 0.0;
 
+	// Index of the body dominating this segment
+	size_t body = 0;
+
+	std::vector<double> times;
 	std::vector<glm::dvec3> positions;
 	std::vector<glm::dvec3> velocities;
+	// Position of the dominant body at every point, to plot relative to it
+	std::vector<glm::dvec3> body_positions;
 
 	glm::dvec3 v_last;
 
 	glm::dvec3 p0;
 	glm::dvec3 v0;
-	
+
 	// nullptr if this is the end of the prediction
-	Prediction* next;
+	std::unique_ptr<Prediction> next;
+
+	// Returns nullptr if t is not in the prediction
+	const Prediction* get_segment(double t) const;
+	// Position at time t (which must be inside the segment)
+	glm::dvec3 get_position(double t) const;
 };
 
-// Allows prediction of an orbit in arbitrary 
-// plotting frames 
+// Allows prediction of an orbit in arbitrary
+// plotting frames
 // Vessel centerd plotting frames are special
 // as the target vessel needs to be predicted too
+//
+// Predictions are integrated in a background thread, against a copy of the
+// system states which is propagated alongside the vessel. The main thread only
+// calls update() every frame, which requests a new flight path when the vessel
+// is thrusting, deviates from the prediction or reaches its end, and picks up
+// finished predictions.
 class OrbitPredictor
 {
 public:
@@ -70,9 +97,94 @@ public:
 	// or just a higher quality, build-on-command plot
 	Prediction planned;
 
+	// Seconds predicted by the flight path
+	double flight_path_duration = 86400.0;
+	// Steps are this fraction of the orbital time scale around the closest body
+	double step_factor = 0.01;
+	double min_step = 0.05;
+	double max_step = 3600.0;
+	// Maximum step used to propagate the system during the prediction
+	double system_step = 60.0;
+	size_t max_points = 20000;
+	// Distance to the flight path, relative to the distance to its body,
+	// that triggers a new prediction
+	double deviation_threshold = 0.01;
+	// Non gravitational acceleration (m/s^2) that triggers a new prediction
+	double thrust_threshold = 0.05;
+	// Minimum seconds between flight path requests
+	double min_request_interval = 1.0;
+
+	// Call every frame, t is the time of the given states (bullet time for
+	// unpacked vessels). radii are used to stop predictions on impact.
+	// If the ephemeris covers a prediction, the bodies are queried from it instead
+	// of propagated. It must not be rebuilt while the predictor exists
+	void update(double t, const CartesianState& vessel, const std::vector<CartesianState>& bodies,
+		const std::vector<double>& radii, SystemPropagator* propagator, const Ephemeris* ephemeris = nullptr);
+
+	// Starts building the planned prediction, with velocities
+	void request_plan(double duration);
+
+	// Is the background thread working on something?
+	bool is_busy();
+
+	// Increased every time update picks up a new flight_path
+	size_t get_flight_path_generation() const { return flight_path_generation; }
 
-	
 	OrbitPredictor();
 	~OrbitPredictor();
-};
 
+private:
+
+	struct Request
+	{
+		bool valid = false;
+		double t = 0.0;
+		double duration = 0.0;
+		bool with_velocities = false;
+		CartesianState vessel;
+		std::vector<CartesianState> bodies;
+		std::vector<double> radii;
+		SystemPropagator* propagator = nullptr;
+		const Ephemeris* ephemeris = nullptr;
+	};
+
+	enum Kind
+	{
+		FLIGHT_PATH,
+		PLANNED,
+		KIND_COUNT
+	};
+
+	std::thread thread;
+	std::mutex mtx;
+	std::condition_variable cv;
+	// Checked while integrating, so destruction doesn't wait for a long prediction
+	std::atomic<bool> run;
+	bool working;
+	Kind working_kind;
+	// A flight path is requested or being integrated
+	bool flight_path_pending;
+	size_t flight_path_generation;
+
+	// Newest request of each kind, older ones are simply overwritten
+	Request requests[KIND_COUNT];
+	std::unique_ptr<Prediction> results[KIND_COUNT];
+
+	// Time of the last flight path request
+	bool has_requested;
+	double last_request_t;
+
+	// Last state given to update, to estimate thrust
+	bool has_last;
+	double last_t;
+	CartesianState last_vessel;
+	double last_history_t;
+	bool has_plan_request;
+	double plan_duration;
+
+	void thread_func();
+	void update_history(double t, glm::dvec3 pos);
+	bool needs_prediction(double t, const CartesianState& vessel, const std::vector<CartesianState>& bodies);
+
+	Prediction integrate(const Request& req) const;
+};
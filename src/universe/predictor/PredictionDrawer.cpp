@@ -1,9 +1,124 @@
 #include "PredictionDrawer.h"
+#include <util/DebugDrawer.h>
+#include <glm/gtx/norm.hpp>
 
+// Distance from p to the segment ab, squared
+static double distance2_to_segment(glm::dvec3 p, glm::dvec3 a, glm::dvec3 b)
+{
+	glm::dvec3 ab = b - a;
+	double len2 = glm::length2(ab);
+	if(len2 == 0.0)
+	{
+		return glm::length2(p - a);
+	}
+
+	double s = glm::clamp(glm::dot(p - a, ab) / len2, 0.0, 1.0);
+	return glm::length2(p - (a + ab * s));
+}
+
+// Ramer-Douglas-Peucker, without recursion as predictions may be long
+static void decimate(const std::vector<glm::dvec3>& points, double tolerance, std::vector<glm::dvec3>& out)
+{
+	out.clear();
+	if(points.size() <= 2)
+	{
+		out = points;
+		return;
+	}
+
+	std::vector<bool> keep(points.size(), false);
+	keep.front() = true;
+	keep.back() = true;
+
+	double tolerance2 = tolerance * tolerance;
+	std::vector<std::pair<size_t, size_t>> stack;
+	stack.emplace_back(0, points.size() - 1);
+	while(!stack.empty())
+	{
+		auto range = stack.back();
+		stack.pop_back();
+
+		double max_dist2 = 0.0;
+		size_t max_i = range.first;
+		for(size_t i = range.first + 1; i < range.second; i++)
+		{
+			double dist2 = distance2_to_segment(points[i], points[range.first], points[range.second]);
+			if(dist2 > max_dist2)
+			{
+				max_dist2 = dist2;
+				max_i = i;
+			}
+		}
+
+		if(max_dist2 > tolerance2)
+		{
+			keep[max_i] = true;
+			stack.emplace_back(range.first, max_i);
+			stack.emplace_back(max_i, range.second);
+		}
+	}
+
+	for(size_t i = 0; i < points.size(); i++)
+	{
+		if(keep[i])
+		{
+			out.push_back(points[i]);
+		}
+	}
+}
+
+void PredictionDrawer::build(const Prediction& pred, PlottingFrame frame)
+{
+	this->frame = frame;
+	polylines.clear();
+	bodies.clear();
+
+	std::vector<glm::dvec3> points;
+	for(const Prediction* seg = &pred; seg != nullptr; seg = seg->next.get())
+	{
+		if(seg->positions.empty())
+		{
+			continue;
+		}
+
+		// The tolerance scales with the size of the segment around its body
+		double mean_dist = 0.0;
+		points.resize(seg->positions.size());
+		for(size_t i = 0; i < seg->positions.size(); i++)
+		{
+			glm::dvec3 rel = seg->positions[i] - seg->body_positions[i];
+			mean_dist += glm::length(rel);
+			points[i] = frame == PATCHED ? rel : seg->positions[i];
+		}
+		mean_dist /= (double)points.size();
 
+		polylines.emplace_back();
+		bodies.push_back(seg->body);
+		decimate(points, tolerance * mean_dist, polylines.back());
+	}
+}
+
+void PredictionDrawer::draw_debug(glm::vec3 color, const std::vector<glm::dvec3>& body_positions) const
+{
+	for(size_t l = 0; l < polylines.size(); l++)
+	{
+		const auto& line = polylines[l];
+		glm::dvec3 offset = glm::dvec3(0.0);
+		if(frame == PATCHED && bodies[l] < body_positions.size())
+		{
+			offset = body_positions[bodies[l]];
+		}
+
+		for(size_t i = 1; i < line.size(); i++)
+		{
+			debug_drawer->add_line(offset + line[i - 1], offset + line[i], color);
+		}
+	}
+}
 
 PredictionDrawer::PredictionDrawer()
 {
+	frame = INERTIAL;
 }
 
 
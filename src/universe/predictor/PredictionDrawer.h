@@ -1,8 +1,40 @@
 #pragma once
+#include "OrbitPredictor.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+// Turns predictions into decimated polylines in a plotting frame. Build once per
+// prediction (or plotting frame change), PATCHED polylines are kept relative to
+// their body so they follow it when drawn without being rebuilt.
 class PredictionDrawer
 {
 public:
+
+	enum PlottingFrame
+	{
+		// Points as they are predicted
+		INERTIAL,
+		// Every segment relative to its body, drawn around its current position
+		// (like patched conics)
+		PATCHED
+	};
+
+	// Points closer than this to the simplified line are removed, relative
+	// to the distance to the segment's body
+	double tolerance = 0.001;
+
+	PlottingFrame frame;
+
+	// One per segment, global for INERTIAL and relative to the segment body for PATCHED
+	std::vector<std::vector<glm::dvec3>> polylines;
+	// Body of each polyline
+	std::vector<size_t> bodies;
+
+	void build(const Prediction& pred, PlottingFrame frame);
+
+	// body_positions are the current positions of the bodies, used by PATCHED
+	void draw_debug(glm::vec3 color, const std::vector<glm::dvec3>& body_positions) const;
+
 	PredictionDrawer();
 	~PredictionDrawer();
 };
-
@@ -0,0 +1,394 @@
+#include "Ephemeris.h"
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+static constexpr uint32_t EPHEMERIS_MAGIC = 0x4D485045; // "EPHM"
+static constexpr uint32_t EPHEMERIS_VERSION = 1;
+
+// Evaluates the chebyshev series of the three coordinates (consecutive in c) at tau
+static glm::dvec3 clenshaw3(const double* c, double tau)
+{
+	const double* cx = c;
+	const double* cy = c + Ephemeris::COEFS;
+	const double* cz = c + Ephemeris::COEFS * 2;
+
+	glm::dvec3 b1 = glm::dvec3(0.0);
+	glm::dvec3 b2 = glm::dvec3(0.0);
+	double tau2 = tau * 2.0;
+	for(size_t k = Ephemeris::COEFS - 1; k >= 1; k--)
+	{
+		glm::dvec3 b0 = tau2 * b1 - b2 + glm::dvec3(cx[k], cy[k], cz[k]);
+		b2 = b1;
+		b1 = b0;
+	}
+
+	return tau * b1 - b2 + glm::dvec3(cx[0], cy[0], cz[0]);
+}
+
+void Ephemeris::build_fit_matrix()
+{
+	constexpr size_t N = FIT_SAMPLES + 1;
+
+	// Basis evaluated at the samples, uniformly spaced in [-1, 1]
+	std::vector<double> a(N * COEFS);
+	for(size_t i = 0; i < N; i++)
+	{
+		double tau = -1.0 + 2.0 * (double)i / (double)FIT_SAMPLES;
+		double t0 = 1.0;
+		double t1 = tau;
+		a[i * COEFS] = t0;
+		a[i * COEFS + 1] = t1;
+		for(size_t k = 2; k < COEFS; k++)
+		{
+			double t2 = 2.0 * tau * t1 - t0;
+			a[i * COEFS + k] = t2;
+			t0 = t1;
+			t1 = t2;
+		}
+	}
+
+	// Solve (A^T A) P = A^T with gauss-jordan, the system is small and well conditioned
+	std::vector<double> ata(COEFS * COEFS, 0.0);
+	fit_matrix.assign(COEFS * N, 0.0);
+	for(size_t r = 0; r < COEFS; r++)
+	{
+		for(size_t c = 0; c < COEFS; c++)
+		{
+			for(size_t i = 0; i < N; i++)
+			{
+				ata[r * COEFS + c] += a[i * COEFS + r] * a[i * COEFS + c];
+			}
+		}
+		for(size_t i = 0; i < N; i++)
+		{
+			fit_matrix[r * N + i] = a[i * COEFS + r];
+		}
+	}
+
+	for(size_t col = 0; col < COEFS; col++)
+	{
+		size_t pivot = col;
+		for(size_t r = col + 1; r < COEFS; r++)
+		{
+			if(std::abs(ata[r * COEFS + col]) > std::abs(ata[pivot * COEFS + col]))
+			{
+				pivot = r;
+			}
+		}
+		if(pivot != col)
+		{
+			std::swap_ranges(ata.begin() + pivot * COEFS, ata.begin() + (pivot + 1) * COEFS, ata.begin() + col * COEFS);
+			std::swap_ranges(fit_matrix.begin() + pivot * N, fit_matrix.begin() + (pivot + 1) * N,
+				fit_matrix.begin() + col * N);
+		}
+
+		double inv = 1.0 / ata[col * COEFS + col];
+		for(size_t c = 0; c < COEFS; c++)
+		{
+			ata[col * COEFS + c] *= inv;
+		}
+		for(size_t i = 0; i < N; i++)
+		{
+			fit_matrix[col * N + i] *= inv;
+		}
+
+		for(size_t r = 0; r < COEFS; r++)
+		{
+			double f = ata[r * COEFS + col];
+			if(r == col || f == 0.0)
+			{
+				continue;
+			}
+			for(size_t c = 0; c < COEFS; c++)
+			{
+				ata[r * COEFS + c] -= f * ata[col * COEFS + c];
+			}
+			for(size_t i = 0; i < N; i++)
+			{
+				fit_matrix[r * N + i] -= f * fit_matrix[col * N + i];
+			}
+		}
+	}
+}
+
+double Ephemeris::fit_segment(const std::vector<CartesianState>& samples, size_t first, size_t steps, double* out) const
+{
+	constexpr size_t N = FIT_SAMPLES + 1;
+	size_t stride = steps / FIT_SAMPLES;
+
+	std::fill(out, out + COEFS * 6, 0.0);
+	for(size_t i = 0; i < N; i++)
+	{
+		const CartesianState& st = samples[first + i * stride];
+		for(size_t k = 0; k < COEFS; k++)
+		{
+			double p = fit_matrix[k * N + i];
+			out[k] += p * st.pos.x;
+			out[COEFS + k] += p * st.pos.y;
+			out[COEFS * 2 + k] += p * st.pos.z;
+			out[COEFS * 3 + k] += p * st.vel.x;
+			out[COEFS * 4 + k] += p * st.vel.y;
+			out[COEFS * 5 + k] += p * st.vel.z;
+		}
+	}
+
+	// Checked at every step, not only the fitted samples
+	double max_err = 0.0;
+	for(size_t j = 0; j <= steps; j++)
+	{
+		double tau = -1.0 + 2.0 * (double)j / (double)steps;
+		glm::dvec3 pos = clenshaw3(out, tau);
+		max_err = std::max(max_err, glm::distance(pos, samples[first + j].pos));
+	}
+
+	return max_err;
+}
+
+void Ephemeris::build(const std::vector<CartesianState>& initial, double t_start, const PropagateFnc& propagate)
+{
+	if(fit_matrix.empty())
+	{
+		build_fit_matrix();
+	}
+
+	const size_t chunk_steps = FIT_SAMPLES << MAX_LEVEL;
+	chunk_length = (double)chunk_steps * step;
+	size_t chunk_count = std::max((size_t)std::ceil(duration / chunk_length), (size_t)1);
+	this->t_start = t_start;
+	t_end = t_start + (double)chunk_count * chunk_length;
+
+	bodies.clear();
+	bodies.resize(initial.size());
+	for(size_t b = 0; b < initial.size(); b++)
+	{
+		bodies[b].mass = initial[b].mass;
+		bodies[b].chunks.reserve(chunk_count);
+	}
+
+	std::vector<CartesianState> states = initial;
+	std::vector<std::vector<CartesianState>> samples(initial.size(), std::vector<CartesianState>(chunk_steps + 1));
+	std::vector<double> fitted;
+
+	for(size_t chunk = 0; chunk < chunk_count; chunk++)
+	{
+		for(size_t b = 0; b < states.size(); b++)
+		{
+			samples[b][0] = states[b];
+		}
+
+		for(size_t i = 1; i <= chunk_steps; i++)
+		{
+			for(size_t j = 0; j < substeps; j++)
+			{
+				propagate(states, step / (double)substeps);
+			}
+			for(size_t b = 0; b < states.size(); b++)
+			{
+				samples[b][i] = states[b];
+			}
+		}
+
+		// Every body uses the longest segments that fit well
+		for(size_t b = 0; b < states.size(); b++)
+		{
+			for(uint32_t level = 0; level <= MAX_LEVEL; level++)
+			{
+				size_t segments = (size_t)1 << level;
+				size_t steps = chunk_steps >> level;
+				fitted.resize(segments * COEFS * 6);
+
+				double max_err = 0.0;
+				for(size_t s = 0; s < segments && max_err <= tolerance; s++)
+				{
+					max_err = std::max(max_err, fit_segment(samples[b], s * steps, steps, &fitted[s * COEFS * 6]));
+				}
+
+				if(max_err <= tolerance || level == MAX_LEVEL)
+				{
+					BodyTable& table = bodies[b];
+					table.chunks.push_back(Chunk{level, table.coefs.size()});
+					table.coefs.insert(table.coefs.end(), fitted.begin(), fitted.end());
+					break;
+				}
+			}
+		}
+	}
+}
+
+size_t Ephemeris::get_segment_count() const
+{
+	size_t count = 0;
+	for(const BodyTable& table : bodies)
+	{
+		count += table.coefs.size() / (COEFS * 6);
+	}
+	return count;
+}
+
+const double* Ephemeris::find_segment(const BodyTable& table, double t, double& tau) const
+{
+	size_t chunk_count = table.chunks.size();
+	double rel = std::clamp((t - t_start) / chunk_length, 0.0, (double)chunk_count);
+	size_t chunk = std::min((size_t)rel, chunk_count - 1);
+
+	size_t segments = (size_t)1 << table.chunks[chunk].level;
+	double local = (rel - (double)chunk) * (double)segments;
+	size_t segment = std::min((size_t)local, segments - 1);
+	tau = 2.0 * (local - (double)segment) - 1.0;
+
+	return &table.coefs[table.chunks[chunk].offset + segment * COEFS * 6];
+}
+
+CartesianState Ephemeris::state_at(size_t body, double t) const
+{
+	const BodyTable& table = bodies[body];
+	double tau;
+	const double* c = find_segment(table, t, tau);
+
+	return CartesianState(clenshaw3(c, tau), clenshaw3(c + COEFS * 3, tau), table.mass);
+}
+
+glm::dvec3 Ephemeris::position_at(size_t body, double t) const
+{
+	const BodyTable& table = bodies[body];
+	double tau;
+	const double* c = find_segment(table, t, tau);
+
+	return clenshaw3(c, tau);
+}
+
+void Ephemeris::states_at(double t, std::vector<CartesianState>& out) const
+{
+	for(size_t b = 0; b < bodies.size(); b++)
+	{
+		out[b] = state_at(b, t);
+	}
+}
+
+template<typename T>
+static void write_value(std::vector<uint8_t>& out, const T& v)
+{
+	size_t start = out.size();
+	out.resize(start + sizeof(T));
+	memcpy(&out[start], &v, sizeof(T));
+}
+
+void Ephemeris::write(std::vector<uint8_t>& out) const
+{
+	write_value(out, EPHEMERIS_MAGIC);
+	write_value(out, EPHEMERIS_VERSION);
+	write_value(out, (uint64_t)DEGREE);
+	write_value(out, (uint64_t)FIT_SAMPLES);
+	write_value(out, (uint64_t)MAX_LEVEL);
+	write_value(out, t_start);
+	write_value(out, t_end);
+	write_value(out, chunk_length);
+	write_value(out, (uint64_t)bodies.size());
+
+	for(const BodyTable& table : bodies)
+	{
+		write_value(out, table.mass);
+		write_value(out, (uint64_t)table.chunks.size());
+		for(const Chunk& chunk : table.chunks)
+		{
+			write_value(out, chunk.level);
+			write_value(out, chunk.offset);
+		}
+		write_value(out, (uint64_t)table.coefs.size());
+		size_t start = out.size();
+		out.resize(start + table.coefs.size() * sizeof(double));
+		memcpy(&out[start], table.coefs.data(), table.coefs.size() * sizeof(double));
+	}
+}
+
+bool Ephemeris::read(const uint8_t* data, size_t size)
+{
+	size_t pos = 0;
+	bool failed = false;
+	auto read_bytes = [&](void* to, size_t bytes)
+	{
+		if(failed || pos + bytes > size)
+		{
+			failed = true;
+			return;
+		}
+		memcpy(to, data + pos, bytes);
+		pos += bytes;
+	};
+	auto read_u64 = [&]()
+	{
+		uint64_t v = 0;
+		read_bytes(&v, sizeof(uint64_t));
+		return v;
+	};
+
+	uint32_t magic = 0, version = 0;
+	read_bytes(&magic, sizeof(uint32_t));
+	read_bytes(&version, sizeof(uint32_t));
+	uint64_t degree = read_u64();
+	uint64_t fit_samples = read_u64();
+	uint64_t max_level = read_u64();
+	if(failed || magic != EPHEMERIS_MAGIC || version != EPHEMERIS_VERSION || degree != DEGREE ||
+		fit_samples != FIT_SAMPLES || max_level != MAX_LEVEL)
+	{
+		return false;
+	}
+
+	std::vector<BodyTable> n_bodies;
+	read_bytes(&t_start, sizeof(double));
+	read_bytes(&t_end, sizeof(double));
+	read_bytes(&chunk_length, sizeof(double));
+	uint64_t body_count = read_u64();
+	for(uint64_t b = 0; b < body_count && !failed; b++)
+	{
+		BodyTable table;
+		read_bytes(&table.mass, sizeof(double));
+		uint64_t chunk_count = read_u64();
+		if(failed || chunk_count == 0 || chunk_count > size)
+		{
+			return false;
+		}
+		table.chunks.resize(chunk_count);
+		for(Chunk& chunk : table.chunks)
+		{
+			read_bytes(&chunk.level, sizeof(uint32_t));
+			read_bytes(&chunk.offset, sizeof(uint64_t));
+		}
+
+		uint64_t coef_count = read_u64();
+		if(failed || coef_count * sizeof(double) > size - pos)
+		{
+			return false;
+		}
+		table.coefs.resize(coef_count);
+		read_bytes(table.coefs.data(), coef_count * sizeof(double));
+
+		// Every chunk must point to valid segments
+		for(const Chunk& chunk : table.chunks)
+		{
+			if(chunk.level > MAX_LEVEL ||
+				chunk.offset + ((uint64_t)1 << chunk.level) * COEFS * 6 > coef_count)
+			{
+				return false;
+			}
+		}
+
+		n_bodies.push_back(std::move(table));
+	}
+
+	if(failed || pos != size)
+	{
+		return false;
+	}
+
+	bodies = std::move(n_bodies);
+	return true;
+}
+
+Ephemeris::Ephemeris()
+{
+	t_start = 0.0;
+	t_end = 0.0;
+	chunk_length = 0.0;
+}
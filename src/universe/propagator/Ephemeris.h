@@ -0,0 +1,100 @@
+#pragma once
+#include "../CartesianState.h"
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+// Precomputed states of the bodies of a system over a time window, so that
+// predictions, plotting and planning can know where a body is at any time
+// without propagating the whole system.
+//
+// The system is integrated once with a fixed step, and the trajectory of every
+// body is fitted with Chebyshev polynomials. The window is divided in chunks,
+// and every body may split a chunk in 2^level equal segments (level chosen so the
+// fit is within tolerance), so queries are O(1): find the chunk, then the segment,
+// then evaluate the polynomials.
+//
+// Times are the same as the system times (0 is the loaded epoch)
+class Ephemeris
+{
+public:
+
+	// Advances the states by dt, usually the system propagator
+	using PropagateFnc = std::function<void(std::vector<CartesianState>&, double)>;
+
+	// Polynomial degree of every segment
+	static constexpr size_t DEGREE = 12;
+	static constexpr size_t COEFS = DEGREE + 1;
+	// Samples used for fitting every segment, more than COEFS as it's a least squares fit
+	static constexpr size_t FIT_SAMPLES = 64;
+	// Chunks have FIT_SAMPLES << MAX_LEVEL steps
+	static constexpr size_t MAX_LEVEL = 8;
+
+	// Seconds covered after t_start
+	double duration = 365.25 * 24.0 * 3600.0;
+	// Seconds between the samples that are fitted
+	double step = 60.0;
+	// Propagator calls per step, as the system propagator is low order and
+	// the game propagates it with much smaller (frame) steps
+	size_t substeps = 60;
+	// Maximum position error in meters, checked at every step
+	double tolerance = 1.0;
+
+private:
+
+	struct Chunk
+	{
+		uint32_t level;
+		// Into coefs, segments are consecutive
+		uint64_t offset;
+	};
+
+	struct BodyTable
+	{
+		double mass;
+		std::vector<Chunk> chunks;
+		// Every segment is COEFS coefficients for x, y, z, vx, vy, vz
+		std::vector<double> coefs;
+	};
+
+	double t_start;
+	double t_end;
+	double chunk_length;
+	std::vector<BodyTable> bodies;
+
+	// Least squares fit matrix, COEFS rows of FIT_SAMPLES + 1
+	std::vector<double> fit_matrix;
+
+	void build_fit_matrix();
+	// Fits the samples of a segment (one every stride samples), returns the max position error
+	double fit_segment(const std::vector<CartesianState>& samples, size_t first, size_t steps, double* out) const;
+	// Coefficients of the segment containing t, tau is the time in it in [-1, 1]
+	const double* find_segment(const BodyTable& table, double t, double& tau) const;
+
+public:
+
+	bool is_built() const { return !bodies.empty(); }
+	bool covers(double t) const { return is_built() && t >= t_start && t <= t_end; }
+	double get_start() const { return t_start; }
+	double get_end() const { return t_end; }
+	size_t get_body_count() const { return bodies.size(); }
+	// Total number of polynomial segments, for all bodies
+	size_t get_segment_count() const;
+
+	// Integrates the system from the initial states at t_start and fits the tables
+	void build(const std::vector<CartesianState>& initial, double t_start, const PropagateFnc& propagate);
+
+	// t must be covered, it's clamped otherwise
+	CartesianState state_at(size_t body, double t) const;
+	// Only the position, slightly faster
+	glm::dvec3 position_at(size_t body, double t) const;
+	// All the bodies, out must have get_body_count() elements
+	void states_at(double t, std::vector<CartesianState>& out) const;
+
+	// Serialization for caching on disk, in native endianness
+	void write(std::vector<uint8_t>& out) const;
+	// Returns false (and stays empty) if the data is not valid
+	bool read(const uint8_t* data, size_t size);
+
+	Ephemeris();
+};
@@ -0,0 +1,159 @@
+#include "MachineScheduler.h"
+#include "Vehicle.h"
+#include <util/Logger.h>
+
+// Returns nil, or an array of (index, error) pairs for the hooks that failed
+// Errors are caught per hook, so a failing machine doesn't stop the rest
+static const char* TRAMPOLINE = R"LUA(
+local xpcall = xpcall
+return function(fncs, count, dt, handler)
+	local errors = nil
+	for i = 1, count do
+		local ok, err = xpcall(fncs[i], handler, dt)
+		if not ok then
+			errors = errors or {}
+			errors[#errors + 1] = i
+			errors[#errors + 1] = err
+		end
+	end
+	return errors
+end
+)LUA";
+
+bool MachineScheduler::needs_rebuild(Vehicle* veh)
+{
+	bool dirty = false;
+	scratch.clear();
+	for(Part* part : veh->parts)
+	{
+		for(auto& pair : part->machines)
+		{
+			scratch.push_back(pair.second);
+			dirty |= pair.second->schedule_dirty;
+		}
+
+		for(Machine* m : part->attached_machines)
+		{
+			scratch.push_back(m);
+			dirty |= m->schedule_dirty;
+		}
+	}
+
+	return dirty || scratch != machines;
+}
+
+void MachineScheduler::rebuild()
+{
+	machines.swap(scratch);
+	unbatched.clear();
+
+	for(int i = 0; i < Machine::HOOK_COUNT; i++)
+	{
+		hook_machines[i].clear();
+	}
+
+	for(Machine* m : machines)
+	{
+		m->schedule_dirty = false;
+		// Functions can't be stored in a table of another lua state
+		if(m->paused || m->lua_state != lua_state)
+		{
+			unbatched.push_back(m);
+			continue;
+		}
+
+		for(int i = 0; i < Machine::HOOK_COUNT; i++)
+		{
+			if(m->has_hook((Machine::Hook)i))
+			{
+				hook_machines[i].push_back(m);
+			}
+		}
+	}
+
+	for(int i = 0; i < Machine::HOOK_COUNT; i++)
+	{
+		hook_fncs[i] = lua_state->create_table((int)hook_machines[i].size(), 0);
+		for(size_t j = 0; j < hook_machines[i].size(); j++)
+		{
+			hook_fncs[i][j + 1] = hook_machines[i][j]->hooks[i];
+		}
+	}
+}
+
+void MachineScheduler::run(Vehicle* veh, Machine::Hook hook, double dt)
+{
+	if(lua_state == nullptr)
+	{
+		return;
+	}
+
+	if(needs_rebuild(veh))
+	{
+		rebuild();
+	}
+
+	const std::vector<Machine*>& running = hook_machines[hook];
+	if(!running.empty())
+	{
+		auto result = trampoline(hook_fncs[hook], running.size(), dt, error_handler);
+		if(!result.valid())
+		{
+			sol::error err = result;
+			LuaUtil::lua_error_handler(lua_state->lua_state(), err);
+		}
+		else if(result.get_type() == sol::type::table)
+		{
+			sol::table errors = result;
+			size_t count = errors.size();
+			for(size_t i = 1; i + 1 <= count; i += 2)
+			{
+				size_t idx = errors[i].get<size_t>() - 1;
+				Machine* m = running[idx];
+				logger->error("Lua error in machine {}:{} ({}):\n{}", m->get_pkg(), m->get_name(),
+							  m->runtime_uid, errors[i + 1].get<std::string>());
+			}
+		}
+
+	}
+
+	for(Machine* m : unbatched)
+	{
+		m->run_hook(hook, dt);
+	}
+}
+
+void MachineScheduler::init(sol::state* lua_state)
+{
+	this->lua_state = lua_state;
+
+	// Shared by all vehicles in the same lua state
+	sol::object cached = lua_state->registry()["__machine_trampoline"];
+	if(cached.get_type() == sol::type::function)
+	{
+		trampoline = cached.as<sol::protected_function>();
+	}
+	else
+	{
+		sol::protected_function_result result = lua_state->safe_script(TRAMPOLINE, sol::script_pass_on_error,
+																		 "machine_trampoline");
+		logger->check(result.valid(), "Could not load the machine trampoline");
+		trampoline = result.get<sol::protected_function>();
+		lua_state->registry()["__machine_trampoline"] = trampoline;
+	}
+
+	lua_CFunction handler = &sol::default_traceback_error_handler;
+	error_handler = sol::make_object(*lua_state, handler);
+
+	// Force a rebuild on the next run
+	machines.clear();
+	for(int i = 0; i < Machine::HOOK_COUNT; i++)
+	{
+		hook_machines[i].clear();
+	}
+}
+
+MachineScheduler::MachineScheduler()
+{
+	lua_state = nullptr;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "part/Machine.h"
+#include <vector>
+
+class Vehicle;
+
+// Runs the per-frame hooks of all the machines in a vehicle.
+// Instead of calling every machine from C++, the hook functions of the running
+// machines are kept in a lua array, and a small lua trampoline calls all of them,
+// so we cross into lua once per hook and frame for the whole vehicle.
+// The arrays are rebuilt when the machines of the vehicle change (parts added or
+// removed, machines initialized, paused or unpaused), which we detect every frame
+// by walking the parts, cheap as it's all C++.
+// Paused machines are called individually, so they can be stepped.
+class MachineScheduler
+{
+private:
+
+	sol::state* lua_state;
+	sol::protected_function trampoline;
+	sol::object error_handler;
+
+	// Machines in the order they were found, to detect changes
+	std::vector<Machine*> machines;
+	std::vector<Machine*> scratch;
+	// Paused or in another lua state, called one by one
+	std::vector<Machine*> unbatched;
+
+	// Array of functions for each hook, and the machine they belong to
+	sol::table hook_fncs[Machine::HOOK_COUNT];
+	std::vector<Machine*> hook_machines[Machine::HOOK_COUNT];
+
+	bool needs_rebuild(Vehicle* veh);
+	void rebuild();
+
+public:
+
+	void run(Vehicle* veh, Machine::Hook hook, double dt);
+
+	void init(sol::state* lua_state);
+
+	MachineScheduler();
+};
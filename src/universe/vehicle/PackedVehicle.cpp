@@ -4,6 +4,17 @@
 PackedVehicle::PackedVehicle(Vehicle* v)
 {
 	this->vehicle = v;
+	compound = nullptr;
+	rigid_body = nullptr;
+	motion_state = nullptr;
+	in_world = nullptr;
+	total_mass = 0.0;
+}
+
+PackedVehicle::~PackedVehicle()
+{
+	deactivate();
+	delete compound;
 }
 
 
@@ -28,3 +39,89 @@ void PackedVehicle::calculate_com()
 
 	com = acc / tot_mass;
 }
+
+void PackedVehicle::invalidate_compound()
+{
+	logger->check(!is_active(), "Tried to invalidate the compound of an active packed vehicle");
+
+	delete compound;
+	compound = nullptr;
+}
+
+void PackedVehicle::build_compound()
+{
+	std::vector<btScalar> masses;
+	masses.reserve(vehicle->all_pieces.size());
+
+	compound = new btCompoundShape(true, (int)vehicle->all_pieces.size());
+	total_mass = 0.0;
+	for(Piece* p : vehicle->all_pieces)
+	{
+		compound->addChildShape(p->packed_tform, p->collider);
+		masses.push_back(p->mass);
+		total_mass += p->mass;
+	}
+
+	// Children are moved so the principal axes are the identity, as bullet expects
+	compound->calculatePrincipalAxisTransform(masses.data(), principal, local_inertia);
+	btTransform inv_principal = principal.inverse();
+	for(int i = 0; i < compound->getNumChildShapes(); i++)
+	{
+		compound->updateChildTransform(i, inv_principal * compound->getChildTransform(i), false);
+	}
+	compound->recalculateLocalAabb();
+}
+
+void PackedVehicle::activate(btDynamicsWorld* world)
+{
+	logger->check(!is_active(), "Tried to activate an active packed vehicle");
+
+	if(compound == nullptr)
+	{
+		build_compound();
+	}
+
+	btTransform tform = root_transform * principal;
+	motion_state = new btDefaultMotionState(tform);
+	btRigidBody::btRigidBodyConstructionInfo info(total_mass, motion_state, compound, local_inertia);
+	rigid_body = new btRigidBody(info);
+	rigid_body->setActivationState(DISABLE_DEACTIVATION);
+	rigid_body->setLinearVelocity(to_btVector3(root_state.cartesian.vel));
+	rigid_body->setAngularVelocity(to_btVector3(root_state.angular_velocity));
+
+	world->addRigidBody(rigid_body);
+	in_world = world;
+}
+
+void PackedVehicle::deactivate()
+{
+	if(!is_active())
+	{
+		return;
+	}
+
+	in_world->removeRigidBody(rigid_body);
+	delete rigid_body;
+	delete motion_state;
+	rigid_body = nullptr;
+	motion_state = nullptr;
+	in_world = nullptr;
+}
+
+void PackedVehicle::update_from_body()
+{
+	btTransform root = rigid_body->getWorldTransform() * principal.inverse();
+
+	WorldState st = root_state;
+	st.cartesian.pos = to_dvec3(root.getOrigin());
+	st.rotation = to_dquat(root.getRotation());
+	// The packed velocity is that of the center of mass, same as the rigidbody
+	st.cartesian.vel = to_dvec3(rigid_body->getLinearVelocity());
+	st.angular_velocity = to_dvec3(rigid_body->getAngularVelocity());
+	set_world_state(st);
+}
+
+void PackedVehicle::apply_gravity(btVector3 dir)
+{
+	rigid_body->setGravity(dir);
+}
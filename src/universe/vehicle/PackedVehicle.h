@@ -8,6 +8,10 @@
 
 class Vehicle;
 
+// While packed, the vehicle can still be in the physics world as a single
+// rigidbody, made of a compound shape with every piece collider. The shape and its
+// mass properties are cached, so entering the world again is cheap unless the pieces
+// changed (call invalidate_compound() then).
 class PackedVehicle
 {
 private:
@@ -25,18 +29,44 @@ private:
 	// Center of mass relative to the root part
 	btVector3 com;
 
+	// Children are relative to the principal axes
+	btCompoundShape* compound;
+	// Transform of the principal axes relative to root, its origin is the center of mass
+	btTransform principal;
+	btScalar total_mass;
+	btVector3 local_inertia;
+
+	btRigidBody* rigid_body;
+	btDefaultMotionState* motion_state;
+	btDynamicsWorld* in_world;
+
+	void build_compound();
+
 public:
 
 	Vehicle* vehicle;
 
 	void set_world_state(WorldState n_state);
-	WorldState get_world_state() { return root_state; }
+	WorldState get_world_state() const { return root_state; }
 
 	PackedVehicle(Vehicle* v);
-	btTransform get_root_transform(){ return root_transform; }
-	WorldState get_root_state(){ return root_state; }
+	~PackedVehicle();
+	btTransform get_root_transform() const { return root_transform; }
+	WorldState get_root_state() const { return root_state; }
 	btVector3 get_com_root_relative(){ return com; }
 
 	void calculate_com();
 
+	// Call after changing pieces or their packed transforms
+	void invalidate_compound();
+
+	// Adds the vehicle to the world as a single rigidbody, with the current state
+	void activate(btDynamicsWorld* world);
+	void deactivate();
+	bool is_active() const { return rigid_body != nullptr; }
+
+	// Reads the state of the rigidbody, call every physics tick while active
+	void update_from_body();
+	void apply_gravity(btVector3 dir);
+
 };
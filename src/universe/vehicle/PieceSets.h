@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+// Union-find (disjoint sets) over piece indices. Used to find the welded groups
+// of a vehicle and the pieces that separated from it in near linear time, instead
+// of searching through every group for each piece.
+// Standalone so it can be benchmarked without the rest of the engine.
+class PieceSets
+{
+private:
+
+	std::vector<uint32_t> parent;
+	std::vector<uint32_t> count;
+
+public:
+
+	// Every index starts in its own set
+	void reset(size_t n)
+	{
+		parent.resize(n);
+		count.assign(n, 1);
+		for(size_t i = 0; i < n; i++)
+		{
+			parent[i] = (uint32_t)i;
+		}
+	}
+
+	// Returns the representative of the set containing i
+	uint32_t find(uint32_t i)
+	{
+		while(parent[i] != i)
+		{
+			// Path halving
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	}
+
+	void join(uint32_t a, uint32_t b)
+	{
+		a = find(a);
+		b = find(b);
+		if(a == b)
+		{
+			return;
+		}
+
+		// Union by size
+		if(count[a] < count[b])
+		{
+			std::swap(a, b);
+		}
+		parent[b] = a;
+		count[a] += count[b];
+	}
+
+	// Number of elements in the set containing i
+	uint32_t size_of(uint32_t i)
+	{
+		return count[find(i)];
+	}
+
+	explicit PieceSets(size_t n = 0)
+	{
+		reset(n);
+	}
+};
@@ -4,8 +4,10 @@
 #include "../../physics/glm/BulletGlmCompat.h"
 #include "Vehicle.h"
 #include "../entity/entities/VehicleEntity.h"
+#include "PieceSets.h"
+#include <algorithm>
 
-using WeldedGroupCreation = std::pair<std::unordered_set<Piece*>, bool>;
+using PieceStates = UnpackedVehicle::PieceStates;
 
 
 static UnpackedVehicle::PieceState obtain_piece_state(Piece* piece)
@@ -18,240 +20,134 @@ static UnpackedVehicle::PieceState obtain_piece_state(Piece* piece)
 	return st;
 }
 
-
-static std::unordered_map<Piece*, UnpackedVehicle::PieceState> get_states_at_start(Vehicle* vehicle)
+static std::unordered_map<Piece*, uint32_t> index_pieces(const std::vector<Piece*>& pieces)
 {
-	std::unordered_map<Piece*, UnpackedVehicle::PieceState> states_at_start;
-
-	for (Piece* piece : vehicle->all_pieces)
+	std::unordered_map<Piece*, uint32_t> out;
+	out.reserve(pieces.size());
+	for (size_t i = 0; i < pieces.size(); i++)
 	{
-		piece->in_vehicle = vehicle;
-		states_at_start[piece] = obtain_piece_state(piece);
+		out[pieces[i]] = (uint32_t)i;
 	}
 
-	return states_at_start;
+	return out;
 }
 
-static void add_to_welded_groups(std::vector<WeldedGroupCreation>& welded_groups, Piece* piece)
+static void remove_welded_group(WeldedGroup* wgroup, btDynamicsWorld* world)
 {
-	bool found = false;
-	// Find what welded group to add this to
-	if (piece->welded)
-	{
-		for (size_t i = 0; i < welded_groups.size(); i++)
-		{
-			if (welded_groups[i].first.count(piece->attached_to) != 0)
-			{
-				welded_groups[i].first.insert(piece);
-				found = true;
-				break;
-			}
-		}
-	}
+	world->removeRigidBody(wgroup->rigid_body);
 
-	if (!found)
+	// Set all group rigidbodies to nullptr!
+	for (Piece* p : wgroup->pieces)
 	{
-		// Create the welded group, add the part, and, if this part is welded, add
-		// whatever it's welded to (Note: individual parts get a lone welded group)
-		welded_groups.push_back(std::make_pair(std::unordered_set<Piece*>(), false));
-		welded_groups[welded_groups.size() - 1].first.insert(piece);
-		if (piece->welded && piece->attached_to != nullptr)
+		if (p->in_group == wgroup)
 		{
-			welded_groups[welded_groups.size() - 1].first.insert(piece->attached_to);
+			p->rigid_body = nullptr;
+			p->motion_state = nullptr;
+			p->in_group = nullptr;
+			p->welded_collider_id = -1;
 		}
 	}
+
+	delete wgroup->motion_state;
+	delete wgroup->rigid_body;
+	delete wgroup;
 }
 
-static std::vector<Piece*> extract_single_pieces(std::vector<WeldedGroupCreation>& welded_groups)
+static void create_new_welded_group(
+	std::vector<WeldedGroup*>& welded, const std::vector<Piece*>& pieces,
+	PieceStates& states_at_start, btDynamicsWorld* world)
 {
-	std::vector<Piece*> single_pieces;
+	// Create a new WeldedGroup
+	WeldedGroup* n_group = new WeldedGroup();
+	n_group->pieces.reserve(pieces.size());
 
-	// Find single piece (groups of only one piece)
-	for (auto it = welded_groups.begin(); it != welded_groups.end();)
-	{
-		if (it->first.size() == 1)
-		{
-			Piece* piece = *it->first.begin();
+	// Create collider
+	btCompoundShape temp_collider = btCompoundShape();
+	btCompoundShape* collider = new btCompoundShape();
 
-			single_pieces.push_back(piece);
-			// Remove welded colliders, if it had any
-			if (piece->in_group != nullptr)
-			{
-				piece->rigid_body = nullptr;
-				piece->motion_state = nullptr;
-				piece->in_group = nullptr;
-				piece->welded_collider_id = -1;
-			}
+	btTransform identity;
+	identity.setIdentity();
 
-			it = welded_groups.erase(it);
-		}
-		else
-		{
-			it++;
-		}
-	}
+	std::vector<btScalar> masses;
+	btTransform principal;
+	principal.setIdentity();
 
-	return single_pieces;
-}
+	double tot_mass = 0.0;
 
-static void remove_outdated_welded_groups(
-	std::vector<WeldedGroup*>& welded, std::vector<WeldedGroupCreation>& welded_groups, btDynamicsWorld* world)
-{
-	for (auto it = welded.begin(); it != welded.end();)
+	for (Piece* p : pieces)
 	{
-		WeldedGroup* wgroup = *it;
-
-		bool found = false;
-		// Find any same group, to be the same, the welded_group
-		// must contain every piece in wgroup, and be the same size
-		for (size_t j = 0; j < welded_groups.size(); j++)
-		{
-			int count = 0;
-			for (size_t i = 0; i < wgroup->pieces.size(); i++)
-			{
-				count += (int)welded_groups[j].first.count(wgroup->pieces[i]);
-			}
-
-			if (count == wgroup->pieces.size() && !wgroup->dirty)
-			{
-				found = true;
-				welded_groups[j].second = true;
-				break;
-			}
-		}
-
-		if (!found)
-		{
-			// We remove the group as it is not present anymore
-			world->removeRigidBody(wgroup->rigid_body);
-
-			// Set all group rigidbodies to nullptr!
-			for (Piece* p : wgroup->pieces)
-			{
-				p->rigid_body = nullptr;
-			}
+		p->welded_tform = states_at_start[p].transform;
+		temp_collider.addChildShape(p->welded_tform, p->collider);
+		masses.push_back(p->mass);
+		tot_mass += p->mass;
 
-			delete wgroup->motion_state;
-			delete wgroup->rigid_body;
-			delete wgroup;
+		p->welded_collider_id = temp_collider.getNumChildShapes() - 1;
+	}
 
+	// Create rigidbody
+	btVector3 local_inertia;
 
+	temp_collider.calculatePrincipalAxisTransform(masses.data(), principal, local_inertia);
 
-			it = welded.erase(it);
-		}
-		else
-		{
-			it++;
-		}
-	}
-}
+	btTransform principal_inverse = principal.inverse();
 
-static void create_new_welded_group(
-	std::vector<WeldedGroup*>& welded, WeldedGroupCreation& wg, 
-	std::unordered_map<Piece*, UnpackedVehicle::PieceState>& states_at_start, btDynamicsWorld* world,
-	std::vector<Piece*>& all_pieces)
-{
-	if (wg.second == false)
+	for (int i = 0; i < temp_collider.getNumChildShapes(); i++)
 	{
-		// Create a new WeldedGroup
-		WeldedGroup* n_group = new WeldedGroup();
-		n_group->pieces.reserve(wg.first.size());
-
-		// Create collider
-		btCompoundShape temp_collider = btCompoundShape();
-		btCompoundShape* collider = new btCompoundShape();
+		collider->addChildShape(principal_inverse * temp_collider.getChildTransform(i),
+			temp_collider.getChildShape(i));
+	}
 
-		btTransform identity;
-		identity.setIdentity();
 
-		std::vector<btScalar> masses;
-		btTransform principal;
-		principal.setIdentity();
+	collider->calculateLocalInertia(tot_mass, local_inertia);
 
-		double tot_mass = 0.0;
+	btMotionState* motion_state = new btDefaultMotionState(principal);
+	btRigidBody::btRigidBodyConstructionInfo info(tot_mass, motion_state, collider, local_inertia);
+	btRigidBody* rigid_body = new btRigidBody(info);
 
-		for (Piece* p : wg.first)
-		{
-			p->welded_tform = states_at_start[p].transform;
-			temp_collider.addChildShape(p->welded_tform, p->collider);
-			masses.push_back(p->mass);
-			tot_mass += p->mass;
+	rigid_body->setActivationState(DISABLE_DEACTIVATION);
 
-			p->welded_collider_id = temp_collider.getNumChildShapes() - 1;
-		}
+	// TODO: Think, maybe we can do the average of all parts? Maybe using default values is good
+	rigid_body->setFriction(PIECE_DEFAULT_FRICTION);
+	rigid_body->setRestitution(PIECE_DEFAULT_RESTITUTION);
 
-		// Create rigidbody
-		btVector3 local_inertia;
+	world->addRigidBody(rigid_body);
 
-		temp_collider.calculatePrincipalAxisTransform(masses.data(), principal, local_inertia);
+	btVector3 total_angvel = btVector3(0, 0, 0);
 
-		btTransform principal_inverse = principal.inverse();
+	for (Piece* p : pieces)
+	{
+		n_group->pieces.push_back(p);
+		p->in_group = n_group;
 
-		for (int i = 0; i < temp_collider.getNumChildShapes(); i++)
+		// Old welded groups were already removed, so this can only be the piece's own rigidbody
+		if (p->rigid_body != nullptr)
 		{
-			collider->addChildShape(principal_inverse * temp_collider.getChildTransform(i),
-				temp_collider.getChildShape(i));
+			world->removeRigidBody(p->rigid_body);
+			delete p->motion_state;
+			delete p->rigid_body;
 		}
 
+		p->rigid_body = rigid_body;
+		p->motion_state = motion_state;
+		p->welded_tform = principal_inverse * p->welded_tform;
 
-		collider->calculateLocalInertia(tot_mass, local_inertia);
-
-		btMotionState* motion_state = new btDefaultMotionState(principal);
-		btRigidBody::btRigidBodyConstructionInfo info(tot_mass, motion_state, collider, local_inertia);
-		btRigidBody* rigid_body = new btRigidBody(info);
-
-		rigid_body->setActivationState(DISABLE_DEACTIVATION);
-
-		// TODO: Think, maybe we can do the average of all parts? Maybe using default values is good
-		rigid_body->setFriction(PIECE_DEFAULT_FRICTION);
-		rigid_body->setRestitution(PIECE_DEFAULT_RESTITUTION);
-
-		world->addRigidBody(rigid_body);
-
-		btVector3 total_angvel = btVector3(0, 0, 0);
-
-		for (Piece* p : wg.first)
-		{
-			n_group->pieces.push_back(p);
-			p->in_group = n_group;
-
-			if (p->rigid_body != nullptr)
-			{
-				// We must be careful here, we may be removing an already welded rigidbody!
-				for (Piece* sp : wg.first)
-				{
-					if (sp->rigid_body == p->rigid_body && sp != p)
-					{
-						sp->rigid_body = nullptr;
-					}
-				}
-
-				world->removeRigidBody(p->rigid_body);
-				delete p->rigid_body;
-			}
-
-			p->rigid_body = rigid_body;
-			p->motion_state = motion_state;
-			p->welded_tform = principal_inverse * p->welded_tform;
-
-			//rigid_body->applyCentralImpulse(states_at_start[p].linear * p->mass);
-			rigid_body->applyImpulse(states_at_start[p].linear * p->mass, p->get_local_transform().getOrigin());
-			//rigid_body->applyImpulse(states_at_start[p].linear * p->mass, p->get_relative_position()); 
-			total_angvel += states_at_start[p].angular;
-		}
+		//rigid_body->applyCentralImpulse(states_at_start[p].linear * p->mass);
+		rigid_body->applyImpulse(states_at_start[p].linear * p->mass, p->get_local_transform().getOrigin());
+		//rigid_body->applyImpulse(states_at_start[p].linear * p->mass, p->get_relative_position()); 
+		total_angvel += states_at_start[p].angular;
+	}
 
 
-		// Angular momentum is conserved, we need to get angular velocity back
-		// from total_angmom
-		glm::dvec3 ang_veld = to_dvec3(total_angvel) / (double)wg.first.size();
-		btVector3 ang_vel = to_btVector3(ang_veld);
-		rigid_body->setAngularVelocity(ang_vel);
+	// Angular momentum is conserved, we need to get angular velocity back
+	// from total_angmom
+	glm::dvec3 ang_veld = to_dvec3(total_angvel) / (double)pieces.size();
+	btVector3 ang_vel = to_btVector3(ang_veld);
+	rigid_body->setAngularVelocity(ang_vel);
 
-		n_group->rigid_body = rigid_body;
-		n_group->motion_state = motion_state;
+	n_group->rigid_body = rigid_body;
+	n_group->motion_state = motion_state;
 
-		welded.push_back(n_group);
-	}
+	welded.push_back(n_group);
 }
 
 static void add_piece_physics(Piece* piece, btTransform tform, btDynamicsWorld* world)
@@ -305,46 +201,22 @@ static void create_piece_physics(Piece* piece,
 void UnpackedVehicle::update()
 {
 	std::vector<Vehicle*> n_vehicles;
-	// Check for any broken links, they instantly set the dirty flags,
-	// but they cannot set it themselves
-	if(!dirty)
+	// Links report breaks from the physics step, intact vehicles do nothing here
+	if (!broken_links.empty())
 	{
-		for (Piece* p : vehicle->all_pieces)
-		{
-			if (p->link != nullptr && p->attached_to != nullptr && !p->welded)
-			{
-				if (p->link->is_broken())
-				{
-					logger->info("Link {}", p->id);
-					dirty = true;
-					logger->info("BREIK!");
-					break;
-				}
-			}
-		}
+		dirty = true;
 	}
 
-
 	if (dirty)
 	{
-		// We need this as we may remove rigidbodies, and with them,
-		// physics information. 
-
-		auto states_at_start = get_states_at_start(vehicle);
+		// States of pieces whose rigidbody was destroyed while separating
+		PieceStates removed_states;
 
-		n_vehicles = handle_separation();
+		n_vehicles = handle_separation(removed_states);
 
 		vehicle->sort(); //< Not sure if needed
 
-		build_physics(states_at_start);
-
-		for (Piece* p : vehicle->all_pieces)
-		{
-			if (p->link != nullptr && p->attached_to != nullptr)
-			{
-				p->link->set_breaking_enabled(breaking_enabled);
-			}
-		}
+		build_physics(removed_states);
 
 		dirty = false;
 
@@ -357,37 +229,152 @@ void UnpackedVehicle::update()
 
 }
 
-void UnpackedVehicle::build_physics(std::unordered_map<Piece*, PieceState>& states_at_start)
+void UnpackedVehicle::build_physics(const PieceStates& known_states)
 {	
-	// Remove all old links
-	for (Piece* piece : vehicle->all_pieces)
+	std::vector<Piece*>& pieces = vehicle->all_pieces;
+	auto index = index_pieces(pieces);
+
+	// Welded groups are the sets of pieces joined by welded attachments
+	PieceSets sets(pieces.size());
+	for (uint32_t i = 0; i < pieces.size(); i++)
 	{
-		if (piece->link != nullptr)
+		Piece* p = pieces[i];
+		p->in_vehicle = vehicle;
+
+		if (p->welded && p->attached_to != nullptr)
 		{
-			piece->link->deactivate();
+			auto it = index.find(p->attached_to);
+			if (it != index.end())
+			{
+				sets.join(i, it->second);
+			}
 		}
 	}
 
-	// We need to create shared colliders for all welded 
-	// groups, and individual colliders for every other piece
-	// The bool is used later on to check if the group was already present
-	
-	std::vector<WeldedGroupCreation> welded_groups;
+	// Groups which still contain exactly the same pieces keep their rigidbody
+	std::vector<bool> set_kept(pieces.size(), false);
+	std::vector<WeldedGroup*> removed_groups;
+	for (auto it = welded.begin(); it != welded.end();)
+	{
+		WeldedGroup* wgroup = *it;
 
+		bool same = !wgroup->dirty && !wgroup->pieces.empty();
+		uint32_t set = 0;
+		for (size_t i = 0; i < wgroup->pieces.size() && same; i++)
+		{
+			auto idx = index.find(wgroup->pieces[i]);
+			if (idx == index.end())
+			{
+				same = false;
+				break;
+			}
 
-	for (Piece* piece : vehicle->all_pieces)
+			uint32_t piece_set = sets.find(idx->second);
+			if (i == 0)
+			{
+				set = piece_set;
+			}
+			same = piece_set == set;
+		}
+
+		if (same && sets.size_of(set) == wgroup->pieces.size())
+		{
+			set_kept[set] = true;
+			it++;
+		}
+		else
+		{
+			removed_groups.push_back(wgroup);
+			it = welded.erase(it);
+		}
+	}
+
+	// Pieces which end up with a different rigidbody than they have now
+	std::vector<bool> changed(pieces.size(), false);
+	for (uint32_t i = 0; i < pieces.size(); i++)
+	{
+		Piece* p = pieces[i];
+		uint32_t set = sets.find(i);
+		if (set_kept[set])
+		{
+			continue;
+		}
+
+		bool keeps_own_body = sets.size_of(i) == 1 && p->in_group == nullptr && p->rigid_body != nullptr;
+		changed[i] = !keeps_own_body;
+	}
+
+	// Only links touching a changed rigidbody are recreated, the rest stay as they are
+	for (uint32_t i = 0; i < pieces.size(); i++)
 	{
-		add_to_welded_groups(welded_groups, piece);
+		Piece* p = pieces[i];
+		if (p->link == nullptr || !p->link->is_initialized)
+		{
+			continue;
+		}
+
+		bool keep = !p->welded && p->attached_to != nullptr && !changed[i];
+		if (keep)
+		{
+			auto it = index.find(p->attached_to);
+			keep = it != index.end() && !changed[it->second];
+		}
+
+		if (!keep)
+		{
+			p->link->deactivate();
+		}
+	}
+
+	// We need this as we are about to remove rigidbodies, and with them,
+	// physics information
+	PieceStates states_at_start;
+	for (uint32_t i = 0; i < pieces.size(); i++)
+	{
+		if (changed[i])
+		{
+			auto known = known_states.find(pieces[i]);
+			if (known != known_states.end())
+			{
+				states_at_start[pieces[i]] = known->second;
+			}
+			else
+			{
+				states_at_start[pieces[i]] = obtain_piece_state(pieces[i]);
+			}
+		}
 	}
 
-	std::vector<Piece*> single_pieces = extract_single_pieces(welded_groups);
-	this->single_pieces = single_pieces;
+	for (WeldedGroup* wgroup : removed_groups)
+	{
+		remove_welded_group(wgroup, world);
+	}
 
-	remove_outdated_welded_groups(welded, welded_groups, world);
+	// Gather the new groups, in all_pieces order, and single pieces
+	std::vector<int32_t> set_to_group(pieces.size(), -1);
+	std::vector<std::vector<Piece*>> new_groups;
+	single_pieces.clear();
+	for (uint32_t i = 0; i < pieces.size(); i++)
+	{
+		uint32_t set = sets.find(i);
+		if (sets.size_of(set) == 1)
+		{
+			single_pieces.push_back(pieces[i]);
+		}
+		else if (!set_kept[set])
+		{
+			if (set_to_group[set] < 0)
+			{
+				set_to_group[set] = (int32_t)new_groups.size();
+				new_groups.emplace_back();
+			}
+			new_groups[set_to_group[set]].push_back(pieces[i]);
+		}
+	}
 
-	for (WeldedGroupCreation& wg : welded_groups)
+	for (const std::vector<Piece*>& group : new_groups)
 	{
-		create_new_welded_group(welded, wg, states_at_start, world, vehicle->all_pieces);
+		create_new_welded_group(welded, group, states_at_start, world);
 	}
 
 	for (Piece* piece : single_pieces)
@@ -398,11 +385,12 @@ void UnpackedVehicle::build_physics(std::unordered_map<Piece*, PieceState>& stat
 		}
 	}
 
-	for (Piece* piece : vehicle->all_pieces)
+	for (Piece* piece : pieces)
 	{
 		// piece->attached_to cannot have null rigidbody as it will have already been built
 		// in the previous loop
-		if (piece->attached_to != nullptr && piece->link != nullptr && !piece->welded)
+		if (piece->attached_to != nullptr && piece->link != nullptr && !piece->welded && 
+			!piece->link->is_initialized)
 		{
 			btTransform from_tform = btTransform::getIdentity();
 			btTransform to_tform = btTransform::getIdentity();
@@ -413,12 +401,11 @@ void UnpackedVehicle::build_physics(std::unordered_map<Piece*, PieceState>& stat
 
 			btTransform real_from = piece->get_local_transform() * from_tform;
 			btTransform real_to = piece->attached_to->get_local_transform() * to_tform;
-			piece->link->activate(piece->rigid_body, real_from, piece->attached_to->rigid_body, real_to, world);
+			piece->link->activate(piece, piece->rigid_body, real_from, piece->attached_to->rigid_body, real_to, world);
+			piece->link->set_breaking_enabled(breaking_enabled);
 		}
 	}
 
-	
-
 }
 
 void UnpackedVehicle::add_piece(Piece* piece, btTransform pos)
@@ -432,155 +419,149 @@ void UnpackedVehicle::add_piece(Piece* piece, btTransform pos)
 
 }
 
-std::vector<Vehicle*> UnpackedVehicle::handle_separation()
+std::vector<Vehicle*> UnpackedVehicle::handle_separation(PieceStates& removed_states)
 {
 	std::vector<Vehicle*> n_vehicles;
 
-	std::unordered_set<WeldedGroup*> wgroups;
-
-	// First pass to remove any broken links
-	for (auto it = vehicle->all_pieces.begin(); it != vehicle->all_pieces.end(); it++)
+	// Detach the pieces whose link broke
+	for (Piece* p : broken_links)
 	{
-		Piece* p = *it;
-
-		if (p == vehicle->root)
+		if (p->link != nullptr && p->link->is_broken())
 		{
-			continue;
+			logger->info("Link of piece {} broke", p->id);
+			p->attached_to = nullptr;
+			p->link->deactivate();
 		}
+	}
+	broken_links.clear();
 
-		// Handle broken links
-		if (p->welded == false)
+	// Pieces which are neither welded nor linked are free
+	for (Piece* p : vehicle->all_pieces)
+	{
+		if (p != vehicle->root && !p->welded && p->link == nullptr)
 		{
-			if (p->link == nullptr)
-			{
-				p->attached_to = nullptr;
-			}
-			else
-			{
-				if (p->link->is_broken())
-				{
-					p->attached_to = nullptr;
-					p->link->deactivate();
-				}
-			}
+			p->attached_to = nullptr;
 		}
 	}
 
 	// Find all pieces that can't reach root, and create a new vehicle from them
 	// Assumes the vehicle was sorted before the part separated!
 	// (Don't sort with a part separated)
+	std::vector<Piece*>& pieces = vehicle->all_pieces;
+	auto index = index_pieces(pieces);
 
-	std::vector<std::vector<Piece*>> n_pieces;
-
-	for (auto it = vehicle->all_pieces.begin(); it != vehicle->all_pieces.end(); )
+	PieceSets sets(pieces.size());
+	for (uint32_t i = 0; i < pieces.size(); i++)
 	{
-		Piece* p = *it;
-
-		if (p == vehicle->root)
+		if (pieces[i]->attached_to != nullptr)
 		{
-			it++;
-			continue;
+			auto it = index.find(pieces[i]->attached_to);
+			if (it != index.end())
+			{
+				sets.join(i, it->second);
+			}
 		}
+	}
 
+	auto root_it = index.find(vehicle->root);
+	logger->check(root_it != index.end(), "Vehicle root is not one of its pieces");
+	uint32_t root_set = sets.find(root_it->second);
 
-		if (p->attached_to == nullptr)
-		{
-			n_pieces.push_back(std::vector<Piece*>());
-			n_pieces[n_pieces.size() - 1].push_back(p);
+	// As parents come before their children, the first piece of each separated
+	// set is the one that broke off, which becomes the root of the new vehicle
+	std::vector<int32_t> set_to_vehicle(pieces.size(), -1);
+	std::vector<std::vector<Piece*>> n_pieces;
+	std::vector<Piece*> remaining;
+	remaining.reserve(pieces.size());
+	// -1 for the remaining pieces, otherwise index into n_pieces
+	constexpr int32_t SPLIT_GROUP = -2;
+	std::unordered_map<WeldedGroup*, int32_t> group_destination;
+	std::vector<WeldedGroup*> split_groups;
+
+	for (uint32_t i = 0; i < pieces.size(); i++)
+	{
+		Piece* p = pieces[i];
+		uint32_t set = sets.find(i);
+		int32_t destination = -1;
 
-			it = vehicle->all_pieces.erase(it);
+		if (set == root_set)
+		{
+			remaining.push_back(p);
 		}
 		else
 		{
-			bool removed = false;
-
-			for (auto& list : n_pieces)
+			if (set_to_vehicle[set] < 0)
 			{
-				for (auto sub_p : list)
-				{
-					if (p->attached_to == sub_p)
-					{
-						list.push_back(p);
-						it = vehicle->all_pieces.erase(it);
-						removed = true;
-
-						// Lord, I'm sorry, but this is the cleanest option
-						goto out;
-					}
-				}
+				set_to_vehicle[set] = (int32_t)n_pieces.size();
+				n_pieces.emplace_back();
 			}
+			destination = set_to_vehicle[set];
+			n_pieces[destination].push_back(p);
+		}
 
-			out:
-
-			if (!removed)
+		if (p->in_group != nullptr)
+		{
+			auto inserted = group_destination.emplace(p->in_group, destination);
+			int32_t& group_dest = inserted.first->second;
+			if (group_dest != destination && group_dest != SPLIT_GROUP)
 			{
-				it++;
+				// Pieces of the group went to different vehicles (it was being unwelded)
+				split_groups.push_back(p->in_group);
+				group_dest = SPLIT_GROUP;
 			}
 		}
 	}
-	
-	// Find welded groups to transfer
 
-	for (auto& n_vessel_pieces : n_pieces)
+	if (n_pieces.empty())
+	{
+		return n_vehicles;
+	}
+
+	pieces = std::move(remaining);
+
+	// Split groups can't be kept by anyone, so we destroy them here while we can still
+	// obtain the state of their pieces
+	for (WeldedGroup* w : split_groups)
 	{
-		for (WeldedGroup* w : welded)
+		for (Piece* p : w->pieces)
 		{
-			for (size_t i = 0; i < n_vessel_pieces.size(); i++)
-			{
-				if (w->rigid_body == n_vessel_pieces[i]->rigid_body)
-				{
-					wgroups.insert(w);
-				}
-			}
+			removed_states[p] = obtain_piece_state(p);
 		}
+		welded.erase(std::remove(welded.begin(), welded.end(), w), welded.end());
+		remove_welded_group(w, world);
 	}
 
-
-	// Here we remove the welded groups from original vessel
-	for (WeldedGroup* w : wgroups)
+	// Here we transfer the welded groups from the original vessel
+	std::vector<std::vector<WeldedGroup*>> n_welded(n_pieces.size());
+	for (auto it = welded.begin(); it != welded.end();)
 	{
-		for (size_t i = 0; i < welded.size(); i++)
+		auto dest = group_destination.find(*it);
+		if (dest != group_destination.end() && dest->second >= 0)
 		{
-			if (welded[i] == w)
-			{
-				welded.erase(welded.begin() + i);
-				break;
-			}
+			n_welded[dest->second].push_back(*it);
+			it = welded.erase(it);
+		}
+		else
+		{
+			it++;
 		}
 	}
 
-	for (auto& n_vessel_pieces : n_pieces)
+	for (size_t i = 0; i < n_pieces.size(); i++)
 	{
+		std::vector<Piece*>& n_vessel_pieces = n_pieces[i];
 
 		Vehicle* n_vehicle = new Vehicle();
 		n_vehicle->unpacked_veh.set_world(world);
+		n_vehicle->unpacked_veh.breaking_enabled = breaking_enabled;
 	
 		n_vehicle->all_pieces = n_vessel_pieces;
 		n_vehicle->root = n_vessel_pieces[0];
-
-		for (WeldedGroup* w : wgroups)
-		{
-			for (size_t i = 0; i < w->pieces.size(); i++)
-			{
-				for (size_t j = 0; j < n_vessel_pieces.size(); j++)
-				{
-					if (n_vessel_pieces[j] == w->pieces[i])
-					{
-						// Transfer the welded group
-						n_vehicle->unpacked_veh.welded.push_back(w);
-						i = w->pieces.size() + 1;
-						break;
-					}
-				}
-
-			}
-
-		}
+		n_vehicle->unpacked_veh.welded = std::move(n_welded[i]);
 
 		n_vehicle->packed = false;
 		n_vehicle->sort();
-		auto st_at_start = get_states_at_start(n_vehicle);
-		n_vehicle->unpacked_veh.build_physics(st_at_start);
+		n_vehicle->unpacked_veh.build_physics(removed_states);
 		
 		logger->info("Separated new vehicle");
 		n_vehicles.push_back(n_vehicle);
@@ -631,8 +612,15 @@ void UnpackedVehicle::set_linear_velocity(glm::dvec3 vel)
 
 void UnpackedVehicle::set_breaking_enabled(bool value)
 {
-	dirty = true;
 	this->breaking_enabled = value;
+
+	for (Piece* p : vehicle->all_pieces)
+	{
+		if (p->link != nullptr && p->attached_to != nullptr)
+		{
+			p->link->set_breaking_enabled(value);
+		}
+	}
 }
 
 
@@ -673,12 +661,20 @@ void UnpackedVehicle::draw_debug()
 
 void UnpackedVehicle::deactivate()
 {
+	// Breaks of links we are about to deactivate don't matter anymore
+	broken_links.clear();
+
+	for(Piece* p : vehicle->all_pieces)
+	{
+		if(p->link != nullptr && p->link->is_initialized)
+		{
+			p->link->deactivate();
+		}
+	}
+
 	for(WeldedGroup* group : welded)
 	{
-		world->removeRigidBody(group->rigid_body);
-		delete group->rigid_body;
-		delete group->motion_state;
-		delete group;
+		remove_welded_group(group, world);
 	}
 
 	for(Piece* p : single_pieces)
@@ -686,6 +682,8 @@ void UnpackedVehicle::deactivate()
 		world->removeRigidBody(p->rigid_body);
 		delete p->rigid_body;
 		delete p->motion_state;
+		p->rigid_body = nullptr;
+		p->motion_state = nullptr;
 	}
 
 	single_pieces.clear();
@@ -720,14 +718,17 @@ void UnpackedVehicle::activate()
 	dirty = true;
 	vehicle->packed = true;
 	// sort() 				// TODO: Sorting may not be neccesary here as pieces won't change while packed
-	auto st0 = get_states_at_start(vehicle);
-	build_physics(st0);
+	// Every piece is rebuilt, taking its state from the packed vehicle
+	build_physics(PieceStates());
 	vehicle->packed = false;
 }
 
 UnpackedVehicle::UnpackedVehicle(Vehicle* v)
 {
 	this->vehicle = v;
+	this->world = nullptr;
+	dirty = false;
+	breaking_enabled = true;
 }
 
 void UnpackedVehicle::apply_gravity(btVector3 dir)
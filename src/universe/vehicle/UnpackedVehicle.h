@@ -34,15 +34,22 @@ public:
 
 	std::vector<WeldedGroup*> welded;
 	std::vector<Piece*> single_pieces;
+
+	// Pieces whose link reported a break, handled on the next update
+	std::vector<Piece*> broken_links;
 	
 
 	// Call every frame, it checks the dirty flag
 	// Can create new vehicles if parts separate (only when unpacked)
 	void update();
 
+	using PieceStates = std::unordered_map<Piece*, PieceState>;
+
 	// Called automatically by update to rebuild the physics
-	// whenever the dirty flag is set
-	void build_physics(std::unordered_map<Piece*, PieceState>& states_at_start);
+	// whenever the dirty flag is set. Only welded groups whose pieces changed
+	// are rebuilt, and only the links attached to a rebuilt rigidbody are recreated.
+	// known_states is used for pieces whose rigidbody was already destroyed
+	void build_physics(const PieceStates& known_states);
 
 	// Piece gets 0 velocity and angular momentum
 	// Use only while building the vehicle, all at once
@@ -51,7 +58,9 @@ public:
 	// Creates new vehicles from any separated pieces
 	// (that cannot reach the root piece)
 	// It automatically assigns Parts, pieces, ids...
-	std::vector<Vehicle*> handle_separation();
+	// Welded groups split between vehicles are destroyed, the state of their pieces
+	// is written to removed_states for build_physics
+	std::vector<Vehicle*> handle_separation(PieceStates& removed_states);
 
 	void draw_debug();
 
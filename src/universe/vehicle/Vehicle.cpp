@@ -3,6 +3,12 @@
 void Vehicle::unpack()
 {
 	logger->check(packed, "Tried to unpack an unpacked vehicle");
+
+	if(packed_veh.is_active())
+	{
+		packed_veh.update_from_body();
+		packed_veh.deactivate();
+	}
 	
 	packed = false;
 
@@ -16,15 +22,97 @@ void Vehicle::unpack()
 	unpacked_veh.activate();	
 }
 
+WorldState Vehicle::get_packed_state(std::vector<btTransform>& packed_tforms) const
+{
+	packed_tforms.resize(all_pieces.size());
+	if(packed)
+	{
+		for(size_t i = 0; i < all_pieces.size(); i++)
+		{
+			packed_tforms[i] = all_pieces[i]->packed_tform;
+		}
+		return packed_veh.get_world_state();
+	}
+
+	// Pieces keep the transform they had relative to root, and all move
+	// with the velocity of the center of mass
+	btTransform root_tform = root->get_global_transform();
+	btTransform inv_root = root_tform.inverse();
+	btVector3 momentum = btVector3(0, 0, 0);
+	double tot_mass = 0.0;
+	for(size_t i = 0; i < all_pieces.size(); i++)
+	{
+		Piece* p = all_pieces[i];
+		packed_tforms[i] = inv_root * p->get_global_transform();
+		momentum += p->get_linear_velocity() * p->mass;
+		tot_mass += p->mass;
+	}
+
+	WorldState st = packed_veh.get_world_state();
+	st.cartesian.pos = to_dvec3(root_tform.getOrigin());
+	st.rotation = to_dquat(root_tform.getRotation());
+	st.cartesian.vel = to_dvec3(momentum / tot_mass);
+	st.angular_velocity = to_dvec3(root->get_angular_velocity());
+	return st;
+}
+
 void Vehicle::pack()
 {
 	logger->check(!packed, "Tried to pack a packed vehicle");
 
+	std::vector<btTransform> packed_tforms;
+	WorldState st = get_packed_state(packed_tforms);
+	for(size_t i = 0; i < all_pieces.size(); i++)
+	{
+		all_pieces[i]->packed_tform = packed_tforms[i];
+	}
+
 	packed = true;
 
 	unpacked_veh.deactivate();
 
+	packed_veh.set_world_state(st);
 	packed_veh.calculate_com();
+	packed_veh.invalidate_compound();
+}
+
+void Vehicle::update_physics_distance(double dist)
+{
+	Universe* uv = in_universe;
+	btDynamicsWorld* world = unpacked_veh.world;
+	// Out of every physics scene (see Universe::update_physics_loading)
+	if(world == nullptr)
+	{
+		return;
+	}
+
+	if(!packed)
+	{
+		if(dist > uv->pack_distance)
+		{
+			pack();
+			if(dist < uv->unload_distance)
+			{
+				packed_veh.activate(world);
+			}
+		}
+	}
+	else
+	{
+		if(dist < uv->unpack_distance)
+		{
+			unpack();
+		}
+		else if(!packed_veh.is_active() && dist < uv->load_distance)
+		{
+			packed_veh.activate(world);
+		}
+		else if(packed_veh.is_active() && dist > uv->unload_distance)
+		{
+			packed_veh.update_from_body();
+			packed_veh.deactivate();
+		}
+	}
 }
 
 Piece* Vehicle::remove_piece(Piece* p)
@@ -45,28 +133,51 @@ Piece* Vehicle::remove_piece(Piece* p)
 	return p;
 }
 
-void Vehicle::update(double dt)
+void Vehicle::leave_world()
 {
-	for(Part* part : parts)
+	if(!packed)
 	{
-		part->pre_update(dt);
+		pack();
+	}
+	else if(packed_veh.is_active())
+	{
+		packed_veh.update_from_body();
 	}
 
-	for(Part* part : parts)
+	packed_veh.deactivate();
+}
+
+void Vehicle::update_rails(double dt)
+{
+	logger->check(packed && !packed_veh.is_active(), "Tried to update on rails a vehicle in the bullet world");
+
+	// Symplectic Euler, the steps are small compared to orbits
+	WorldState st = packed_veh.get_world_state();
+	glm::dvec3 grav = in_universe->system.get_gravity_vector(st.cartesian.pos, &in_universe->system.bullet_states);
+	st.cartesian.vel += grav * dt;
+	st.cartesian.pos += st.cartesian.vel * dt;
+
+	double angle = glm::length(st.angular_velocity) * dt;
+	if(angle > 0.0)
 	{
-		part->update(dt);
+		st.rotation = glm::angleAxis(angle, glm::normalize(st.angular_velocity)) * st.rotation;
 	}
 
+	packed_veh.set_world_state(st);
+}
+
+void Vehicle::update(double dt)
+{
+	scheduler.run(this, Machine::PRE_UPDATE, dt);
+	scheduler.run(this, Machine::UPDATE, dt);
+
 	plumbing.update_pipes(dt, this);
 
 }
 
 void Vehicle::editor_update(double dt)
 {
-	for(Part* part : parts)
-	{
-		part->editor_update(dt);
-	}
+	scheduler.run(this, Machine::EDITOR_UPDATE, dt);
 }
 
 
@@ -82,12 +193,29 @@ void Vehicle::physics_update(double dt)
 		unpacked_veh.apply_gravity(to_btVector3(grav)); 
 		unpacked_veh.update();
 	}	
+	else if(packed_veh.is_active())
+	{
+		packed_veh.update_from_body();
+
+		glm::dvec3 pos = packed_veh.get_world_state().cartesian.pos;
+		glm::dvec3 grav = in_universe->system.get_gravity_vector(pos, &in_universe->system.bullet_states);
+		packed_veh.apply_gravity(to_btVector3(grav));
+	}
 
 }
 
 void Vehicle::init(Universe* universe)
 {
-	init(&universe->lua_state);
+	if(universe->parallel_vehicles)
+	{
+		own_lua_state = std::make_unique<sol::state>();
+		lua_core->load(*own_lua_state, "__UNDEFINED__");
+		init(own_lua_state.get());
+	}
+	else
+	{
+		init(&universe->lua_state);
+	}
 	this->in_universe = universe;
 }
 
@@ -96,6 +224,7 @@ void Vehicle::init(sol::state* lua_state)
 	this->in_universe = nullptr;
 
 	remove_outdated();
+	scheduler.init(lua_state);
 
 	for(Part* part : parts)
 	{
@@ -164,6 +293,7 @@ void Vehicle::remove_outdated()
 			it++;
 		}
 	}
+	wire_index.invalidate();
 
 	// Some pipes might have been cut (TODO)
 }
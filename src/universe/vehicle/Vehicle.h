@@ -16,9 +16,12 @@
 #include "UnpackedVehicle.h"
 #include "PackedVehicle.h"
 #include "plumbing/VehiclePlumbing.h"
+#include "MachineScheduler.h"
+#include "WireIndex.h"
 
 
 class VehicleLoader;
+class VehicleSnapshotLoader;
 
 // A Vehicle is basically a tree of parts (actually pieces), connected
 // via various links. The root piece is always the root node.
@@ -45,6 +48,10 @@ class VehicleLoader;
 //  different positions. Pieces store their absolute position, but the trajectory
 //  updates the center of mass of the vehicle. 
 //
+//  A packed vehicle may still be in the physics world as a single rigidbody (see
+//  PackedVehicle), so vehicles far from the focused one are cheap but still collide.
+//  update_physics_distance switches between the states with some hysteresis.
+//
 // 	Vehicles are always serialized as packed, which means that serialization
 // 	is only possible when the vehicle is relatively estabilized, without very big
 // 	inter-part interactions. A similar situation happens in the vehicle editor.
@@ -61,6 +68,10 @@ private:
 	std::unordered_map<int64_t, Piece*> id_to_piece;
 	std::unordered_map<int64_t, Part*> id_to_part;
 
+	// Only used with parallel vehicles, declared before everything holding
+	// lua references so it's destroyed after them
+	std::unique_ptr<sol::state> own_lua_state;
+
 public:
 
 	Universe* in_universe;
@@ -68,10 +79,12 @@ public:
 	UnpackedVehicle unpacked_veh;
 	PackedVehicle packed_veh;
 	VehiclePlumbing plumbing;
+	MachineScheduler scheduler;
 	
 	friend class UnpackedVehicle;
 	friend class PackedVehicle;
 	friend class VehicleLoader;
+	friend class VehicleSnapshotLoader;
 	friend class Piece;
 	friend class Part;
 
@@ -83,11 +96,26 @@ public:
 
 	// Bidirectional wires, so if A is connected to B then B is connected to A
 	std::unordered_multimap<Machine*, Machine*> wires;
+	// Call wire_index.invalidate() after modifying wires!
+	WireIndex wire_index;
 
 	void pack();
+	// The state pack() would set, without packing. packed_tforms are the transforms
+	// relative to root, in all_pieces order (for packed vehicles, the current ones)
+	WorldState get_packed_state(std::vector<btTransform>& packed_tforms) const;
 
 	void unpack();
 	bool is_packed() const { return packed; }
+	// Called with the distance to the nearest physics loader, packs / unpacks the vehicle
+	// and adds / removes its packed rigidbody according to the universe distances
+	void update_physics_distance(double dist);
+	// Packs the vehicle and removes it from the bullet world, for time warp on rails
+	// or before moving to another physics scene
+	void leave_world();
+	// Moves the packed vehicle under the gravity of the system (bullet states)
+	void update_rails(double dt);
+	// If true, our machines don't share the universe lua state and we may be updated in parallel
+	bool has_own_lua_state() const { return own_lua_state != nullptr; }
 
 	void set_position(glm::dvec3 pos);
 	void set_linear_velocity(glm::dvec3 vel);
@@ -117,6 +145,11 @@ public:
 		unpacked_veh.world = world;
 	}
 
+	btDynamicsWorld* get_world()
+	{
+		return unpacked_veh.world;
+	}
+
 	void sort();
 
 	void remove_outdated();
@@ -69,6 +69,23 @@ void VehicleLoader::obtain_parts(const cpptoml::table& root)
 		return;
 	}
 
+	// Every prototype is requested first, so they are decoded in parallel by the asset
+	// workers, instead of one after the other as we reach each part. The futures hold
+	// an use until we are done, parts take their own
+	std::unordered_map<std::string, AssetFuture<PartPrototype>> prefetch;
+	if(osp->assets->is_main_thread())
+	{
+		for(const auto& part : *parts)
+		{
+			std::string proto_path = *part->get_qualified_as<std::string>("proto");
+			if(prefetch.find(proto_path) == prefetch.end())
+			{
+				auto[pkg, name] = osp->assets->get_package_and_name(proto_path, osp->assets->get_current_package());
+				prefetch.emplace(proto_path, osp->assets->get_async<PartPrototype>(pkg, name));
+			}
+		}
+	}
+
 	for(const auto& part : *parts)
 	{
 		std::string proto_path = *part->get_qualified_as<std::string>("proto");
@@ -201,6 +218,7 @@ void VehicleLoader::copy_pieces(const cpptoml::table& root)
 			p->editor_dettachable = link->get_qualified_as<bool>("editor_dettachable").value_or(true);
 
 			std::string link_type = link->get_qualified_as<std::string>("type").value_or("none");
+			p->link_type = link_type;
 			if(link_type != "none")
 			{
 				// Load the physical link
@@ -275,6 +293,8 @@ void VehicleLoader::obtain_wires(const cpptoml::table& root)
 				from, fmachine, to,  tmachine);
 		}
 	}
+
+	n_vehicle->wire_index.invalidate();
 }
 
 VehicleLoader::VehicleLoader(const cpptoml::table& root, Vehicle& to)
@@ -310,7 +330,13 @@ VehicleLoader::VehicleLoader(const cpptoml::table& root, Vehicle& to)
 
 VehicleSaver::VehicleSaver(cpptoml::table &target, const Vehicle &what)
 {
-	logger->check(what.is_packed(), "Cannot serialize a unpacked vehicle");
+	std::vector<btTransform> tforms;
+	what.get_packed_state(tforms);
+	for(size_t i = 0; i < what.all_pieces.size(); i++)
+	{
+		packed_tforms[what.all_pieces[i]] = tforms[i];
+	}
+
 	assign_ids(target, what);
 	write_parts(target, what);
 	write_pieces(target, what);
@@ -419,7 +445,7 @@ void VehicleSaver::write_pieces(cpptoml::table &target, const Vehicle &what)
 		}
 
 		table->insert("node", pair.first->piece_prototype->name);
-		auto matrix = serialize_matrix(to_dmat4(pair.first->packed_tform));
+		auto matrix = serialize_matrix(to_dmat4(packed_tforms[pair.first]));
 		table->insert("transform", matrix);
 
 
@@ -440,7 +466,13 @@ void VehicleSaver::write_pieces(cpptoml::table &target, const Vehicle &what)
 				link->insert("editor_dettachable", false);
 			}
 
-			// TODO: Insert links, link orientation, etc...
+			if(pair.first->link_type != "none")
+			{
+				link->insert("type", pair.first->link_type);
+				serialize_to_table(pair.first->link_from, *link, "pfrom");
+				serialize_to_table(pair.first->link_to, *link, "pto");
+				serialize_to_table(pair.first->link_rot, *link, "rot");
+			}
 
 			if(pair.first->from_attachment != "")
 			{
@@ -11,6 +11,8 @@ private:
 
 	std::unordered_map<Piece*, int64_t> piece_to_id;
 	std::unordered_map<Part*, int64_t> part_to_id;
+	// Relative to root, as the vehicle may be unpacked
+	std::unordered_map<Piece*, btTransform> packed_tforms;
 
 	void assign_ids(cpptoml::table& target, const Vehicle& what);
 	void write_parts(cpptoml::table& target, const Vehicle& what);
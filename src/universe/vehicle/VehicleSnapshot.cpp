@@ -0,0 +1,411 @@
+#include "VehicleSnapshot.h"
+#include <OSP.h>
+#include <physics/glm/BulletGlmCompat.h>
+#include <util/SerializeUtil.h>
+#include <util/serializers/glm.h>
+#include <set>
+
+static constexpr uint32_t NO_ID = 0xFFFFFFFF;
+
+// Machines are identified by their name in the part, or by index if attached
+static void find_machine_name(Machine* m, std::string& name, int32_t& attached)
+{
+	name = "";
+	attached = -1;
+	for(const auto& pair : m->in_part->machines)
+	{
+		if(pair.second == m)
+		{
+			name = pair.first;
+			return;
+		}
+	}
+
+	for(size_t i = 0; i < m->in_part->attached_machines.size(); i++)
+	{
+		if(m->in_part->attached_machines[i] == m)
+		{
+			attached = (int32_t)i;
+			return;
+		}
+	}
+
+	logger->fatal("Could not find machine in its part! Something is wrong");
+}
+
+VehicleSnapshotSaver::VehicleSnapshotSaver(BakedWriter& w, const Vehicle& what)
+{
+	for(size_t i = 0; i < what.all_pieces.size(); i++)
+	{
+		piece_to_id[what.all_pieces[i]] = (uint32_t)i;
+	}
+	for(size_t i = 0; i < what.parts.size(); i++)
+	{
+		part_to_id[what.parts[i]] = (uint32_t)i;
+	}
+
+	std::vector<btTransform> tforms;
+	WorldState state = what.get_packed_state(tforms);
+	w.write_pod(state);
+
+	write_parts(w, what);
+	write_pieces(w, what, tforms);
+	write_wires(w, what);
+	write_pipes(w, what);
+	write_machine_states(w, what);
+}
+
+void VehicleSnapshotSaver::write_parts(BakedWriter& w, const Vehicle& what)
+{
+	w.write_u32((uint32_t)what.parts.size());
+	for(Part* part : what.parts)
+	{
+		w.write_string(part->part_proto.pkg + ":" + part->part_proto.name);
+
+		// Overrides of the prototype machines
+		w.write_u32(part->our_table ? 1 : 0);
+		if(part->our_table && !BakedCache::write_toml(w, *part->our_table))
+		{
+			logger->fatal("Part '{}' has a table that can't be saved", part->part_proto.name);
+		}
+
+		w.write_u32((uint32_t)part->attached_machines.size());
+		for(Machine* m : part->attached_machines)
+		{
+			if(!BakedCache::write_toml(w, *m->init_toml))
+			{
+				logger->fatal("Attached machine '{}' has a table that can't be saved", m->get_name());
+			}
+		}
+	}
+}
+
+void VehicleSnapshotSaver::write_pieces(BakedWriter& w, const Vehicle& what, const std::vector<btTransform>& tforms)
+{
+	w.write_u32((uint32_t)what.all_pieces.size());
+	w.write_u32(what.root ? piece_to_id[what.root] : NO_ID);
+	for(size_t i = 0; i < what.all_pieces.size(); i++)
+	{
+		Piece* p = what.all_pieces[i];
+		logger->check(p->part != nullptr, "Cannot save a piece without part");
+
+		w.write_u32(part_to_id[p->part]);
+		w.write_string(p->piece_prototype->name);
+		w.write_pod(to_dmat4(tforms[i]));
+
+		if(p->attached_to == nullptr)
+		{
+			w.write_u32(NO_ID);
+			continue;
+		}
+
+		w.write_u32(piece_to_id[p->attached_to]);
+		w.write_u32((p->welded ? 1 : 0) | (p->editor_dettachable ? 2 : 0));
+		w.write_string(p->from_attachment);
+		w.write_string(p->to_attachment);
+		w.write_string(p->link_type);
+		w.write_pod(p->link_from);
+		w.write_pod(p->link_to);
+		w.write_pod(p->link_rot);
+	}
+}
+
+void VehicleSnapshotSaver::write_wires(BakedWriter& w, const Vehicle& what)
+{
+	// Wires are bidirectional, we only store one direction
+	std::vector<std::pair<Machine*, Machine*>> unique;
+	std::set<std::pair<Machine*, Machine*>> seen_pairs;
+	for(const auto& pair : what.wires)
+	{
+		if(seen_pairs.count(std::make_pair(pair.second, pair.first)) == 0 && seen_pairs.insert(pair).second)
+		{
+			unique.push_back(pair);
+		}
+	}
+
+	w.write_u32((uint32_t)unique.size());
+	for(const auto& pair : unique)
+	{
+		std::string name;
+		int32_t attached;
+		for(Machine* m : {pair.first, pair.second})
+		{
+			find_machine_name(m, name, attached);
+			w.write_u32(part_to_id[m->in_part]);
+			w.write_string(name);
+			w.write_pod(attached);
+		}
+	}
+}
+
+void VehicleSnapshotSaver::write_pipes(BakedWriter& w, const Vehicle& what)
+{
+	w.write_u32((uint32_t)what.plumbing.pipes.size());
+	for(const Pipe& pipe : what.plumbing.pipes)
+	{
+		std::string name;
+		int32_t attached;
+		for(const FluidPort* port : {pipe.a, pipe.b})
+		{
+			Machine* m = port->in_machine->in_machine;
+			find_machine_name(m, name, attached);
+			w.write_u32(part_to_id[m->in_part]);
+			w.write_string(name);
+			w.write_pod(attached);
+			w.write_string(port->id);
+		}
+
+		w.write_u32((uint32_t)pipe.waypoints.size());
+		for(const glm::ivec2& wp : pipe.waypoints)
+		{
+			w.write_pod(wp);
+		}
+	}
+}
+
+void VehicleSnapshotSaver::write_machine_states(BakedWriter& w, const Vehicle& what)
+{
+	for(Part* part : what.parts)
+	{
+		w.write_u32((uint32_t)part->machines.size());
+		for(const auto& pair : part->machines)
+		{
+			w.write_string(pair.first);
+			w.write_pod(pair.second->plumbing.editor_position);
+			w.write_pod((int32_t)pair.second->plumbing.editor_rotation);
+			size_t block = w.begin_block();
+			pair.second->write_state(w);
+			w.end_block(block);
+		}
+
+		for(Machine* m : part->attached_machines)
+		{
+			w.write_pod(m->plumbing.editor_position);
+			w.write_pod((int32_t)m->plumbing.editor_rotation);
+			size_t block = w.begin_block();
+			m->write_state(w);
+			w.end_block(block);
+		}
+	}
+}
+
+Part* VehicleSnapshotLoader::get_part(uint32_t id)
+{
+	logger->check(id < parts.size(), "Malformed vehicle snapshot, invalid part ({}/{})", id, parts.size());
+	return parts[id];
+}
+
+Machine* VehicleSnapshotLoader::get_machine(Part* part, const std::string& name, int32_t attached)
+{
+	if(attached < 0)
+	{
+		return part->get_machine(name);
+	}
+
+	logger->check((size_t)attached < part->attached_machines.size(),
+		"Malformed vehicle snapshot, invalid attached machine");
+	return part->attached_machines[attached];
+}
+
+void VehicleSnapshotLoader::obtain_parts(BakedReader& r)
+{
+	uint32_t count = r.read_u32();
+	for(uint32_t i = 0; i < count && !r.failed; i++)
+	{
+		std::string proto_path = r.read_string();
+		std::shared_ptr<cpptoml::table> our_table = nullptr;
+		if(r.read_u32() != 0)
+		{
+			our_table = BakedCache::read_toml(r);
+		}
+
+		AssetHandle<PartPrototype> part_proto = AssetHandle<PartPrototype>(proto_path);
+		Part* n_part = new Part(part_proto, our_table);
+		n_part->id = (int64_t)i + 1;
+
+		uint32_t attached_count = r.read_u32();
+		for(uint32_t j = 0; j < attached_count && !r.failed; j++)
+		{
+			auto table = BakedCache::read_toml(r);
+			if(table)
+			{
+				n_part->attached_machines.push_back(new Machine(table, "core"));
+			}
+		}
+
+		n_vehicle->parts.push_back(n_part);
+		n_vehicle->id_to_part[n_part->id] = n_part;
+		parts.push_back(n_part);
+	}
+}
+
+void VehicleSnapshotLoader::obtain_pieces(BakedReader& r)
+{
+	uint32_t count = r.read_u32();
+	uint32_t root = r.read_u32();
+	logger->check(!r.failed && root < count, "Malformed vehicle snapshot, no root piece");
+
+	// Links point to any piece, so they are resolved once all are created
+	std::vector<uint32_t> attached_to(count, NO_ID);
+	for(uint32_t i = 0; i < count && !r.failed; i++)
+	{
+		Part* part = get_part(r.read_u32());
+		std::string node = r.read_string();
+		logger->check(part->pieces.find(node) == part->pieces.end(), "Duplicate piece of part");
+
+		Piece* n_piece = new Piece(part, node);
+		n_piece->id = (int64_t)i + 1;
+		n_piece->part = part;
+		n_piece->in_vehicle = n_vehicle;
+		n_piece->packed_tform = to_btTransform(r.read_pod<glm::dmat4>());
+		part->pieces[node] = n_piece;
+
+		attached_to[i] = r.read_u32();
+		if(attached_to[i] != NO_ID)
+		{
+			uint32_t flags = r.read_u32();
+			n_piece->welded = (flags & 1) != 0;
+			n_piece->editor_dettachable = (flags & 2) != 0;
+			n_piece->from_attachment = r.read_string();
+			n_piece->to_attachment = r.read_string();
+			n_piece->link_type = r.read_string();
+			n_piece->link_from = r.read_pod<glm::dvec3>();
+			n_piece->link_to = r.read_pod<glm::dvec3>();
+			n_piece->link_rot = r.read_pod<glm::dquat>();
+
+			if(n_piece->link_type != "none")
+			{
+				n_piece->link = std::make_unique<Link>(osp->assets->load_script(n_piece->link_type).first);
+			}
+		}
+
+		pieces.push_back(n_piece);
+		n_vehicle->id_to_piece[n_piece->id] = n_piece;
+	}
+
+	if(r.failed)
+	{
+		return;
+	}
+
+	// The root goes first, as VehicleLoader does
+	n_vehicle->root = pieces[root];
+	n_vehicle->all_pieces.push_back(pieces[root]);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		if(attached_to[i] != NO_ID)
+		{
+			logger->check(attached_to[i] < count, "Malformed vehicle snapshot, link to a non-existant piece");
+			pieces[i]->attached_to = pieces[attached_to[i]];
+		}
+
+		if(i != root)
+		{
+			n_vehicle->all_pieces.push_back(pieces[i]);
+		}
+	}
+}
+
+void VehicleSnapshotLoader::obtain_wires(BakedReader& r)
+{
+	uint32_t count = r.read_u32();
+	for(uint32_t i = 0; i < count && !r.failed; i++)
+	{
+		Machine* ends[2];
+		for(Machine*& end : ends)
+		{
+			Part* part = get_part(r.read_u32());
+			std::string name = r.read_string();
+			int32_t attached = r.read_pod<int32_t>();
+			end = get_machine(part, name, attached);
+		}
+
+		n_vehicle->wires.insert(std::make_pair(ends[0], ends[1]));
+		n_vehicle->wires.insert(std::make_pair(ends[1], ends[0]));
+	}
+
+	n_vehicle->wire_index.invalidate();
+}
+
+void VehicleSnapshotLoader::obtain_pipes(BakedReader& r)
+{
+	uint32_t count = r.read_u32();
+	for(uint32_t i = 0; i < count && !r.failed; i++)
+	{
+		Pipe p = Pipe();
+		PlumbingMachine** machines[2] = {&p.amachine, &p.bmachine};
+		std::string* ports[2] = {&p.aport, &p.bport};
+		for(size_t j = 0; j < 2; j++)
+		{
+			Part* part = get_part(r.read_u32());
+			std::string name = r.read_string();
+			int32_t attached = r.read_pod<int32_t>();
+			*machines[j] = &get_machine(part, name, attached)->plumbing;
+			*ports[j] = r.read_string();
+		}
+
+		uint32_t waypoints = r.read_u32();
+		for(uint32_t j = 0; j < waypoints && !r.failed; j++)
+		{
+			p.waypoints.push_back(r.read_pod<glm::ivec2>());
+		}
+
+		n_vehicle->plumbing.pipes.push_back(p);
+	}
+}
+
+void VehicleSnapshotLoader::obtain_machine_states(BakedReader& r)
+{
+	// Applied to the init table (as the toml loader does) and passed to the script on init
+	auto restore = [&r](Machine* m)
+	{
+		glm::ivec2 editor_position = r.read_pod<glm::ivec2>();
+		int32_t editor_rotation = r.read_pod<int32_t>();
+		BakedReader state = r.read_block();
+		size_t len = state.remaining();
+		const uint8_t* data = state.read(len);
+		if(r.failed || data == nullptr)
+		{
+			return;
+		}
+
+		m->init_toml->insert("plumbing_rot", editor_rotation);
+		serialize_to_table(editor_position, *m->init_toml, "plumbing_pos");
+		m->pending_state.assign(data, data + len);
+	};
+
+	for(Part* part : parts)
+	{
+		uint32_t count = r.read_u32();
+		for(uint32_t i = 0; i < count && !r.failed; i++)
+		{
+			std::string name = r.read_string();
+			restore(part->get_machine(name));
+		}
+
+		for(Machine* m : part->attached_machines)
+		{
+			restore(m);
+		}
+	}
+}
+
+VehicleSnapshotLoader::VehicleSnapshotLoader(BakedReader& r, Vehicle& to)
+{
+	n_vehicle = &to;
+
+	WorldState state = r.read_pod<WorldState>();
+	obtain_parts(r);
+	obtain_pieces(r);
+	obtain_wires(r);
+	obtain_pipes(r);
+	obtain_machine_states(r);
+
+	logger->check(!r.failed && n_vehicle->root != nullptr, "Malformed vehicle snapshot");
+
+	n_vehicle->packed_veh.set_world_state(state);
+	n_vehicle->packed = true;
+	n_vehicle->packed_veh.calculate_com();
+
+	n_vehicle->update_attachments();
+}
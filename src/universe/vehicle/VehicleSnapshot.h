@@ -0,0 +1,49 @@
+#pragma once
+#include "Vehicle.h"
+#include <assets/BakedCache.h>
+
+// Binary equivalents of VehicleSaver and VehicleLoader, used by game snapshots.
+// Besides the structure they store the physical state (the vehicle may be unpacked,
+// it's saved as if it was packed) and the state of every machine (see Machine::write_state).
+// Parts and pieces are identified by their index.
+class VehicleSnapshotSaver
+{
+private:
+
+	std::unordered_map<Piece*, uint32_t> piece_to_id;
+	std::unordered_map<Part*, uint32_t> part_to_id;
+
+	void write_parts(BakedWriter& w, const Vehicle& what);
+	void write_pieces(BakedWriter& w, const Vehicle& what, const std::vector<btTransform>& tforms);
+	void write_wires(BakedWriter& w, const Vehicle& what);
+	void write_pipes(BakedWriter& w, const Vehicle& what);
+	void write_machine_states(BakedWriter& w, const Vehicle& what);
+
+public:
+
+	VehicleSnapshotSaver(BakedWriter& w, const Vehicle& what);
+};
+
+class VehicleSnapshotLoader
+{
+private:
+
+	Vehicle* n_vehicle;
+	std::vector<Part*> parts;
+	std::vector<Piece*> pieces;
+
+	void obtain_parts(BakedReader& r);
+	void obtain_pieces(BakedReader& r);
+	void obtain_wires(BakedReader& r);
+	void obtain_pipes(BakedReader& r);
+	void obtain_machine_states(BakedReader& r);
+
+	Part* get_part(uint32_t id);
+	Machine* get_machine(Part* part, const std::string& name, int32_t attached);
+
+public:
+
+	// Malformed data is fatal, as the rest of the snapshot can't be trusted either
+	// Doesn't sort, and leaves the vehicle packed with the saved state
+	VehicleSnapshotLoader(BakedReader& r, Vehicle& to);
+};
@@ -0,0 +1,133 @@
+#include "WireIndex.h"
+#include "part/Machine.h"
+
+void WireIndex::invalidate()
+{
+	dirty = true;
+}
+
+void WireIndex::rebuild(const std::unordered_multimap<Machine*, Machine*>& wires)
+{
+	adjacency.clear();
+	adjacency_with_this.clear();
+	filtered.clear();
+	interface_tables.clear();
+
+	for(const auto& pair : wires)
+	{
+		adjacency[pair.first].push_back(pair.second);
+	}
+
+	for(const auto& pair : adjacency)
+	{
+		std::vector<Machine*>& with_this = adjacency_with_this[pair.first];
+		with_this = pair.second;
+		with_this.push_back(pair.first);
+	}
+
+	dirty = false;
+}
+
+const std::vector<Machine*>& WireIndex::get_wired(const std::unordered_multimap<Machine*, Machine*>& wires,
+												  Machine* m, bool include_this)
+{
+	if(dirty)
+	{
+		rebuild(wires);
+	}
+
+	auto& map = include_this ? adjacency_with_this : adjacency;
+	auto it = map.find(m);
+	if(it != map.end())
+	{
+		return it->second;
+	}
+
+	// Not wired to anything
+	if(include_this)
+	{
+		std::vector<Machine*>& alone = adjacency_with_this[m];
+		alone.push_back(m);
+		return alone;
+	}
+
+	return empty;
+}
+
+const std::vector<Machine*>& WireIndex::get_wired_with(const std::unordered_multimap<Machine*, Machine*>& wires,
+													   Machine* m, const std::vector<std::string>& interfaces,
+													   bool include_this)
+{
+	if(dirty)
+	{
+		rebuild(wires);
+	}
+
+	FilterKey key;
+	key.m = m;
+	key.include_this = include_this;
+	for(size_t i = 0; i < interfaces.size(); i++)
+	{
+		if(i != 0)
+		{
+			key.interfaces += ',';
+		}
+		key.interfaces += interfaces[i];
+	}
+
+	auto it = filtered.find(key);
+	if(it != filtered.end())
+	{
+		return it->second;
+	}
+
+	std::vector<Machine*> out;
+	for(Machine* wired : get_wired(wires, m, include_this))
+	{
+		for(const std::string& a : interfaces)
+		{
+			if(wired->interfaces.find(a) != wired->interfaces.end())
+			{
+				out.push_back(wired);
+				break;
+			}
+		}
+	}
+
+	return filtered.emplace(std::move(key), std::move(out)).first->second;
+}
+
+const std::vector<sol::table>& WireIndex::get_wired_interfaces(const std::unordered_multimap<Machine*, Machine*>& wires,
+										   Machine* m, const std::string& type, bool include_this)
+{
+	if(dirty)
+	{
+		rebuild(wires);
+	}
+
+	FilterKey key;
+	key.m = m;
+	key.interfaces = type;
+	key.include_this = include_this;
+
+	auto it = interface_tables.find(key);
+	if(it != interface_tables.end())
+	{
+		return it->second;
+	}
+
+	const std::vector<Machine*>& machines = get_wired_with(wires, m, {type}, include_this);
+	std::vector<sol::table> out;
+	out.reserve(machines.size());
+	for(Machine* wired : machines)
+	{
+		out.push_back(wired->interfaces[type]);
+	}
+
+	return interface_tables.emplace(std::move(key), std::move(out)).first->second;
+}
+
+WireIndex::WireIndex()
+{
+	dirty = true;
+}
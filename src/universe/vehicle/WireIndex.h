@@ -0,0 +1,71 @@
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <sol/sol.hpp>
+#include <util/defines.h>
+
+class Machine;
+
+// Cached lookups over Vehicle::wires, so machines can query who they are wired to
+// every frame without walking the multimap. Everything is built lazily on the first
+// query after invalidate(), which must be called whenever wires or the interfaces
+// of a machine change (Vehicle::remove_outdated, the editor and the loader do it).
+// Returned references stay valid until the next invalidate().
+class WireIndex
+{
+private:
+
+	struct FilterKey
+	{
+		Machine* m;
+		// Interface names joined with ','
+		std::string interfaces;
+		bool include_this;
+
+		bool operator==(const FilterKey& other) const
+		{
+			return m == other.m && include_this == other.include_this && interfaces == other.interfaces;
+		}
+	};
+
+	struct FilterKeyHasher
+	{
+		size_t operator()(const FilterKey& key) const
+		{
+			size_t seed = 0;
+			hash_combine(seed, key.m);
+			hash_combine(seed, key.interfaces);
+			hash_combine(seed, key.include_this);
+			return seed;
+		}
+	};
+
+	bool dirty;
+
+	// Machines wired to each machine, in the order of Vehicle::wires
+	std::unordered_map<Machine*, std::vector<Machine*>> adjacency;
+	// Same, with the machine itself at the end
+	std::unordered_map<Machine*, std::vector<Machine*>> adjacency_with_this;
+	std::unordered_map<FilterKey, std::vector<Machine*>, FilterKeyHasher> filtered;
+	std::unordered_map<FilterKey, std::vector<sol::table>, FilterKeyHasher> interface_tables;
+
+	std::vector<Machine*> empty;
+
+	void rebuild(const std::unordered_multimap<Machine*, Machine*>& wires);
+
+public:
+
+	void invalidate();
+
+	const std::vector<Machine*>& get_wired(const std::unordered_multimap<Machine*, Machine*>& wires,
+										  Machine* m, bool include_this);
+	const std::vector<Machine*>& get_wired_with(const std::unordered_multimap<Machine*, Machine*>& wires,
+												Machine* m, const std::vector<std::string>& interfaces,
+												bool include_this);
+	// The given interface of every wired machine which has it
+	const std::vector<sol::table>& get_wired_interfaces(const std::unordered_multimap<Machine*, Machine*>& wires,
+									Machine* m, const std::string& type, bool include_this);
+
+	WireIndex();
+};
@@ -1,3 +1,33 @@
 #include "Link.h"
+#include "Piece.h"
+#include "../Vehicle.h"
 
+void Link::notify_broken()
+{
+	if(!is_initialized || broken)
+	{
+		return;
+	}
 
+	broken = true;
+	piece->in_vehicle->unpacked_veh.broken_links.push_back(piece);
+}
+
+Link::Link(sol::state&& st)
+{
+	this->lua_state = std::move(st);
+	is_initialized = false;
+	broken = false;
+	piece = nullptr;
+
+	lua_state["watch_constraint"] = [this](btTypedConstraint* constraint)
+	{
+		constraint->setUserConstraintType(USER_CONSTRAINT_TYPE);
+		constraint->setUserConstraintPtr(this);
+	};
+
+	lua_state["notify_broken"] = [this]()
+	{
+		notify_broken();
+	};
+}
@@ -10,14 +10,32 @@
 #include "../../../lua/libs/LuaBullet.h"
 #include <cpptoml.h>
 
+class Piece;
+
 // Base class for any link, which can be as simple as
 // a bullet3 constraint, or as complex as a soft-body rope
+//
+// Links are not polled for breaking. Instead, the link script calls
+// 'watch_constraint(constraint)' on its bullet constraints once they are created,
+// and the solver reports them when bullet disables them (breaking impulse threshold
+// exceeded, or disabled from lua). Links which break by other means call 'notify_broken()'.
+// The break is queued in the vehicle, which handles separation on its next update.
 class Link
 {
+private:
+
+	bool broken;
+
 public:
 
+	// Set as the user constraint type of watched constraints, whose user
+	// constraint pointer is then the Link
+	static constexpr int USER_CONSTRAINT_TYPE = 0x4C4E4B;
+
 	bool is_initialized;
 	sol::state lua_state;
+	// The piece which activated the link, valid while it's initialized
+	Piece* piece;
 
 	// Called during loading of the link to give it its 
 	// toml serialized data
@@ -28,12 +46,15 @@ public:
 
 	// Called when the pieces are unwelded, or first created
 	void activate(
+		Piece* piece,
 		btRigidBody* from, btTransform from_frame,
 		btRigidBody* to, btTransform to_frame,
 		btDynamicsWorld* world
 	)
 	{
 		is_initialized = true;
+		broken = false;
+		this->piece = piece;
 
 		LuaUtil::safe_call_function(lua_state["activate"],
 				from, BulletTransform(from_frame), to, BulletTransform(to_frame), world);
@@ -51,27 +72,19 @@ public:
 	}
 
 	// Return true if the link has broken and should be deleted
-	bool is_broken()
+	bool is_broken() const
 	{
-		if(!is_initialized)
-		{
-			return false;
-		}
-		else
-		{
-			return LuaUtil::safe_call_function(lua_state["is_broken"]).get<bool>();
-		}
+		return is_initialized && broken;
 	}
 
+	// Queues the break in the vehicle of the piece, only once per activation
+	void notify_broken();
+
 	void set_breaking_enabled(bool value)
 	{
 		LuaUtil::safe_call_function(lua_state["set_breaking_enabled"], value);
 	}
 
-	Link(sol::state&& st)
-	{
-		this->lua_state = std::move(st);
-		is_initialized = false;
-	}
+	Link(sol::state&& st);
 };
 
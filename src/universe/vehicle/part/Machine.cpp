@@ -4,6 +4,8 @@
 #include <assets/AssetManager.h>
 #include <lua/libs/LuaAssets.h>
 #include <game/database/GameDatabase.h>
+#include <assets/BakedCache.h>
+#include <lua/LuaSerialize.h>
 
 #include "../Vehicle.h"
 #include "Part.h"
@@ -15,6 +17,9 @@ Machine::Machine(std::shared_ptr<cpptoml::table> init_toml, std::string cur_pkg)
 {
 	paused = false;
 	step = false;
+	schedule_dirty = true;
+	lua_state = nullptr;
+	in_part = nullptr;
 	this->init_toml = init_toml;
 	this->in_pkg = cur_pkg;
 	this->editor_location_marker = init_toml->get_as<std::string>("__editor_marker").value_or("");
@@ -29,33 +34,49 @@ Machine::Machine(std::shared_ptr<cpptoml::table> init_toml, std::string cur_pkg)
 void Machine::load_interface(const std::string& name, sol::table n_table) 
 {
 	interfaces.insert(std::make_pair(name, n_table));
+	if(in_part && in_part->vehicle)
+	{
+		in_part->vehicle->wire_index.invalidate();
+	}
 }
 
-void Machine::pre_update(double dt)
+static const char* hook_names[Machine::HOOK_COUNT] = {"pre_update", "update", "editor_update"};
+
+void Machine::run_hook(Hook hook, double dt)
 {
-	if(!paused || step)
+	if((paused && !step) || !hooks[hook].valid())
 	{
-		LuaUtil::call_function_if_present(env["pre_update"], dt);
+		return;
 	}
-}
 
-void Machine::update(double dt)
-{
-	if(!paused || step)
+	auto result = hooks[hook](dt);
+	if(!result.valid())
+	{
+		sol::error err = result;
+		LuaUtil::lua_error_handler(lua_state->lua_state(), err);
+	}
+
+	// pre_update is always followed by update, which consumes the step
+	if(hook != PRE_UPDATE)
 	{
-		LuaUtil::call_function_if_present(env["update"], dt);
 		step = false;
 	}
 }
 
+void Machine::pre_update(double dt)
+{
+	run_hook(PRE_UPDATE, dt);
+}
+
+void Machine::update(double dt)
+{
+	run_hook(UPDATE, dt);
+}
+
 void Machine::editor_update(double dt)
 {
-	if(!paused || step)
-	{
-		// Called regardless of enabled status
-		LuaUtil::call_function_if_present(env["editor_update"], dt);
-		step = false;
-	}
+	// Called regardless of enabled status
+	run_hook(EDITOR_UPDATE, dt);
 }
 
 void Machine::init(sol::state* lua_state, Part* in_part)
@@ -94,47 +115,81 @@ void Machine::init(sol::state* lua_state, Part* in_part)
 		logger->fatal("Lua Error loading machine:\n{}", err.what());
 	}
 
+	// Resolved once, so updating doesn't need to look them up by name
+	for(int i = 0; i < HOOK_COUNT; i++)
+	{
+		sol::object fnc = env[hook_names[i]];
+		if(fnc.get_type() == sol::type::function)
+		{
+			hooks[i] = fnc.as<sol::protected_function>();
+		}
+		else
+		{
+			hooks[i] = sol::protected_function();
+		}
+	}
+	schedule_dirty = true;
+
 	// Then we simply move over the environment to an entry in the global lua_state
 	// TODO: Is this even neccesary?
 	//(*lua_state)[this] = sol::table(env);
 
 	plumbing.init(*init_toml);
-}
 
-std::vector<Machine*> Machine::get_all_wired_machines(bool include_this)
-{
-	// TODO: We could cache this? Could be a small perfomance gain
-	return get_connected_if([](Machine* m){ return true; }, include_this);
+	if(!pending_state.empty())
+	{
+		BakedReader r(pending_state.data(), pending_state.size());
+		sol::object state = LuaSerialize::read(r, *lua_state);
+		if(r.failed)
+		{
+			logger->warn("Invalid saved state for machine '{}', ignored", name);
+		}
+		else
+		{
+			LuaUtil::call_function_if_present(env["load_state"], state);
+		}
+		pending_state.clear();
+	}
 }
 
-std::vector<Machine*> Machine::get_wired_machines_with(const std::vector<std::string>& interfaces, bool include_this)
+void Machine::write_state(BakedWriter& w)
 {
-	return get_connected_if([interfaces](Machine* m)
+	if(lua_state == nullptr)
+	{
+		LuaSerialize::write_nil(w);
+		return;
+	}
+
+	auto result = LuaUtil::call_function_if_present(env["save_state"]);
+	if(result.has_value() && result->valid())
 	{
-		for(const std::string& a : interfaces)
+		if(!LuaSerialize::write(w, result->get<sol::object>()))
 		{
-			if(m->interfaces.find(a) != m->interfaces.end())
-			{
-				return true;
-			}
+			logger->warn("Parts of the state of machine '{}' could not be saved", name);
 		}
-
-		return false;
-	}, include_this);
+	}
+	else
+	{
+		LuaSerialize::write_nil(w);
+	}
 }
 
-std::vector<sol::table> Machine::get_wired_interfaces(const std::string& type, bool include_this) 
+const std::vector<Machine*>& Machine::get_all_wired_machines(bool include_this)
 {
-	std::vector<Machine*> machines = get_wired_machines_with({type}, include_this);
-	std::vector<sol::table> out;
-	out.reserve(machines.size());
+	Vehicle* veh = in_part->vehicle;
+	return veh->wire_index.get_wired(veh->wires, this, include_this);
+}
 
-	for(Machine* m : machines)
-	{
-		out.push_back(m->interfaces[type]);
-	}
+const std::vector<Machine*>& Machine::get_wired_machines_with(const std::vector<std::string>& interfaces, bool include_this)
+{
+	Vehicle* veh = in_part->vehicle;
+	return veh->wire_index.get_wired_with(veh->wires, this, interfaces, include_this);
+}
 
-	return out;
+std::vector<sol::table> Machine::get_wired_interfaces(const std::string& type, bool include_this)
+{
+	Vehicle* veh = in_part->vehicle;
+	return veh->wire_index.get_wired_interfaces(veh->wires, this, type, include_this);
 }
 
 sol::table Machine::get_interface(const std::string& name) 
@@ -169,27 +224,6 @@ Machine::~Machine()
 	lua_state->collect_garbage();
 }
 
-std::vector<Machine*> Machine::get_connected_if(std::function<bool(Machine*)> fnc, bool include_this) 
-{
-	std::vector<Machine*> out;
-
-	auto range = in_part->vehicle->wires.equal_range(this);
-	for(auto it = range.first; it != range.second; it++)
-	{
-		if(fnc(it->second))
-		{
-			out.push_back(it->second);
-		}
-	}
-
-	if(include_this && fnc(this))
-	{
-		out.push_back(this);
-	}
-
-	return out;
-}
-
 bool Machine::is_enabled()
 {
 	return !piece_missing;
@@ -217,6 +251,7 @@ void Machine::draw_imgui(bool* open)
 			if(ImGui::Button("Unpause"))
 			{
 				paused = false;
+				schedule_dirty = true;
 			}
 			if(ImGui::Button("Step"))
 			{
@@ -228,6 +263,7 @@ void Machine::draw_imgui(bool* open)
 			if (ImGui::Button("Pause"))
 			{
 				paused = true;
+				schedule_dirty = true;
 			}
 		}
 		ImGui::EndMenuBar();
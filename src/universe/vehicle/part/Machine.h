@@ -8,6 +8,7 @@
 class Vehicle;
 class Part;
 class Piece;
+class BakedWriter;
 
 // Machines implement functionality for parts in lua
 // TODO: Think naming of the lua global variables, or 
@@ -16,11 +17,21 @@ class Piece;
 class Machine
 {
 friend class Vehicle;
+friend class MachineScheduler;
 
-private:
+public:
 
+	// Functions the vehicle calls every frame, if the script defines them
+	enum Hook
+	{
+		PRE_UPDATE,
+		UPDATE,
+		EDITOR_UPDATE,
+		HOOK_COUNT
+	};
+
+private:
 
-	std::vector<Machine*> get_connected_if(std::function<bool(Machine*)> fnc, bool include_this);
 
 	std::string in_pkg, name;
 	AssetHandle<Image> default_icon;
@@ -31,6 +42,14 @@ private:
 	bool paused;
 	bool step;
 
+	// Resolved on init, invalid if the script doesn't define the hook
+	sol::protected_function hooks[HOOK_COUNT];
+	// Set when hooks or pause state change, the vehicle's scheduler then rebuilds
+	bool schedule_dirty;
+
+	// Calls the hook if present, respecting pause and step
+	void run_hook(Hook hook, double dt);
+
 public:
 
 	// An unique id assigned at runtime to identify stuff like ImGui windows, etc...
@@ -48,6 +67,9 @@ public:
 
 	std::shared_ptr<cpptoml::table> init_toml;
 
+	// State restored from a snapshot, passed to the script's load_state on init
+	std::vector<uint8_t> pending_state;
+
 	std::unordered_map<std::string, sol::table> interfaces;
 	// May be "", in that case the machine is "centered" on the piece
 	std::string editor_location_marker;
@@ -63,12 +85,20 @@ public:
 	void update(double dt);
 	void editor_update(double dt);
 
+	bool has_hook(Hook hook) const { return hooks[hook].valid(); }
+
 	void init(sol::state* lua_state, Part* in_part);
 
+	// Writes what the script's save_state returns (the fluids in a tank, for example),
+	// nil if it doesn't define it
+	void write_state(BakedWriter& w);
+
 	void load_interface(const std::string& name, sol::table n_table);
 
-	std::vector<Machine*> get_all_wired_machines(bool include_this = true);
-	std::vector<Machine*> get_wired_machines_with(const std::vector<std::string>& interfaces, bool include_this = true);
+	// These are cached by the vehicle's WireIndex, references are valid until wires change
+	const std::vector<Machine*>& get_all_wired_machines(bool include_this = true);
+	const std::vector<Machine*>& get_wired_machines_with(const std::vector<std::string>& interfaces, bool include_this = true);
+	// A copy of the cached list, so lua gets its own container which it may modify
 	std::vector<sol::table> get_wired_interfaces(const std::string& type, bool include_this = true);
 
 	sol::table get_interface(const std::string& name);
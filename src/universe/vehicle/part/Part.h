@@ -12,6 +12,8 @@ class Part
 {
 private:
 
+	friend class VehicleSnapshotSaver;
+
 	// We keep it for initizalition
 	std::shared_ptr<cpptoml::table> our_table;
 
@@ -248,6 +248,7 @@ Piece::Piece(Part* in_part, std::string piece_name)
 	motion_state = nullptr;
 	in_group = nullptr;
 	welded = false;
+	link_type = "none";
 
 	part = in_part;
 
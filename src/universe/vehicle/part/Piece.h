@@ -140,6 +140,8 @@ public:
 	void set_dirty(bool update_now);
 	// The piece OWNS the link, which can be null
 	std::unique_ptr<Link> link;
+	// Script the link was created from, "none" if there's no link
+	std::string link_type;
 	// The point in our collider where the link originates
 	glm::dvec3 link_from;
 	// The point in the other collider where the link arrives
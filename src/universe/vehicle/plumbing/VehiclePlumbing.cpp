@@ -462,7 +462,13 @@ void VehiclePlumbing::update_pipes(float dt, Vehicle *in_vehicle)
 {
 	if(input->key_down(GLFW_KEY_K) || input->key_pressed(GLFW_KEY_L))
 	{
+		step_flows(dt);
+	}
+
+}
 
+void VehiclePlumbing::step_flows(float dt)
+{
 	// Clear flows in pipes
 	fws.clear();
 	for(Pipe& p : pipes)
@@ -473,8 +479,6 @@ void VehiclePlumbing::update_pipes(float dt, Vehicle *in_vehicle)
 	reduce_to_forced_paths();
 	calculate_flowrates();
 	execute_flows(dt);
-	}
-
 }
 
 void VehiclePlumbing::init()
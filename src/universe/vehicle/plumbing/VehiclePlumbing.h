@@ -100,6 +100,8 @@ public:
 	std::vector<PlumbingMachine*> plumbing_machines;
 
 	void update_pipes(float dt, Vehicle* in_vehicle);
+	// Finds the flows and moves the fluids, update_pipes only does it while debugging
+	void step_flows(float dt);
 	// Called when adding new parts, or merging vehicles (etc...)
 	glm::ivec2 find_free_space(glm::ivec2 size);
 	// Returns (0, 0) if none of the machines have plumbing
@@ -145,7 +145,7 @@ void DebugDrawer::add_cone(glm::dvec3 base, glm::dvec3 tip, double radius, glm::
 	}
 
 
-	draw_list.push_back(shape);
+	push_shape(std::move(shape));
 }
 
 void DebugDrawer::add_orbit(glm::dvec3 origin, KeplerOrbit orbit, glm::vec3 color, bool striped, int verts)
@@ -176,7 +176,7 @@ void DebugDrawer::add_orbit(glm::dvec3 origin, KeplerOrbit orbit, glm::vec3 colo
 		prev = pos;
 	}
 
-	draw_list.push_back(shape);
+	push_shape(std::move(shape));
 }
 
 void DebugDrawer::add_line(glm::dvec3 a, glm::dvec3 b, glm::vec3 color)
@@ -184,7 +184,7 @@ void DebugDrawer::add_line(glm::dvec3 a, glm::dvec3 b, glm::vec3 color)
 	DebugShape shape;
 	shape.verts.push_back(DebugVertex(a, color));
 	shape.verts.push_back(DebugVertex(b, color));
-	draw_list.push_back(shape);
+	push_shape(std::move(shape));
 }
 
 void DebugDrawer::add_line(glm::dvec3 a, glm::dvec3 b, glm::vec3 acolor, glm::vec3 bcolor)
@@ -192,7 +192,7 @@ void DebugDrawer::add_line(glm::dvec3 a, glm::dvec3 b, glm::vec3 acolor, glm::ve
 	DebugShape shape;
 	shape.verts.push_back(DebugVertex(a, acolor));
 	shape.verts.push_back(DebugVertex(b, bcolor));
-	draw_list.push_back(shape);
+	push_shape(std::move(shape));
 }
 
 void DebugDrawer::add_arrow(glm::dvec3 a, glm::dvec3 b, glm::vec3 color)
@@ -204,11 +204,17 @@ void DebugDrawer::add_arrow(glm::dvec3 a, glm::dvec3 b, glm::vec3 color)
 	add_cone(base, b, glm::distance(a, b) * 0.03, color, 8);
 }
 
+void DebugDrawer::push_shape(DebugShape&& shape)
+{
+	std::lock_guard<std::mutex> lock(draw_list_mtx);
+	draw_list.push_back(std::move(shape));
+}
+
 void DebugDrawer::add_point(glm::dvec3 a, glm::vec3 color)
 {
 	DebugShape shape;
 	shape.verts.push_back(DebugVertex(a, color));
-	draw_list.push_back(shape);
+	push_shape(std::move(shape));
 }
 
 void DebugDrawer::add_transform(glm::dvec3 origin, glm::dmat4 tform, double length)
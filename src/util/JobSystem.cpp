@@ -0,0 +1,132 @@
+#include "JobSystem.h"
+#include "Logger.h"
+
+thread_local bool JobSystem::in_job = false;
+
+void JobSystem::run_batch()
+{
+	while(true)
+	{
+		size_t i = next.fetch_add(1, std::memory_order_relaxed);
+		if(i >= count)
+		{
+			break;
+		}
+
+		(*fnc)(i);
+
+		if(done.fetch_add(1, std::memory_order_acq_rel) + 1 == count)
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			done_cv.notify_all();
+		}
+	}
+}
+
+void JobSystem::worker_func()
+{
+	in_job = true;
+	uint64_t seen = 0;
+
+	while(true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			wake_cv.wait(lock, [this, seen](){ return !run || generation != seen; });
+			if(!run)
+			{
+				return;
+			}
+			seen = generation;
+			busy++;
+		}
+
+		run_batch();
+
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			busy--;
+			done_cv.notify_all();
+		}
+	}
+}
+
+void JobSystem::parallel_for(size_t n, const std::function<void(size_t)>& f)
+{
+	logger->check(!in_job, "parallel_for can't be called from a job");
+
+	if(n == 0)
+	{
+		return;
+	}
+
+	if(workers.empty() || n == 1)
+	{
+		in_job = true;
+		for(size_t i = 0; i < n; i++)
+		{
+			f(i);
+		}
+		in_job = false;
+		return;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		// Workers which woke up late for the previous batch may still be leaving it
+		done_cv.wait(lock, [this](){ return busy == 0; });
+		fnc = &f;
+		count = n;
+		next = 0;
+		done = 0;
+		generation++;
+	}
+	wake_cv.notify_all();
+
+	in_job = true;
+	run_batch();
+	in_job = false;
+
+	std::unique_lock<std::mutex> lock(mtx);
+	done_cv.wait(lock, [this](){ return done.load() == count; });
+}
+
+JobSystem::JobSystem(const cpptoml::table& settings)
+{
+	run = true;
+	fnc = nullptr;
+	count = 0;
+	next = 0;
+	done = 0;
+	generation = 0;
+	busy = 0;
+
+	// The main thread also runs jobs, so by default we leave one core for it
+	auto worker_count = (size_t)settings.get_qualified_as<int64_t>("jobs.worker_threads").value_or(0);
+	if(worker_count == 0)
+	{
+		size_t hw = std::thread::hardware_concurrency();
+		worker_count = hw > 1 ? hw - 1 : 0;
+	}
+
+	for(size_t i = 0; i < worker_count; i++)
+	{
+		workers.emplace_back(&JobSystem::worker_func, this);
+	}
+
+	logger->info("Started job system with {} workers", worker_count);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::unique_lock<std::mutex> lock(mtx);
+		run = false;
+	}
+	wake_cv.notify_all();
+
+	for(std::thread& t : workers)
+	{
+		t.join();
+	}
+}
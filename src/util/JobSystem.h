@@ -0,0 +1,52 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <cpptoml.h>
+
+// A fixed pool of worker threads for data parallel work, started with the game.
+// Work is given as a range of indices, the calling thread helps running them and
+// returns once all are done, so from outside it looks like a normal loop:
+//
+//		osp->jobs->parallel_for(vehicles.size(), [&](size_t i){ vehicles[i]->update(dt); });
+//
+// Only one parallel_for may run at a time, and jobs may not start another one.
+class JobSystem
+{
+private:
+
+	std::vector<std::thread> workers;
+	std::mutex mtx;
+	std::condition_variable wake_cv;
+	std::condition_variable done_cv;
+	bool run;
+
+	// Current batch, only changed while no worker is busy
+	const std::function<void(size_t)>* fnc;
+	size_t count;
+	std::atomic<size_t> next;
+	std::atomic<size_t> done;
+	uint64_t generation;
+	// Workers currently inside a batch
+	size_t busy;
+
+	static thread_local bool in_job;
+
+	void worker_func();
+	void run_batch();
+
+public:
+
+	// Runs f(i) for every i in [0, count), in any order and thread
+	void parallel_for(size_t count, const std::function<void(size_t)>& f);
+
+	size_t get_worker_count() const { return workers.size(); }
+	// True while running inside parallel_for, in any thread
+	static bool is_in_job() { return in_job; }
+
+	explicit JobSystem(const cpptoml::table& settings);
+	~JobSystem();
+};
@@ -1,5 +1,7 @@
 #pragma once
 #include <mutex>
+#include <atomic>
+#include <array>
 
 
 // Automatically unlocks a mutex on destructor
@@ -109,3 +111,107 @@ public:
 
 };
 
+// Lock-free single producer, single consumer ring queue. Only ONE thread
+// may push and only ONE (other) thread may pop. Capacity is N - 1
+// N must be a power of two
+template<typename T, size_t N>
+class SPSCQueue
+{
+private:
+
+	static_assert((N & (N - 1)) == 0, "SPSCQueue size must be a power of two");
+
+	std::array<T, N> data;
+	// Written by the consumer
+	alignas(64) std::atomic<size_t> head;
+	// Written by the producer
+	alignas(64) std::atomic<size_t> tail;
+
+public:
+
+	// Returns false if the queue is full (nothing is pushed)
+	bool push(const T& elem)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		size_t next = (t + 1) & (N - 1);
+		if(next == head.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		data[t] = elem;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Returns false if the queue is empty
+	bool pop(T& out)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if(h == tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		out = data[h];
+		head.store((h + 1) & (N - 1), std::memory_order_release);
+		return true;
+	}
+
+	SPSCQueue()
+	{
+		head = 0;
+		tail = 0;
+	}
+};
+
+// Lock-free way to pass a value from one writer thread to one reader thread,
+// where only the latest value matters. The writer fills back() and publishes,
+// the reader obtains the latest published value with read(). The writer and
+// reader never touch the same slot (front / back double buffering plus a
+// third "in flight" slot so neither has to wait).
+template<typename T>
+class SwapBuffer
+{
+private:
+
+	std::array<T, 3> slots;
+	// Bits 0-1: index of the latest published slot, bit 2: is it new?
+	std::atomic<int> middle;
+	int back_idx;
+	int front_idx;
+
+public:
+
+	// Writer side
+	T& back()
+	{
+		return slots[back_idx];
+	}
+
+	// Writer side, makes back() visible to the reader
+	void publish()
+	{
+		int old = middle.exchange(back_idx | 4, std::memory_order_acq_rel);
+		back_idx = old & 3;
+	}
+
+	// Reader side, returns the latest published value
+	const T& read()
+	{
+		if(middle.load(std::memory_order_relaxed) & 4)
+		{
+			int old = middle.exchange(front_idx, std::memory_order_acq_rel);
+			front_idx = old & 3;
+		}
+
+		return slots[front_idx];
+	}
+
+	SwapBuffer()
+	{
+		back_idx = 0;
+		middle = 1;
+		front_idx = 2;
+	}
+};